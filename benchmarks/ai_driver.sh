@@ -0,0 +1,16 @@
+#!/bin/sh
+
+# Benchmarks for the AI subsystem (src/ai), defined in src/tests/ai.rs.
+# Per-stage microbenchmarks report ns/iter and C++ allocations per call; the end-to-end
+# benchmark drives the C API against a local mock Gemini server and reports p50/p99 latency
+# and allocations per request; bench_ai_time_to_first_byte reports the time to the first
+# streamed suggestion on a new connection and on the reused one. An optional filter selects
+# benchmarks by name.
+
+if [ "$1" = "-h" ] || [ "$1" = "--help" ]; then
+    echo "Usage: ai_driver.sh [benchmark name prefix, e.g. bench_ai_context]"
+    exit 0
+fi
+
+cd "$(dirname "$0")/.." || exit 1
+exec cargo +nightly bench --features=benchmark -- --nocapture "tests::ai::bench::${1:-}"
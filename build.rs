@@ -56,15 +56,39 @@ fn main() {
     target.set_verbose(true);
     detect_cfgs(&mut target);
 
-    // 1. 시스템의 libcurl 라이브러리를 링크하라고 Rust에게 알림
-    println!("cargo:rustc-link-lib=curl");
+    // 1. libcurl은 링크하지 않음: 처음 전송할 때 dlopen으로 적재 (src/ai/ai_curl.cpp)
+    //    AI를 쓰지 않는 fish 프로세스가 시작할 때 libcurl과 의존 라이브러리를 적재하지 않도록.
+    //    glibc 2.34 미만에서는 dlopen이 libdl에 있음
+    if cfg!(target_os = "linux") {
+        println!("cargo:rustc-link-lib=dl");
+    }
 
     // 2. 우리가 만든 C++ 파일들을 컴파일해서 'libfish_ai.a'라는 정적 라이브러리로 만듦
-    cc::Build::new()
-        .cpp(true)                  // C++ 모드 활성화
+    let mut ai = cc::Build::new();
+    // 벤치마크 빌드에서는 단계별 측정 함수와 할당 카운터를 함께 컴파일
+    #[cfg(feature = "benchmark")]
+    ai.define("FISH_AI_BENCHMARK", None);
+    // TSAN 빌드에서는 C++ 쪽도 계측해야 Rust/C++ 스레드 사이의 경합이 보임
+    #[cfg(feature = "tsan")]
+    ai.flag("-fsanitize=thread");
+    ai.cpp(true)                    // C++ 모드 활성화
         .std("c++17")               // C++17 표준 사용
         .file("src/ai/ai_manager.cpp") // 소스 파일 1
         .file("src/ai/ai_bridge.cpp")  // 소스 파일 2
+        .file("src/ai/ai_cache.cpp")   // 소스 파일 3 (결과 캐시)
+        .file("src/ai/ai_local_engine.cpp") // 소스 파일 4 (로컬 자동완성)
+        .file("src/ai/ai_history_store.cpp") // 소스 파일 5 (히스토리 저장소)
+        .file("src/ai/ai_workflow.cpp")      // 소스 파일 6 (작업 패턴 감지)
+        .file("src/ai/ai_prompt.cpp")        // 소스 파일 7 (프롬프트 조립)
+        .file("src/ai/ai_backend.cpp")       // 소스 파일 8 (백엔드/전송)
+        .file("src/ai/ai_metrics.cpp")       // 소스 파일 9 (실행 지표)
+        .file("src/ai/ai_json.cpp")          // 소스 파일 10 (JSON 추출/직렬화)
+        .file("src/ai/ai_daemon.cpp")        // 소스 파일 11 (공유 데몬)
+        .file("src/ai/ai_curl.cpp")          // 소스 파일 12 (libcurl 지연 적재)
+        .file("src/ai/ai_similarity.cpp")    // 소스 파일 13 (입력 정규화/유사 입력 색인)
+        .file("src/ai/ai_risk.cpp")          // 소스 파일 14 (로컬 위험 검사)
+        .file("src/ai/ai_rate_limit.cpp")    // 소스 파일 15 (요청 속도 제한)
+        .file("src/ai/ai_directory.cpp")     // 소스 파일 16 (작업 디렉토리 컨텍스트)
         .include("src/ai")          // 헤더 파일 경로
         .compile("fish_ai");        // 컴파일 실행! (결과물 이름: libfish_ai.a)
 
@@ -0,0 +1,5 @@
+complete -c ai -f
+complete -c ai -s h -l help -d "Display help and exit"
+complete -c ai -s s -l stats -d "Print AI request, cache and latency statistics"
+complete -c ai -s j -l json -d "Print statistics as JSON"
+complete -c ai -s d -l daemon -d "Run the shared AI daemon for all sessions" -F
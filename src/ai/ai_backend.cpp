@@ -0,0 +1,395 @@
+#include "ai_backend.h"
+#include "ai_curl.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// ---------------------------------------------------------
+// Gemini: candidates[0].content.parts[0].text
+// ---------------------------------------------------------
+static const AIJsonStep GEMINI_TEXT[] = {
+    AIJsonStep::field("candidates"), AIJsonStep::at(0), AIJsonStep::field("content"),
+    AIJsonStep::field("parts"), AIJsonStep::at(0), AIJsonStep::field("text"),
+};
+static const AIJsonPath GEMINI_TEXT_PATHS[] = {
+    {GEMINI_TEXT, sizeof(GEMINI_TEXT) / sizeof(GEMINI_TEXT[0])},
+};
+
+class GeminiBackend : public AIBackend {
+public:
+    GeminiBackend(const std::string& base_url, const std::string& model, const std::string& api_key)
+        : AIBackend(base_url, model, api_key) {}
+
+    AIBackendKind kind() const override { return AIBackendKind::GEMINI; }
+    bool usable() const override { return !api_key_.empty(); }
+
+protected:
+    std::string request_url(bool stream) const override {
+        std::string url = base_url_ + "/models/" + model_ + ":";
+        url += stream ? "streamGenerateContent?alt=sse&key=" : "generateContent?key=";
+        url += api_key_;
+        return url;
+    }
+
+    // {"contents":[{"parts":[{"text":"..."}]}]}
+    void request_body(const std::string& prompt, bool, std::string& out) const override {
+        out += "{\"contents\":[{\"parts\":[{\"text\":";
+        ai_json_append_string(out, prompt);
+        out += "}]}]}";
+    }
+
+    const AIJsonPath* text_paths(size_t* count) const override {
+        *count = sizeof(GEMINI_TEXT_PATHS) / sizeof(GEMINI_TEXT_PATHS[0]);
+        return GEMINI_TEXT_PATHS;
+    }
+};
+
+// ---------------------------------------------------------
+// OpenAI 호환: choices[0].message.content (스트리밍은 choices[0].delta.content)
+// 마지막 SSE 이벤트 "[DONE]"은 JSON이 아니므로 빈 텍스트로 처리됨
+// ---------------------------------------------------------
+static const AIJsonStep OPENAI_DELTA_TEXT[] = {
+    AIJsonStep::field("choices"), AIJsonStep::at(0), AIJsonStep::field("delta"),
+    AIJsonStep::field("content"),
+};
+static const AIJsonStep OPENAI_MESSAGE_TEXT[] = {
+    AIJsonStep::field("choices"), AIJsonStep::at(0), AIJsonStep::field("message"),
+    AIJsonStep::field("content"),
+};
+static const AIJsonPath OPENAI_TEXT_PATHS[] = {
+    {OPENAI_DELTA_TEXT, sizeof(OPENAI_DELTA_TEXT) / sizeof(OPENAI_DELTA_TEXT[0])},
+    {OPENAI_MESSAGE_TEXT, sizeof(OPENAI_MESSAGE_TEXT) / sizeof(OPENAI_MESSAGE_TEXT[0])},
+};
+
+class OpenAIBackend : public AIBackend {
+public:
+    OpenAIBackend(const std::string& base_url, const std::string& model, const std::string& api_key)
+        : AIBackend(base_url, model, api_key) {}
+
+    AIBackendKind kind() const override { return AIBackendKind::OPENAI; }
+
+protected:
+    std::string request_url(bool) const override {
+        return base_url_ + "/chat/completions";
+    }
+
+    // {"model":"...","messages":[{"role":"user","content":"..."}],"stream":true}
+    void request_body(const std::string& prompt, bool stream, std::string& out) const override {
+        out += "{\"model\":";
+        ai_json_append_string(out, model_);
+        out += ",\"messages\":[{\"role\":\"user\",\"content\":";
+        ai_json_append_string(out, prompt);
+        out += stream ? "}],\"stream\":true}" : "}],\"stream\":false}";
+    }
+
+    void add_headers(struct curl_slist*& headers) const override {
+        AIBackend::add_headers(headers);
+        if (!api_key_.empty()) {
+            headers = ai_curl().slist_append(headers, ("Authorization: Bearer " + api_key_).c_str());
+        }
+    }
+
+    const AIJsonPath* text_paths(size_t* count) const override {
+        *count = sizeof(OPENAI_TEXT_PATHS) / sizeof(OPENAI_TEXT_PATHS[0]);
+        return OPENAI_TEXT_PATHS;
+    }
+};
+
+// ---------------------------------------------------------
+// AICircuitBreaker 구현
+// ---------------------------------------------------------
+
+AICircuitBreaker::AICircuitBreaker()
+    : open_(false), failures_(0), cooldown_(0) {}
+
+bool AICircuitBreaker::allow() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !open_;
+}
+
+void AICircuitBreaker::record_success() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    open_ = false;
+    failures_ = 0;
+    cooldown_ = std::chrono::milliseconds(0);
+}
+
+bool AICircuitBreaker::record_failure(Clock::time_point now, std::chrono::milliseconds cooldown) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    failures_++;
+    if (open_ || failures_ < FAILURE_THRESHOLD) return false;
+    open_ = true;
+    // 확인 요청으로 닫힌 뒤 다시 열리면 이전 대기 시간을 이어서 늘림
+    cooldown_ = std::max(cooldown, cooldown_);
+    probe_at_ = now + cooldown_;
+    return true;
+}
+
+bool AICircuitBreaker::probe_due(Clock::time_point now) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return open_ && now >= probe_at_;
+}
+
+AICircuitBreaker::Clock::time_point AICircuitBreaker::probe_at() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return probe_at_;
+}
+
+void AICircuitBreaker::probe_succeeded() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    open_ = false;
+    failures_ = FAILURE_THRESHOLD - 1;
+    cooldown_ = std::min(cooldown_ * 2, std::chrono::milliseconds(MAX_COOLDOWN_MS));
+}
+
+void AICircuitBreaker::probe_failed(Clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cooldown_ = std::min(cooldown_ * 2, std::chrono::milliseconds(MAX_COOLDOWN_MS));
+    probe_at_ = now + cooldown_;
+}
+
+uint32_t AICircuitBreaker::failures() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failures_;
+}
+
+// ---------------------------------------------------------
+// AITransfer 구현
+// ---------------------------------------------------------
+
+AITransfer::AITransfer() : curl_(nullptr), streaming_(false) {
+    receive_.line = ReceiveState::LINE_START;
+    receive_.event_has_data = false;
+}
+
+AITransfer::~AITransfer() {
+    if (curl_) ai_curl().easy_cleanup(curl_);
+}
+
+// 전용 핸들 생성: 모든 요청에 공통인 옵션은 한 번만 설정 (DNS/TLS/연결은 share로 공유)
+bool AITransfer::ensure_handle(CURLSH* share) {
+    if (curl_) return true;
+    const AICurl& curl = ai_curl();
+    curl_ = curl.easy_init();
+    if (!curl_) return false;
+
+    if (share) curl.easy_setopt_share(curl_, share);
+    curl.easy_setopt_long(curl_, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl.easy_setopt_long(curl_, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl.easy_setopt_long(curl_, CURLOPT_TCP_KEEPIDLE, 60L);
+    curl.easy_setopt_long(curl_, CURLOPT_TCP_KEEPINTVL, 30L);
+    curl.easy_setopt_long(curl_, CURLOPT_TCP_NODELAY, 1L);
+    curl.easy_setopt_long(curl_, CURLOPT_DNS_CACHE_TIMEOUT, 600L);
+    curl.easy_setopt_long(curl_, CURLOPT_NOSIGNAL, 1L);
+
+    // 로컬 대체 서버 등 별도 CA를 쓰는 경우 (curl 도구와 같은 환경 변수)
+    const char* ca_bundle = std::getenv("CURL_CA_BUNDLE");
+    if (ca_bundle && *ca_bundle) curl.easy_setopt_str(curl_, CURLOPT_CAINFO, ca_bundle);
+    return true;
+}
+
+// 전송 시간 제한: 전체, 연결, 저속(STALL_SECONDS 동안 1바이트 미만이면 중단)
+void AITransfer::set_timeouts(std::chrono::milliseconds timeout) {
+    const AICurl& curl = ai_curl();
+    long total = std::max<long>(1, timeout.count());
+    curl.easy_setopt_long(curl_, CURLOPT_TIMEOUT_MS, total);
+    curl.easy_setopt_long(curl_, CURLOPT_CONNECTTIMEOUT_MS,
+                          std::min(total, AIBackend::CONNECT_TIMEOUT_MS));
+    curl.easy_setopt_long(curl_, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl.easy_setopt_long(curl_, CURLOPT_LOW_SPEED_TIME, AIBackend::STALL_SECONDS);
+}
+
+// 새 응답을 받을 준비 (추출 경로는 백엔드 종류별)
+void AITransfer::reset_receive(const AIJsonPath* paths, size_t count) {
+    receive_.extractor.set_paths(paths, count);
+    receive_.line = ReceiveState::LINE_START;
+    receive_.prefix.clear();
+    receive_.event_has_data = false;
+    receive_.event_text.clear();
+    receive_.text.clear();
+    receive_.on_text = nullptr;
+}
+
+std::string AITransfer::finish() {
+    if (curl_) ai_curl().easy_setopt_str(curl_, CURLOPT_POSTFIELDS, nullptr);
+    body_.clear();
+
+    // 마지막 이벤트 뒤에 빈 줄이 없는 경우도 처리
+    if (streaming_) dispatch_event(&receive_);
+    receive_.on_text = nullptr;
+    std::string text;
+    text.swap(receive_.text);
+    return text;
+}
+
+// ---------------------------------------------------------
+// AIBackend 공통 구현
+// ---------------------------------------------------------
+
+std::unique_ptr<AIBackend> AIBackend::create(const std::string& kind, const std::string& base_url,
+                                             const std::string& model, const std::string& api_key) {
+    if (kind == "gemini") {
+        return std::unique_ptr<AIBackend>(new GeminiBackend(
+            base_url.empty() ? "https://generativelanguage.googleapis.com/v1" : base_url,
+            model.empty() ? "gemini-2.5-flash" : model, api_key));
+    }
+    if (kind == "openai") {
+        return std::unique_ptr<AIBackend>(new OpenAIBackend(
+            base_url.empty() ? "https://api.openai.com/v1" : base_url,
+            model.empty() ? "gpt-4o-mini" : model, api_key));
+    }
+    return nullptr;
+}
+
+AIBackend::AIBackend(const std::string& base_url, const std::string& model,
+                     const std::string& api_key)
+    : base_url_(base_url), model_(model), api_key_(api_key), headers_(nullptr),
+      latency_count_(0), latency_next_(0), p95_ms_(-1), requests_(0), wins_(0) {}
+
+AIBackend::~AIBackend() {
+    if (headers_) ai_curl().slist_free_all(headers_);
+}
+
+bool AIBackend::usable() const {
+    return true;
+}
+
+void AIBackend::add_headers(struct curl_slist*& headers) const {
+    headers = ai_curl().slist_append(headers, "Content-Type: application/json");
+}
+
+CURL* AIBackend::prepare(AITransfer& transfer, const std::string& prompt, CURLSH* share,
+                         const std::function<void(const std::string&)>& on_text,
+                         std::chrono::milliseconds timeout) {
+    if (!transfer.ensure_handle(share)) return nullptr;
+    std::call_once(headers_once_, [this] { add_headers(headers_); });
+    transfer.set_timeouts(timeout);
+
+    bool streaming = static_cast<bool>(on_text);
+    transfer.streaming_ = streaming;
+    std::string& body = transfer.body_;
+    body.clear();
+    body.reserve(prompt.size() + prompt.size() / 8 + 128);
+    request_body(prompt, streaming, body);
+    size_t count = 0;
+    const AIJsonPath* paths = text_paths(&count);
+    transfer.reset_receive(paths, count);
+    transfer.receive_.on_text = on_text;
+
+    // 요청별 옵션만 다시 설정 (연결/세션은 재사용)
+    const AICurl& curl = ai_curl();
+    CURL* handle = transfer.curl_;
+    curl.easy_setopt_str(handle, CURLOPT_URL, request_url(streaming).c_str());
+    curl.easy_setopt_long(handle, CURLOPT_NOBODY, 0L);
+    curl.easy_setopt_slist(handle, CURLOPT_HTTPHEADER, headers_);
+    curl.easy_setopt_long(handle, CURLOPT_POSTFIELDSIZE, (long)body.size());
+    curl.easy_setopt_str(handle, CURLOPT_POSTFIELDS, body.c_str());
+    curl.easy_setopt_write_function(
+        handle, streaming ? AITransfer::write_stream : AITransfer::write_body);
+    curl.easy_setopt_ptr(handle, CURLOPT_WRITEDATA, &transfer.receive_);
+    return handle;
+}
+
+CURL* AIBackend::prepare_warm(AITransfer& transfer, CURLSH* share,
+                              std::chrono::milliseconds timeout) {
+    if (!transfer.ensure_handle(share)) return nullptr;
+    transfer.set_timeouts(timeout);
+    transfer.streaming_ = false;
+    size_t count = 0;
+    const AIJsonPath* paths = text_paths(&count);
+    transfer.reset_receive(paths, count);
+    const AICurl& curl = ai_curl();
+    CURL* handle = transfer.curl_;
+    curl.easy_setopt_str(handle, CURLOPT_URL, (base_url_ + "/models").c_str());
+    curl.easy_setopt_long(handle, CURLOPT_HTTPGET, 1L);
+    curl.easy_setopt_long(handle, CURLOPT_NOBODY, 1L);
+    curl.easy_setopt_slist(handle, CURLOPT_HTTPHEADER, nullptr);
+    curl.easy_setopt_write_function(handle, AITransfer::write_body);
+    curl.easy_setopt_ptr(handle, CURLOPT_WRITEDATA, &transfer.receive_);
+    return handle;
+}
+
+// 응답 지연 기록: 최근 LATENCY_WINDOW개로 p95를 다시 계산
+void AIBackend::record_latency(std::chrono::milliseconds latency) {
+    long ms = std::max<long>(0, latency.count());
+    std::lock_guard<std::mutex> lock(latency_mutex_);
+    latencies_[latency_next_] = static_cast<uint32_t>(std::min<long>(ms, UINT32_MAX));
+    latency_next_ = (latency_next_ + 1) % LATENCY_WINDOW;
+    if (latency_count_ < LATENCY_WINDOW) latency_count_++;
+    if (latency_count_ < MIN_SAMPLES) return;
+
+    uint32_t sorted[LATENCY_WINDOW];
+    std::copy(latencies_, latencies_ + latency_count_, sorted);
+    size_t rank = (latency_count_ * 95 + 99) / 100 - 1;
+    std::nth_element(sorted, sorted + rank, sorted + latency_count_);
+    p95_ms_ = sorted[rank];
+}
+
+// ---------------------------------------------------------
+// libcurl 수신 콜백
+// ---------------------------------------------------------
+size_t AITransfer::write_body(char* contents, size_t size, size_t nmemb, void* userp) {
+    ReceiveState* state = static_cast<ReceiveState*>(userp);
+    state->extractor.feed(contents, size * nmemb, state->text);
+    return size * nmemb;
+}
+
+// SSE(server-sent events): 이벤트마다 "data: {json}" 줄이 오고 빈 줄로 끝남
+void AITransfer::dispatch_event(ReceiveState* state) {
+    state->extractor.reset();
+    state->event_has_data = false;
+    if (state->event_text.empty()) return;
+    state->text += state->event_text;
+    if (state->on_text) state->on_text(state->event_text);
+    state->event_text.clear();
+}
+
+// 줄 단위로 나누되 data 줄은 모으지 않고 받는 대로 추출기에 넣음 (줄이 여러 조각으로 와도 됨)
+size_t AITransfer::write_stream(char* contents, size_t size, size_t nmemb, void* userp) {
+    static const char DATA_FIELD[] = "data:";
+    static const size_t DATA_FIELD_LEN = sizeof(DATA_FIELD) - 1;
+    ReceiveState* state = static_cast<ReceiveState*>(userp);
+    const char* data = contents;
+    size_t len = size * nmemb, i = 0;
+
+    while (i < len) {
+        if (state->line != ReceiveState::LINE_START) {
+            const char* newline = static_cast<const char*>(memchr(data + i, '\n', len - i));
+            size_t end = newline ? static_cast<size_t>(newline - data) : len;
+            if (state->line == ReceiveState::LINE_DATA) {
+                state->extractor.feed(data + i, end - i, state->event_text);
+            }
+            if (!newline) break;
+            state->line = ReceiveState::LINE_START;
+            i = end + 1;
+            continue;
+        }
+
+        char c = data[i++];
+        if (c == '\n') {
+            // 빈 줄("\r\n" 포함): 이벤트 끝
+            if (state->prefix.empty() || state->prefix == "\r") dispatch_event(state);
+            state->prefix.clear();
+            continue;
+        }
+        if (c == '\r' && state->prefix.empty()) {
+            state->prefix = "\r";
+            continue;
+        }
+        state->prefix += c;
+        if (state->prefix.size() < DATA_FIELD_LEN &&
+            memcmp(state->prefix.data(), DATA_FIELD, state->prefix.size()) == 0) {
+            continue;
+        }
+        if (state->prefix == DATA_FIELD) {
+            // 한 이벤트의 data 줄이 여럿이면 줄바꿈으로 이어짐 (JSON 안에서는 공백)
+            if (state->event_has_data) state->extractor.feed("\n", 1, state->event_text);
+            state->event_has_data = true;
+            state->line = ReceiveState::LINE_DATA;
+        } else {
+            state->line = ReceiveState::LINE_SKIP;
+        }
+        state->prefix.clear();
+    }
+    return size * nmemb;
+}
@@ -0,0 +1,192 @@
+#ifndef FISH_AI_BACKEND_H
+#define FISH_AI_BACKEND_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <curl/curl.h>
+#include "ai_json.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// ---------------------------------------------------------
+// 회로 차단기: 백엔드가 계속 실패하면 한동안 요청을 보내지 않음
+//  - CLOSED: 정상. 연속 실패가 FAILURE_THRESHOLD번이면 OPEN
+//    (429는 고장이 아니므로 세지 않음: AIRateLimiter가 Retry-After만큼 쉬게 함)
+//  - OPEN: 요청을 보내지 않음 (로컬 결과로 바로 완료). probe_at() 이후
+//    백그라운드 확인 요청이 성공하면 CLOSED로, 실패하면 대기 시간을 두 배로 늘림
+// 확인 요청으로 닫힌 직후에는 한 번만 더 실패해도 다시 열림. 스레드 안전.
+// ---------------------------------------------------------
+class AICircuitBreaker {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    AICircuitBreaker();
+
+    bool allow() const;            // 요청을 보내도 되는지 (CLOSED)
+    bool open() const { return !allow(); }
+
+    void record_success();
+    // 실패 기록. 차단기가 이번에 열렸으면 true
+    bool record_failure(Clock::time_point now, std::chrono::milliseconds cooldown);
+
+    bool probe_due(Clock::time_point now) const;
+    Clock::time_point probe_at() const;
+    void probe_succeeded();
+    void probe_failed(Clock::time_point now);
+
+    uint32_t failures() const;
+
+    static const uint32_t FAILURE_THRESHOLD = 3;
+    static constexpr long MAX_COOLDOWN_MS = 60000;
+
+private:
+    mutable std::mutex mutex_;
+    bool open_;
+    uint32_t failures_;                   // 연속 실패 횟수
+    std::chrono::milliseconds cooldown_;  // 다음 확인 요청까지의 대기 시간
+    Clock::time_point probe_at_;
+};
+
+// ---------------------------------------------------------
+// 전송 하나의 상태: 전용 curl 핸들, 요청 본문, 수신 상태
+//  - 전송마다 따로 가지므로 여러 요청이 같은 백엔드에 동시에 보낼 수 있음
+//  - 어느 백엔드에나 쓸 수 있고, 다 쓴 뒤 다른 요청에 재사용됨 (공통 옵션은 한 번만 설정)
+// 한 번에 한 스레드만 씀
+// ---------------------------------------------------------
+class AITransfer {
+public:
+    AITransfer();
+    ~AITransfer();
+
+    AITransfer(const AITransfer&) = delete;
+    AITransfer& operator=(const AITransfer&) = delete;
+
+    CURL* handle() const { return curl_; }
+
+    // 전송이 끝난 뒤 받은 텍스트 (스트리밍이면 조각을 이어 붙인 전체)
+    std::string finish();
+
+private:
+    friend class AIBackend;
+
+    // 수신 상태: 받은 바이트를 바로 추출기에 넣으므로 응답 본문은 모아 두지 않음
+    // 스트리밍이면 SSE 줄을 나누어 "data:" 줄의 내용만 이벤트별로 추출기에 넣음
+    struct ReceiveState {
+        enum Line : uint8_t {
+            LINE_START,  // 줄 시작: 필드 이름을 모으는 중
+            LINE_DATA,   // "data:" 줄: 줄바꿈까지 추출기로
+            LINE_SKIP    // 그 밖의 줄 (event:, id:, 주석 등)
+        };
+        Line line;
+        std::string prefix;      // 줄 첫 몇 바이트 (필드 이름 판별용)
+        bool event_has_data;
+        AIJsonExtractor extractor;
+        std::string event_text;  // 현재 이벤트에서 추출한 텍스트
+        std::string text;        // 지금까지 받은 전체 텍스트
+        std::function<void(const std::string&)> on_text;
+    };
+
+    static size_t write_body(char* contents, size_t size, size_t nmemb, void* userp);
+    static size_t write_stream(char* contents, size_t size, size_t nmemb, void* userp);
+    static void dispatch_event(ReceiveState* state);
+    bool ensure_handle(CURLSH* share);
+    void reset_receive(const AIJsonPath* paths, size_t count);
+    void set_timeouts(std::chrono::milliseconds timeout);
+
+    CURL* curl_;
+    std::string body_;           // 요청 본문 (전송이 끝날 때까지 유지, 버퍼는 재사용)
+    ReceiveState receive_;
+    bool streaming_;
+};
+
+// ---------------------------------------------------------
+// AI 백엔드(엔드포인트) 인터페이스
+//  - 요청 URL/본문/헤더 형식과 응답(일반 JSON, SSE 이벤트) 해석을 종류별로 구현
+//  - 전송 상태는 AITransfer에 있으므로 여러 스레드가 동시에 전송을 준비할 수 있음
+//  - 응답 지연을 기록해서 p95를 계산 (헤지 요청 대기 시간 결정용)
+// 모든 메서드는 어느 스레드에서나 호출 가능.
+// ---------------------------------------------------------
+
+enum class AIBackendKind {
+    GEMINI,   // Google Gemini (generateContent / streamGenerateContent)
+    OPENAI    // OpenAI 호환 서버 (/chat/completions, 로컬 서버 포함)
+};
+
+class AIBackend {
+public:
+    // 종류 이름("gemini", "openai")으로 생성. 모르는 종류면 nullptr
+    static std::unique_ptr<AIBackend> create(const std::string& kind, const std::string& base_url,
+                                             const std::string& model, const std::string& api_key);
+    virtual ~AIBackend();
+
+    AIBackend(const AIBackend&) = delete;
+    AIBackend& operator=(const AIBackend&) = delete;
+
+    virtual AIBackendKind kind() const = 0;
+    const std::string& base_url() const { return base_url_; }
+    const std::string& model() const { return model_; }
+
+    // 요청을 보낼 수 있는지 (Gemini는 API 키가 필요)
+    virtual bool usable() const;
+
+    // 전송 준비: transfer의 핸들에 URL/본문/수신 콜백을 설정해서 돌려줌 (핸들은 처음 쓸 때 생성)
+    // on_text가 있으면 SSE 스트리밍으로 받고 조각마다 호출
+    // timeout이 지나면 curl이 전송을 끝냄 (연결/저속 제한도 그 안에서 적용)
+    // 받은 텍스트는 전송이 끝난 뒤 transfer.finish()로 가져감
+    CURL* prepare(AITransfer& transfer, const std::string& prompt, CURLSH* share,
+                  const std::function<void(const std::string&)>& on_text,
+                  std::chrono::milliseconds timeout);
+    // 연결 미리 맺기/상태 확인용 본문 없는 요청
+    CURL* prepare_warm(AITransfer& transfer, CURLSH* share, std::chrono::milliseconds timeout);
+
+    // 응답 지연 기록과 p95 (기록이 MIN_SAMPLES개 미만이면 -1)
+    void record_latency(std::chrono::milliseconds latency);
+    long p95_ms() const { return p95_ms_.load(); }
+    void count_request() { requests_++; }
+    void count_win() { wins_++; }
+    uint64_t requests() const { return requests_.load(); }
+    uint64_t wins() const { return wins_.load(); }
+
+    AICircuitBreaker& breaker() { return breaker_; }
+    const AICircuitBreaker& breaker() const { return breaker_; }
+
+    static const size_t LATENCY_WINDOW = 64;
+    static const size_t MIN_SAMPLES = 8;
+    static constexpr long CONNECT_TIMEOUT_MS = 3000;  // 연결(DNS/TCP/TLS) 제한
+    static constexpr long STALL_SECONDS = 5;          // 이 시간 동안 데이터가 없으면 중단
+
+protected:
+    AIBackend(const std::string& base_url, const std::string& model, const std::string& api_key);
+
+    virtual std::string request_url(bool stream) const = 0;
+    // 요청 본문 JSON을 out에 씀 (ai_json_append_string으로 문자열을 붙임)
+    virtual void request_body(const std::string& prompt, bool stream, std::string& out) const = 0;
+    virtual void add_headers(struct curl_slist*& headers) const;
+    // 응답 본문(또는 SSE 이벤트 하나의 data)에서 텍스트가 있는 위치 (여럿이면 먼저 나오는 것)
+    virtual const AIJsonPath* text_paths(size_t* count) const = 0;
+
+    std::string base_url_;
+    std::string model_;
+    std::string api_key_;
+
+private:
+    // 요청 헤더 (처음 전송을 준비할 때 한 번 만들고, 전송하는 동안 읽기만 함)
+    std::once_flag headers_once_;
+    struct curl_slist* headers_;
+
+    // 최근 응답 지연 (순환 버퍼, 밀리초, latency_mutex_로 보호)
+    std::mutex latency_mutex_;
+    uint32_t latencies_[LATENCY_WINDOW];
+    size_t latency_count_;
+    size_t latency_next_;
+    std::atomic<long> p95_ms_;
+    std::atomic<uint64_t> requests_;
+    std::atomic<uint64_t> wins_;
+    AICircuitBreaker breaker_;
+};
+
+#endif // FISH_AI_BACKEND_H
@@ -1,75 +1,501 @@
 #include "ai_manager.h"
+#include "ai_risk.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
 #include <cstring>
 #include <cstdlib> // free 사용을 위해 필요
+#include <ctime>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#ifdef FISH_AI_BENCHMARK
+#include <new>
+#endif
 
-// 전역 AI 매니저 인스턴스 (모든 함수가 이 인스턴스를 공유)
-static AIManager g_manager;
+// 전역 AI 매니저: 처음 AI 기능을 쓸 때 만듦 (모든 함수가 이 인스턴스를 공유)
+// `fish -c`나 스크립트 실행처럼 AI를 쓰지 않는 프로세스는 생성 비용을 내지 않음
+static std::atomic<AIManager*> g_created(nullptr);
+static std::string g_pending_history;  // 매니저가 생기기 전에 받은 히스토리 파일 (메인 스레드)
+static bool g_private_mode = false;     // 매니저가 생기기 전에 받은 private 모드 (메인 스레드)
+
+// 매니저가 생기기 전에 실행된 명령어 (메인 스레드). 최근 것만 몇 개 남겨 두었다가 만들 때 넣음
+struct PendingCommand {
+    std::string command;
+    long long timestamp;
+    std::string cwd;
+};
+static const size_t MAX_PENDING_COMMANDS = 64;
+static std::vector<PendingCommand> g_pending_commands;
+
+static AIManager& manager() {
+    static AIManager instance;  // 처음 호출할 때 한 번만 생성 (스레드 안전)
+    static const bool published = [] {
+        if (g_private_mode) instance.set_private_mode(true);
+        // 쌓아 둔 명령어를 먼저 넣고 파일을 적재함 (적재가 끝나면 새 저장소로 옮겨짐)
+        for (const PendingCommand& c : g_pending_commands) {
+            instance.add_command_to_history(c.command, c.timestamp, c.cwd);
+        }
+        g_pending_commands.clear();
+        g_pending_commands.shrink_to_fit();
+        if (!g_pending_history.empty()) instance.load_history_in_background(g_pending_history);
+        g_pending_history.clear();
+        g_created.store(&instance);
+        return true;
+    }();
+    (void)published;
+    return instance;
+}
+
+// 이미 만들어진 매니저 (없으면 nullptr): 상태 조회만 하는 함수는 매니저를 만들지 않음
+static AIManager* existing_manager() {
+    return g_created.load();
+}
+
+// 데몬용 매니저와 서버: 데몬을 실행할 때만 만듦 (연결 스레드가 끝까지 쓰므로 해제하지 않음)
+// 세션용 매니저와 따로 두고, 데몬 자신에게 요청을 보내지 않도록 데몬 사용을 끔
+static AIManager& daemon_manager() {
+    static AIManager* m = [] {
+        AIManager* created = new AIManager();
+        created->set_daemon_socket("");
+        return created;
+    }();
+    return *m;
+}
+
+static AIDaemonServer& daemon_server() {
+    static AIDaemonServer* server = new AIDaemonServer(daemon_manager());
+    return *server;
+}
+
+// 정수형 모드를 C++ Enum으로 변환
+// mode_int: 1(자동완성), 2(설명), 3(진단)
+static AIMode mode_from_int(int mode_int) {
+    if (mode_int == 2) {
+        return AIMode::EXPLAIN;       // 2: 설명 (Alt+Q)
+    } else if (mode_int == 3) {
+        return AIMode::DIAGNOSE;      // 3: 진단 (Alt+R)
+    }
+    return AIMode::GENERATION;        // 기본값: 1 (자동완성)
+}
+
+#ifdef FISH_AI_BENCHMARK
+// ---------------------------------------------------------
+// 벤치마크 빌드 전용: 전역 operator new를 바꿔서 C++ 할당 횟수를 셈
+// (libcurl 내부의 malloc은 세지 않음)
+// ---------------------------------------------------------
+static std::atomic<uint64_t> g_alloc_count(0);
+
+void* operator new(std::size_t size) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+#endif
 
 extern "C" {
 
-    // [핵심] Rust에서 요청한 모드(int)를 받아서 AI 제안 생성
-    // mode_int: 1(자동완성), 2(설명), 3(진단)
+    // [핵심] Rust에서 요청한 모드(int)를 받아서 AI 제안 생성 (네트워크 응답까지 블록됨)
     void generate_ai_suggestions_from_cpp(const char* input, int mode_int) {
         if (input == nullptr) return;
-        
-        // 정수형 모드를 C++ Enum으로 변환
-        AIMode mode = AIMode::GENERATION; // 기본값: 1 (자동완성)
-        
-        if (mode_int == 2) {
-            mode = AIMode::EXPLAIN;       // 2: 설명 (Alt+Q)
-        } else if (mode_int == 3) {
-            mode = AIMode::DIAGNOSE;      // 3: 진단 (Alt+R)
+        manager().generate_suggestions(input, mode_from_int(mode_int));
+    }
+
+    // 비동기 요청 제출: 즉시 반환하고, 완료 시 ai_notify_fd_from_cpp()가 읽기 가능해짐
+    // 반환값: 요청 번호 (0이면 실패)
+    uint64_t submit_ai_request_from_cpp(const char* input, int mode_int) {
+        if (input == nullptr) return 0;
+        return manager().submit_request(input, mode_from_int(mode_int));
+    }
+
+    // 비동기 요청 상태 확인 및 결과 반영
+    // 반환값: -1(요청 없음), 0(처리 중), 1(결과 준비됨), 2(스트리밍 중 일부 준비됨)
+    int poll_ai_request_from_cpp() {
+        AIManager* m = existing_manager();
+        return m ? m->poll_request() : -1;
+    }
+
+    // 진행 중인 요청 취소 (전송 중이면 즉시 중단되고 연결도 정리됨)
+    void cancel_ai_request_from_cpp() {
+        if (AIManager* m = existing_manager()) m->cancel_request();
+    }
+
+    // 입력이 요청 당시와 달라졌으면 진행 중인 요청 취소 (취소했으면 true)
+    bool cancel_stale_ai_request_from_cpp(const char* input) {
+        AIManager* m = existing_manager();
+        if (input == nullptr || m == nullptr) return false;
+        return m->cancel_if_stale(input);
+    }
+
+    // 통합 요청 사용 여부 (입력마다 첫 요청에서 세 모드의 답을 한 번에 받음)
+    void set_ai_combined_requests_from_cpp(bool enabled) {
+        manager().set_combined_requests(enabled);
+    }
+
+    // 설명 결과를 비슷한 입력에 재사용하는 문턱값 (0이면 끔)
+    void set_ai_similarity_threshold_from_cpp(double threshold) {
+        manager().set_similarity_threshold(threshold);
+    }
+
+    // 연속 요청을 하나로 합치는 대기 시간(밀리초) 설정
+    void set_ai_debounce_ms_from_cpp(int ms) {
+        manager().set_debounce(std::chrono::milliseconds(ms < 0 ? 0 : ms));
+    }
+
+    // 완료/취소/합류한 요청 수 조회 (nullptr인 항목은 건너뜀)
+    void get_ai_request_stats_from_cpp(uint64_t* completed, uint64_t* cancelled,
+                                       uint64_t* coalesced) {
+        AIRequestStats stats = manager().request_stats();
+        if (completed) *completed = stats.completed;
+        if (cancelled) *cancelled = stats.cancelled;
+        if (coalesced) *coalesced = stats.coalesced;
+    }
+
+    // 통계 출력 (`ai --stats`): 요청/캐시 통계와 모드별 카운터, 단계별 지연
+    // 필요한 바이트 수를 반환하고, cap보다 크면 쓰지 않음 (NUL 종료 없음)
+    size_t get_ai_stats_from_cpp(bool json, char* buf, size_t cap) {
+        std::string text = manager().format_stats(json);
+        if (text.size() <= cap && buf != nullptr) memcpy(buf, text.data(), text.size());
+        return text.size();
+    }
+
+    // 명령어 위험 검사 (실행 전 확인용, 네트워크 없음, 매니저를 만들지 않음)
+    // 위험 수준(0 없음, 1 주의, 2 위험)을 반환하고 경고 문구를 buf에 씀 (잘릴 수 있음, NUL 종료)
+    int scan_ai_command_risk_from_cpp(const char* command, char* buf, size_t cap) {
+        if (command == nullptr) return 0;
+        AIRiskFinding risk = ai_scan_risk(command);
+        if (buf != nullptr && cap > 0) {
+            size_t len = std::min(risk.message.size(), cap - 1);
+            memcpy(buf, risk.message.data(), len);
+            buf[len] = '\0';
         }
-        
-        g_manager.generate_suggestions(input, mode);
+        return static_cast<int>(risk.level);
+    }
+
+    // 요청 완료 알림용 fd (리더의 select 대상, 매니저가 아직 없으면 -1)
+    int ai_notify_fd_from_cpp() {
+        AIManager* m = existing_manager();
+        return m ? m->notify_fd() : -1;
+    }
+
+    // API 서버 연결을 백그라운드에서 미리 맺기 (API 키가 없으면 아무것도 안 함)
+    // 백엔드 설정이 없는 세션은 이 호출 때문에 매니저를 만들지 않음
+    void prewarm_ai_connection_from_cpp() {
+        if (existing_manager() == nullptr && std::getenv("GEMINI_API_KEY") == nullptr &&
+            std::getenv("FISH_AI_BACKENDS") == nullptr) {
+            return;
+        }
+        manager().prewarm_connection();
+    }
+
+    // API 서버 주소와 키 변경 (로컬 대체 서버 테스트용)
+    void set_ai_backend_from_cpp(const char* base_url, const char* api_key) {
+        if (base_url == nullptr || api_key == nullptr) return;
+        manager().set_backend(base_url, api_key);
+    }
+
+    // 백엔드 추가 (kind: "gemini" 또는 "openai", 빈 주소/모델은 기본값). 성공 시 true
+    // 앞에 추가된 백엔드가 우선이고, 뒤의 백엔드는 헤지 요청과 실패 시 대체용으로 쓰임
+    bool add_ai_backend_from_cpp(const char* kind, const char* base_url,
+                                 const char* model, const char* api_key) {
+        if (kind == nullptr) return false;
+        return manager().add_backend(kind, base_url ? base_url : "", model ? model : "",
+                                     api_key ? api_key : "");
+    }
+
+    // 헤지 요청 대기 시간(밀리초) 설정: 응답 기록이 쌓이기 전에 쓰는 값. 음수면 헤지 안 함
+    void set_ai_hedge_delay_ms_from_cpp(int ms) {
+        manager().set_hedge_delay(std::chrono::milliseconds(ms));
+    }
+
+    // index번째 백엔드의 요청 수, 먼저 답한 횟수, p95 지연(밀리초, 기록 부족 시 -1)
+    // 백엔드가 없으면 false
+    bool get_ai_backend_stats_from_cpp(int index, uint64_t* requests, uint64_t* wins,
+                                       long* p95_ms) {
+        if (index < 0) return false;
+        return manager().backend_stats(index, requests, wins, p95_ms);
+    }
+
+    // index번째 백엔드의 회로 차단기 상태 (open: 요청 차단 중, failures: 연속 실패 횟수)
+    bool get_ai_backend_breaker_from_cpp(int index, bool* open, uint32_t* failures) {
+        if (index < 0) return false;
+        return manager().backend_breaker(index, open, failures);
+    }
+
+    // 모드별 요청 제한 시간(밀리초) 설정. 0 이하는 무시
+    void set_ai_timeout_ms_from_cpp(int mode_int, int ms) {
+        manager().set_timeout(mode_from_int(mode_int), std::chrono::milliseconds(ms));
+    }
+
+    // 회로 차단기가 열린 뒤 첫 확인 요청까지의 대기 시간(밀리초)
+    void set_ai_breaker_cooldown_ms_from_cpp(int ms) {
+        manager().set_breaker_cooldown(std::chrono::milliseconds(ms));
+    }
+
+    // 요청 속도 제한: 분당 요청 수(0이면 끔)와 한 번에 몰아 보낼 수 있는 수
+    void set_ai_rate_limit_from_cpp(double per_minute, double burst) {
+        manager().set_rate_limit(per_minute, burst);
+    }
+
+    // 속도 제한 통계 조회 (nullptr인 항목은 건너뜀)
+    void get_ai_rate_limit_stats_from_cpp(uint64_t* throttled, uint64_t* rate_limited,
+                                          uint64_t* dropped) {
+        AIRateLimitStats stats = manager().rate_limit_stats();
+        if (throttled) *throttled = stats.throttled;
+        if (rate_limited) *rate_limited = stats.rate_limited;
+        if (dropped) *dropped = stats.dropped;
+    }
+
+    // 작업 디렉토리 컨텍스트를 프롬프트에 넣을지
+    void set_ai_directory_context_from_cpp(bool enabled) {
+        manager().set_directory_context(enabled);
+    }
+
+    // 작업 디렉토리 컨텍스트 통계 조회 (nullptr인 항목은 건너뜀)
+    void get_ai_directory_stats_from_cpp(uint64_t* gathers, uint64_t* hits,
+                                         uint64_t* misses, uint64_t* invalidations) {
+        AIDirectoryStats stats = manager().directory_stats();
+        if (gathers) *gathers = stats.gathers;
+        if (hits) *hits = stats.hits;
+        if (misses) *misses = stats.misses;
+        if (invalidations) *invalidations = stats.invalidations;
+    }
+
+    // 결과 캐시 통계 조회 (nullptr인 항목은 건너뜀)
+    void get_ai_cache_stats_from_cpp(uint64_t* hits, uint64_t* disk_hits,
+                                     uint64_t* misses, uint64_t* entries,
+                                     uint64_t* similar_hits) {
+        AICacheStats stats = manager().cache_stats();
+        if (hits) *hits = stats.hits;
+        if (disk_hits) *disk_hits = stats.disk_hits;
+        if (misses) *misses = stats.misses;
+        if (entries) *entries = stats.entries;
+        if (similar_hits) *similar_hits = stats.similar_hits;
+    }
+
+    // 매니저와 별개인 결과 캐시 (테스트용). disk_path가 있으면 그 파일을 디스크 캐시로 엶
+    AIResultCache* new_ai_result_cache_from_cpp(const char* disk_path, size_t capacity) {
+        AIResultCache* cache = new AIResultCache(capacity);
+        if (disk_path != nullptr && *disk_path) cache->open_disk(disk_path);
+        return cache;
+    }
+
+    void free_ai_result_cache_from_cpp(AIResultCache* cache) {
+        delete cache;
+    }
+
+    void ai_result_cache_store_from_cpp(AIResultCache* cache, const char* key, const char* value,
+                                        int64_t ttl_seconds) {
+        if (cache == nullptr || key == nullptr || value == nullptr) return;
+        cache->store(key, value, ttl_seconds);
+    }
+
+    // 적중하면 값을 buf에 복사 (NUL 종료, 잘릴 수 있음). 미스면 false
+    bool ai_result_cache_lookup_from_cpp(AIResultCache* cache, const char* key, char* buf,
+                                         size_t cap) {
+        if (cache == nullptr || key == nullptr) return false;
+        std::string value;
+        if (!cache->lookup(key, value)) return false;
+        if (buf != nullptr && cap > 0) {
+            size_t n = std::min(value.size(), cap - 1);
+            memcpy(buf, value.data(), n);
+            buf[n] = '\0';
+        }
+        return true;
+    }
+
+    // 별개 캐시의 통계 조회 (nullptr인 항목은 건너뜀)
+    void get_ai_result_cache_stats_from_cpp(AIResultCache* cache, uint64_t* hits,
+                                            uint64_t* disk_hits, uint64_t* misses,
+                                            uint64_t* entries) {
+        if (cache == nullptr) return;
+        AICacheStats stats = cache->stats();
+        if (hits) *hits = stats.hits;
+        if (disk_hits) *disk_hits = stats.disk_hits;
+        if (misses) *misses = stats.misses;
+        if (entries) *entries = stats.entries;
     }
     
     // 다음 제안으로 이동 (주로 자동완성 모드에서 Tab/순환 시 사용)
     void next_ai_suggestion_from_cpp() {
-        g_manager.next_suggestion();
+        if (AIManager* m = existing_manager()) m->next_suggestion();
     }
     
     // 현재 제안 가져오기: "명령어 (설명)" 형태
     // 반환된 문자열은 Rust 쪽에서 free_ai_suggestion으로 해제해야 함
     char* get_ai_suggestion_with_description_from_cpp() {
-        std::string suggestion = g_manager.get_current_suggestion_with_description();
+        AIManager* m = existing_manager();
+        if (m == nullptr) return nullptr;
+        std::string suggestion = m->get_current_suggestion_with_description();
         if (suggestion.empty()) return nullptr;
         return strdup(suggestion.c_str());
     }
     
     // 현재 제안 중 "명령어" 부분만 가져오기 (실제 입력 적용 시 사용)
     char* get_ai_command_only_from_cpp() {
-        std::string command = g_manager.get_current_command_only();
+        AIManager* m = existing_manager();
+        if (m == nullptr) return nullptr;
+        std::string command = m->get_current_command_only();
         if (command.empty()) return nullptr;
         return strdup(command.c_str());
     }
     
+    // 제안 목록 전체를 한 번에 가져오기 (버퍼는 호출자 소유, 해제 불필요)
+    // 레코드 형식: [u32 명령어 길이][명령어][u32 설명 길이][설명] x count
+    // known_generation이 현재 세대와 같으면 목록이 그대로이므로 아무것도 쓰지 않고 0을 반환.
+    // 그 밖에는 필요한 바이트 수를 반환하며, cap보다 크면 쓰지 않음 (더 큰 버퍼로 다시 호출)
+    size_t get_ai_suggestions_from_cpp(uint64_t known_generation, char* buf, size_t cap,
+                                       uint64_t* generation, uint32_t* count, uint32_t* current) {
+        // 세대, 개수, 위치, 목록을 모두 같은 스냅숏에서 읽음 (쓰는 쪽을 기다리지 않음)
+        AIManager* m = existing_manager();
+        if (m == nullptr) {
+            if (generation) *generation = 0;
+            if (count) *count = 0;
+            if (current) *current = 0;
+            return 0;
+        }
+        AISuggestionsView set = m->suggestions();
+        if (generation) *generation = set->generation;
+        if (count) *count = static_cast<uint32_t>(set->suggestions.size());
+        if (current) *current = set->current_index();
+        if (set->generation == known_generation) return 0;
+        return set->export_records(buf, cap);
+    }
+
     // 현재 유효한 제안이 있는지 확인
     bool has_ai_suggestions_from_cpp() {
-        return g_manager.has_suggestions();
+        AIManager* m = existing_manager();
+        return m && m->has_suggestions();
     }
     
     // 제안 데이터 초기화
     void clear_ai_suggestions_from_cpp() {
-        g_manager.clear_suggestions();
+        if (AIManager* m = existing_manager()) m->clear_suggestions();
     }
     
     // 입력값 변경 여부 확인 (최적화용)
     bool is_same_input_from_cpp(const char* input) {
-        if (input == nullptr) return false;
-        return g_manager.is_same_input(input);
+        AIManager* m = existing_manager();
+        if (input == nullptr || m == nullptr) return false;
+        return m->is_same_input(input);
+    }
+
+    // private 모드 전환 (`fish --private`). 매니저가 아직 없으면 만들 때 적용
+    void set_ai_private_mode_from_cpp(bool enabled) {
+        g_private_mode = enabled;
+        if (AIManager* m = existing_manager()) m->set_private_mode(enabled);
     }
 
     // 실행된 명령어를 히스토리에 추가
+    // 매니저가 아직 없으면 만들지 않고 시각과 디렉토리만 붙여 쌓아 둠 (만들 때 넣음)
     void add_command_history_from_cpp(const char* command) {
         if (command == nullptr) return;
-        g_manager.add_command_to_history(command);
+        if (AIManager* m = existing_manager()) {
+            m->add_command_to_history(command);
+            return;
+        }
+        if (g_private_mode || *command == '\0') return;
+        if (g_pending_commands.size() == MAX_PENDING_COMMANDS) {
+            g_pending_commands.erase(g_pending_commands.begin());
+        }
+        PendingCommand pending;
+        pending.command = command;
+        pending.timestamp = static_cast<long long>(time(nullptr));
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, sizeof cwd)) pending.cwd = cwd;
+        g_pending_commands.push_back(std::move(pending));
     }
 
     // 히스토리 초기화
     void clear_command_history_from_cpp() {
-        g_manager.clear_history();
+        g_pending_commands.clear();
+        if (AIManager* m = existing_manager()) m->clear_history();
+    }
+
+    // 첫 프롬프트용: fish 히스토리 파일을 워커 스레드에서 적재 (기다리지 않음)
+    // 매니저가 아직 없으면 경로만 기억해 두고 처음 AI 기능을 쓸 때 적재
+    void queue_ai_history_load_from_cpp(const char* history_path) {
+        if (history_path == nullptr) return;
+        if (AIManager* m = existing_manager()) {
+            m->load_history_in_background(history_path);
+        } else {
+            g_pending_history = history_path;
+        }
+    }
+
+    // fish 히스토리 파일을 AI 히스토리 저장소로 바로 적재
+    // 매니저가 아직 없으면 경로만 기억해 두고 처음 AI 기능을 쓸 때 적재 (이때는 항상 true)
+    bool load_ai_history_from_cpp(const char* history_path) {
+        if (history_path == nullptr) return false;
+        AIManager* m = existing_manager();
+        if (m == nullptr) {
+            g_pending_history = history_path;
+            return true;
+        }
+        return m->load_history(history_path);
+    }
+
+    // 히스토리 저장소 통계 (항목 수, 명령어 수, 힙 사용량, 매핑된 파일 크기)
+    void get_ai_history_stats_from_cpp(uint64_t* entries, uint64_t* commands,
+                                       uint64_t* memory_bytes, uint64_t* mapped_bytes) {
+        AIHistoryStats s = manager().history_stats();
+        if (entries) *entries = s.entries;
+        if (commands) *commands = s.commands;
+        if (memory_bytes) *memory_bytes = s.memory_bytes;
+        if (mapped_bytes) *mapped_bytes = s.mapped_bytes;
+    }
+
+    // 프롬프트 토큰 예산 설정
+    void set_ai_prompt_budget_from_cpp(int tokens) {
+        if (tokens > 0) manager().set_prompt_budget(tokens);
+    }
+
+    // 작업 패턴 규칙 교체 (기본 규칙 뒤에 rules가 적용됨)
+    void set_ai_workflow_rules_from_cpp(const char* rules) {
+        manager().set_workflow_rules(rules ? rules : "");
+    }
+
+    // 공유 데몬 실행 (`ai --daemon`): socket_path(nullptr이나 빈 문자열이면 기본 경로)에서
+    // 다른 fish 세션의 요청을 받음. stop_ai_daemon_from_cpp()나 SIGINT/SIGTERM/SIGHUP까지 블록.
+    // history_path가 있으면 요청을 받기 전에 그 히스토리 파일을 적재함
+    // 소켓을 열 수 없거나 이미 데몬이 떠 있으면 바로 false
+    bool run_ai_daemon_from_cpp(const char* socket_path, const char* history_path) {
+        std::string path = socket_path && *socket_path ? socket_path : ai_daemon_default_socket(true);
+        if (history_path && *history_path) daemon_manager().share_history(history_path);
+        return daemon_server().run(path);
+    }
+
+    void stop_ai_daemon_from_cpp() {
+        daemon_server().stop();
+    }
+
+    // 이 세션이 요청을 맡길 데몬 소켓 변경 (빈 문자열이면 데몬을 쓰지 않음)
+    void set_ai_daemon_socket_from_cpp(const char* socket_path) {
+        manager().set_daemon_socket(socket_path ? socket_path : "");
+    }
+
+#ifdef FISH_AI_BENCHMARK
+    // 벤치마크 전용: 처리 단계 하나를 실행 (stage 값은 AIBenchStage 참고)
+    size_t run_ai_bench_stage_from_cpp(int stage, const char* text, int mode_int) {
+        if (stage < 0 || stage > static_cast<int>(AIBenchStage::RISK)) return 0;
+        return manager().run_bench_stage(static_cast<AIBenchStage>(stage), text ? text : "",
+                                         mode_from_int(mode_int));
+    }
+
+    // 벤치마크 전용: 지금까지의 C++ 할당 횟수
+    uint64_t get_ai_alloc_count_from_cpp() {
+        return g_alloc_count.load(std::memory_order_relaxed);
     }
+#endif
 
     // C++에서 할당(strdup)한 메모리를 해제
     void free_ai_suggestion(char* ptr) {
@@ -0,0 +1,296 @@
+#include "ai_cache.h"
+#include "ai_similarity.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------
+// 디스크 캐시 파일 형식
+//  [헤더 64바이트][슬롯 0][슬롯 1]...
+//  슬롯: tag(8) expires_at(8) checksum(8) key_len(4) value_len(4) 데이터...
+//  tag가 0이면 빈 슬롯(또는 쓰는 중). 다른 fish 프로세스와 동시에 쓸 수 있으므로
+//  읽을 때 tag를 앞뒤로 확인하고 checksum으로 찢어진 쓰기를 걸러냄.
+// ---------------------------------------------------------
+static const char DISK_MAGIC[8] = {'F', 'I', 'S', 'H', 'A', 'I', 'C', '1'};
+static const uint32_t DISK_SLOT_COUNT = 1024;
+static const uint32_t DISK_SLOT_SIZE = 2048;
+static const size_t DISK_HEADER_SIZE = 64;
+static const size_t SLOT_HEADER_SIZE = 32;
+
+struct DiskHeader {
+    char magic[8];
+    uint32_t slot_count;
+    uint32_t slot_size;
+};
+
+struct DiskSlot {
+    uint64_t tag;
+    int64_t expires_at;
+    uint64_t checksum;
+    uint32_t key_len;
+    uint32_t value_len;
+};
+
+static int64_t now_seconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+}
+
+// 캐시 파일 경로: $XDG_CACHE_HOME/fish/ai_cache (기본 ~/.cache/fish/ai_cache)
+static std::string disk_cache_path() {
+    std::string dir;
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    const char* home = std::getenv("HOME");
+    if (xdg && xdg[0] == '/') {
+        dir = xdg;
+    } else if (home && *home) {
+        dir = std::string(home) + "/.cache";
+    } else {
+        return "";
+    }
+    mkdir(dir.c_str(), 0700);
+    dir += "/fish";
+    mkdir(dir.c_str(), 0700);
+    return dir + "/ai_cache";
+}
+
+// ---------------------------------------------------------
+// AIResultCache 구현
+// ---------------------------------------------------------
+
+AIResultCache::AIResultCache(size_t capacity)
+    : capacity_(capacity), hits_(0), disk_hits_(0), misses_(0),
+      persistent_(true), disk_opened_(false), disk_map_(nullptr), disk_size_(0) {}
+
+AIResultCache::~AIResultCache() {
+    if (disk_map_) munmap(disk_map_, disk_size_);
+}
+
+uint64_t AIResultCache::hash(const char* data, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+std::string AIResultCache::make_key(int mode, const std::string& input, uint64_t context_hash) {
+    std::string key;
+    key.reserve(input.size() + 24);
+    key += static_cast<char>('0' + mode);
+    key += '\x1f';
+
+    // 입력 정규화: 공백 정리 + 독립 짧은 옵션 정렬 ("ls  -la " == "ls -al")
+    key += ai_canonical_text(input);
+
+    key += '\x1f';
+    char buf[17];
+    snprintf(buf, sizeof buf, "%016llx", static_cast<unsigned long long>(context_hash));
+    key += buf;
+    return key;
+}
+
+bool AIResultCache::lookup(const std::string& key, std::string& value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        // 최근 사용으로 이동
+        lru_.splice(lru_.begin(), lru_, it->second);
+        value = it->second->second;
+        hits_++;
+        return true;
+    }
+
+    if (disk_lookup_locked(key, value)) {
+        insert_memory_locked(key, value);
+        disk_hits_++;
+        return true;
+    }
+
+    misses_++;
+    return false;
+}
+
+void AIResultCache::store(const std::string& key, const std::string& value, int64_t ttl_seconds) {
+    if (value.empty()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    insert_memory_locked(key, value);
+    disk_store_locked(key, value, ttl_seconds);
+}
+
+void AIResultCache::set_persistent(bool persistent) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    persistent_ = persistent;
+}
+
+void AIResultCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lru_.clear();
+    index_.clear();
+}
+
+AICacheStats AIResultCache::stats() const {
+    AICacheStats s;
+    s.hits = hits_.load();
+    s.disk_hits = disk_hits_.load();
+    s.misses = misses_.load();
+    s.similar_hits = 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    s.entries = lru_.size();
+    return s;
+}
+
+void AIResultCache::insert_memory_locked(const std::string& key, const std::string& value) {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        it->second->second = value;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return;
+    }
+
+    lru_.emplace_front(key, value);
+    index_[key] = lru_.begin();
+
+    // 용량 초과 시 가장 오래 사용하지 않은 항목 제거
+    while (lru_.size() > capacity_) {
+        index_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+}
+
+// 디스크 캐시 파일 열기 및 매핑: 실패하면 nullptr
+static unsigned char* map_disk_file(const std::string& path, size_t size) {
+    if (path.empty()) return nullptr;
+
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (static_cast<size_t>(st.st_size) < size && ftruncate(fd, size) != 0)) {
+        close(fd);
+        return nullptr;
+    }
+
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return nullptr;
+    unsigned char* map = static_cast<unsigned char*>(mapped);
+
+    // 형식이 다르면 초기화
+    DiskHeader* header = reinterpret_cast<DiskHeader*>(map);
+    if (memcmp(header->magic, DISK_MAGIC, sizeof DISK_MAGIC) != 0 ||
+        header->slot_count != DISK_SLOT_COUNT || header->slot_size != DISK_SLOT_SIZE) {
+        memset(map, 0, size);
+        header->slot_count = DISK_SLOT_COUNT;
+        header->slot_size = DISK_SLOT_SIZE;
+        memcpy(header->magic, DISK_MAGIC, sizeof DISK_MAGIC);
+    }
+    return map;
+}
+
+bool AIResultCache::open_disk(const std::string& path) {
+    std::lock_guard<std::mutex> open_lock(open_mutex_);
+    if (disk_opened_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return disk_map_ != nullptr;
+    }
+    disk_opened_ = true;
+
+    // 파일 작업은 잠금 밖에서 (그동안 조회는 메모리 캐시만 씀), 매핑만 잠금 안에서 발행
+    size_t size = DISK_HEADER_SIZE + static_cast<size_t>(DISK_SLOT_COUNT) * DISK_SLOT_SIZE;
+    unsigned char* map = map_disk_file(path.empty() ? disk_cache_path() : path, size);
+    if (!map) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    disk_map_ = map;
+    disk_size_ = size;
+    return true;
+}
+
+static DiskSlot* slot_at(unsigned char* map, uint32_t index) {
+    return reinterpret_cast<DiskSlot*>(map + DISK_HEADER_SIZE + static_cast<size_t>(index) * DISK_SLOT_SIZE);
+}
+
+bool AIResultCache::disk_lookup_locked(const std::string& key, std::string& value) {
+    if (!disk_map_) return false;
+
+    uint64_t tag = hash(key.data(), key.size()) | 1;
+    int64_t now = now_seconds();
+
+    // 인접한 두 슬롯을 탐색
+    uint32_t base = static_cast<uint32_t>(tag % DISK_SLOT_COUNT);
+    for (uint32_t probe = 0; probe < 2; probe++) {
+        DiskSlot* slot = slot_at(disk_map_, (base + probe) % DISK_SLOT_COUNT);
+        if (__atomic_load_n(&slot->tag, __ATOMIC_ACQUIRE) != tag) continue;
+
+        int64_t expires_at = slot->expires_at;
+        uint64_t checksum = slot->checksum;
+        uint32_t key_len = slot->key_len;
+        uint32_t value_len = slot->value_len;
+        if (expires_at < now || key_len != key.size() ||
+            SLOT_HEADER_SIZE + key_len + value_len > DISK_SLOT_SIZE) {
+            continue;
+        }
+
+        const char* data = reinterpret_cast<const char*>(slot) + SLOT_HEADER_SIZE;
+        if (memcmp(data, key.data(), key_len) != 0) continue;
+        std::string found(data + key_len, value_len);
+
+        // 읽는 동안 다른 프로세스가 덮어쓰지 않았는지 확인
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->tag, __ATOMIC_RELAXED) != tag ||
+            hash(data, key_len + value_len) != checksum) {
+            continue;
+        }
+
+        value = std::move(found);
+        return true;
+    }
+    return false;
+}
+
+void AIResultCache::disk_store_locked(const std::string& key, const std::string& value,
+                                      int64_t ttl_seconds) {
+    if (!persistent_ || SLOT_HEADER_SIZE + key.size() + value.size() > DISK_SLOT_SIZE) return;
+    if (!disk_map_) return;
+
+    uint64_t tag = hash(key.data(), key.size()) | 1;
+    int64_t now = now_seconds();
+
+    // 같은 키 > 비었거나 만료된 슬롯 > 먼저 만료될 슬롯 순으로 선택
+    uint32_t base = static_cast<uint32_t>(tag % DISK_SLOT_COUNT);
+    DiskSlot* target = nullptr;
+    for (uint32_t probe = 0; probe < 2; probe++) {
+        DiskSlot* slot = slot_at(disk_map_, (base + probe) % DISK_SLOT_COUNT);
+        uint64_t slot_tag = __atomic_load_n(&slot->tag, __ATOMIC_ACQUIRE);
+        if (slot_tag == tag) {
+            target = slot;
+            break;
+        }
+        if (slot_tag == 0 || slot->expires_at < now) {
+            if (!target || target->tag != 0) target = slot;
+        } else if (!target || (target->tag != 0 && slot->expires_at < target->expires_at)) {
+            target = slot;
+        }
+    }
+
+    // 쓰는 동안 tag를 0으로 두어 다른 프로세스가 읽지 않게 함
+    __atomic_store_n(&target->tag, 0, __ATOMIC_RELEASE);
+    char* data = reinterpret_cast<char*>(target) + SLOT_HEADER_SIZE;
+    memcpy(data, key.data(), key.size());
+    memcpy(data + key.size(), value.data(), value.size());
+    target->expires_at = now + ttl_seconds;
+    target->key_len = static_cast<uint32_t>(key.size());
+    target->value_len = static_cast<uint32_t>(value.size());
+    target->checksum = hash(data, key.size() + value.size());
+    __atomic_store_n(&target->tag, tag, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,86 @@
+#ifndef FISH_AI_CACHE_H
+#define FISH_AI_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// ---------------------------------------------------------
+// AI 응답 결과 캐시
+//  - 1단계: 메모리 LRU (프로세스 내, 크기 제한)
+//  - 2단계: 메모리 맵 파일 (세션 간 공유, TTL 적용)
+// 키는 make_key()로 만들고, 값은 API 응답 텍스트 (제안 파싱 전).
+// 모든 메서드는 스레드 안전.
+// ---------------------------------------------------------
+
+// 캐시 통계
+struct AICacheStats {
+    uint64_t hits;       // 메모리 캐시 적중
+    uint64_t disk_hits;  // 디스크 캐시 적중
+    uint64_t misses;     // 미스 (네트워크 호출 필요)
+    uint64_t entries;    // 현재 메모리 캐시 항목 수
+    uint64_t similar_hits;  // 미스 중 비슷한 이전 입력의 답으로 대신한 수 (AIManager가 채움,
+                            // 빌려 온 답을 찾은 조회는 hits에도 셈)
+};
+
+class AIResultCache {
+public:
+    explicit AIResultCache(size_t capacity = 256);
+    ~AIResultCache();
+
+    AIResultCache(const AIResultCache&) = delete;
+    AIResultCache& operator=(const AIResultCache&) = delete;
+
+    // 캐시 키 생성: 모드 + 정규화된 입력 + 컨텍스트 해시
+    static std::string make_key(int mode, const std::string& input, uint64_t context_hash);
+
+    // 조회: 적중 시 true와 함께 value를 채움
+    bool lookup(const std::string& key, std::string& value);
+
+    // 저장: ttl_seconds 동안 디스크 캐시에서도 유효
+    void store(const std::string& key, const std::string& value, int64_t ttl_seconds);
+
+    void clear();
+    AICacheStats stats() const;
+
+    // 디스크 캐시에 쓸지 (private 모드에서는 끔: 입력이 키에 들어가므로). 읽기는 그대로
+    void set_persistent(bool persistent);
+
+    // 디스크 캐시 파일을 열고 매핑 (한 번만 시도, 이후 호출은 결과만 돌려줌)
+    // 파일 생성/ftruncate/mmap을 하므로 메인 스레드가 아닌 워커나 데몬 스레드에서 부름.
+    // 열기 전의 조회/저장은 메모리 캐시만 씀. path가 비어 있으면 기본 경로
+    bool open_disk(const std::string& path = std::string());
+
+    // 64비트 FNV-1a 해시
+    static uint64_t hash(const char* data, size_t len);
+
+private:
+    typedef std::list<std::pair<std::string, std::string>> LruList;
+
+    size_t capacity_;
+    mutable std::mutex mutex_;
+    LruList lru_;
+    std::unordered_map<std::string, LruList::iterator> index_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> disk_hits_;
+    std::atomic<uint64_t> misses_;
+
+    // 디스크 캐시 (open_disk()에서 매핑). disk_map_은 mutex_ 안에서만 읽고 씀
+    bool persistent_;
+    std::mutex open_mutex_;  // open_disk()끼리 순서화 (파일 작업 중에 mutex_를 잡지 않도록)
+    bool disk_opened_;       // open_mutex_로 보호
+    unsigned char* disk_map_;
+    size_t disk_size_;
+
+    void insert_memory_locked(const std::string& key, const std::string& value);
+    bool disk_lookup_locked(const std::string& key, std::string& value);
+    void disk_store_locked(const std::string& key, const std::string& value, int64_t ttl_seconds);
+};
+
+#endif // FISH_AI_CACHE_H
@@ -0,0 +1,219 @@
+#include "ai_curl.h"
+#include <cstdlib>
+#include <mutex>
+#include <dlfcn.h>
+
+// ---------------------------------------------------------
+// 적재한 libcurl의 함수 목록 (이 파일 밖에서는 AICurl을 거쳐서만 부름)
+// ---------------------------------------------------------
+
+namespace {
+
+struct CurlApi {
+    CURLcode (*global_init)(long flags);
+    CURL* (*easy_init)();
+    CURLcode (*easy_setopt)(CURL* handle, CURLoption option, ...);
+    CURLcode (*easy_getinfo)(CURL* handle, CURLINFO info, ...);
+    void (*easy_cleanup)(CURL* handle);
+    CURLM* (*multi_init)();
+    CURLMcode (*multi_add_handle)(CURLM* multi, CURL* handle);
+    CURLMcode (*multi_remove_handle)(CURLM* multi, CURL* handle);
+    CURLMcode (*multi_perform)(CURLM* multi, int* running);
+    CURLMcode (*multi_poll)(CURLM* multi, struct curl_waitfd extra_fds[], unsigned int extra_nfds,
+                            int timeout_ms, int* numfds);
+    CURLMcode (*multi_wakeup)(CURLM* multi);
+    CURLMsg* (*multi_info_read)(CURLM* multi, int* msgs_in_queue);
+    CURLMcode (*multi_cleanup)(CURLM* multi);
+    CURLSH* (*share_init)();
+    CURLSHcode (*share_setopt)(CURLSH* share, CURLSHoption option, ...);
+    CURLSHcode (*share_cleanup)(CURLSH* share);
+    struct curl_slist* (*slist_append)(struct curl_slist* list, const char* text);
+    void (*slist_free_all)(struct curl_slist* list);
+};
+
+CurlApi g_api;
+bool g_loaded = false;
+std::once_flag g_load_once;
+
+template <typename Fn>
+bool bind(void* lib, const char* name, Fn& fn) {
+    fn = reinterpret_cast<Fn>(dlsym(lib, name));
+    return fn != nullptr;
+}
+
+void* open_library() {
+    const char* env = std::getenv("FISH_AI_LIBCURL");
+    if (env && *env) return dlopen(env, RTLD_NOW | RTLD_LOCAL);
+
+    static const char* const NAMES[] = {
+#ifdef __APPLE__
+        "libcurl.4.dylib", "libcurl.dylib",
+#else
+        "libcurl.so.4", "libcurl-gnutls.so.4", "libcurl.so",
+#endif
+    };
+    for (const char* name : NAMES) {
+        if (void* lib = dlopen(name, RTLD_NOW | RTLD_LOCAL)) return lib;
+    }
+    return nullptr;
+}
+
+void load() {
+    void* lib = open_library();
+    if (lib == nullptr) return;
+
+    CurlApi api;
+    bool bound = bind(lib, "curl_global_init", api.global_init) &&
+                 bind(lib, "curl_easy_init", api.easy_init) &&
+                 bind(lib, "curl_easy_setopt", api.easy_setopt) &&
+                 bind(lib, "curl_easy_getinfo", api.easy_getinfo) &&
+                 bind(lib, "curl_easy_cleanup", api.easy_cleanup) &&
+                 bind(lib, "curl_multi_init", api.multi_init) &&
+                 bind(lib, "curl_multi_add_handle", api.multi_add_handle) &&
+                 bind(lib, "curl_multi_remove_handle", api.multi_remove_handle) &&
+                 bind(lib, "curl_multi_perform", api.multi_perform) &&
+                 bind(lib, "curl_multi_poll", api.multi_poll) &&
+                 bind(lib, "curl_multi_wakeup", api.multi_wakeup) &&
+                 bind(lib, "curl_multi_info_read", api.multi_info_read) &&
+                 bind(lib, "curl_multi_cleanup", api.multi_cleanup) &&
+                 bind(lib, "curl_share_init", api.share_init) &&
+                 bind(lib, "curl_share_setopt", api.share_setopt) &&
+                 bind(lib, "curl_share_cleanup", api.share_cleanup) &&
+                 bind(lib, "curl_slist_append", api.slist_append) &&
+                 bind(lib, "curl_slist_free_all", api.slist_free_all);
+    // curl_multi_poll/wakeup이 없는 오래된 libcurl(7.68 미만)은 쓰지 않음
+    if (!bound) {
+        dlclose(lib);
+        return;
+    }
+    g_api = api;
+    g_loaded = true;
+}
+
+} // namespace
+
+const AICurl& ai_curl() {
+    static const AICurl curl;
+    std::call_once(g_load_once, load);
+    return curl;
+}
+
+// ---------------------------------------------------------
+// AICurl: 적재한 함수로 넘김 (ai_curl()이 적재를 마친 뒤에만 얻을 수 있음)
+// 가변 인자는 옵션마다 libcurl이 읽는 형식 그대로 넘김
+// ---------------------------------------------------------
+
+bool AICurl::loaded() const {
+    return g_loaded;
+}
+
+CURLcode AICurl::global_init(long flags) const {
+    return g_loaded ? g_api.global_init(flags) : CURLE_FAILED_INIT;
+}
+
+CURL* AICurl::easy_init() const {
+    return g_loaded ? g_api.easy_init() : nullptr;
+}
+
+void AICurl::easy_cleanup(CURL* handle) const {
+    if (g_loaded) g_api.easy_cleanup(handle);
+}
+
+CURLcode AICurl::easy_setopt_long(CURL* handle, CURLoption option, long value) const {
+    return g_loaded ? g_api.easy_setopt(handle, option, value) : CURLE_FAILED_INIT;
+}
+
+CURLcode AICurl::easy_setopt_str(CURL* handle, CURLoption option, const char* value) const {
+    return g_loaded ? g_api.easy_setopt(handle, option, value) : CURLE_FAILED_INIT;
+}
+
+CURLcode AICurl::easy_setopt_ptr(CURL* handle, CURLoption option, void* value) const {
+    return g_loaded ? g_api.easy_setopt(handle, option, value) : CURLE_FAILED_INIT;
+}
+
+CURLcode AICurl::easy_setopt_slist(CURL* handle, CURLoption option, curl_slist* value) const {
+    return g_loaded ? g_api.easy_setopt(handle, option, value) : CURLE_FAILED_INIT;
+}
+
+CURLcode AICurl::easy_setopt_share(CURL* handle, CURLSH* share) const {
+    return g_loaded ? g_api.easy_setopt(handle, CURLOPT_SHARE, share) : CURLE_FAILED_INIT;
+}
+
+CURLcode AICurl::easy_setopt_write_function(CURL* handle, curl_write_callback callback) const {
+    return g_loaded ? g_api.easy_setopt(handle, CURLOPT_WRITEFUNCTION, callback) : CURLE_FAILED_INIT;
+}
+
+CURLcode AICurl::easy_getinfo_long(CURL* handle, CURLINFO info, long* value) const {
+    return g_loaded ? g_api.easy_getinfo(handle, info, value) : CURLE_FAILED_INIT;
+}
+
+CURLcode AICurl::easy_getinfo_off(CURL* handle, CURLINFO info, curl_off_t* value) const {
+    return g_loaded ? g_api.easy_getinfo(handle, info, value) : CURLE_FAILED_INIT;
+}
+
+CURLM* AICurl::multi_init() const {
+    return g_loaded ? g_api.multi_init() : nullptr;
+}
+
+CURLMcode AICurl::multi_add_handle(CURLM* multi, CURL* handle) const {
+    return g_loaded ? g_api.multi_add_handle(multi, handle) : CURLM_BAD_HANDLE;
+}
+
+CURLMcode AICurl::multi_remove_handle(CURLM* multi, CURL* handle) const {
+    return g_loaded ? g_api.multi_remove_handle(multi, handle) : CURLM_BAD_HANDLE;
+}
+
+CURLMcode AICurl::multi_perform(CURLM* multi, int* running) const {
+    return g_loaded ? g_api.multi_perform(multi, running) : CURLM_BAD_HANDLE;
+}
+
+CURLMcode AICurl::multi_poll(CURLM* multi, curl_waitfd extra_fds[], unsigned int extra_nfds,
+                             int timeout_ms, int* numfds) const {
+    return g_loaded ? g_api.multi_poll(multi, extra_fds, extra_nfds, timeout_ms, numfds)
+                    : CURLM_BAD_HANDLE;
+}
+
+CURLMcode AICurl::multi_wakeup(CURLM* multi) const {
+    return g_loaded ? g_api.multi_wakeup(multi) : CURLM_BAD_HANDLE;
+}
+
+CURLMsg* AICurl::multi_info_read(CURLM* multi, int* msgs_in_queue) const {
+    return g_loaded ? g_api.multi_info_read(multi, msgs_in_queue) : nullptr;
+}
+
+CURLMcode AICurl::multi_cleanup(CURLM* multi) const {
+    return g_loaded ? g_api.multi_cleanup(multi) : CURLM_BAD_HANDLE;
+}
+
+CURLSH* AICurl::share_init() const {
+    return g_loaded ? g_api.share_init() : nullptr;
+}
+
+// SHARE/UNSHARE의 값은 curl_lock_data이지만 libcurl은 int로 읽음
+CURLSHcode AICurl::share_setopt_data(CURLSH* share, CURLSHoption option, curl_lock_data data) const {
+    return g_loaded ? g_api.share_setopt(share, option, static_cast<int>(data)) : CURLSHE_NOT_BUILT_IN;
+}
+
+CURLSHcode AICurl::share_setopt_lock_function(CURLSH* share, curl_lock_function callback) const {
+    return g_loaded ? g_api.share_setopt(share, CURLSHOPT_LOCKFUNC, callback) : CURLSHE_NOT_BUILT_IN;
+}
+
+CURLSHcode AICurl::share_setopt_unlock_function(CURLSH* share, curl_unlock_function callback) const {
+    return g_loaded ? g_api.share_setopt(share, CURLSHOPT_UNLOCKFUNC, callback) : CURLSHE_NOT_BUILT_IN;
+}
+
+CURLSHcode AICurl::share_setopt_userdata(CURLSH* share, void* userdata) const {
+    return g_loaded ? g_api.share_setopt(share, CURLSHOPT_USERDATA, userdata) : CURLSHE_NOT_BUILT_IN;
+}
+
+CURLSHcode AICurl::share_cleanup(CURLSH* share) const {
+    return g_loaded ? g_api.share_cleanup(share) : CURLSHE_INVALID;
+}
+
+curl_slist* AICurl::slist_append(curl_slist* list, const char* text) const {
+    return g_loaded ? g_api.slist_append(list, text) : nullptr;
+}
+
+void AICurl::slist_free_all(curl_slist* list) const {
+    if (g_loaded) g_api.slist_free_all(list);
+}
@@ -0,0 +1,59 @@
+#ifndef FISH_AI_CURL_H
+#define FISH_AI_CURL_H
+
+#include <curl/curl.h>
+
+// ---------------------------------------------------------
+// libcurl 지연 적재
+//  - fish 실행 파일은 libcurl에 링크하지 않고, 처음 전송할 때 dlopen으로 불러옴
+//    (AI를 쓰지 않는 프로세스는 libcurl과 그 의존 라이브러리(TLS 등)의 적재 비용을 내지 않음)
+//  - 적재한 함수는 ai_curl()의 함수 목록으로만 부름. curl_* 이름의 전역 함수는 정의하지 않으므로
+//    같은 프로세스에 진짜 libcurl이 링크되어 있어도 충돌하지 않음
+//  - curl_easy_setopt 등의 가변 인자는 값의 형식별 함수(easy_setopt_long 등)로 넘김
+//  - 라이브러리 경로는 $FISH_AI_LIBCURL로 바꿀 수 있음
+//  - 적재에 실패하면 loaded()가 false이고 *_init 함수가 nullptr를 돌려주므로 AI 요청만 실패함
+// ---------------------------------------------------------
+
+class AICurl {
+public:
+    bool loaded() const;
+
+    CURLcode global_init(long flags) const;
+
+    CURL* easy_init() const;
+    void easy_cleanup(CURL* handle) const;
+    CURLcode easy_setopt_long(CURL* handle, CURLoption option, long value) const;
+    CURLcode easy_setopt_str(CURL* handle, CURLoption option, const char* value) const;
+    CURLcode easy_setopt_ptr(CURL* handle, CURLoption option, void* value) const;  // 객체/데이터 포인터
+    CURLcode easy_setopt_slist(CURL* handle, CURLoption option, curl_slist* value) const;
+    CURLcode easy_setopt_share(CURL* handle, CURLSH* share) const;
+    CURLcode easy_setopt_write_function(CURL* handle, curl_write_callback callback) const;
+    CURLcode easy_getinfo_long(CURL* handle, CURLINFO info, long* value) const;
+    CURLcode easy_getinfo_off(CURL* handle, CURLINFO info, curl_off_t* value) const;
+
+    CURLM* multi_init() const;
+    CURLMcode multi_add_handle(CURLM* multi, CURL* handle) const;
+    CURLMcode multi_remove_handle(CURLM* multi, CURL* handle) const;
+    CURLMcode multi_perform(CURLM* multi, int* running) const;
+    CURLMcode multi_poll(CURLM* multi, curl_waitfd extra_fds[], unsigned int extra_nfds,
+                         int timeout_ms, int* numfds) const;
+    CURLMcode multi_wakeup(CURLM* multi) const;
+    CURLMsg* multi_info_read(CURLM* multi, int* msgs_in_queue) const;
+    CURLMcode multi_cleanup(CURLM* multi) const;
+
+    CURLSH* share_init() const;
+    // CURLSHOPT_SHARE/UNSHARE
+    CURLSHcode share_setopt_data(CURLSH* share, CURLSHoption option, curl_lock_data data) const;
+    CURLSHcode share_setopt_lock_function(CURLSH* share, curl_lock_function callback) const;
+    CURLSHcode share_setopt_unlock_function(CURLSH* share, curl_unlock_function callback) const;
+    CURLSHcode share_setopt_userdata(CURLSH* share, void* userdata) const;
+    CURLSHcode share_cleanup(CURLSH* share) const;
+
+    curl_slist* slist_append(curl_slist* list, const char* text) const;
+    void slist_free_all(curl_slist* list) const;
+};
+
+// 적재한 libcurl (처음 부를 때 한 번만 적재를 시도, 스레드 안전)
+const AICurl& ai_curl();
+
+#endif // FISH_AI_CURL_H
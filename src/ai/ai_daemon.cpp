@@ -0,0 +1,535 @@
+#include "ai_daemon.h"
+#include "ai_manager.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const size_t MAX_HEADER = 128;
+static const size_t MAX_FIELD = 1 << 20;  // 입력/명령어/경로 한 개의 최대 길이
+static const auto CONNECT_RETRY = std::chrono::seconds(5);
+static const struct timeval SEND_TIMEOUT = {1, 0};  // 연결과 쓰기 (데몬이 멈춰도 오래 막히지 않게)
+static const int STREAM_FLAG = 1;       // 응답 요청 플래그
+static const int COMBINED_FLAG = 2;
+
+// ---------------------------------------------------------
+// 헬퍼 함수: 소켓 입출력
+// ---------------------------------------------------------
+
+static void set_cloexec(int fd) {
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+// 전부 쓰거나 실패 (상대가 끊었을 때 SIGPIPE 대신 실패로)
+static bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+#ifdef MSG_NOSIGNAL
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+#else
+        ssize_t n = send(fd, data, len, 0);
+#endif
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool read_exact(int fd, char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = recv(fd, data, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// '\n'까지 한 줄 (헤더는 짧으므로 한 바이트씩 읽어서 본문을 더 읽지 않게 함)
+static bool read_line(int fd, std::string& line) {
+    line.clear();
+    char c;
+    while (line.size() < MAX_HEADER) {
+        if (!read_exact(fd, &c, 1)) return false;
+        if (c == '\n') return true;
+        line += c;
+    }
+    return false;
+}
+
+static bool read_field(int fd, size_t len, std::string& out) {
+    if (len > MAX_FIELD) return false;
+    out.resize(len);
+    return len == 0 || read_exact(fd, &out[0], len);
+}
+
+static bool fill_address(const std::string& path, sockaddr_un& addr) {
+    if (path.empty() || path.size() >= sizeof addr.sun_path) return false;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+static int connect_to(const std::string& path) {
+    sockaddr_un addr;
+    if (!fill_address(path, addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    set_cloexec(fd);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &SEND_TIMEOUT, sizeof SEND_TIMEOUT);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 연결 상대 프로세스가 같은 사용자인지 (서버는 받은 연결, 클라이언트는 연결한 데몬을 확인)
+static bool same_user(int fd) {
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof cred;
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) return false;
+    return cred.uid == geteuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(fd, &uid, &gid) != 0) return false;
+    return uid == geteuid();
+#endif
+}
+
+static void drain(int fd) {
+    char buf[64];
+    while (read(fd, buf, sizeof buf) > 0) {}
+}
+
+static void open_wake_pipe(int fds[2]) {
+    fds[0] = fds[1] = -1;
+    if (pipe(fds) != 0) {
+        fds[0] = fds[1] = -1;
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        set_cloexec(fds[i]);
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    }
+}
+
+static void signal_wake_pipe(int fd) {
+    if (fd < 0) return;
+    char c = 1;
+    ssize_t unused = write(fd, &c, 1);
+    (void)unused;
+}
+
+// ---------------------------------------------------------
+// 헬퍼 함수: 데몬 종료 시그널
+//  - run() 동안만 SIGINT/SIGTERM/SIGHUP을 받아 깨우기 파이프에 씀 (핸들러는 write만 함)
+//  - 정리가 끝나면 원래 핸들러를 되돌리고 받은 시그널을 다시 보냄 (셸이 평소대로 처리)
+// ---------------------------------------------------------
+
+static const int STOP_SIGNALS[] = {SIGINT, SIGTERM, SIGHUP};
+static volatile sig_atomic_t g_stop_signal = 0;
+static volatile sig_atomic_t g_stop_wake_fd = -1;
+
+static void stop_signal_handler(int sig) {
+    int saved_errno = errno;
+    g_stop_signal = sig;
+    if (g_stop_wake_fd >= 0) {
+        char c = 1;
+        ssize_t unused = write(g_stop_wake_fd, &c, 1);
+        (void)unused;
+    }
+    errno = saved_errno;
+}
+
+// 이 사용자만 쓸 수 있는 디렉토리 (없으면 0700으로 만듦)
+// 다른 사용자가 먼저 만들었거나, 심볼릭 링크이거나, 다른 사용자도 쓸 수 있으면 false
+static bool private_directory(const std::string& dir) {
+    if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) return false;
+    struct stat st;
+    if (lstat(dir.c_str(), &st) != 0) return false;
+    return S_ISDIR(st.st_mode) && st.st_uid == geteuid() && (st.st_mode & 077) == 0;
+}
+
+std::string ai_daemon_default_socket(bool create_directory) {
+    const char* env = std::getenv("FISH_AI_DAEMON_SOCKET");
+    if (env != nullptr) return env;
+    const char* runtime = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime != nullptr && *runtime != '\0') return std::string(runtime) + "/fish-ai.sock";
+    // /tmp 바로 아래에 두면 다른 사용자가 같은 이름으로 먼저 소켓을 열 수 있으므로 사용자 전용
+    // 디렉토리 안에 둠. 그 디렉토리를 믿을 수 없으면 데몬을 쓰지 않음
+    std::string dir = "/tmp/fish-ai-" + std::to_string(geteuid());
+    if (create_directory && !private_directory(dir)) return "";
+    return dir + "/daemon.sock";
+}
+
+// ---------------------------------------------------------
+// AIDaemonClient 구현
+// ---------------------------------------------------------
+
+AIDaemonClient::AIDaemonClient() : sending_(false), stopping_(false) {
+    open_wake_pipe(wake_pipe_);
+}
+
+AIDaemonClient::~AIDaemonClient() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    outbox_cv_.notify_all();
+    if (sender_.joinable()) sender_.join();
+    for (int fd : wake_pipe_) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+void AIDaemonClient::set_socket(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    retry_at_ = std::chrono::steady_clock::time_point();
+}
+
+// 데몬에 연결 (실패하면 CONNECT_RETRY 동안은 다시 시도하지 않고 바로 -1)
+// 소켓을 연 것이 다른 사용자의 프로세스면 명령어와 디렉토리를 보내지 않고 연결 실패로 처리
+int AIDaemonClient::connect_socket() {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (path_.empty() || std::chrono::steady_clock::now() < retry_at_) return -1;
+        path = path_;
+    }
+    int fd = connect_to(path);
+    if (fd >= 0 && !same_user(fd)) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retry_at_ = std::chrono::steady_clock::now() + CONNECT_RETRY;
+    }
+    return fd;
+}
+
+// 전달 메시지를 쌓아 두고 보내는 스레드를 깨움 (호출한 스레드는 기다리지 않음)
+// 데몬을 쓰지 않거나 최근에 연결하지 못했으면 버림 (스레드도 만들지 않음)
+void AIDaemonClient::post(const std::string& message) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (path_.empty() || std::chrono::steady_clock::now() < retry_at_ || stopping_) return;
+    if (outbox_.size() + message.size() > OUTBOX_LIMIT) return;
+    outbox_ += message;
+    if (!sender_.joinable()) sender_ = std::thread(&AIDaemonClient::sender_loop, this);
+    outbox_cv_.notify_all();
+}
+
+// 쌓인 전달 메시지를 가져감. 보내는 스레드가 쓰는 중이면 끝날 때까지 기다림
+// (그 연결이 뒤에 보내는 요청보다 먼저 데몬에 닿도록. 쓰기는 SEND_TIMEOUT으로 제한됨)
+std::string AIDaemonClient::take_outbox() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    outbox_cv_.wait(lock, [this] { return !sending_; });
+    std::string pending;
+    pending.swap(outbox_);
+    return pending;
+}
+
+// 보내는 스레드: 쌓인 메시지를 연결 하나에 모두 쓰고 닫음 (처리 완료는 기다리지 않음)
+void AIDaemonClient::sender_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        outbox_cv_.wait(lock, [this] { return stopping_ || !outbox_.empty(); });
+        if (stopping_) return;
+        std::string batch;
+        batch.swap(outbox_);
+        sending_ = true;
+        lock.unlock();
+        int fd = connect_socket();
+        if (fd >= 0) {
+            write_all(fd, batch.data(), batch.size());
+            close(fd);
+        }
+        lock.lock();
+        sending_ = false;
+        outbox_cv_.notify_all();
+    }
+}
+
+void AIDaemonClient::send_command(const std::string& command, long long timestamp,
+                                  const std::string& cwd) {
+    char header[MAX_HEADER];
+    snprintf(header, sizeof header, "C %lld %zu %zu\n", timestamp, command.size(), cwd.size());
+    post(header + command + cwd);
+}
+
+void AIDaemonClient::wake() {
+    signal_wake_pipe(wake_pipe_[1]);
+}
+
+AIDaemonClient::Result AIDaemonClient::request(
+    const std::string& input, int mode, bool combined, const std::string& cwd,
+    std::chrono::steady_clock::time_point deadline,
+    const std::function<void(const std::string&)>& on_text,
+    const std::function<bool()>& cancelled, std::string* response, bool* timed_out) {
+    int fd = connect_socket();
+    if (fd < 0) return UNAVAILABLE;
+
+    // 아직 보내지 않은 히스토리 전달을 요청 앞에 실음 (데몬이 요청 전에 반영)
+    std::string pending = take_outbox();
+    char header[MAX_HEADER];
+    int flags = (on_text ? STREAM_FLAG : 0) | (combined ? COMBINED_FLAG : 0);
+    snprintf(header, sizeof header, "R %d %d %zu %zu\n", mode, flags, input.size(), cwd.size());
+    if (!write_all(fd, pending.data(), pending.size()) || !write_all(fd, header, strlen(header)) ||
+        !write_all(fd, input.data(), input.size()) ||
+        !write_all(fd, cwd.data(), cwd.size())) {
+        close(fd);
+        return UNAVAILABLE;
+    }
+    if (wake_pipe_[0] >= 0) drain(wake_pipe_[0]);
+
+    // 받은 바이트 중 아직 처리하지 않은 부분은 buf[pos..]
+    std::string buf, chunk;
+    size_t pos = 0;
+    bool received = false;
+    for (;;) {
+        // 완성된 프레임 처리
+        for (;;) {
+            size_t newline = buf.find('\n', pos);
+            if (newline == std::string::npos) break;
+            const char* line = buf.c_str() + pos;
+            size_t len = 0;
+            int flag = 0;
+            if (line[0] == 'T' && sscanf(line, "T %zu", &len) == 1) {
+                if (buf.size() < newline + 1 + len) break;
+                chunk.assign(buf, newline + 1, len);
+                response->append(chunk);
+                if (on_text) on_text(chunk);
+                received = true;
+                pos = newline + 1 + len;
+            } else if (line[0] == 'E' && sscanf(line, "E %d", &flag) == 1) {
+                *timed_out = flag != 0;
+                close(fd);
+                return DONE;
+            } else {
+                // 알 수 없는 응답: 이미 받은 것이 있으면 잘린 응답으로 끝냄
+                close(fd);
+                *timed_out = received;
+                return received ? DONE : UNAVAILABLE;
+            }
+        }
+        buf.erase(0, pos);
+        pos = 0;
+
+        if (cancelled && cancelled()) {
+            close(fd);
+            return CANCELLED;
+        }
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            // 데몬은 살아 있지만 응답이 늦음: 직접 다시 보내도 같은 백엔드이므로 여기서 끝냄
+            close(fd);
+            *timed_out = true;
+            return DONE;
+        }
+
+        struct pollfd fds[2] = {{fd, POLLIN, 0}, {wake_pipe_[0], POLLIN, 0}};
+        int ready = poll(fds, wake_pipe_[0] >= 0 ? 2 : 1, static_cast<int>(remaining.count()));
+        if (ready < 0 && errno != EINTR) break;
+        if (ready <= 0) continue;
+        if (wake_pipe_[0] >= 0 && (fds[1].revents & POLLIN)) drain(wake_pipe_[0]);
+        if (fds[0].revents == 0) continue;
+
+        char data[16384];
+        ssize_t n = recv(fd, data, sizeof data, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        buf.append(data, n);
+    }
+
+    // 응답 도중 데몬이 끊김: 받은 것이 없으면 호출자가 직접 처리
+    close(fd);
+    *timed_out = received;
+    return received ? DONE : UNAVAILABLE;
+}
+
+// ---------------------------------------------------------
+// AIDaemonServer 구현
+// ---------------------------------------------------------
+
+AIDaemonServer::AIDaemonServer(AIManager& manager)
+    : manager_(manager), stopping_(false), connections_(0) {
+    open_wake_pipe(wake_pipe_);
+}
+
+AIDaemonServer::~AIDaemonServer() {
+    for (int fd : wake_pipe_) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+void AIDaemonServer::stop() {
+    stopping_ = true;
+    signal_wake_pipe(wake_pipe_[1]);
+}
+
+bool AIDaemonServer::run(const std::string& path) {
+    sockaddr_un addr;
+    if (!fill_address(path, addr)) return false;
+
+    // 이미 응답하는 데몬이 있으면 그대로 둠. 남아 있는 소켓 파일만 지움
+    int existing = connect_to(path);
+    if (existing >= 0) {
+        close(existing);
+        return false;
+    }
+    unlink(path.c_str());
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) return false;
+    set_cloexec(listen_fd);
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0 ||
+        chmod(path.c_str(), 0600) != 0 || listen(listen_fd, 64) != 0) {
+        close(listen_fd);
+        return false;
+    }
+
+    stopping_ = false;
+    if (wake_pipe_[0] >= 0) drain(wake_pipe_[0]);
+
+    // 종료 시그널을 받으면 멈춤 (소켓 파일을 지우고 끝나도록)
+    struct sigaction previous[sizeof STOP_SIGNALS / sizeof STOP_SIGNALS[0]];
+    struct sigaction act;
+    memset(&act, 0, sizeof act);
+    act.sa_handler = stop_signal_handler;
+    act.sa_flags = SA_RESTART;
+    sigemptyset(&act.sa_mask);
+    g_stop_signal = 0;
+    g_stop_wake_fd = wake_pipe_[1];
+    for (size_t i = 0; i < sizeof STOP_SIGNALS / sizeof STOP_SIGNALS[0]; i++) {
+        sigaction(STOP_SIGNALS[i], &act, &previous[i]);
+    }
+
+    while (!stopping_ && g_stop_signal == 0) {
+        struct pollfd fds[2] = {{listen_fd, POLLIN, 0}, {wake_pipe_[0], POLLIN, 0}};
+        if (poll(fds, wake_pipe_[0] >= 0 ? 2 : 1, -1) < 0 && errno != EINTR) break;
+        if (stopping_ || g_stop_signal != 0) break;
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        int client = accept(listen_fd, nullptr, nullptr);
+        if (client < 0) continue;
+        set_cloexec(client);
+        connections_++;
+        std::thread([this, client] {
+            serve(client);
+            close(client);
+            connections_--;
+        }).detach();
+    }
+
+    close(listen_fd);
+    unlink(path.c_str());
+    while (connections_ > 0) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    for (size_t i = 0; i < sizeof STOP_SIGNALS / sizeof STOP_SIGNALS[0]; i++) {
+        sigaction(STOP_SIGNALS[i], &previous[i], nullptr);
+    }
+    g_stop_wake_fd = -1;
+    int sig = g_stop_signal;
+    g_stop_signal = 0;
+    if (sig != 0) raise(sig);
+    return true;
+}
+
+// 연결 하나의 메시지 처리
+void AIDaemonServer::serve(int fd) {
+    if (!same_user(fd)) return;
+
+    // 보내다 만 클라이언트 때문에 스레드가 영원히 남지 않도록
+    struct timeval timeout = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+
+    // 히스토리 전달 메시지를 차례로 처리하다가 응답 요청이 오면 답하고 끝냄
+    std::string header, a, b;
+    while (read_line(fd, header)) {
+        int mode = 0, flags = 0;
+        long long timestamp = 0;
+        size_t first = 0, second = 0;
+        if (sscanf(header.c_str(), "C %lld %zu %zu", &timestamp, &first, &second) == 3) {
+            if (!read_field(fd, first, a) || !read_field(fd, second, b)) return;
+            manager_.record_command(a, timestamp, b);
+        } else if (sscanf(header.c_str(), "R %d %d %zu %zu", &mode, &flags, &first, &second) == 4) {
+            if (!read_field(fd, first, a) || !read_field(fd, second, b)) return;
+            serve_request(fd, a, mode, flags, b);
+            return;
+        } else {
+            return;
+        }
+    }
+}
+
+// 응답 요청 하나에 답함
+// 스트리밍 조각은 받는 대로 보내고, 캐시 적중이나 스트리밍이 아닌 응답은 한 번에 보냄
+// 세션이 연결을 끊거나 조각을 보낼 수 없으면 그 요청의 전송을 바로 중단함
+void AIDaemonServer::serve_request(int fd, const std::string& input, int mode, int flags,
+                                   const std::string& cwd) {
+    uint64_t id = manager_.open_daemon_request();
+
+    // 요청 뒤에는 세션이 보낼 것이 없으므로, 읽을 수 있게 되면 세션이 끊은 것
+    int done_pipe[2];
+    open_wake_pipe(done_pipe);
+    std::thread watcher;
+    if (done_pipe[0] >= 0) {
+        watcher = std::thread([this, fd, id, &done_pipe] {
+            struct pollfd fds[2] = {{fd, POLLIN, 0}, {done_pipe[0], POLLIN, 0}};
+#ifdef POLLRDHUP
+            fds[0].events |= POLLRDHUP;
+#endif
+            while (poll(fds, 2, -1) < 0 && errno == EINTR) {}
+            if (fds[0].revents != 0 && !(fds[1].revents & POLLIN)) {
+                manager_.cancel_daemon_request(id);
+            }
+        });
+    }
+
+    bool streamed = false, connected = true;
+    auto send_text = [this, fd, id, &connected](const std::string& text) {
+        if (!connected) return;
+        char frame[MAX_HEADER];
+        snprintf(frame, sizeof frame, "T %zu\n", text.size());
+        connected = write_all(fd, frame, strlen(frame)) && write_all(fd, text.data(), text.size());
+        if (!connected) manager_.cancel_daemon_request(id);
+    };
+    std::function<void(const std::string&)> on_text;
+    if (flags & STREAM_FLAG) {
+        on_text = [&](const std::string& chunk) {
+            streamed = true;
+            send_text(chunk);
+        };
+    }
+    AIMode ai_mode = mode == 2 ? AIMode::EXPLAIN : mode == 3 ? AIMode::DIAGNOSE : AIMode::GENERATION;
+    bool timed_out = false;
+    std::string response = manager_.fetch_response(id, input, ai_mode, (flags & COMBINED_FLAG) != 0,
+                                                   cwd, on_text, &timed_out);
+    if (!streamed && !response.empty()) send_text(response);
+    if (connected) write_all(fd, timed_out ? "E 1\n" : "E 0\n", 4);
+
+    if (watcher.joinable()) {
+        signal_wake_pipe(done_pipe[1]);
+        watcher.join();
+    }
+    for (int pipe_fd : done_pipe) {
+        if (pipe_fd >= 0) close(pipe_fd);
+    }
+    manager_.close_daemon_request(id);
+}
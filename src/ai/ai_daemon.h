@@ -0,0 +1,119 @@
+#ifndef FISH_AI_DAEMON_H
+#define FISH_AI_DAEMON_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class AIManager;
+
+// ---------------------------------------------------------
+// 사용자별 AI 데몬 (선택 사항)
+//  - 여러 fish 세션이 Unix 소켓으로 데몬 하나에 요청을 맡김: 데몬이 연결 풀, 결과 캐시,
+//    모든 세션의 명령어 히스토리를 한 곳에서 가짐 (히스토리 파일은 데몬이 시작할 때 적재)
+//  - 데몬이 없거나 응답 전에 연결이 끊기면 세션은 조용히 프로세스 안에서 직접 처리
+//  - 연결 하나에 메시지 여러 개를 보낼 수 있고, 응답 요청은 항상 마지막. 메시지는
+//    헤더 한 줄 + 길이만큼의 본문:
+//      "R <모드> <플래그> <입력 길이> <디렉토리 길이>\n" 입력 디렉토리       → 응답 요청
+//        (플래그: 1 스트리밍, 2 통합 요청)
+//      "C <시각> <명령어 길이> <디렉토리 길이>\n" 명령어 디렉토리            → 실행한 명령어
+//    응답 요청에 대한 답은 "T <길이>\n" 텍스트 조각 여러 개와 마지막 "E <시간 초과 0/1>\n"
+//  - 같은 사용자끼리만 주고받음: 데몬은 소켓 권한 0600과 연결한 프로세스의 uid를,
+//    세션은 연결한 데몬 프로세스의 uid를 확인
+// ---------------------------------------------------------
+
+// 데몬 소켓 기본 경로: $FISH_AI_DAEMON_SOCKET, $XDG_RUNTIME_DIR/fish-ai.sock,
+// /tmp/fish-ai-<uid>/daemon.sock 순서
+// 데몬 쪽(create_directory)은 마지막 디렉토리를 0700으로 만들고, 믿을 수 없으면 빈 문자열
+// 세션 쪽은 아무것도 만들지 않음 (연결한 데몬의 uid를 확인하므로)
+std::string ai_daemon_default_socket(bool create_directory);
+
+// 세션 쪽: 데몬에 요청을 보냄 (요청은 워커 스레드, 명령어 전달은 메인 스레드에서 호출)
+// 명령어 전달은 쌓아 두기만 하고 바로 돌아옴. 보내는 스레드가 따로 보내거나, 그 전에
+// 응답 요청이 나가면 같은 연결에 요청보다 앞에 실어 보냄 (데몬이 요청 전에 처리함)
+class AIDaemonClient {
+public:
+    // 응답 요청 결과
+    enum Result {
+        UNAVAILABLE,  // 데몬에 연결할 수 없거나 아무것도 받기 전에 끊김: 직접 처리해야 함
+        DONE,         // 응답을 받음 (빈 응답일 수도 있음)
+        CANCELLED     // cancelled()가 true가 되어 중단함
+    };
+
+    AIDaemonClient();
+    ~AIDaemonClient();
+
+    AIDaemonClient(const AIDaemonClient&) = delete;
+    AIDaemonClient& operator=(const AIDaemonClient&) = delete;
+
+    // 소켓 경로 변경 (빈 문자열이면 데몬을 쓰지 않음). 연결 실패 기록도 초기화
+    void set_socket(const std::string& path);
+
+    // 응답 요청. on_text가 있으면 스트리밍 조각을 받는 대로 전달
+    // deadline이 지나면 그때까지 받은 응답으로 끝내고 timed_out을 설정
+    // combined면 mode를 맨 앞 섹션으로 하는 통합 요청
+    Result request(const std::string& input, int mode, bool combined, const std::string& cwd,
+                   std::chrono::steady_clock::time_point deadline,
+                   const std::function<void(const std::string&)>& on_text,
+                   const std::function<bool()>& cancelled, std::string* response,
+                   bool* timed_out);
+
+    // 실행한 명령어를 데몬에 알림 (기다리지 않음, 데몬이 없으면 버림)
+    void send_command(const std::string& command, long long timestamp, const std::string& cwd);
+
+    // 진행 중인 request()를 깨워서 cancelled()를 다시 확인하게 함
+    void wake();
+
+private:
+    static const size_t OUTBOX_LIMIT = 256 * 1024;  // 보내지 못하고 쌓아 둘 전달 메시지 크기
+
+    int connect_socket();
+    void post(const std::string& message);
+    std::string take_outbox();
+    void sender_loop();
+
+    std::mutex mutex_;
+    std::string path_;
+    std::chrono::steady_clock::time_point retry_at_;  // 연결 실패 후 다시 시도할 시각
+    int wake_pipe_[2];
+
+    // 아직 보내지 않은 히스토리 전달 메시지 (이어 붙인 바이트). 보내는 스레드는 처음 쌓일 때 만듦
+    std::string outbox_;
+    bool sending_;
+    bool stopping_;
+    std::condition_variable outbox_cv_;
+    std::thread sender_;
+};
+
+// 데몬 쪽: 소켓에서 요청을 받아 manager로 처리 (연결마다 스레드 하나)
+class AIDaemonServer {
+public:
+    explicit AIDaemonServer(AIManager& manager);
+    ~AIDaemonServer();
+
+    AIDaemonServer(const AIDaemonServer&) = delete;
+    AIDaemonServer& operator=(const AIDaemonServer&) = delete;
+
+    // path에서 요청을 받음 (stop()이나 SIGINT/SIGTERM/SIGHUP까지 블록, 끝나면 소켓 파일을 지움)
+    // 소켓을 열 수 없거나 이미 다른 데몬이 있으면 false
+    // 시그널로 멈췄으면 원래 핸들러를 되돌린 뒤 그 시그널을 다시 보냄
+    bool run(const std::string& path);
+    void stop();
+
+private:
+    void serve(int fd);
+    void serve_request(int fd, const std::string& input, int mode, int flags,
+                       const std::string& cwd);
+
+    AIManager& manager_;
+    std::atomic<bool> stopping_;
+    std::atomic<int> connections_;  // 처리 중인 연결 수 (run()은 모두 끝난 뒤 반환)
+    int wake_pipe_[2];
+};
+
+#endif // FISH_AI_DAEMON_H
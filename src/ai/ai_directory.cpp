@@ -0,0 +1,537 @@
+#include "ai_directory.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+extern char** environ;
+
+// 프로젝트 종류를 알려 주는 파일 (있는 것만 이름을 넣음)
+static const char* const BUILD_FILES[] = {
+    "Cargo.toml", "Makefile", "CMakeLists.txt", "meson.build", "package.json",
+    "pyproject.toml", "setup.py", "requirements.txt", "go.mod", "pom.xml",
+    "build.gradle", "build.gradle.kts", "Gemfile", "composer.json", "mix.exs",
+    "Dockerfile", "docker-compose.yml", "compose.yaml", "flake.nix", "justfile",
+};
+
+static const size_t MAX_SCAN = 4096;            // 목록을 만들 때 읽는 항목 수 상한
+static const size_t MAX_GIT_OUTPUT = 256 * 1024;
+static const size_t MAX_NAME_BYTES = 64;        // 이보다 긴 이름은 잘라서 넣음
+
+#ifdef __linux__
+static const uint32_t DIRECTORY_EVENTS = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                         IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF;
+#endif
+
+// ---------------------------------------------------------
+// 수집 (워커 스레드에서 잠금 없이)
+// ---------------------------------------------------------
+
+// 이름을 한 줄에 안전하게 붙임: 제어 문자는 '?'로, 너무 길면 잘라서
+static void append_name(std::string& out, std::string_view name) {
+    size_t start = out.size();
+    for (char c : name) {
+        if (out.size() - start >= MAX_NAME_BYTES) {
+            while (out.size() > start && (static_cast<unsigned char>(out.back()) & 0xC0) == 0x80) {
+                out.pop_back();
+            }
+            if (out.size() > start) out.pop_back();
+            out += "...";
+            return;
+        }
+        out += static_cast<unsigned char>(c) < 0x20 || c == 0x7f ? '?' : c;
+    }
+}
+
+// 홈 디렉토리 아래면 "~"로 줄여서 보여 줌
+static std::string display_path(const std::string& path) {
+    const char* home = std::getenv("HOME");
+    size_t len = home ? strlen(home) : 0;
+    if (len > 1 && path.compare(0, len, home) == 0 && (path.size() == len || path[len] == '/')) {
+        return "~" + path.substr(len);
+    }
+    return path;
+}
+
+// 파일 내용의 첫 줄 (줄바꿈 제외)
+static bool read_first_line(const std::string& path, std::string& line) {
+    FILE* file = fopen(path.c_str(), "re");
+    if (!file) return false;
+    char buf[512];
+    bool ok = fgets(buf, sizeof buf, file) != nullptr;
+    fclose(file);
+    if (!ok) return false;
+    line.assign(buf);
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+    return true;
+}
+
+// cwd에서 위로 올라가며 .git을 찾아 작업 트리 루트와 git 디렉토리를 돌려줌
+// .git이 파일이면(추가 작업 트리, 서브모듈) 그 안의 "gitdir: 경로"를 따라감
+static bool find_git(const std::string& cwd, std::string* root, std::string* git_dir) {
+    std::string dir = cwd;
+    while (!dir.empty()) {
+        std::string candidate = dir == "/" ? "/.git" : dir + "/.git";
+        struct stat st;
+        if (stat(candidate.c_str(), &st) == 0) {
+            *root = dir;
+            std::string line;
+            if (S_ISDIR(st.st_mode)) {
+                *git_dir = candidate;
+            } else if (read_first_line(candidate, line) && line.compare(0, 8, "gitdir: ") == 0) {
+                *git_dir = line[8] == '/' ? line.substr(8) : dir + "/" + line.substr(8);
+            } else {
+                return false;
+            }
+            return true;
+        }
+        if (dir == "/") break;
+        size_t slash = dir.find_last_of('/');
+        if (slash == std::string::npos) break;
+        dir = slash == 0 ? "/" : dir.substr(0, slash);
+    }
+    return false;
+}
+
+// git status를 실행해서 출력을 out에 (GIT_TIMEOUT_MS 안에 끝나지 않으면 중단)
+// --no-optional-locks: 상태를 보는 것만으로 index를 다시 쓰지 않게 함 (감시 이벤트가 생기지 않도록)
+static bool run_git_status(const std::string& cwd, std::string& out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    for (int fd : fds) fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+    posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+    const char* argv[] = {"git", "--no-optional-locks", "-C", cwd.c_str(), "status",
+                          "--porcelain=v1", "--branch", "--untracked-files=normal", nullptr};
+    pid_t pid;
+    int err = posix_spawnp(&pid, "git", &actions, nullptr, const_cast<char* const*>(argv), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (err != 0) {
+        close(fds[0]);
+        return false;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(AIDirectoryContext::GIT_TIMEOUT_MS);
+    bool complete = false;
+    char buf[4096];
+    while (out.size() <= MAX_GIT_OUTPUT) {
+        long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) break;
+        struct pollfd pfd = {fds[0], POLLIN, 0};
+        int ready = poll(&pfd, 1, static_cast<int>(remaining));
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) break;
+        ssize_t n = read(fds[0], buf, sizeof buf);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            complete = n == 0;
+            break;
+        }
+        out.append(buf, static_cast<size_t>(n));
+    }
+    close(fds[0]);
+    if (!complete) kill(pid, SIGKILL);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    return complete && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// "## main...origin/main [ahead 1]" 같은 git status 머리 줄에서 브랜치 설명
+static std::string branch_from_status(std::string_view header) {
+    static const std::string_view NO_COMMITS = "No commits yet on ";
+    if (header.compare(0, NO_COMMITS.size(), NO_COMMITS) == 0) {
+        return std::string(header.substr(NO_COMMITS.size())) + " (no commits yet)";
+    }
+    if (header.compare(0, 4, "HEAD") == 0) return "detached HEAD";
+    size_t upstream = header.find("...");
+    if (upstream == std::string_view::npos) return std::string(header);
+    std::string branch(header.substr(0, upstream));
+    size_t track = header.find(" [", upstream);
+    if (track != std::string_view::npos) branch += header.substr(track);
+    return branch;
+}
+
+// git을 실행할 수 없을 때: HEAD 파일에서 브랜치 이름
+static std::string branch_from_head(const std::string& git_dir) {
+    std::string line;
+    if (!read_first_line(git_dir + "/HEAD", line)) return "";
+    if (line.compare(0, 16, "ref: refs/heads/") == 0) return line.substr(16);
+    return "detached HEAD";
+}
+
+// 디렉토리에 있는 빌드 파일 이름을 ", "로 이어서 붙임. 하나라도 있으면 true
+static bool append_build_files(const std::string& dir, std::string& out) {
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool any = false;
+    for (const char* name : BUILD_FILES) {
+        if (faccessat(fd, name, F_OK, 0) != 0) continue;
+        if (any) out += ", ";
+        out += name;
+        any = true;
+    }
+    close(fd);
+    return any;
+}
+
+// 맨 위 항목 목록 (숨김 파일 제외, 이름순, 디렉토리는 "/"를 붙임)
+static void append_listing(const std::string& cwd, std::string& out) {
+    DIR* dir = opendir(cwd.c_str());
+    if (!dir) return;
+    std::vector<std::string> names;
+    size_t count = 0;
+    bool truncated = false;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') continue;
+        if (count == MAX_SCAN) {
+            truncated = true;
+            break;
+        }
+        count++;
+        bool is_dir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            struct stat st;
+            is_dir = fstatat(dirfd(dir), entry->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+        }
+        names.emplace_back(entry->d_name);
+        if (is_dir) names.back() += '/';
+    }
+    closedir(dir);
+    if (names.empty()) return;
+
+    size_t shown = names.size();
+    if (shown > AIDirectoryContext::MAX_ENTRIES) shown = AIDirectoryContext::MAX_ENTRIES;
+    std::partial_sort(names.begin(), names.begin() + shown, names.end());
+    out += "Top-level entries (";
+    out += std::to_string(count);
+    out += truncated ? "+): " : "): ";
+    for (size_t i = 0; i < shown; i++) {
+        if (i > 0) out += ", ";
+        append_name(out, names[i]);
+    }
+    if (count > shown) out += ", ...";
+    out += "\n";
+}
+
+namespace {
+
+struct Gathered {
+    std::string facts;
+    std::string details;
+};
+
+}  // namespace
+
+// cwd의 사실 수집. root/git_dir는 find_git이 찾은 작업 트리 루트와 git 디렉토리 (없으면 빈 문자열)
+static void gather(const std::string& cwd, const std::string& root, const std::string& git_dir,
+                   Gathered& out) {
+    out.facts = "Working directory: ";
+    append_name(out.facts, display_path(cwd));
+    out.facts += "\n";
+
+    std::string status;
+    bool have_status = !git_dir.empty() && run_git_status(cwd, status);
+    if (!git_dir.empty()) {
+        // 첫 줄은 "## 브랜치", 나머지는 "XY 경로"
+        std::string branch;
+        size_t changes = 0, named = 0;
+        std::string names;
+        size_t pos = 0;
+        while (have_status && pos < status.size()) {
+            size_t end = status.find('\n', pos);
+            if (end == std::string::npos) end = status.size();
+            std::string_view line(status.data() + pos, end - pos);
+            pos = end + 1;
+            if (line.compare(0, 3, "## ") == 0) {
+                branch = branch_from_status(line.substr(3));
+            } else if (line.size() > 3) {
+                changes++;
+                if (named++ >= AIDirectoryContext::MAX_CHANGES) continue;
+                if (!names.empty()) names += ", ";
+                append_name(names, line.substr(3));
+            }
+        }
+        if (!have_status) branch = branch_from_head(git_dir);
+        if (!branch.empty()) {
+            out.facts += "Git branch: ";
+            append_name(out.facts, branch);
+            out.facts += "\n";
+        }
+        if (have_status && changes == 0) {
+            out.details += "Uncommitted changes: none\n";
+        } else if (have_status) {
+            out.details += "Uncommitted changes (" + std::to_string(changes) + "): " + names;
+            if (changes > AIDirectoryContext::MAX_CHANGES) out.details += ", ...";
+            out.details += "\n";
+        }
+    }
+
+    // 하위 디렉토리에서는 저장소 루트의 빌드 파일도 봄
+    std::string files;
+    if (append_build_files(cwd, files)) {
+        out.facts += "Build files: " + files + "\n";
+    } else if (!root.empty() && root != cwd && append_build_files(root, files)) {
+        out.facts += "Build files at repository root: " + files + "\n";
+    }
+
+    append_listing(cwd, out.details);
+}
+
+// ---------------------------------------------------------
+// AIDirectoryContext 구현
+// ---------------------------------------------------------
+
+AIDirectoryContext::AIDirectoryContext()
+    : enabled_(true), use_seq_(0), stats_{0, 0, 0, 0}, shutting_down_(false), inotify_fd_(-1),
+      wake_pipe_{-1, -1} {
+    const char* env = std::getenv("FISH_AI_DIRECTORY_CONTEXT");
+    enabled_ = !(env && std::string(env) == "0");
+}
+
+AIDirectoryContext::~AIDirectoryContext() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shutting_down_ = true;
+    }
+    if (wake_pipe_[1] >= 0) {
+        char c = 1;
+        ssize_t unused = write(wake_pipe_[1], &c, 1);
+        (void)unused;
+    }
+    if (worker_.joinable()) worker_.join();
+    for (int fd : wake_pipe_) {
+        if (fd >= 0) close(fd);
+    }
+    if (inotify_fd_ >= 0) close(inotify_fd_);
+}
+
+void AIDirectoryContext::set_enabled(bool enabled) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    enabled_ = enabled;
+}
+
+// cwd를 방금 쓴 디렉토리로 표시하고 항목을 돌려줌 (mutex_를 잡은 상태에서 호출)
+// 없거나, 바뀌었거나, 오래된 항목이면 수집을 예약
+AIDirectoryContext::Entry& AIDirectoryContext::touch_locked(const std::string& cwd) {
+    auto now = Clock::now();
+    auto it = entries_.find(cwd);
+    if (it == entries_.end()) {
+        if (entries_.size() >= CAPACITY) evict_locked();
+        it = entries_.emplace(cwd, Entry{"", "", false, false, false, now, 0, -1}).first;
+    }
+    Entry& entry = it->second;
+    entry.used = ++use_seq_;
+    bool expired = entry.ready && now - entry.gathered_at > std::chrono::milliseconds(MAX_AGE_MS);
+    if (!entry.queued && (!entry.ready || entry.stale || expired)) schedule_locked(cwd, entry, now);
+    return entry;
+}
+
+bool AIDirectoryContext::lookup(const std::string& cwd, std::string& facts, std::string& details) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_ || cwd.empty()) return false;
+    const Entry& entry = touch_locked(cwd);
+    if (!entry.ready) {
+        stats_.misses++;
+        return false;
+    }
+    // 다시 수집하는 중이면 이전 글을 씀 (프롬프트는 기다리지 않음)
+    stats_.hits++;
+    facts = entry.facts;
+    details = entry.details;
+    return true;
+}
+
+void AIDirectoryContext::prefetch(const std::string& cwd) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (enabled_ && !cwd.empty()) touch_locked(cwd);
+}
+
+AIDirectoryStats AIDirectoryContext::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+// 수집 예약 (mutex_를 잡은 상태에서 호출). 워커와 감시는 처음 필요할 때 만듦
+void AIDirectoryContext::schedule_locked(const std::string& cwd, Entry& entry,
+                                         Clock::time_point due) {
+    entry.queued = true;
+    pending_.push_back(Pending{cwd, due});
+    if (!worker_.joinable()) {
+        if (pipe(wake_pipe_) == 0) {
+            for (int fd : wake_pipe_) {
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            }
+        } else {
+            wake_pipe_[0] = wake_pipe_[1] = -1;
+        }
+#ifdef __linux__
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+        worker_ = std::thread(&AIDirectoryContext::worker_loop, this);
+    }
+    if (wake_pipe_[1] >= 0) {
+        char c = 1;
+        ssize_t unused = write(wake_pipe_[1], &c, 1);
+        (void)unused;
+    }
+}
+
+// 가장 오래 안 쓴 디렉토리를 잊음 (mutex_를 잡은 상태에서 호출)
+void AIDirectoryContext::evict_locked() {
+    auto oldest = std::min_element(entries_.begin(), entries_.end(),
+                                   [](const std::pair<const std::string, Entry>& a,
+                                      const std::pair<const std::string, Entry>& b) {
+                                       return a.second.used < b.second.used;
+                                   });
+    if (oldest == entries_.end()) return;
+    unwatch_locked(oldest->second);
+    entries_.erase(oldest);
+}
+
+// 감시 해제 (mutex_를 잡은 상태에서 호출). 같은 디렉토리는 감시 번호가 같으므로
+// 마지막으로 쓰던 항목이 놓을 때만 실제로 해제
+void AIDirectoryContext::unwatch_locked(Entry& entry) {
+    if (entry.watch < 0) return;
+    auto ref = watch_refs_.find(entry.watch);
+    if (ref != watch_refs_.end() && --ref->second == 0) {
+        watch_refs_.erase(ref);
+#ifdef __linux__
+        inotify_rm_watch(inotify_fd_, entry.watch);
+#endif
+    }
+    entry.watch = -1;
+}
+
+// inotify 이벤트를 읽어 해당 디렉토리를 무효화 (워커 스레드)
+// 다시 수집은 하지 않고 표시만 함 (다음 조회가 예약). ignored_watch의 이벤트는 방금 끝난
+// 수집이 만든 것이므로 버림
+void AIDirectoryContext::read_events(int ignored_watch) {
+#ifdef __linux__
+    alignas(struct inotify_event) char buf[4096];
+    for (;;) {
+        ssize_t n = read(inotify_fd_, buf, sizeof buf);
+        if (n <= 0) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (ssize_t offset = 0; offset < n;) {
+            const struct inotify_event* event =
+                reinterpret_cast<const struct inotify_event*>(buf + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+            bool overflow = (event->mask & IN_Q_OVERFLOW) != 0;
+            bool ignored = event->wd == ignored_watch ||
+                           (event->len && strcmp(event->name, ".git") == 0);
+            for (auto& item : entries_) {
+                Entry& entry = item.second;
+                if (!overflow && entry.watch != event->wd) continue;
+                // 감시가 없어졌으면(디렉토리 삭제 등) 번호를 버림 (다음 수집에서 다시 감시)
+                if (event->mask & IN_IGNORED) {
+                    entry.watch = -1;
+                } else if (ignored) {
+                    continue;
+                }
+                if (!entry.ready || entry.stale) continue;
+                entry.stale = true;
+                stats_.invalidations++;
+            }
+            if (event->mask & IN_IGNORED) watch_refs_.erase(event->wd);
+        }
+    }
+#else
+    (void)ignored_watch;
+#endif
+}
+
+// 워커 스레드: 때가 된 수집을 하나씩 처리하고, 없으면 다음 수집 시각이나 이벤트까지 기다림
+void AIDirectoryContext::worker_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!shutting_down_) {
+        auto now = Clock::now();
+        auto due = std::find_if(pending_.begin(), pending_.end(),
+                                [now](const Pending& p) { return p.due <= now; });
+        if (due != pending_.end()) {
+            std::string cwd = std::move(due->cwd);
+            pending_.erase(due);
+            auto it = entries_.find(cwd);
+            if (it == entries_.end()) continue;  // 기다리는 동안 잊힘
+            it->second.queued = false;
+            it->second.stale = false;  // 수집 중에 또 바뀌면 이벤트가 다시 표시함
+            lock.unlock();
+
+            // 수집 전에 감시를 걸어서, 다음 수집 전에 생긴 변경을 놓치지 않게 함
+            std::string root, git_dir;
+            bool in_git = find_git(cwd, &root, &git_dir);
+            int watch = -1;
+#ifdef __linux__
+            if (inotify_fd_ >= 0) {
+                watch = inotify_add_watch(inotify_fd_, cwd.c_str(), DIRECTORY_EVENTS | IN_ONLYDIR);
+            }
+#endif
+            Gathered gathered;
+            gather(cwd, in_git ? root : "", in_git ? git_dir : "", gathered);
+
+            lock.lock();
+            stats_.gathers++;
+            // 새 감시의 참조를 먼저 세고 이전 것을 풀어야 같은 번호가 지워지지 않음
+            if (watch >= 0) watch_refs_[watch]++;
+            it = entries_.find(cwd);
+            if (it == entries_.end()) {
+                Entry gone{"", "", false, false, false, now, 0, watch};
+                unwatch_locked(gone);
+                continue;
+            }
+            Entry& entry = it->second;
+            unwatch_locked(entry);
+            entry.watch = watch;
+            entry.facts = std::move(gathered.facts);
+            entry.details = std::move(gathered.details);
+            entry.ready = true;
+            entry.gathered_at = Clock::now();
+
+            // 수집하는 동안 쌓인 이 디렉토리의 이벤트는 수집 자신이 만든 것으로 보고 버림
+            if (inotify_fd_ >= 0 && watch >= 0) {
+                lock.unlock();
+                read_events(watch);
+                lock.lock();
+            }
+            continue;
+        }
+
+        // 다음 수집 시각까지 (없으면 무한히) 이벤트나 깨우기 신호를 기다림. 잠금 없이 poll
+        int timeout = -1;
+        for (const Pending& p : pending_) {
+            long ms = std::chrono::duration_cast<std::chrono::milliseconds>(p.due - now).count() + 1;
+            if (timeout < 0 || ms < timeout) timeout = static_cast<int>(ms);
+        }
+        lock.unlock();
+        struct pollfd fds[2] = {{wake_pipe_[0], POLLIN, 0}, {inotify_fd_, POLLIN, 0}};
+        int ready = poll(fds, inotify_fd_ >= 0 ? 2 : 1, timeout);
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            char drain[64];
+            while (read(wake_pipe_[0], drain, sizeof drain) > 0) {
+            }
+        }
+        if (ready > 0 && inotify_fd_ >= 0 && (fds[1].revents & POLLIN)) read_events(-1);
+        lock.lock();
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef FISH_AI_DIRECTORY_H
+#define FISH_AI_DIRECTORY_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// ---------------------------------------------------------
+// 작업 디렉토리 컨텍스트 (프롬프트용)
+//  - 디렉토리마다 경로, git 브랜치와 변경 파일, 빌드 파일(Cargo.toml, Makefile 등),
+//    맨 위 항목 목록을 모아 프롬프트에 넣을 글로 만들어 둠
+//  - 수집(디렉토리 읽기, git status 실행)은 백그라운드 스레드에서만 함. lookup()은
+//    캐시만 보므로 프롬프트 조립이 파일 시스템을 기다리지 않음 (처음 보는 디렉토리는
+//    수집을 예약하고 이번 프롬프트에는 넣지 않음)
+//  - 캐시한 디렉토리를 inotify로 지켜보다가 바뀌면 표시만 해 두고, 다음 lookup 때 다시
+//    수집 (다시 수집하는 동안은 이전 글을 씀). .git 안의 변경과 수집 중에 생긴 이벤트는
+//    무시함 (git이 수시로 고쳐 쓰므로 프롬프트마다 다시 수집하게 됨)
+//  - inotify로 보이지 않는 하위 디렉토리 안의 변경 때문에 MAX_AGE_MS가 지나도 다시 수집
+//    (inotify가 없는 플랫폼에서는 이것만 적용)
+// 스레드 안전.
+// ---------------------------------------------------------
+
+struct AIDirectoryStats {
+    uint64_t gathers;        // 수집 횟수
+    uint64_t hits;           // 캐시에서 바로 돌려준 조회
+    uint64_t misses;         // 아직 수집되지 않아 빈 손으로 돌아간 조회
+    uint64_t invalidations;  // 파일 시스템 변경으로 무효화된 횟수
+};
+
+class AIDirectoryContext {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const size_t CAPACITY = 16;           // 기억하는 디렉토리 수 (넘치면 가장 오래 안 쓴 것부터)
+    static const size_t MAX_ENTRIES = 20;        // 목록에 넣을 항목 수
+    static const size_t MAX_CHANGES = 8;         // 이름을 넣을 변경 파일 수
+    static constexpr long MAX_AGE_MS = 30000;
+    static constexpr long GIT_TIMEOUT_MS = 2000;
+
+    AIDirectoryContext();
+    ~AIDirectoryContext();
+
+    AIDirectoryContext(const AIDirectoryContext&) = delete;
+    AIDirectoryContext& operator=(const AIDirectoryContext&) = delete;
+
+    // 끄면 lookup이 항상 false (기본값은 $FISH_AI_DIRECTORY_CONTEXT=0 이 아니면 켬)
+    void set_enabled(bool enabled);
+
+    // cwd의 글을 facts/details에 복사. 수집된 적이 없으면 수집을 예약하고 false
+    //  facts: 잘 바뀌지 않는 줄 (경로, 브랜치, 빌드 파일). 캐시 키에 들어감
+    //  details: 자주 바뀌는 줄 (변경 파일, 항목 목록)
+    // 줄마다 "\n"으로 끝남. 잠금만 잡고 파일 시스템은 건드리지 않음
+    bool lookup(const std::string& cwd, std::string& facts, std::string& details);
+
+    // 아직 없거나 바뀐 디렉토리면 미리 수집 (디렉토리를 옮겼을 수 있는 시점에 호출)
+    void prefetch(const std::string& cwd);
+
+    AIDirectoryStats stats() const;
+
+private:
+    struct Entry {
+        std::string facts;
+        std::string details;
+        bool ready;                 // 한 번이라도 수집됨
+        bool stale;                 // 바뀌어서 다시 수집해야 함
+        bool queued;
+        Clock::time_point gathered_at;
+        uint64_t used;              // 마지막으로 쓴 순서 (LRU)
+        int watch;                  // 디렉토리 감시 번호 (-1이면 없음)
+    };
+
+    struct Pending {
+        std::string cwd;
+        Clock::time_point due;
+    };
+
+    Entry& touch_locked(const std::string& cwd);
+    void schedule_locked(const std::string& cwd, Entry& entry, Clock::time_point due);
+    void evict_locked();
+    void unwatch_locked(Entry& entry);
+    void read_events(int ignored_watch);
+    void worker_loop();
+
+    mutable std::mutex mutex_;
+    bool enabled_;
+    std::unordered_map<std::string, Entry> entries_;
+    std::deque<Pending> pending_;
+    std::unordered_map<int, size_t> watch_refs_;  // 감시 번호 → 쓰는 항목 수 (같은 디렉토리는 번호가 같음)
+    uint64_t use_seq_;
+    AIDirectoryStats stats_;
+
+    std::thread worker_;
+    bool shutting_down_;
+    int inotify_fd_;
+    int wake_pipe_[2];
+};
+
+#endif // FISH_AI_DIRECTORY_H
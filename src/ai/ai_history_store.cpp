@@ -0,0 +1,448 @@
+#include "ai_history_store.h"
+#include "ai_cache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+// 디렉토리 기록 파일 레코드: when(8) command_hash(8) dir_hash(8)
+struct DiskDirRecord {
+    int64_t when;
+    uint64_t command_hash;
+    uint64_t dir_hash;
+};
+
+static const size_t ARENA_BLOCK_SIZE = 64 * 1024;
+static const size_t MAX_DIR_RECORDS = 100000;
+static const uint32_t NO_COMMAND = UINT32_MAX;
+
+static uint64_t hash_view(std::string_view text) {
+    return AIResultCache::hash(text.data(), text.size());
+}
+
+// 인메모리 해시 테이블용 해시 (디스크 형식과 무관하므로 빠른 표준 해시 사용)
+static uint32_t table_hash(std::string_view text) {
+    return static_cast<uint32_t>(std::hash<std::string_view>()(text));
+}
+
+// fish 히스토리의 YAML 이스케이프 해제 ("\\" -> "\", "\n" -> 줄바꿈)
+static std::string unescape_yaml(std::string_view text) {
+    std::string result;
+    result.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '\\' && i + 1 < text.size()) {
+            char next = text[i + 1];
+            if (next == '\\' || next == 'n') {
+                result += next == 'n' ? '\n' : '\\';
+                i++;
+                continue;
+            }
+        }
+        result += text[i];
+    }
+    return result;
+}
+
+// ---------------------------------------------------------
+// AIHistoryStore 구현
+// ---------------------------------------------------------
+
+AIHistoryStore::AIHistoryStore()
+    : sorted_dirty_(false), dir_version_(1), newest_loaded_(0), dir_cache_hash_(0), dir_cache_version_(0),
+      dir_cache_n_(0), arena_used_(0), arena_capacity_(0), arena_bytes_(0),
+      map_size_(0), dirs_fd_(-1) {}
+
+AIHistoryStore::~AIHistoryStore() {
+    release();
+}
+
+void AIHistoryStore::release() {
+    clear();
+    arena_blocks_.clear();
+    arena_used_ = arena_capacity_ = arena_bytes_ = 0;
+    map_size_ = 0;
+    if (dirs_fd_ >= 0) close(dirs_fd_);
+    dirs_fd_ = -1;
+}
+
+void AIHistoryStore::stop_recording_dirs() {
+    if (dirs_fd_ >= 0) close(dirs_fd_);
+    dirs_fd_ = -1;
+}
+
+void AIHistoryStore::clear() {
+    entries_.clear();
+    commands_.clear();
+    slots_.clear();
+    hashes_.clear();
+    sorted_.clear();
+    sorted_dirty_ = false;
+    dir_records_.clear();
+    dir_version_++;
+    added_.clear();
+    newest_loaded_ = 0;
+}
+
+void AIHistoryStore::swap(AIHistoryStore& other) {
+    entries_.swap(other.entries_);
+    commands_.swap(other.commands_);
+    slots_.swap(other.slots_);
+    hashes_.swap(other.hashes_);
+    sorted_.swap(other.sorted_);
+    std::swap(sorted_dirty_, other.sorted_dirty_);
+    dir_records_.swap(other.dir_records_);
+    added_.swap(other.added_);
+    std::swap(newest_loaded_, other.newest_loaded_);
+    arena_blocks_.swap(other.arena_blocks_);
+    std::swap(arena_used_, other.arena_used_);
+    std::swap(arena_capacity_, other.arena_capacity_);
+    std::swap(arena_bytes_, other.arena_bytes_);
+    std::swap(map_size_, other.map_size_);
+    std::swap(dirs_fd_, other.dirs_fd_);
+    // 버전은 둘 다 앞으로만 움직여야 이전 메모가 새 내용에 맞아 보이지 않음
+    uint64_t version = std::max(dir_version_, other.dir_version_) + 1;
+    dir_version_ = other.dir_version_ = version;
+}
+
+std::string_view AIHistoryStore::arena_copy(std::string_view text) {
+    if (text.empty()) return std::string_view();
+    if (text.size() > arena_capacity_ - arena_used_) {
+        // 블록보다 큰 문자열은 전용 블록에 보관
+        size_t size = std::max(ARENA_BLOCK_SIZE, text.size());
+        arena_blocks_.emplace_back(new char[size]);
+        arena_used_ = 0;
+        arena_capacity_ = size;
+        arena_bytes_ += size;
+    }
+    char* dest = arena_blocks_.back().get() + arena_used_;
+    memcpy(dest, text.data(), text.size());
+    arena_used_ += text.size();
+    return std::string_view(dest, text.size());
+}
+
+uint32_t AIHistoryStore::find(std::string_view text, uint32_t hash) const {
+    if (slots_.empty()) return NO_COMMAND;
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        uint32_t slot = slots_[i];
+        if (slot == 0) return NO_COMMAND;
+        if (hashes_[slot - 1] == hash && commands_[slot - 1].text == text) return slot - 1;
+    }
+}
+
+// 테이블 크기를 두 배로 (부하율 50% 이하 유지)
+void AIHistoryStore::grow_slots() {
+    std::vector<uint32_t> slots(std::max<size_t>(1024, slots_.size() * 2), 0);
+    size_t mask = slots.size() - 1;
+    for (uint32_t id = 0; id < commands_.size(); id++) {
+        size_t i = hashes_[id] & mask;
+        while (slots[i] != 0) i = (i + 1) & mask;
+        slots[i] = id + 1;
+    }
+    slots_.swap(slots);
+}
+
+// text에 해당하는 명령어 id 반환 (없으면 아레나에 복사해서 추가)
+uint32_t AIHistoryStore::intern(std::string_view text) {
+    uint32_t hash = table_hash(text);
+    uint32_t found = find(text, hash);
+    if (found != NO_COMMAND) return found;
+
+    text = arena_copy(text);
+    uint32_t id = static_cast<uint32_t>(commands_.size());
+    commands_.push_back(HistoryCommand{text, 0, 0});
+    hashes_.push_back(hash);
+    if (commands_.size() * 2 > slots_.size()) {
+        grow_slots();
+    } else {
+        size_t mask = slots_.size() - 1;
+        size_t i = hash & mask;
+        while (slots_[i] != 0) i = (i + 1) & mask;
+        slots_[i] = id + 1;
+    }
+
+    // 정렬 인덱스가 최신이면 제자리에 삽입, 아니면 다음 조회 때 다시 정렬
+    if (!sorted_dirty_) {
+        auto pos = std::lower_bound(sorted_.begin(), sorted_.end(), text,
+                                    [this](uint32_t a, std::string_view b) {
+                                        return commands_[a].text < b;
+                                    });
+        sorted_.insert(pos, id);
+    }
+    return id;
+}
+
+bool AIHistoryStore::load(const std::string& history_path) {
+    release();
+
+    int fd = open(history_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    const char* map = nullptr;
+    if (st.st_size > 0) {
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE;  // 어차피 전부 읽으므로 페이지 폴트를 한 번에 처리
+#endif
+        void* mapped = mmap(nullptr, st.st_size, PROT_READ, flags, fd, 0);
+        if (mapped != MAP_FAILED) {
+            map = static_cast<const char*>(mapped);
+            map_size_ = st.st_size;
+        }
+    }
+    close(fd);
+
+    // 줄 단위 파싱: "- cmd: ..." 다음에 오는 "  when: ..."만 사용 (paths 등은 무시)
+    // 명령어는 모두 아레나에 복사하고 매핑은 파싱이 끝나면 풂
+    sorted_dirty_ = true;
+    entries_.reserve(std::min<size_t>(map_size_ / 64, MAX_ENTRIES * 2));
+    bool have_entry = false;
+    const char* p = map;
+    const char* end = map + map_size_;
+    while (p < end) {
+        const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        const char* line_end = newline ? newline : end;
+        std::string_view line(p, line_end - p);
+        p = newline ? newline + 1 : end;
+
+        if (line.compare(0, 7, "- cmd: ") == 0) {
+            std::string_view text = line.substr(7);
+            have_entry = !text.empty();
+            if (!have_entry) continue;
+            uint32_t id = text.find('\\') == std::string_view::npos ? intern(text)
+                                                                     : intern(unescape_yaml(text));
+            commands_[id].count++;
+            entries_.push_back(Entry{0, id});
+        } else if (have_entry && line.compare(0, 8, "  when: ") == 0) {
+            long long when = 0;
+            for (char c : line.substr(8)) {
+                if (c < '0' || c > '9') break;
+                when = when * 10 + (c - '0');
+            }
+            entries_.back().when = when;
+            HistoryCommand& cmd = commands_[entries_.back().command];
+            cmd.last_used = std::max(cmd.last_used, when);
+            newest_loaded_ = std::max(newest_loaded_, when);
+            have_entry = false;
+        }
+    }
+
+    if (map) munmap(const_cast<char*>(map), map_size_);
+
+    trim_entries();
+    entries_.shrink_to_fit();
+    sort_commands();
+    load_dirs(history_path + ".dirs");
+    return true;
+}
+
+// 디렉토리 기록 파일 적재. 이후 add()가 같은 파일에 덧붙임
+void AIHistoryStore::load_dirs(const std::string& path) {
+    dirs_fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (dirs_fd_ < 0) return;
+
+    struct stat st;
+    if (fstat(dirs_fd_, &st) != 0) return;
+    size_t count = st.st_size / sizeof(DiskDirRecord);
+    if (count == 0) return;
+
+    void* map = mmap(nullptr, count * sizeof(DiskDirRecord), PROT_READ, MAP_PRIVATE, dirs_fd_, 0);
+    if (map == MAP_FAILED) return;
+    const DiskDirRecord* records = static_cast<const DiskDirRecord*>(map);
+
+    std::unordered_map<uint64_t, uint32_t> by_hash;
+    by_hash.reserve(commands_.size());
+    for (uint32_t id = 0; id < commands_.size(); id++) {
+        by_hash.emplace(hash_view(commands_[id].text), id);
+    }
+
+    size_t first = count > MAX_DIR_RECORDS ? count - MAX_DIR_RECORDS : 0;
+    dir_records_.reserve(count - first);
+    for (size_t i = first; i < count; i++) {
+        auto it = by_hash.find(records[i].command_hash);
+        if (it == by_hash.end()) continue;  // 히스토리에서 지워진 명령어
+        dir_records_.push_back(DirRecord{records[i].when, records[i].dir_hash, it->second});
+    }
+    dir_version_++;
+
+    // 파일이 너무 커지면 최근 기록만 남기고 다시 씀
+    if (count > 2 * MAX_DIR_RECORDS) {
+        std::string tmp = path + ".tmp";
+        int out = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (out >= 0) {
+            size_t bytes = (count - first) * sizeof(DiskDirRecord);
+            bool ok = write(out, records + first, bytes) == static_cast<ssize_t>(bytes);
+            close(out);
+            if (ok && rename(tmp.c_str(), path.c_str()) == 0) {
+                close(dirs_fd_);
+                dirs_fd_ = open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+            } else {
+                unlink(tmp.c_str());
+            }
+        }
+    }
+    munmap(map, count * sizeof(DiskDirRecord));
+}
+
+void AIHistoryStore::add(const std::string& command, long long timestamp, const std::string& cwd) {
+    uint32_t id = intern(command);
+    HistoryCommand& cmd = commands_[id];
+    cmd.count++;
+    cmd.last_used = std::max(cmd.last_used, timestamp);
+    entries_.push_back(Entry{timestamp, id});
+    trim_entries();
+
+    uint64_t dir_hash = cwd.empty() ? 0 : hash_view(cwd);
+    bool saved = false;
+    if (!cwd.empty()) {
+        dir_records_.push_back(DirRecord{timestamp, dir_hash, id});
+        dir_version_++;
+        saved = save_dir_record(timestamp, cmd.text, dir_hash);
+    }
+    added_.push_back(Added{timestamp, dir_hash, id, !cwd.empty(), saved});
+}
+
+// 디렉토리 기록 파일에 한 건 덧붙임 (기록하지 않는 중이거나 실패하면 false)
+// 실패는 무시해도 됨 (다음 세션의 디렉토리 정보만 줄어듦)
+bool AIHistoryStore::save_dir_record(long long when, std::string_view command, uint64_t dir_hash) {
+    if (dirs_fd_ < 0) return false;
+    DiskDirRecord record{when, hash_view(command), dir_hash};
+    return write(dirs_fd_, &record, sizeof record) == sizeof record;
+}
+
+void AIHistoryStore::merge_added(const AIHistoryStore& other) {
+    for (const Added& added : other.added_) {
+        std::string_view text = other.commands_[added.command].text;
+        uint32_t existing = find(text, table_hash(text));
+        uint32_t id = existing != NO_COMMAND ? existing : intern(text);
+        if (added.when > newest_loaded_) {
+            HistoryCommand& cmd = commands_[id];
+            cmd.count++;
+            cmd.last_used = std::max(cmd.last_used, added.when);
+            entries_.push_back(Entry{added.when, id});
+        }
+        // 파일에 이미 있는 디렉토리 기록은 그 명령어가 파일에도 있었으면 적재할 때 읽힘
+        bool saved = added.dir_saved;
+        if (added.has_dir && !(saved && existing != NO_COMMAND)) {
+            dir_records_.push_back(DirRecord{added.when, added.dir_hash, id});
+            dir_version_++;
+            if (!saved) saved = save_dir_record(added.when, text, added.dir_hash);
+        }
+        added_.push_back(Added{added.when, added.dir_hash, id, added.has_dir, saved});
+    }
+    trim_entries();
+}
+
+// 실행 기록이 상한을 넘으면 오래된 것부터 제거 (명령어별 횟수는 유지)
+void AIHistoryStore::trim_entries() {
+    if (entries_.size() > MAX_ENTRIES + MAX_ENTRIES / 8) {
+        entries_.erase(entries_.begin(), entries_.end() - MAX_ENTRIES);
+    }
+    if (dir_records_.size() > MAX_DIR_RECORDS + MAX_DIR_RECORDS / 8) {
+        dir_records_.erase(dir_records_.begin(), dir_records_.end() - MAX_DIR_RECORDS);
+    }
+    if (added_.size() > MAX_ENTRIES + MAX_ENTRIES / 8) {
+        added_.erase(added_.begin(), added_.end() - MAX_ENTRIES);
+    }
+}
+
+std::vector<uint32_t> AIHistoryStore::recent(size_t n) const {
+    std::vector<uint32_t> result;
+    recent(n, result);
+    return result;
+}
+
+void AIHistoryStore::recent(size_t n, std::vector<uint32_t>& out) const {
+    size_t first = entries_.size() > n ? entries_.size() - n : 0;
+    out.clear();
+    for (size_t i = first; i < entries_.size(); i++) {
+        out.push_back(entries_[i].command);
+    }
+}
+
+std::vector<uint32_t> AIHistoryStore::frequent(size_t n) const {
+    std::vector<uint32_t> ids(commands_.size());
+    for (uint32_t id = 0; id < ids.size(); id++) ids[id] = id;
+
+    n = std::min(n, ids.size());
+    std::partial_sort(ids.begin(), ids.begin() + n, ids.end(), [this](uint32_t a, uint32_t b) {
+        if (commands_[a].count != commands_[b].count) return commands_[a].count > commands_[b].count;
+        return commands_[a].last_used > commands_[b].last_used;
+    });
+    ids.resize(n);
+    return ids;
+}
+
+const std::vector<uint32_t>& AIHistoryStore::in_directory(std::string_view dir, size_t n) const {
+    uint64_t dir_hash = hash_view(dir);
+    if (dir_hash == dir_cache_hash_ && dir_version_ == dir_cache_version_ && n == dir_cache_n_) {
+        return dir_cache_;
+    }
+    std::unordered_map<uint32_t, std::pair<uint32_t, long long>> uses;
+    for (const auto& record : dir_records_) {
+        if (record.dir_hash != dir_hash) continue;
+        auto& use = uses[record.command];
+        use.first++;
+        use.second = std::max(use.second, record.when);
+    }
+
+    std::vector<std::pair<uint32_t, std::pair<uint32_t, long long>>> ranked(uses.begin(), uses.end());
+    n = std::min(n, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + n, ranked.end(),
+                      [](const auto& a, const auto& b) {
+                          if (a.second.first != b.second.first) return a.second.first > b.second.first;
+                          return a.second.second > b.second.second;
+                      });
+
+    dir_cache_.clear();
+    for (size_t i = 0; i < n; i++) dir_cache_.push_back(ranked[i].first);
+    dir_cache_hash_ = dir_hash;
+    dir_cache_version_ = dir_version_;
+    dir_cache_n_ = n;
+    return dir_cache_;
+}
+
+// 접두사 조회용 정렬 인덱스를 다시 만듦 (적재 후 한 번, 이후 intern이 제자리 삽입)
+void AIHistoryStore::sort_commands() {
+    sorted_.resize(commands_.size());
+    for (uint32_t id = 0; id < sorted_.size(); id++) sorted_[id] = id;
+    std::sort(sorted_.begin(), sorted_.end(), [this](uint32_t a, uint32_t b) {
+        return commands_[a].text < commands_[b].text;
+    });
+    sorted_dirty_ = false;
+}
+
+void AIHistoryStore::prefix_matches(const std::string& prefix, size_t limit,
+                                    std::vector<uint32_t>& out) const {
+    std::string_view key(prefix);
+    auto it = std::lower_bound(sorted_.begin(), sorted_.end(), key,
+                               [this](uint32_t a, std::string_view b) {
+                                   return commands_[a].text < b;
+                               });
+    for (; it != sorted_.end() && out.size() < limit; ++it) {
+        if (commands_[*it].text.compare(0, key.size(), key) != 0) break;
+        out.push_back(*it);
+    }
+}
+
+AIHistoryStats AIHistoryStore::stats() const {
+    AIHistoryStats s;
+    s.entries = entries_.size();
+    s.commands = commands_.size();
+    s.memory_bytes = entries_.capacity() * sizeof(Entry) +
+                     commands_.capacity() * sizeof(HistoryCommand) +
+                     (slots_.capacity() + hashes_.capacity()) * sizeof(uint32_t) +
+                     sorted_.capacity() * sizeof(uint32_t) +
+                     dir_records_.capacity() * sizeof(DirRecord) + arena_bytes_;
+    s.mapped_bytes = map_size_;
+    return s;
+}
@@ -0,0 +1,142 @@
+#ifndef FISH_AI_HISTORY_STORE_H
+#define FISH_AI_HISTORY_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ---------------------------------------------------------
+// AI 컨텍스트용 명령어 히스토리 저장소
+//  - fish 히스토리 파일을 mmap해서 한 번에 파싱하고 매핑은 바로 풂
+//    (fish가 파일을 다시 쓰거나 줄여도 남은 참조가 SIGBUS를 내지 않도록)
+//  - 같은 명령어는 한 번만 아레나에 복사(인터닝)하고, 실행 기록은 16바이트 항목으로 보관
+//  - 실행 디렉토리 기록은 "<히스토리 파일>.dirs"에 고정 크기 레코드로 덧붙임
+// 최근 순, 빈도 순, 디렉토리별, 접두사 조회를 지원. 스레드 안전하지 않음 (적재는 따로 만든
+// 저장소에 하고 swap()으로 바꿔 넣을 수 있음)
+// ---------------------------------------------------------
+
+// 인터닝된 명령어 한 개
+struct HistoryCommand {
+    std::string_view text;
+    uint32_t count;        // 실행 횟수
+    long long last_used;   // 마지막 실행 시각 (Unix timestamp)
+};
+
+// 저장소 통계 (벤치마크/진단용)
+struct AIHistoryStats {
+    uint64_t entries;         // 실행 기록 수
+    uint64_t commands;        // 서로 다른 명령어 수
+    uint64_t memory_bytes;    // 힙 사용량 추정치 (매핑된 파일 제외)
+    uint64_t mapped_bytes;    // 적재할 때 매핑한 히스토리 파일 크기 (적재 뒤에는 풀어 둠)
+};
+
+class AIHistoryStore {
+public:
+    AIHistoryStore();
+    ~AIHistoryStore();
+
+    AIHistoryStore(const AIHistoryStore&) = delete;
+    AIHistoryStore& operator=(const AIHistoryStore&) = delete;
+
+    // fish 히스토리 파일 적재 (기존 내용은 버림). 실패 시 false
+    bool load(const std::string& history_path);
+
+    // 실행된 명령어 기록. cwd가 비어 있지 않으면 디렉토리 기록도 남김
+    void add(const std::string& command, long long timestamp, const std::string& cwd);
+
+    // 메모리 내용만 비움 (파일은 건드리지 않음)
+    void clear();
+
+    // 내용 전체를 other와 맞바꿈 (참조하는 쪽은 그대로 this를 봄)
+    void swap(AIHistoryStore& other);
+
+    // other에 add()로 기록된 명령어를 이 저장소에도 넣음 (적재한 저장소로 바꿔 넣기 전에 호출)
+    // 적재한 파일의 마지막 기록보다 나중 것만 실행 기록으로 세고 (파일에 이미 저장된 실행을
+    // 두 번 세지 않도록), 디렉토리 기록 파일에 아직 못 쓴 디렉토리 기록은 여기서 씀
+    void merge_added(const AIHistoryStore& other);
+
+    // 이후 add()는 디렉토리 기록 파일에 덧붙이지 않음 (다른 프로세스가 같은 파일에 기록할 때)
+    void stop_recording_dirs();
+
+    size_t size() const { return entries_.size(); }
+    const HistoryCommand& command(uint32_t id) const { return commands_[id]; }
+
+    // 최근 실행 n개 (중복 포함, 오래된 것부터)
+    std::vector<uint32_t> recent(size_t n) const;
+    void recent(size_t n, std::vector<uint32_t>& out) const;
+    // 실행 횟수가 많은 명령어 n개
+    std::vector<uint32_t> frequent(size_t n) const;
+    // dir에서 자주 실행한 명령어 n개 (기록이 바뀌지 않았으면 이전 결과를 재사용)
+    const std::vector<uint32_t>& in_directory(std::string_view dir, size_t n) const;
+    // prefix로 시작하는 명령어를 사전 순으로 최대 limit개
+    void prefix_matches(const std::string& prefix, size_t limit, std::vector<uint32_t>& out) const;
+
+    AIHistoryStats stats() const;
+
+    static const size_t MAX_ENTRIES = 100000;
+
+private:
+    // 실행 기록 한 건 (16바이트)
+    struct Entry {
+        long long when;
+        uint32_t command;
+    };
+
+    // 디렉토리 기록 한 건
+    struct DirRecord {
+        long long when;
+        uint64_t dir_hash;
+        uint32_t command;
+    };
+
+    // add()로 기록된 실행 한 건 (merge_added용)
+    struct Added {
+        long long when;
+        uint64_t dir_hash;
+        uint32_t command;
+        bool has_dir;
+        bool dir_saved;      // 디렉토리 기록 파일에 씀
+    };
+
+    std::vector<Entry> entries_;
+    std::vector<HistoryCommand> commands_;
+    // 명령어 텍스트 -> id 해시 테이블 (개방 주소법, 값은 id + 1, 0은 빈 슬롯)
+    std::vector<uint32_t> slots_;
+    std::vector<uint32_t> hashes_;           // 명령어별 해시 (테이블 확장/비교용)
+    std::vector<uint32_t> sorted_;           // 텍스트 순 명령어 id (접두사 조회용)
+    bool sorted_dirty_;                      // 적재 중에는 삽입 대신 마지막에 한 번 정렬
+    std::vector<DirRecord> dir_records_;
+    uint64_t dir_version_;                   // dir_records_가 바뀔 때마다 증가
+    std::vector<Added> added_;
+    long long newest_loaded_;                // 적재한 파일의 마지막 실행 시각
+
+    // in_directory 결과 메모 (같은 디렉토리에서 반복 요청 시 재계산 생략)
+    mutable uint64_t dir_cache_hash_;
+    mutable uint64_t dir_cache_version_;
+    mutable size_t dir_cache_n_;
+    mutable std::vector<uint32_t> dir_cache_;
+
+    // 아레나: 큰 블록에 문자열을 이어 붙여 항목마다 할당하지 않음
+    std::vector<std::unique_ptr<char[]>> arena_blocks_;
+    size_t arena_used_;
+    size_t arena_capacity_;
+    size_t arena_bytes_;
+
+    size_t map_size_;                        // 마지막으로 적재한 히스토리 파일 크기
+    int dirs_fd_;
+
+    uint32_t find(std::string_view text, uint32_t hash) const;
+    uint32_t intern(std::string_view text);
+    void grow_slots();
+    void sort_commands();
+    std::string_view arena_copy(std::string_view text);
+    void trim_entries();
+    bool save_dir_record(long long when, std::string_view command, uint64_t dir_hash);
+    void load_dirs(const std::string& path);
+    void release();
+};
+
+#endif // FISH_AI_HISTORY_STORE_H
@@ -0,0 +1,378 @@
+#include "ai_json.h"
+
+static const char REPLACEMENT_CHARACTER[] = "\xEF\xBF\xBD";  // U+FFFD (UTF-8)
+
+static bool is_json_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool is_literal_char(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' ||
+           c == '.' || c == 'E';
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// ---------------------------------------------------------
+// AIJsonExtractor 구현
+// ---------------------------------------------------------
+
+AIJsonExtractor::AIJsonExtractor() : paths_(nullptr), path_count_(0) {
+    reset();
+}
+
+void AIJsonExtractor::set_paths(const AIJsonPath* paths, size_t count) {
+    paths_ = paths;
+    path_count_ = count < MAX_PATHS ? count : MAX_PATHS;
+    reset();
+}
+
+void AIJsonExtractor::reset() {
+    state_ = VALUE;
+    string_kind_ = SKIPPED_STRING;
+    in_key_ = false;
+    value_mask_ = static_cast<uint8_t>((1u << path_count_) - 1);
+    stack_.clear();
+    key_.clear();
+    unicode_value_ = 0;
+    unicode_digits_ = 0;
+    high_surrogate_ = 0;
+}
+
+// 다음 값이 key_ 키의 값일 때 그 값을 지나는 경로
+uint8_t AIJsonExtractor::child_mask_for_key() const {
+    const Frame& top = stack_.back();
+    uint8_t mask = 0;
+    for (size_t i = 0; i < path_count_; i++) {
+        if (!(top.mask & (1u << i))) continue;
+        const AIJsonStep& step = paths_[i].steps[stack_.size() - 1];
+        if (step.key && key_ == step.key) mask |= static_cast<uint8_t>(1u << i);
+    }
+    return mask;
+}
+
+// 다음 값이 배열의 index번째 원소일 때 그 값을 지나는 경로
+uint8_t AIJsonExtractor::child_mask_for_index(uint32_t index) const {
+    const Frame& top = stack_.back();
+    uint8_t mask = 0;
+    for (size_t i = 0; i < path_count_; i++) {
+        if (!(top.mask & (1u << i))) continue;
+        const AIJsonStep& step = paths_[i].steps[stack_.size() - 1];
+        if (!step.key && step.index == index) mask |= static_cast<uint8_t>(1u << i);
+    }
+    return mask;
+}
+
+// 값의 첫 글자 처리: 경로가 여기서 끝나면 대상, 더 이어지면 컨테이너 안으로 따라감
+void AIJsonExtractor::begin_value(char c) {
+    size_t depth = stack_.size();
+    uint8_t target = 0, deeper = 0;
+    for (size_t i = 0; i < path_count_; i++) {
+        if (!(value_mask_ & (1u << i))) continue;
+        if (paths_[i].length == depth) target |= static_cast<uint8_t>(1u << i);
+        if (paths_[i].length > depth) deeper |= static_cast<uint8_t>(1u << i);
+    }
+
+    if (c == '{' || c == '[') {
+        if (depth >= MAX_DEPTH) {
+            state_ = FAILED;
+            return;
+        }
+        stack_.push_back(Frame{c == '{', deeper, 0});
+        state_ = c == '{' ? OBJECT_FIRST : ARRAY_FIRST;
+    } else if (c == '"') {
+        string_kind_ = target ? TARGET_STRING : SKIPPED_STRING;
+        in_key_ = false;
+        state_ = STRING;
+    } else if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n') {
+        state_ = LITERAL;
+    } else {
+        state_ = FAILED;
+    }
+}
+
+// 값 하나가 끝남 (루트 값이 끝나면 문서 끝)
+void AIJsonExtractor::end_value() {
+    state_ = stack_.empty() ? END : AFTER_VALUE;
+}
+
+void AIJsonExtractor::append_code_point(uint32_t cp, std::string& out) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// 짝이 없는 상위 대리는 U+FFFD로
+void AIJsonExtractor::flush_surrogate(std::string& out) {
+    if (high_surrogate_ == 0) return;
+    out += REPLACEMENT_CHARACTER;
+    high_surrogate_ = 0;
+}
+
+// "\uXXXX" 하나 처리 (UTF-16 대리 쌍은 합쳐서 한 글자로)
+void AIJsonExtractor::append_unicode_escape(std::string& out) {
+    uint32_t unit = unicode_value_;
+    if (unit >= 0xD800 && unit <= 0xDBFF) {
+        flush_surrogate(out);
+        high_surrogate_ = unit;
+    } else if (unit >= 0xDC00 && unit <= 0xDFFF) {
+        if (high_surrogate_ == 0) {
+            out += REPLACEMENT_CHARACTER;
+        } else {
+            append_code_point(0x10000 + ((high_surrogate_ - 0xD800) << 10) + (unit - 0xDC00), out);
+            high_surrogate_ = 0;
+        }
+    } else {
+        flush_surrogate(out);
+        append_code_point(unit, out);
+    }
+}
+
+void AIJsonExtractor::feed(const char* data, size_t len, std::string& out) {
+    size_t i = 0;
+    while (i < len) {
+        if (state_ == DONE || state_ == END || state_ == FAILED) return;
+        char c = data[i];
+        // 건너뛰는 문자열은 버리고, 키는 key_에, 대상 값은 out에 모음
+        std::string* sink = string_kind_ == TARGET_STRING ? &out
+                            : string_kind_ == KEY_STRING  ? &key_
+                                                          : nullptr;
+
+        switch (state_) {
+        case STRING: {
+            // 따옴표나 역슬래시가 나올 때까지 한 번에 복사
+            size_t run = i;
+            while (run < len && data[run] != '"' && data[run] != '\\') run++;
+            if (run > i) {
+                if (sink) {
+                    flush_surrogate(*sink);
+                    sink->append(data + i, run - i);
+                }
+                i = run;
+                continue;
+            }
+            i++;
+            if (c == '\\') {
+                state_ = STRING_ESCAPE;
+                continue;
+            }
+            if (sink) flush_surrogate(*sink);
+            if (string_kind_ == TARGET_STRING) {
+                state_ = DONE;
+            } else if (in_key_) {
+                state_ = COLON;
+            } else {
+                end_value();
+            }
+            continue;
+        }
+        case STRING_ESCAPE: {
+            i++;
+            state_ = STRING;
+            if (!sink) continue;  // 건너뛰는 문자열: "\uXXXX"의 숫자도 평범한 글자로 넘어감
+            char decoded;
+            switch (c) {
+            case '"': case '\\': case '/': decoded = c; break;
+            case 'b': decoded = '\b'; break;
+            case 'f': decoded = '\f'; break;
+            case 'n': decoded = '\n'; break;
+            case 'r': decoded = '\r'; break;
+            case 't': decoded = '\t'; break;
+            case 'u':
+                state_ = STRING_UNICODE;
+                unicode_value_ = 0;
+                unicode_digits_ = 0;
+                continue;
+            default:
+                state_ = FAILED;
+                continue;
+            }
+            flush_surrogate(*sink);
+            *sink += decoded;
+            continue;
+        }
+        case STRING_UNICODE: {
+            i++;
+            int digit = hex_value(c);
+            if (digit < 0) {
+                state_ = FAILED;
+                continue;
+            }
+            unicode_value_ = (unicode_value_ << 4) | static_cast<uint32_t>(digit);
+            if (++unicode_digits_ < 4) continue;
+            append_unicode_escape(*sink);
+            state_ = STRING;
+            continue;
+        }
+        case LITERAL:
+            if (is_literal_char(c)) {
+                i++;
+            } else {
+                end_value();  // 구분 문자는 다음 상태에서 다시 처리
+            }
+            continue;
+        default:
+            break;
+        }
+
+        // 구조 문자 처리 (공백은 건너뜀)
+        i++;
+        if (is_json_space(c)) continue;
+        switch (state_) {
+        case VALUE:
+            begin_value(c);
+            break;
+        case OBJECT_FIRST:
+            if (c == '}') {
+                stack_.pop_back();
+                end_value();
+                break;
+            }
+            // fall through
+        case OBJECT_KEY:
+            if (c != '"') {
+                state_ = FAILED;
+                break;
+            }
+            // 경로가 지나는 객체의 키만 모아서 비교
+            key_.clear();
+            string_kind_ = stack_.back().mask ? KEY_STRING : SKIPPED_STRING;
+            in_key_ = true;
+            state_ = STRING;
+            break;
+        case COLON:
+            if (c != ':') {
+                state_ = FAILED;
+                break;
+            }
+            value_mask_ = child_mask_for_key();
+            state_ = VALUE;
+            break;
+        case ARRAY_FIRST:
+            if (c == ']') {
+                stack_.pop_back();
+                end_value();
+                break;
+            }
+            value_mask_ = child_mask_for_index(0);
+            begin_value(c);
+            break;
+        case AFTER_VALUE: {
+            Frame& top = stack_.back();
+            if (c == ',') {
+                if (top.object) {
+                    state_ = OBJECT_KEY;
+                } else {
+                    top.index++;
+                    value_mask_ = child_mask_for_index(top.index);
+                    state_ = VALUE;
+                }
+            } else if (c == (top.object ? '}' : ']')) {
+                stack_.pop_back();
+                end_value();
+            } else {
+                state_ = FAILED;
+            }
+            break;
+        }
+        default:
+            state_ = FAILED;
+            break;
+        }
+    }
+}
+
+// ---------------------------------------------------------
+// JSON 문자열 직렬화
+// ---------------------------------------------------------
+
+// s[i]에서 시작하는 올바른 UTF-8 문자의 길이 (잘못되었으면 0)
+static size_t utf8_sequence_length(std::string_view s, size_t i) {
+    unsigned char lead = static_cast<unsigned char>(s[i]);
+    size_t length;
+    unsigned char min = 0x80, max = 0xBF;  // 두 번째 바이트 범위 (overlong/대리 코드 제외)
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        if (lead == 0xE0) min = 0xA0;
+        if (lead == 0xED) max = 0x9F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        if (lead == 0xF0) min = 0x90;
+        if (lead == 0xF4) max = 0x8F;
+    } else {
+        return 0;
+    }
+    if (i + length > s.size()) return 0;
+    unsigned char second = static_cast<unsigned char>(s[i + 1]);
+    if (second < min || second > max) return 0;
+    for (size_t k = 2; k < length; k++) {
+        if ((static_cast<unsigned char>(s[i + k]) & 0xC0) != 0x80) return 0;
+    }
+    return length;
+}
+
+void ai_json_append_string(std::string& out, std::string_view text) {
+    static const char HEX[] = "0123456789abcdef";
+    out += '"';
+    size_t i = 0;
+    while (i < text.size()) {
+        // 그대로 쓸 수 있는 ASCII는 한 번에 복사
+        size_t run = i;
+        while (run < text.size()) {
+            unsigned char c = static_cast<unsigned char>(text[run]);
+            if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\') break;
+            run++;
+        }
+        out.append(text.data() + i, run - i);
+        i = run;
+        if (i == text.size()) break;
+
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x80) {
+            size_t length = utf8_sequence_length(text, i);
+            if (length == 0) {
+                out += REPLACEMENT_CHARACTER;
+                i++;
+            } else {
+                out.append(text.data() + i, length);
+                i += length;
+            }
+            continue;
+        }
+        i++;
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        default:
+            out += "\\u00";
+            out += HEX[c >> 4];
+            out += HEX[c & 0xF];
+            break;
+        }
+    }
+    out += '"';
+}
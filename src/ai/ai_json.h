@@ -0,0 +1,108 @@
+#ifndef FISH_AI_JSON_H
+#define FISH_AI_JSON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ---------------------------------------------------------
+// 응답/요청용 최소 JSON 처리 (DOM 없음)
+//  - AIJsonExtractor: 정해진 경로의 문자열 값 하나만 뽑아냄. 나머지 값은 구조만 따라가며
+//    건너뛰고, 대상 문자열은 이스케이프를 풀면서 바로 출력 버퍼에 씀.
+//    입력을 여러 번에 나눠 넣어도 되므로 curl 수신 콜백에서 바로 호출 가능.
+//  - ai_json_append_string: 문자열을 JSON 문자열 리터럴로 붙임 (요청 본문 직렬화용)
+// ---------------------------------------------------------
+
+// 경로 한 단계: 객체 키 또는 배열 위치
+struct AIJsonStep {
+    const char* key;  // nullptr이면 배열 위치(index)
+    uint32_t index;
+
+    static constexpr AIJsonStep field(const char* name) { return AIJsonStep{name, 0}; }
+    static constexpr AIJsonStep at(uint32_t position) { return AIJsonStep{nullptr, position}; }
+};
+
+// 루트부터의 경로 (예: candidates[0].content.parts[0].text)
+struct AIJsonPath {
+    const AIJsonStep* steps;
+    size_t length;
+};
+
+class AIJsonExtractor {
+public:
+    static const size_t MAX_PATHS = 8;
+    static const size_t MAX_DEPTH = 64;
+
+    AIJsonExtractor();
+
+    // 뽑아낼 경로 (여럿이면 먼저 나오는 것 하나). paths는 추출기보다 오래 살아 있어야 함
+    void set_paths(const AIJsonPath* paths, size_t count);
+
+    // 새 문서 시작 (경로 설정은 유지)
+    void reset();
+
+    // data를 이어서 처리하고, 대상 문자열의 내용을 out 뒤에 붙임
+    // 대상 값을 끝까지 읽었거나 JSON이 잘못되었으면 이후 입력은 무시
+    void feed(const char* data, size_t len, std::string& out);
+
+    bool found() const { return state_ == DONE; }
+    bool failed() const { return state_ == FAILED; }
+
+private:
+    enum State : uint8_t {
+        VALUE,          // 값 시작을 기다림
+        OBJECT_FIRST,   // '{' 직후: 키 또는 '}'
+        OBJECT_KEY,     // ',' 직후: 키
+        COLON,          // 키 뒤 ':'
+        ARRAY_FIRST,    // '[' 직후: 값 또는 ']'
+        AFTER_VALUE,    // 값 뒤: ',' 또는 닫는 괄호
+        STRING,         // 문자열 안
+        STRING_ESCAPE,  // '\' 직후
+        STRING_UNICODE, // "\u" 뒤 16진수 4자리
+        LITERAL,        // 숫자, true, false, null
+        DONE,           // 대상 값을 다 읽음
+        END,            // 대상 없이 문서가 끝남
+        FAILED
+    };
+
+    // 현재 어떤 문자열을 읽는 중인지
+    enum StringKind : uint8_t {
+        SKIPPED_STRING,  // 건너뛰는 값 또는 키
+        KEY_STRING,      // 경로 비교용 키 (key_에 모음)
+        TARGET_STRING    // 뽑아낼 값 (out에 씀)
+    };
+
+    struct Frame {
+        bool object;
+        uint8_t mask;    // 이 컨테이너를 지나는 경로 (비트 i = paths_[i])
+        uint32_t index;  // 배열이면 현재 원소 위치
+    };
+
+    void begin_value(char c);
+    void end_value();
+    uint8_t child_mask_for_key() const;
+    uint8_t child_mask_for_index(uint32_t index) const;
+    void append_code_point(uint32_t cp, std::string& out);
+    void append_unicode_escape(std::string& out);
+    void flush_surrogate(std::string& out);
+
+    const AIJsonPath* paths_;
+    size_t path_count_;
+    State state_;
+    StringKind string_kind_;
+    bool in_key_;               // 읽는 문자열이 객체 키인지
+    uint8_t value_mask_;        // 다음 값이 지나는 경로
+    std::vector<Frame> stack_;
+    std::string key_;           // 경로에 있는 객체의 현재 키
+    uint32_t unicode_value_;
+    uint8_t unicode_digits_;
+    uint32_t high_surrogate_;   // 짝을 기다리는 UTF-16 상위 대리 (0이면 없음)
+};
+
+// text를 따옴표로 감싼 JSON 문자열로 out 뒤에 붙임
+// 제어 문자는 이스케이프하고, 잘못된 UTF-8 바이트는 U+FFFD로 바꿈
+void ai_json_append_string(std::string& out, std::string_view text);
+
+#endif // FISH_AI_JSON_H
@@ -0,0 +1,50 @@
+#include "ai_local_engine.h"
+#include <algorithm>
+
+// 점수 = 실행 횟수 x 최근성 가중치
+// (1시간 이내 4배, 하루 이내 2배, 일주일 이내 1배, 그 이후 0.25배)
+double LocalCompletionEngine::score(const HistoryCommand& command, long long now) {
+    long long age = now - command.last_used;
+    double weight;
+    if (age < 3600) {
+        weight = 4.0;
+    } else if (age < 24 * 3600) {
+        weight = 2.0;
+    } else if (age < 7 * 24 * 3600) {
+        weight = 1.0;
+    } else {
+        weight = 0.25;
+    }
+    return command.count * weight;
+}
+
+std::vector<LocalCompletion> LocalCompletionEngine::complete(const std::string& prefix,
+                                                             size_t max_results,
+                                                             long long now) const {
+    std::vector<uint32_t> ids;
+    history_.prefix_matches(prefix, MAX_SCAN, ids);
+
+    std::vector<std::pair<double, const HistoryCommand*>> matches;
+    matches.reserve(ids.size());
+    for (uint32_t id : ids) {
+        const HistoryCommand& command = history_.command(id);
+        if (command.text.size() == prefix.size()) continue;
+        matches.emplace_back(score(command, now), &command);
+    }
+
+    // 점수 내림차순, 같으면 최근 사용 순
+    size_t n = std::min(max_results, matches.size());
+    std::partial_sort(matches.begin(), matches.begin() + n, matches.end(),
+                      [](const auto& a, const auto& b) {
+                          if (a.first != b.first) return a.first > b.first;
+                          return a.second->last_used > b.second->last_used;
+                      });
+
+    std::vector<LocalCompletion> result;
+    result.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        const HistoryCommand& command = *matches[i].second;
+        result.push_back(LocalCompletion{std::string(command.text), command.count, command.last_used});
+    }
+    return result;
+}
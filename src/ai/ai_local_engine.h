@@ -0,0 +1,42 @@
+#ifndef FISH_AI_LOCAL_ENGINE_H
+#define FISH_AI_LOCAL_ENGINE_H
+
+#include "ai_history_store.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------
+// 로컬 자동완성 엔진
+// 히스토리 저장소의 정렬 인덱스에서 입력 접두사로 시작하는 명령어를 찾아
+// 사용 빈도와 최근성(frecency)으로 정렬해 돌려줌.
+// 네트워크 없이 동작하므로 API 키가 없거나 연결이 불안정해도 사용 가능.
+// 메인 스레드 전용.
+// ---------------------------------------------------------
+
+// 로컬 완성 결과 한 건
+struct LocalCompletion {
+    std::string command;
+    uint32_t count;        // 실행 횟수
+    long long last_used;   // 마지막 실행 시각 (Unix timestamp)
+};
+
+class LocalCompletionEngine {
+public:
+    explicit LocalCompletionEngine(const AIHistoryStore& history) : history_(history) {}
+
+    // prefix로 시작하는 명령어 중 점수가 높은 순으로 최대 max_results개
+    // (입력과 완전히 같은 명령어는 제외)
+    std::vector<LocalCompletion> complete(const std::string& prefix, size_t max_results,
+                                          long long now) const;
+
+private:
+    const AIHistoryStore& history_;
+
+    static const size_t MAX_SCAN = 4096;      // 짧은 접두사에서 검사할 최대 항목 수
+
+    static double score(const HistoryCommand& command, long long now);
+};
+
+#endif // FISH_AI_LOCAL_ENGINE_H
@@ -1,55 +1,139 @@
 #include "ai_manager.h"
+#include "ai_curl.h"
+#include "ai_risk.h"
 #include <iostream>
 #include <string>
 #include <vector>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <chrono>
 #include <sstream>
 #include <algorithm>
+#include <functional>
+#include <cerrno>
+#include <fcntl.h>
+#include <climits>
+#include <unistd.h>
 #include <curl/curl.h>
-#include <nlohmann/json.hpp>
 
-using json = nlohmann::json;
 
 // ---------------------------------------------------------
-// 헬퍼 함수: 문자열 앞뒤 공백 제거
+// 헬퍼 함수: 문자열 앞뒤의 chars 문자 제거 (복사 없이 범위만 좁힘)
 // ---------------------------------------------------------
-static std::string trim(const std::string& str) {
-    size_t first = str.find_first_not_of(" \t\n\r");
-    if (std::string::npos == first) return "";
-    size_t last = str.find_last_not_of(" \t\n\r");
+static const char* const WHITESPACE = " \t\n\r";
+static const char* const WHITESPACE_AND_BACKTICKS = " \t\n\r`";  // 인라인 코드 표시 포함
+
+static std::string_view trim(std::string_view str, const char* chars = WHITESPACE) {
+    size_t first = str.find_first_not_of(chars);
+    if (std::string_view::npos == first) return {};
+    size_t last = str.find_last_not_of(chars);
     return str.substr(first, (last - first + 1));
 }
 
 // ---------------------------------------------------------
-// 헬퍼 함수: Markdown 코드 블록 및 백틱 제거
+// 헬퍼 함수: 현재 작업 디렉토리를 out에 (실패 시 빈 문자열)
+// ---------------------------------------------------------
+static const std::string& current_directory(std::string& out) {
+    char buf[PATH_MAX];
+    out.assign(getcwd(buf, sizeof buf) ? buf : "");
+    return out;
+}
+
 // ---------------------------------------------------------
-static std::string remove_markdown(std::string text) {
+// 헬퍼 함수: Markdown 코드 블록이 있으면 그 안쪽 범위 (복사 없음)
+// 첫 "```" 줄(언어 표시 포함) 다음부터 마지막 "```" 앞까지. 백틱은 줄을 파싱할 때 뺌
+// ---------------------------------------------------------
+static std::string_view markdown_body(std::string_view text) {
     size_t start_code = text.find("```");
-    if (start_code != std::string::npos) {
+    if (start_code != std::string_view::npos) {
         size_t newline = text.find('\n', start_code);
-        if (newline != std::string::npos) {
-            text = text.substr(newline + 1);
-        } else {
-            text = text.substr(start_code + 3);
-        }
-        
+        text.remove_prefix(newline != std::string_view::npos ? newline + 1 : start_code + 3);
+
         size_t end_code = text.rfind("```");
-        if (end_code != std::string::npos) {
+        if (end_code != std::string_view::npos) {
             text = text.substr(0, end_code);
         }
     }
-    // 인라인 코드 백틱 제거
-    text.erase(std::remove(text.begin(), text.end(), '`'), text.end());
     return trim(text);
 }
 
 // ---------------------------------------------------------
-// libcurl 쓰기 콜백
+// 헬퍼 함수: 통합 응답에서 mode 섹션의 내용 (제목 줄 제외)
+// 첫 제목 줄 앞의 내용은 맨 앞 섹션(first)의 답으로 봄: 제목 없이 답했으면 전체가 first의 답
+// complete: 섹션 뒤에 다른 섹션이 이어짐 (응답이 잘렸어도 이 섹션은 끝까지 받음)
+// ---------------------------------------------------------
+static std::string combined_section(std::string_view response, int mode, int first,
+                                    bool* complete) {
+    std::string section;
+    int current = first;
+    *complete = false;
+    size_t start = 0;
+    while (start < response.size()) {
+        size_t newline = response.find('\n', start);
+        size_t end = newline == std::string_view::npos ? response.size() : newline + 1;
+        std::string_view line = response.substr(start, end - start);
+        int heading = PromptBuilder::section_mode(trim(line));
+        if (heading != 0) {
+            if (current == mode && heading != mode && !section.empty()) *complete = true;
+            current = heading;
+        } else if (current == mode) {
+            section.append(line);
+            *complete = false;
+        }
+        start = end;
+    }
+    return section;
+}
+
+// ---------------------------------------------------------
+// 헬퍼 함수: 줄 앞 목록 표시("1. ", "10) ", "- ", "* ", "+ ")의 길이 (없으면 0)
+// 표시 뒤에 공백이 있어야 함: "10.0.0.1", "*.txt", "-la" 같은 명령어는 그대로 둠
+// ---------------------------------------------------------
+static size_t list_marker_length(std::string_view line) {
+    size_t i = 0;
+    while (i < line.size() && i < 3 && isdigit(static_cast<unsigned char>(line[i]))) i++;
+    if (i > 0) {
+        if (i == line.size() || (line[i] != '.' && line[i] != ')')) return 0;
+        i++;
+    } else if (!line.empty() && (line[0] == '-' || line[0] == '*' || line[0] == '+')) {
+        i = 1;
+    } else {
+        return 0;
+    }
+    if (i < line.size() && line[i] != ' ' && line[i] != '\t') return 0;
+    return i;
+}
+
+// ---------------------------------------------------------
+// 헬퍼 함수: 인라인 코드 백틱을 빼고 문자열로 (할당 한 번)
+// ---------------------------------------------------------
+static std::string without_backticks(std::string_view text) {
+    std::string out;
+    out.reserve(text.size());
+    for (char c : text) {
+        if (c != '`') out += c;
+    }
+    return out;
+}
+
+// ---------------------------------------------------------
+// 헬퍼 함수: start부터 지금까지 걸린 시간
+// ---------------------------------------------------------
+static std::chrono::microseconds elapsed_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+}
+
+// ---------------------------------------------------------
+// libcurl 공유 캐시(DNS/TLS 세션/연결) 잠금 콜백
 // ---------------------------------------------------------
-static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp) {
-    ((std::string*)userp)->append((char*)contents, size * nmemb);
-    return size * nmemb;
+static void ShareLock(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+    static_cast<std::mutex*>(userptr)[data].lock();
+}
+
+static void ShareUnlock(CURL*, curl_lock_data data, void* userptr) {
+    static_cast<std::mutex*>(userptr)[data].unlock();
 }
 
 // ---------------------------------------------------------
@@ -57,9 +141,104 @@ static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *use
 // ---------------------------------------------------------
 
 // 생성자
-AIManager::AIManager() : current_index_(0), current_mode_(AIMode::GENERATION) {
-    const char* env_key = std::getenv("GEMINI_API_KEY");
-    api_key_ = env_key ? env_key : "";
+AIManager::AIManager()
+    : generation_(0), published_(std::make_unique<AISuggestionSet>()),
+      current_mode_(AIMode::GENERATION), mode_ready_{}, combined_requests_(false),
+      combined_first_(0), stream_section_(0), similar_hits_(0),
+      local_engine_(history_), local_count_(0), local_unreported_(false),
+      request_seq_(0), queued_id_(0), queued_mode_(AIMode::GENERATION), queued_combined_(false),
+      active_id_(0), active_mode_(AIMode::GENERATION), active_combined_(false),
+      completed_id_(0), completed_timed_out_(false),
+      prewarm_requested_(false), prewarm_pending_(false), shutting_down_(false),
+      debounce_(std::chrono::milliseconds(50)), completed_count_(0), cancelled_count_(0),
+      coalesced_count_(0), parse_time_(0), private_mode_(false),
+      streaming_(true), stream_consumed_(0),
+      hedge_delay_ms_(1500), breaker_cooldown_ms_(5000), probe_scheduled_(false),
+      curl_share_(nullptr), daemon_request_seq_(0) {
+    load_backends_from_env();
+
+    // 모드별 제한 시간: 자동완성은 짧게, 설명/진단은 길게 (FISH_AI_TIMEOUT_MS는 모든 모드에 적용)
+    timeout_ms_[0] = 5000;
+    timeout_ms_[static_cast<int>(AIMode::GENERATION)] = 5000;
+    timeout_ms_[static_cast<int>(AIMode::EXPLAIN)] = 15000;
+    timeout_ms_[static_cast<int>(AIMode::DIAGNOSE)] = 15000;
+    const char* env_timeout = std::getenv("FISH_AI_TIMEOUT_MS");
+    if (env_timeout && std::atol(env_timeout) > 0) {
+        for (auto& timeout : timeout_ms_) timeout = std::atol(env_timeout);
+    }
+
+    // 헤지 요청 대기 시간 (응답 기록이 쌓이기 전 기본값, 음수면 헤지 안 함)
+    const char* env_hedge = std::getenv("FISH_AI_HEDGE_MS");
+    if (env_hedge && *env_hedge) {
+        hedge_delay_ms_ = std::atol(env_hedge);
+    }
+
+    // 요청 속도 제한 (분당 요청 수, 한 번에 몰아 보낼 수 있는 수. FISH_AI_RATE_LIMIT=0 이면 끔)
+    double rate_limit = 120, rate_burst = 10;
+    const char* env_rate = std::getenv("FISH_AI_RATE_LIMIT");
+    if (env_rate && *env_rate) rate_limit = std::atof(env_rate);
+    const char* env_burst = std::getenv("FISH_AI_RATE_BURST");
+    if (env_burst && *env_burst) rate_burst = std::atof(env_burst);
+    set_rate_limit(rate_limit, rate_burst);
+
+    // 연속 입력을 하나의 요청으로 합치는 대기 시간 (밀리초)
+    const char* env_debounce = std::getenv("FISH_AI_DEBOUNCE_MS");
+    if (env_debounce && *env_debounce) {
+        debounce_ = std::chrono::milliseconds(std::atol(env_debounce));
+    }
+
+    // 공유 데몬 (FISH_AI_DAEMON=1 이면 씀). 데몬이 떠 있지 않으면 직접 처리
+    const char* env_daemon = std::getenv("FISH_AI_DAEMON");
+    if (env_daemon && std::string(env_daemon) == "1") {
+        daemon_socket_ = ai_daemon_default_socket(false);
+        daemon_.set_socket(daemon_socket_);
+    }
+
+    // 통합 요청 (FISH_AI_COMBINED=1 이면 켬)
+    const char* env_combined = std::getenv("FISH_AI_COMBINED");
+    combined_requests_ = env_combined && std::string(env_combined) == "1";
+
+    // 설명 결과를 비슷한 입력에 재사용하는 문턱값 (FISH_AI_SIMILARITY=0 이면 끔)
+    const char* env_similarity = std::getenv("FISH_AI_SIMILARITY");
+    if (env_similarity && *env_similarity) {
+        similar_.set_threshold(std::atof(env_similarity));
+    }
+
+    // 스트리밍(SSE) 응답 사용 여부 (GEMINI_API_STREAM=0 이면 끔)
+    const char* env_stream = std::getenv("GEMINI_API_STREAM");
+    streaming_ = !(env_stream && std::string(env_stream) == "0");
+
+    // 완료 알림용 파이프 (자식 프로세스로 새지 않도록 CLOEXEC)
+    notify_pipe_[0] = notify_pipe_[1] = -1;
+    if (pipe(notify_pipe_) == 0) {
+        for (int fd : notify_pipe_) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+    } else {
+        notify_pipe_[0] = notify_pipe_[1] = -1;
+    }
+}
+
+// 소멸자: 진행 중인 전송을 중단시키고 워커 종료를 기다림
+AIManager::~AIManager() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shutting_down_ = true;
+    }
+    cv_.notify_all();
+    flight_done_.notify_all();
+    wake_transfer();
+    if (worker_.joinable()) worker_.join();
+    for (int fd : notify_pipe_) {
+        if (fd >= 0) close(fd);
+    }
+
+    // easy 핸들이 share 캐시를 쓰므로 share보다 먼저 정리
+    backends_.clear();
+    idle_transfers_.clear();
+    for (CURLM* multi : idle_multis_) ai_curl().multi_cleanup(multi);
+    if (curl_share_) ai_curl().share_cleanup(curl_share_);
 }
 
 // 명령어 히스토리 추가
@@ -71,245 +250,1750 @@ void AIManager::add_command_to_history(const std::string& command) {
     auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(
         now.time_since_epoch()
     ).count();
-    
-    command_history_.emplace_back(command, timestamp);
-    // 최대 히스토리 개수 유지
-    if (command_history_.size() > MAX_HISTORY_SIZE) {
-        command_history_.pop_front();
+    std::string cwd;
+    add_command_to_history(command, timestamp, current_directory(cwd));
+}
+
+void AIManager::add_command_to_history(const std::string& command, long long timestamp,
+                                       const std::string& cwd) {
+    if (command.empty() || command.find_first_not_of(" \t\n\r") == std::string::npos)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        if (private_mode_) return;
+        history_.add(command, timestamp, cwd);
+        // cd였을 수 있으므로 다음 프롬프트 전에 새 디렉토리 정보를 모아 둠 (보낼 곳이 있을 때만)
+        if (has_backend()) directory_context_.prefetch(cwd);
+        // 위험한 명령어는 작업 패턴으로 배우지 않음 (다음 명령어로 권하지 않도록)
+        if (ai_scan_risk(command).level != AIRiskLevel::DANGER) workflows_.add(command);
+        clear_mode_results();  // 컨텍스트가 바뀌었으므로 받아 둔 답은 버림
     }
+    // 데몬 전달은 쌓아 두기만 함 (보내는 스레드가 보냄)
+    daemon_.send_command(command, timestamp, cwd);
+}
+
+// 데몬 쪽: 다른 세션에서 실행한 명령어를 공유 히스토리에 기록
+void AIManager::record_command(const std::string& command, long long timestamp,
+                               const std::string& cwd) {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    history_.add(command, timestamp, cwd);
+    if (ai_scan_risk(command).level != AIRiskLevel::DANGER) workflows_.add(command);
 }
 
 // 히스토리 초기화
 void AIManager::clear_history() {
-    command_history_.clear();
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    history_.clear();
+    workflows_.clear();
 }
 
-// 작업 패턴 감지 (컨텍스트 분석용)
-std::string AIManager::detect_workflow_pattern() {
-    if (command_history_.empty()) return "";
-    
-    int git_cnt = 0, build_cnt = 0;
-    for (const auto& entry : command_history_) {
-        if (entry.command.find("git") == 0) git_cnt++;
-        if (entry.command.find("make") == 0 || entry.command.find("npm") == 0) 
-            build_cnt++;
+// fish 히스토리 파일 적재 (첫 프롬프트에서 한 번)
+// 파싱은 따로 만든 저장소에 잠금 없이 하고, 바꿔 넣을 때만 state_mutex_를 잡음
+// (적재하는 동안 메인 스레드의 요청 제출과 기록이 기다리지 않도록)
+bool AIManager::load_history(const std::string& history_path) {
+    AIHistoryStore loaded;
+    if (!loaded.load(history_path)) return false;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        // 적재 전에 기록된 명령어(매니저가 생기기 전에 쌓아 둔 것 포함)는 새 저장소로 옮김
+        loaded.merge_added(history_);
+        history_.swap(loaded);
+        refill_workflows();
     }
-    
-    std::string context;
-    if (git_cnt >= 2) context += "Git Workflow; ";
-    if (build_cnt >= 2) context += "Build Workflow; ";
-    return context;
+    return true;
 }
 
-// 컨텍스트 문자열 생성
-std::string AIManager::analyze_context() {
-    if (command_history_.empty()) return "";
-    
-    std::stringstream ss;
-    std::string ptrn = detect_workflow_pattern();
-    if (!ptrn.empty()) ss << "Context: " << ptrn << "\n";
-    
-    ss << "Recent commands:\n";
-    for (const auto& h : command_history_) 
-        ss << "- " << h.command << "\n";
-    
-    return ss.str();
+void AIManager::load_history_in_background(const std::string& history_path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_history_ = history_path;
+        start_worker_locked();
+    }
+    cv_.notify_one();
 }
 
-// [핵심] 모드별 AI 제안 생성
-void AIManager::generate_suggestions(const std::string& current_input, AIMode mode) {
+// 데몬 쪽: 요청을 받기 전에 히스토리 파일을 적재 (그 뒤 세션이 보낸 명령어는 그대로 둠)
+// 디렉토리 기록 파일은 각 세션이 이미 덧붙이므로 데몬은 읽기만 함
+bool AIManager::share_history(const std::string& history_path) {
+    AIHistoryStore loaded;
+    if (!loaded.load(history_path)) return false;
+    loaded.stop_recording_dirs();
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    loaded.merge_added(history_);
+    history_.swap(loaded);
+    refill_workflows();
+    return true;
+}
+
+void AIManager::set_workflow_rules(const std::string& rules) {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    workflows_.set_rules(rules);
+    refill_workflows();
+}
+
+// 작업 패턴 창을 히스토리의 최근 명령어로 다시 채움
+void AIManager::refill_workflows() {
+    workflows_.clear();
+    for (uint32_t id : history_.recent(WorkflowDetector::WINDOW)) {
+        workflows_.add(history_.command(id).text);
+    }
+}
+
+void AIManager::set_directory_context(bool enabled) {
+    directory_context_.set_enabled(enabled);
+}
+
+AIDirectoryStats AIManager::directory_stats() const {
+    return directory_context_.stats();
+}
+
+AIHistoryStats AIManager::history_stats() const {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    return history_.stats();
+}
+
+// 컨텍스트 수집: 작업 디렉토리 정보, 작업 패턴, 최근 명령어, 현재 디렉토리에서 자주 쓴 명령어
+// 작업 패턴 카운터는 add_command_to_history에서 갱신되므로 여기서는 규칙 수만큼만 확인
+// 디렉토리 정보는 아직 수집되지 않았으면 기다리지 않고 뺌
+void AIManager::collect_context(const std::string& cwd) {
+    prompt_builder_.reset();
+    if (directory_context_.lookup(cwd, directory_facts_, directory_details_)) {
+        prompt_builder_.set_directory(directory_facts_, directory_details_);
+    }
+    if (history_.size() == 0) return;
+
+    workflow_scratch_.clear();
+    workflows_.detect(workflow_scratch_);
+    prompt_builder_.set_workflows(workflow_scratch_);
+
+    history_.recent(CONTEXT_RECENT_COMMANDS, context_ids_);
+    for (uint32_t id : context_ids_)
+        prompt_builder_.add_recent(history_.command(id).text);
+
+    // 이전 세션을 포함한 디렉토리 기록
+    for (uint32_t id : history_.in_directory(cwd, CONTEXT_DIRECTORY_COMMANDS))
+        prompt_builder_.add_directory(history_.command(id).text);
+}
+
+// 작업 중인 제안 목록을 새 스냅숏으로 발행 (state_mutex_를 잡은 상태에서 호출)
+// 커서는 이전 스냅숏 위치를 이어받고, 새 목록보다 길면 처음으로
+void AIManager::publish_suggestions() {
+    generation_++;
+    published_.update([this](const AISuggestionSet& previous) {
+        auto next = std::make_unique<AISuggestionSet>();
+        next->suggestions = suggestions_;
+        next->input = last_input_;
+        next->canonical_input = last_canonical_;
+        next->generation = generation_;
+        uint32_t cursor = previous.current_index();
+        next->cursor.store(cursor < suggestions_.size() ? cursor : 0, std::memory_order_relaxed);
+        return std::unique_ptr<const AISuggestionSet>(std::move(next));
+    });
+}
+
+// 입력/모드 상태 초기화 (새 요청 시작 시)
+void AIManager::reset_for_input(const std::string& current_input, AIMode mode) {
     suggestions_.clear();
-    current_index_ = 0;
-    last_input_ = current_input;
+    if (current_input != last_input_) {
+        clear_mode_results();
+        last_input_ = current_input;
+        last_canonical_ = ai_canonical_text(current_input);
+    }
     current_mode_ = mode; // 현재 모드 저장
-    
-    if (current_input.empty() || api_key_.empty()) return;
-    
-    std::string context = analyze_context();
-    
-    // 시스템 프롬프트 설정
-    std::string prompt = "You are a Linux shell expert assistant.\n\n";
-    
-    if (!context.empty()) {
-        prompt += "User's recent activity:\n" + context + "\n";
+    publish_suggestions();
+    stream_consumed_ = 0;
+    local_count_ = 0;
+    local_unreported_ = false;
+    combined_first_ = 0;
+    stream_section_ = 0;
+    parse_time_ = std::chrono::microseconds(0);
+}
+
+// 받아 둔 모드별 응답 버림 (입력이나 컨텍스트가 바뀌었을 때)
+void AIManager::clear_mode_results() {
+    for (int m = 0; m < 4; m++) {
+        mode_responses_[m].clear();
+        mode_ready_[m] = false;
     }
-    prompt += "User Input: \"" + current_input + "\"\n\n";
+}
+
+bool AIManager::any_mode_ready() const {
+    return mode_ready_[1] || mode_ready_[2] || mode_ready_[3];
+}
+
+// 캐시 TTL: 자동완성은 컨텍스트에 따라 달라지므로 짧게, 설명/진단은 길게
+static int64_t cache_ttl_seconds(AIMode mode) {
+    return mode == AIMode::GENERATION ? 24 * 3600 : 7 * 24 * 3600;
+}
 
-    // --- 모드별 프롬프트 분기 ---
+// 캐시 키 생성
+// 설명/진단 결과는 입력 명령어 자체에 대한 것이므로 컨텍스트를 키에 넣지 않음
+std::string AIManager::cache_key(const std::string& current_input, AIMode mode,
+                                 std::string_view context) {
+    uint64_t context_hash = 0;
     if (mode == AIMode::GENERATION) {
-        // Mode 1: 자동 완성 (Alt+W)
-        prompt += "TASK: Provide 3-5 most useful command completion options.\n";
-        prompt += "OUTPUT FORMAT: COMMAND | DESCRIPTION\n";
-        prompt += "RULES:\n";
-        prompt += "- If input is incomplete, complete it.\n";
-        prompt += "- If input is a question (Korean/English), convert intent to a command.\n";
-        prompt += "- One option per line.\n";
-        prompt += "Example:\nls -al | List all files details\n";
-    } 
-    else if (mode == AIMode::EXPLAIN) {
-        // Mode 2: 설명 (Alt+Q)
-        prompt += "TASK: Explain exactly what the User Input command does in KOREAN.\n";
-        prompt += "RULES:\n";
-        prompt += "- Explain flags/options clearly.\n";
-        prompt += "- Use friendly tone.\n";
-        prompt += "- Keep it under 2 sentences.\n";
-        prompt += "OUTPUT FORMAT: ORIGINAL_COMMAND | EXPLANATION_IN_KOREAN\n";
-        prompt += "Example:\ntar -czvf a.tar.gz . | 현재 폴더를 gzip으로 압축합니다.\n";
-    }
-    else if (mode == AIMode::DIAGNOSE) {
-        // Mode 3: 진단 (Alt+R)
-        prompt += "TASK: Analyze the User Input command for safety risks, efficiency, or improvements.\n";
-        prompt += "RULES:\n";
-        prompt += "- If dangerous (e.g., rm -rf /), warn strongly.\n";
-        prompt += "- If safe but old, suggest modern alternatives.\n";
-        prompt += "- If correct, just say 'Safe and correct'.\n";
-        prompt += "- Answer in KOREAN.\n";
-        prompt += "OUTPUT FORMAT: ORIGINAL_COMMAND | DIAGNOSIS_IN_KOREAN\n";
-        prompt += "Example:\nrm -rf / | ⚠️ 루트 디렉토리가 삭제될 수 있어 매우 위험합니다!\n";
-    }
-
-    prompt += "\nNO markdown. Output:";
-    
-    // API 호출
-    std::string result = call_gemini_api(prompt);
-    result = remove_markdown(result);
-    
-    if (!result.empty()) {
-        parse_suggestions(result);
+        context_hash = AIResultCache::hash(context.data(), context.size());
     }
+    return AIResultCache::make_key(static_cast<int>(mode), current_input, context_hash);
 }
 
-// 결과 파싱
-void AIManager::parse_suggestions(const std::string& response) {
-    std::istringstream stream(response);
-    std::string line;
-    
-    while (std::getline(stream, line)) {
-        line = trim(line);
-        if (line.empty()) continue;
-        
-        // "1. ", "- " 등 불필요한 접두사 제거
-        if (line.length() > 2 && line[1] == '.' && isdigit(line[0])) {
-            line = line.substr(3);
+// 완료된 응답을 last_input_의 모드별 응답으로 보관 (메인 스레드)
+// 통합 응답은 섹션별로 나누고, 시간 초과로 잘렸으면 뒤에 다른 섹션이 이어진(끝까지 받은)
+// 섹션만 보관. 단일 응답은 잘리지 않았을 때만 현재 모드로 보관
+void AIManager::store_mode_results(const std::string& response, bool timed_out) {
+    if (response.empty()) return;
+    if (combined_first_ == 0) {
+        if (timed_out) return;
+        int m = static_cast<int>(current_mode_);
+        mode_responses_[m] = response;
+        mode_ready_[m] = true;
+        return;
+    }
+    for (int m = 1; m < 4; m++) {
+        bool complete = false;
+        std::string section = combined_section(response, m, combined_first_, &complete);
+        if (trim(section).empty() || (timed_out && !complete)) continue;
+        mode_responses_[m] = std::move(section);
+        mode_ready_[m] = true;
+    }
+}
+
+// 통합 응답을 섹션별로 캐시에 저장 (keys는 AIMode 값 위치의 캐시 키, 저장 조건은 위와 같음)
+void AIManager::store_sections(const std::string& response, const std::string& input,
+                               AIMode first, const std::string* keys, bool timed_out) {
+    for (int m = 1; m < 4; m++) {
+        bool complete = false;
+        std::string section = combined_section(response, m, static_cast<int>(first), &complete);
+        if (trim(section).empty() || (timed_out && !complete)) continue;
+        store_response(keys[m], input, static_cast<AIMode>(m), section);
+    }
+}
+
+// 설명 답에서 명령어 칸을 뺀 것: 빌려 온 답이 원래 입력의 명령어를 보여 주지 않도록
+// 설명만 남김 (parse_suggestions는 "|"가 없는 줄을 현재 입력의 설명으로 읽음)
+static std::string description_only(std::string_view response) {
+    std::string out;
+    out.reserve(response.size());
+    size_t start = 0;
+    while (start < response.size()) {
+        size_t newline = response.find('\n', start);
+        if (newline == std::string_view::npos) newline = response.size();
+        std::string_view line = response.substr(start, newline - start);
+        start = newline + 1;
+        size_t separator = line.find('|');
+        if (separator != std::string_view::npos) line = trim(line.substr(separator + 1));
+        out += line;
+        out += '\n';
+    }
+    return out;
+}
+
+// 캐시 조회. 설명은 정확히 같은 키가 없으면 비슷한 이전 입력의 답을 빌려 오고,
+// 빌려 온 답은 이 입력의 키로도 저장. 자동완성과 진단은 빌리지 않음: 정규화가 숫자와 경로를
+// 지우므로 `kill -9 1234`와 `kill -9 -1`처럼 위험도가 전혀 다른 입력이 같은 답을 받게 됨
+bool AIManager::lookup_response(const std::string& key, const std::string& input, AIMode mode,
+                                std::string& response) {
+    if (cache_.lookup(key, response)) return true;
+    if (mode != AIMode::EXPLAIN || input.find('\n') != std::string::npos) return false;
+
+    std::string similar_key;
+    if (!similar_.find(static_cast<int>(mode), ai_canonicalize(input), &similar_key) ||
+        similar_key == key || !cache_.lookup(similar_key, response)) {
+        return false;
+    }
+    response = description_only(response);
+    similar_hits_++;
+    cache_.store(key, response, cache_ttl_seconds(mode));
+    return true;
+}
+
+// 받은 답을 캐시에 저장하고, 설명이면 유사 입력 색인에도 등록
+void AIManager::store_response(const std::string& key, const std::string& input, AIMode mode,
+                               const std::string& response) {
+    cache_.store(key, response, cache_ttl_seconds(mode));
+    if (mode == AIMode::EXPLAIN && input.find('\n') == std::string::npos) {
+        similar_.add(static_cast<int>(mode), ai_canonicalize(input), key);
+    }
+}
+
+// 로컬 결과를 먼저 채움 (네트워크 없음)
+//  - 자동완성: 히스토리에서 찾은 명령어 (한 번 실행했던 위험한 명령어는 다시 권하지 않음)
+//  - 진단: 규칙 검사기의 경고 (원격 진단은 그 뒤에 붙음)
+void AIManager::fill_local_suggestions() {
+    if (last_input_.empty()) return;
+    if (current_mode_ == AIMode::DIAGNOSE) {
+        AIRiskFinding risk = ai_scan_risk(last_input_);
+        if (risk.level != AIRiskLevel::NONE) {
+            suggestions_.push_back(AISuggestion(last_input_, std::string(risk.message)));
+            local_count_ = suggestions_.size();
+            publish_suggestions();
+        }
+        return;
+    }
+    if (current_mode_ != AIMode::GENERATION) return;
+
+    long long now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+    for (const auto& local : local_engine_.complete(last_input_, 5, now)) {
+        if (ai_scan_risk(local.command).level == AIRiskLevel::DANGER) continue;
+        suggestions_.push_back(AISuggestion(local.command,
+                                            "히스토리 " + std::to_string(local.count) + "회"));
+    }
+    local_count_ = suggestions_.size();
+    publish_suggestions();
+}
+
+// 모드별 프롬프트 생성: prompt_buffer_에 조립하고 그 안의 컨텍스트 부분을 돌려줌
+// 고정 문구는 PromptBuilder에 미리 만들어져 있고, 컨텍스트는 토큰 예산에 맞게 줄임
+std::string_view AIManager::build_prompt(const std::string& current_input, AIMode mode,
+                                         const std::string& cwd, bool combined) {
+    auto start = std::chrono::steady_clock::now();
+    collect_context(cwd);
+    std::string_view context =
+        combined ? prompt_builder_.build_combined(static_cast<int>(mode), current_input, prompt_buffer_)
+                 : prompt_builder_.build(static_cast<int>(mode), current_input, prompt_buffer_);
+    metrics_.record(static_cast<int>(mode), AIPhase::PROMPT_BUILD, elapsed_since(start));
+    return context;
+}
+
+void AIManager::set_prompt_budget(size_t tokens) {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    prompt_builder_.set_token_budget(tokens);
+}
+
+// API 응답을 정리해서 제안 목록에 반영
+// 응답이 있었는데 제안을 하나도 얻지 못하면 파싱 실패로 집계
+void AIManager::apply_response(const std::string& response) {
+    auto start = std::chrono::steady_clock::now();
+    size_t before = suggestions_.size();
+    bool answered = !response.empty();
+    std::string_view body = markdown_body(response);
+    if (!body.empty()) {
+        parse_suggestions(body);
+    }
+    publish_suggestions();
+
+    int mode = static_cast<int>(current_mode_);
+    if (answered && suggestions_.size() == before) metrics_.add(mode, AICounter::PARSE_FAILURES);
+    if (answered) metrics_.record(mode, AIPhase::PARSE, parse_time_ + elapsed_since(start));
+    parse_time_ = std::chrono::microseconds(0);
+}
+
+// [핵심] 모드별 AI 제안 생성 (동기 방식)
+// 프롬프트 조립과 결과 반영만 state_mutex_ 안에서 하고, 진행 중인 같은 요청을 기다리는 동안과
+// 전송하는 동안은 풀어 둠 (메인 스레드의 다른 호출이 전송 시간만큼 멈추지 않도록)
+void AIManager::generate_suggestions(const std::string& current_input, AIMode mode) {
+    std::string key, prompt;
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> state_lock(state_mutex_);
+        reset_for_input(current_input, mode);
+        fill_local_suggestions();
+
+        // 같은 입력에 대해 이미 받은 답
+        if (mode_ready_[static_cast<int>(mode)]) {
+            apply_response(mode_responses_[static_cast<int>(mode)]);
+            return;
         }
-        if (line.find("- ") == 0) {
-            line = line.substr(2);
+        if (current_input.empty() || !has_backend()) return;
+
+        key = cache_key(current_input, mode,
+                        build_prompt(current_input, mode, current_directory(cwd_scratch_)));
+        prompt = prompt_buffer_;
+        generation = generation_;
+    }
+    {
+        // 같은 요청(또는 같은 입력의 통합 요청)이 백그라운드에서 진행 중이면 끝날 때까지
+        // 기다렸다가 그 결과(캐시)를 씀
+        std::unique_lock<std::mutex> lock(mutex_);
+        uint64_t flight = find_flight_locked(key, current_input);
+        if (flight != 0) {
+            coalesced_count_++;
+            flight_done_.wait(lock, [this, flight] {
+                return shutting_down_ || (queued_id_ != flight && active_id_ != flight);
+            });
         }
-        
-        // "|"로 명령어와 설명 분리
-        size_t separator = line.find('|');
-        
-        if (separator != std::string::npos) {
-            std::string cmd = trim(line.substr(0, separator));
-            std::string desc = trim(line.substr(separator + 1));
-            
-            if (!cmd.empty()) {
-                suggestions_.push_back(AISuggestion(cmd, desc));
+    }
+    // 응답까지 블록되는 호출이므로 디스크 캐시를 여기서 열어도 됨
+    cache_.open_disk();
+    std::string response;
+    bool timed_out = false;
+    if (!lookup_response(key, current_input, mode, response) && backend_available()) {
+        // API 호출 (실패했거나 시간 초과로 잘린 응답은 캐시하지 않음)
+        response = call_api(prompt, mode, request_deadline(mode), 0, nullptr, nullptr, &timed_out);
+        if (!response.empty() && !timed_out) store_response(key, current_input, mode, response);
+    }
+
+    // 그 사이 다른 호출이 제안 목록을 바꿨으면 반영하지 않음 (응답은 캐시에 남음)
+    std::lock_guard<std::mutex> state_lock(state_mutex_);
+    if (generation_ != generation) return;
+    store_mode_results(response, timed_out);
+    apply_response(response);
+}
+
+// 데몬 쪽 요청 처리: 세션의 입력/모드/디렉토리로 공유 히스토리에서 프롬프트를 만들고
+// 공유 캐시나 백엔드에서 응답을 가져옴 (제안 목록은 건드리지 않음)
+// 프롬프트 조립만 state_mutex_ 안에서 하고, 전송은 다른 요청과 동시에 진행
+// 통합 요청의 캐시 적중은 요청한 모드의 답만 돌려줌 (세션은 제목 없는 답을 맨 앞 섹션으로 봄)
+std::string AIManager::fetch_response(uint64_t id, const std::string& input, AIMode mode,
+                                      bool combined, const std::string& cwd,
+                                      const std::function<void(const std::string&)>& on_text,
+                                      bool* timed_out) {
+    std::string prompt, key, section_keys[4];
+    {
+        std::lock_guard<std::mutex> state_lock(state_mutex_);
+        std::string_view context = build_prompt(input, mode, cwd, combined);
+        key = cache_key(input, mode, context);
+        for (int m = 1; combined && m < 4; m++) {
+            section_keys[m] = cache_key(input, static_cast<AIMode>(m), context);
+        }
+        prompt = prompt_buffer_;
+    }
+    // 데몬 연결 스레드에서 부르므로 디스크 캐시를 여기서 열어도 됨
+    cache_.open_disk();
+    std::string response;
+    if (input.empty() || lookup_response(key, input, mode, response) || !backend_available()) {
+        return response;
+    }
+
+    bool cut = false;
+    response = call_api(prompt, mode, request_deadline(mode), id, on_text, nullptr, &cut);
+    if (combined && !response.empty()) {
+        store_sections(response, input, mode, section_keys, cut);
+    } else if (!response.empty() && !cut) {
+        store_response(key, input, mode, response);
+    }
+    if (timed_out) *timed_out = cut;
+    return response;
+}
+
+uint64_t AIManager::open_daemon_request() {
+    std::lock_guard<std::mutex> lock(daemon_requests_mutex_);
+    uint64_t id = DAEMON_REQUEST | ++daemon_request_seq_;
+    live_daemon_requests_.push_back(id);
+    return id;
+}
+
+void AIManager::cancel_daemon_request(uint64_t id) {
+    close_daemon_request(id);
+    wake_transfer();
+}
+
+void AIManager::close_daemon_request(uint64_t id) {
+    std::lock_guard<std::mutex> lock(daemon_requests_mutex_);
+    auto it = std::find(live_daemon_requests_.begin(), live_daemon_requests_.end(), id);
+    if (it != live_daemon_requests_.end()) live_daemon_requests_.erase(it);
+}
+
+void AIManager::set_similarity_threshold(double threshold) {
+    similar_.set_threshold(threshold);
+}
+
+void AIManager::set_combined_requests(bool enabled) {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    combined_requests_ = enabled;
+}
+
+void AIManager::set_daemon_socket(const std::string& path) {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    daemon_socket_ = path;
+    if (!private_mode_) daemon_.set_socket(path);
+}
+
+void AIManager::set_private_mode(bool enabled) {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    if (private_mode_ == enabled) return;
+    private_mode_ = enabled;
+    cache_.set_persistent(!enabled);
+    daemon_.set_socket(enabled ? "" : daemon_socket_);
+}
+
+// 비동기 요청 제출: 이전에 대기 중이던 요청은 새 요청으로 대체됨
+uint64_t AIManager::submit_request(const std::string& current_input, AIMode mode) {
+    std::lock_guard<std::mutex> state_lock(state_mutex_);
+    reset_for_input(current_input, mode);
+    fill_local_suggestions();
+
+    std::string key, cached, section_keys[4];
+    bool send = false, combined = false;
+    if (mode_ready_[static_cast<int>(mode)]) {
+        // 같은 입력에 대해 이미 받은 답 (통합 요청으로 함께 받았거나 앞서 요청한 모드)
+        cached = mode_responses_[static_cast<int>(mode)];
+    } else if (!current_input.empty() && has_backend()) {
+        // 이 입력의 첫 요청이면 통합 요청으로 다른 모드의 답도 이어서 받아 둠
+        // (요청한 모드의 답이 먼저 스트리밍되므로 스트리밍할 때만)
+        combined = combined_requests_ && streaming_ && !any_mode_ready();
+        std::string_view context =
+            build_prompt(current_input, mode, current_directory(cwd_scratch_), combined);
+        key = cache_key(current_input, mode, context);
+        for (int m = 1; combined && m < 4; m++) {
+            section_keys[m] = cache_key(current_input, static_cast<AIMode>(m), context);
+        }
+        send = !lookup_response(key, current_input, mode, cached);
+        // 모든 백엔드의 회로 차단기가 열려 있으면 보내지 않고 로컬 결과로 바로 완료
+        if (send && !backend_available()) send = false;
+    }
+
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // 같은 요청이나 같은 입력의 통합 요청이 대기/전송 중이면 합류: 취소하거나 새로 보내지 않음
+        // 지금까지 스트리밍된 부분과 로컬 결과는 다음 poll에서 다시 반영됨
+        uint64_t flight = send ? find_flight_locked(key, current_input, &combined_first_) : 0;
+        if (flight != 0) {
+            coalesced_count_++;
+            if (local_count_ > 0) local_unreported_ = true;
+            if (local_count_ > 0 || !stream_text_.empty()) wake_reader();
+            return flight;
+        }
+
+        // 아직 시작하지 않은 이전 요청은 새 요청으로 대체 (취소로 집계)
+        if (queued_id_ != 0) cancelled_count_++;
+        id = ++request_seq_;
+        if (!send) {
+            // 캐시 적중(또는 요청 불가): 네트워크 없이 바로 완료 알림
+            clear_queued_locked();
+            notify_completion_locked(id, std::move(cached));
+        } else {
+            // 프롬프트 버퍼는 복사하지 않고 맞바꿈 (워커가 다 쓴 버퍼를 다음 요청에 재사용)
+            queued_id_ = id;
+            queued_prompt_.swap(prompt_buffer_);
+            if (prompt_buffer_.capacity() < spare_prompt_.capacity()) prompt_buffer_.swap(spare_prompt_);
+            queued_cache_key_ = std::move(key);
+            queued_input_ = current_input;
+            queued_cwd_ = cwd_scratch_;
+            queued_mode_ = mode;
+            queued_combined_ = combined;
+            for (int m = 1; combined && m < 4; m++) queued_section_keys_[m] = std::move(section_keys[m]);
+            combined_first_ = combined ? static_cast<int>(mode) : 0;
+            queued_at_ = std::chrono::steady_clock::now();
+            start_worker_locked();
+
+            // 로컬 결과는 원격 응답을 기다리지 않고 바로 표시
+            if (local_count_ > 0) {
+                local_unreported_ = true;
+                wake_reader();
             }
+        }
+    }
+    // 진행 중인 이전 전송은 즉시 중단
+    cv_.notify_one();
+    wake_transfer();
+    return id;
+}
+
+// key와 같은 요청이나 input의 통합 요청이 대기 중이거나 전송 중이면 그 요청 번호
+// (mutex_를 잡은 상태에서 호출). combined_first에는 통합 요청의 맨 앞 모드 (아니면 0)
+// 이미 더 새로운 요청에 밀려 취소되는 중인 요청에는 합류하지 않음
+uint64_t AIManager::find_flight_locked(const std::string& key, const std::string& input,
+                                       int* combined_first) const {
+    uint64_t latest = request_seq_.load();
+    if (latest == 0) return 0;
+    uint64_t flight = 0;
+    AIMode first = AIMode::GENERATION;
+    bool combined = false;
+    if (queued_id_ == latest &&
+        (queued_cache_key_ == key || (queued_combined_ && queued_input_ == input))) {
+        flight = queued_id_;
+        first = queued_mode_;
+        combined = queued_combined_;
+    } else if (active_id_ == latest &&
+               (active_cache_key_ == key || (active_combined_ && active_input_ == input))) {
+        flight = active_id_;
+        first = active_mode_;
+        combined = active_combined_;
+    }
+    if (flight != 0 && combined_first) *combined_first = combined ? static_cast<int>(first) : 0;
+    return flight;
+}
+
+// 진행 중이거나 대기 중인 요청 취소 (입력이 바뀌었을 때)
+void AIManager::cancel_request() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queued_id_ != 0) {
+            cancelled_count_++;
+            clear_queued_locked();
+        }
+        // 요청 번호를 올려서 진행 중인 전송과 도착한 결과를 모두 무효화
+        request_seq_++;
+    }
+    wake_transfer();
+}
+
+// 입력이 요청 당시와 달라졌으면 취소
+bool AIManager::cancel_if_stale(const std::string& current_input) {
+    if (is_same_input(current_input)) return false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queued_id_ != request_seq_ && active_id_ != request_seq_) return false;
+    }
+    cancel_request();
+    return true;
+}
+
+// 전송 대기 중인 스레드를 모두 깨움 (curl_multi_poll, 데몬 응답, 속도 제한 토큰 대기 중단)
+// 깨어난 전송은 각자 자기 요청이 취소되었는지 확인함
+void AIManager::wake_transfer() {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        for (CURLM* multi : busy_multis_) ai_curl().multi_wakeup(multi);
+    }
+    daemon_.wake();
+    rate_limiter_.wake();
+}
+
+// 이 요청이 더 이상 필요 없는지 확인 (더 새로운 요청이 있거나, 데몬 요청을 보낸 세션이
+// 끊겼거나, 종료 중)
+bool AIManager::is_cancelled(uint64_t id) const {
+    if (shutting_down_) return true;
+    if (id & DAEMON_REQUEST) {
+        std::lock_guard<std::mutex> lock(daemon_requests_mutex_);
+        return std::find(live_daemon_requests_.begin(), live_daemon_requests_.end(), id) ==
+               live_daemon_requests_.end();
+    }
+    return id != 0 && id != request_seq_.load();
+}
+
+void AIManager::set_debounce(std::chrono::milliseconds debounce) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    debounce_ = debounce;
+}
+
+AIRequestStats AIManager::request_stats() const {
+    AIRequestStats stats;
+    stats.completed = completed_count_.load();
+    stats.cancelled = cancelled_count_.load();
+    stats.coalesced = coalesced_count_.load();
+    return stats;
+}
+
+// 완료된 결과를 기록하고 알림 파이프에 신호 (mutex_를 잡은 상태에서 호출)
+void AIManager::notify_completion_locked(uint64_t id, std::string response, bool timed_out) {
+    completed_id_ = id;
+    completed_response_ = std::move(response);
+    completed_timed_out_ = timed_out;
+    wake_reader();
+}
+
+// 대기 중인 요청을 모두 비움 (mutex_를 잡은 상태에서 호출)
+// 합류 판단(find_flight_locked)이 지난 요청의 키나 입력을 보지 않도록 함께 지움
+void AIManager::clear_queued_locked() {
+    queued_id_ = 0;
+    queued_prompt_.clear();
+    queued_cache_key_.clear();
+    queued_input_.clear();
+    queued_cwd_.clear();
+    queued_combined_ = false;
+    for (auto& key : queued_section_keys_) key.clear();
+}
+
+// 알림 파이프에 한 바이트 써서 리더의 select를 깨움
+void AIManager::wake_reader() {
+    if (notify_pipe_[1] >= 0) {
+        char c = 1;
+        ssize_t unused = write(notify_pipe_[1], &c, 1);
+        (void)unused;
+    }
+}
+
+// 워커 스레드는 처음 필요할 때만 생성 (mutex_를 잡은 상태에서 호출)
+void AIManager::start_worker_locked() {
+    if (!worker_.joinable()) {
+        worker_ = std::thread(&AIManager::worker_loop, this);
+    }
+}
+
+// 연결 미리 맺기 요청: 실제 작업은 워커 스레드에서 한 번만 수행
+void AIManager::prewarm_connection() {
+    if (!has_backend()) return;
+    std::string cwd;
+    directory_context_.prefetch(current_directory(cwd));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (prewarm_requested_) return;
+        prewarm_requested_ = true;
+        prewarm_pending_ = true;
+        start_worker_locked();
+    }
+    cv_.notify_one();
+}
+
+// 워커 스레드: 대기 중인 요청을 하나씩 꺼내 API 호출 후 알림
+void AIManager::worker_loop() {
+    // 디스크 캐시 파일은 여기서 열어 둠 (키 입력 경로의 조회가 파일을 만들거나 매핑하지 않도록)
+    // 워커는 첫 프롬프트의 연결 미리 맺기로 시작하므로 보통 첫 입력 전에 열림
+    cache_.open_disk();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        auto probe_due = [this] {
+            return probe_scheduled_ && std::chrono::steady_clock::now() >= probe_at_;
+        };
+        auto has_work = [&] {
+            return shutting_down_ || queued_id_ != 0 || prewarm_pending_ || probe_due() ||
+                   !pending_history_.empty();
+        };
+        // 차단기 확인 요청이 예약되어 있으면 그 시각까지만 기다림
+        if (probe_scheduled_) {
+            cv_.wait_until(lock, probe_at_, has_work);
         } else {
-            // 구분자가 없는 경우
-            if (current_mode_ != AIMode::GENERATION) {
-                // 설명/진단 모드: 입력값은 그대로 두고, 응답 전체를 설명으로 처리
-                suggestions_.push_back(AISuggestion(last_input_, line));
+            cv_.wait(lock, has_work);
+        }
+        if (shutting_down_) return;
+        if (!has_work()) continue;
+
+        // 히스토리 적재는 다른 일보다 먼저 (다음 요청의 프롬프트에 들어가도록)
+        if (!pending_history_.empty()) {
+            std::string path;
+            path.swap(pending_history_);
+            lock.unlock();
+            load_history(path);
+            lock.lock();
+            continue;
+        }
+
+        // 확인 요청은 대기 중인 요청이 없을 때만 (요청이 우선)
+        if (queued_id_ == 0 && probe_due()) {
+            probe_scheduled_ = false;
+            lock.unlock();
+            probe_backends();
+            lock.lock();
+            continue;
+        }
+
+        // 실제 요청이 대기 중이면 연결 미리 맺기는 생략 (요청이 연결을 맺음)
+        prewarm_pending_ = false;
+        if (queued_id_ == 0) {
+            lock.unlock();
+            warm_connection();
+            lock.lock();
+            continue;
+        }
+
+        // 디바운스: 마지막 제출 후 debounce_ 동안 새 요청이 없을 때만 시작
+        while (!shutting_down_ && queued_id_ != 0 &&
+               std::chrono::steady_clock::now() < queued_at_ + debounce_) {
+            cv_.wait_until(lock, queued_at_ + debounce_);
+        }
+        if (shutting_down_) return;
+        if (queued_id_ == 0) continue;
+
+        uint64_t id = queued_id_;
+        std::string prompt;
+        prompt.swap(queued_prompt_);
+        std::string key = std::move(queued_cache_key_);
+        std::string input = std::move(queued_input_);
+        std::string cwd = std::move(queued_cwd_);
+        AIMode mode = queued_mode_;
+        bool combined = queued_combined_;
+        std::string section_keys[4];
+        for (int m = 1; combined && m < 4; m++) section_keys[m] = std::move(queued_section_keys_[m]);
+        clear_queued_locked();
+        active_id_ = id;
+        active_cache_key_ = key;
+        active_mode_ = mode;
+        active_combined_ = combined;
+        if (combined) active_input_ = input;
+        stream_text_.clear();
+        lock.unlock();
+
+        auto deadline = request_deadline(mode);
+
+        std::string response;
+        bool cancelled = false, timed_out = false;
+        std::function<void(const std::string&)> on_text;
+        if (streaming_) {
+            // 조각이 올 때마다 공유 버퍼에 붙이고 메인 스레드에 알림
+            on_text = [this, id](const std::string& chunk) {
+                std::lock_guard<std::mutex> guard(mutex_);
+                if (active_id_ != id) return;
+                stream_text_ += chunk;
+                wake_reader();
+            };
+        }
+
+        // 데몬이 있으면 맡기고 (데몬이 공유 히스토리로 프롬프트를 만듦), 없으면 직접 호출
+        auto daemon_result = daemon_.request(
+            input, static_cast<int>(mode), combined, cwd, deadline, on_text,
+            [this, id] { return is_cancelled(id); }, &response, &timed_out);
+        if (daemon_result == AIDaemonClient::CANCELLED) {
+            cancelled = true;
+        } else if (daemon_result == AIDaemonClient::UNAVAILABLE) {
+            response = call_api(prompt, mode, deadline, id, on_text, &cancelled, &timed_out);
+        }
+
+        if (cancelled) {
+            // 취소된 요청의 버퍼는 바로 해제하고 결과도 알리지 않음
+            std::string().swap(response);
+            cancelled_count_++;
+            lock.lock();
+            if (spare_prompt_.capacity() < prompt.capacity()) spare_prompt_.swap(prompt);
+            active_id_ = 0;
+            active_cache_key_.clear();
+            active_combined_ = false;
+            active_input_.clear();
+            std::string().swap(stream_text_);
+            flight_done_.notify_all();
+            continue;
+        }
+
+        // 실패(빈 응답)나 시간 초과로 잘린 응답은 캐시하지 않음: 같은 입력을 다시 요청하면 새로 시도
+        // 통합 응답은 섹션별로 각 모드의 키에 저장
+        if (combined && !response.empty()) {
+            store_sections(response, input, mode, section_keys, timed_out);
+        } else if (!response.empty() && !timed_out) {
+            store_response(key, input, mode, response);
+        }
+        completed_count_++;
+
+        lock.lock();
+        if (spare_prompt_.capacity() < prompt.capacity()) spare_prompt_.swap(prompt);
+        active_id_ = 0;
+        active_cache_key_.clear();
+        active_combined_ = false;
+        active_input_.clear();
+        notify_completion_locked(id, std::move(response), timed_out);
+        flight_done_.notify_all();
+    }
+}
+
+// 스트리밍 중 새로 완성된 줄만 제안 목록에 추가 (메인 스레드)
+// 코드 블록 구분 줄과 백틱은 parse_suggestions가 처리. 처리한 바이트 수를 반환.
+size_t AIManager::parse_stream_lines(const std::string& text) {
+    size_t last_newline = text.rfind('\n');
+    if (last_newline == std::string::npos) return 0;
+    parse_suggestions(std::string_view(text).substr(0, last_newline + 1));
+    publish_suggestions();
+    return last_newline + 1;
+}
+
+// 스트리밍 중인 통합 응답에서 현재 모드 섹션의 새로 완성된 줄만 반영 (메인 스레드)
+// 섹션 경계는 제목 줄로 알고, 첫 제목 앞의 내용은 맨 앞 섹션으로 봄. 처리한 바이트 수를 반환.
+size_t AIManager::parse_stream_sections(std::string_view text) {
+    size_t last_newline = text.rfind('\n');
+    if (last_newline == std::string_view::npos) return 0;
+    if (stream_section_ == 0) stream_section_ = combined_first_;
+
+    const int mode = static_cast<int>(current_mode_);
+    size_t start = 0, run_start = std::string_view::npos;
+    auto flush = [&](size_t end) {
+        if (run_start != std::string_view::npos) parse_suggestions(text.substr(run_start, end - run_start));
+        run_start = std::string_view::npos;
+    };
+    while (start <= last_newline) {
+        size_t end = text.find('\n', start) + 1;
+        int heading = PromptBuilder::section_mode(trim(text.substr(start, end - start)));
+        if (heading != 0) {
+            flush(start);
+            stream_section_ = heading;
+        } else if (stream_section_ == mode && run_start == std::string_view::npos) {
+            run_start = start;
+        }
+        start = end;
+    }
+    flush(last_newline + 1);
+    publish_suggestions();
+    return last_newline + 1;
+}
+
+// 완료된 요청 확인 및 반영 (메인 스레드에서 호출)
+AIRequestStatus AIManager::poll_request() {
+    std::lock_guard<std::mutex> state_lock(state_mutex_);
+
+    // 알림 파이프 비우기
+    if (notify_pipe_[0] >= 0) {
+        char buf[64];
+        while (read(notify_pipe_[0], buf, sizeof buf) > 0) {}
+    }
+
+    std::string response, streamed;
+    bool report_local = false, timed_out = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t id = completed_id_;
+        completed_id_ = 0;
+        response = std::move(completed_response_);
+        completed_response_.clear();
+        timed_out = completed_timed_out_;
+
+        // 더 새로운 요청이 제출된 경우 오래된 결과는 버림
+        if (id == 0 || id != request_seq_) {
+            bool pending = request_seq_ != 0 &&
+                           (queued_id_ == request_seq_ || active_id_ == request_seq_);
+            if (!pending) return AI_REQUEST_IDLE;
+
+            // 스트리밍 중이면 새로 받은 부분만 가져옴
+            if (active_id_ == request_seq_ && stream_text_.size() > stream_consumed_) {
+                streamed = stream_text_.substr(stream_consumed_);
+            } else if (local_unreported_) {
+                report_local = true;
             } else {
-                // 자동 완성 모드: 설명 없이 명령어만 있는 경우
-                suggestions_.push_back(AISuggestion(line, ""));
+                return AI_REQUEST_PENDING;
             }
         }
-        
-        if (suggestions_.size() >= 5) break;
     }
+
+    if (report_local) {
+        local_unreported_ = false;
+        return AI_REQUEST_PARTIAL;
+    }
+
+    if (!streamed.empty()) {
+        size_t before = suggestions_.size();
+        auto start = std::chrono::steady_clock::now();
+        stream_consumed_ += combined_first_ != 0 ? parse_stream_sections(streamed)
+                                                 : parse_stream_lines(streamed);
+        parse_time_ += elapsed_since(start);
+        return suggestions_.size() > before ? AI_REQUEST_PARTIAL : AI_REQUEST_PENDING;
+    }
+
+    // 완료: 로컬 결과 뒤에 전체 응답을 다시 파싱 (스트리밍 중 보던 위치는 발행 시 이어받음)
+    // 모드별 응답으로 보관해 두어 같은 입력에서 다른 모드로 바꾸면 바로 보여줌
+    suggestions_.resize(local_count_, AISuggestion("", ""));
+    local_unreported_ = false;
+    store_mode_results(response, timed_out);
+    if (combined_first_ != 0) {
+        bool complete;
+        apply_response(combined_section(response, static_cast<int>(current_mode_), combined_first_,
+                                        &complete));
+    } else {
+        apply_response(response);
+    }
+    stream_consumed_ = 0;
+    stream_section_ = 0;
+    return AI_REQUEST_READY;
+}
+
+int AIManager::notify_fd() const {
+    return notify_pipe_[0];
+}
+
+AICacheStats AIManager::cache_stats() const {
+    AICacheStats stats = cache_.stats();
+    stats.similar_hits = similar_hits_.load();
+    return stats;
+}
+
+// 통계 출력 (`ai --stats`). JSON은 한 줄짜리 객체:
+// {"requests":{...},"cache":{...},"rate_limit":{...},"directory_context":{...},"modes":{"generation":{...},...}}
+std::string AIManager::format_stats(bool json) const {
+    AIRequestStats requests = request_stats();
+    AICacheStats cache = cache_stats();
+    AIRateLimitStats rate = rate_limit_stats();
+    AIDirectoryStats dir = directory_stats();
+    char line[512];
+    std::string out;
+    if (json) {
+        snprintf(line, sizeof line,
+                 "{\"requests\":{\"completed\":%llu,\"cancelled\":%llu,\"coalesced\":%llu},"
+                 "\"cache\":{\"hits\":%llu,\"disk_hits\":%llu,\"misses\":%llu,\"entries\":%llu,"
+                 "\"similar_hits\":%llu},"
+                 "\"rate_limit\":{\"throttled\":%llu,\"rate_limited\":%llu,\"dropped\":%llu},"
+                 "\"directory_context\":{\"gathers\":%llu,\"hits\":%llu,\"misses\":%llu,"
+                 "\"invalidations\":%llu},"
+                 "\"modes\":",
+                 static_cast<unsigned long long>(requests.completed),
+                 static_cast<unsigned long long>(requests.cancelled),
+                 static_cast<unsigned long long>(requests.coalesced),
+                 static_cast<unsigned long long>(cache.hits),
+                 static_cast<unsigned long long>(cache.disk_hits),
+                 static_cast<unsigned long long>(cache.misses),
+                 static_cast<unsigned long long>(cache.entries),
+                 static_cast<unsigned long long>(cache.similar_hits),
+                 static_cast<unsigned long long>(rate.throttled),
+                 static_cast<unsigned long long>(rate.rate_limited),
+                 static_cast<unsigned long long>(rate.dropped),
+                 static_cast<unsigned long long>(dir.gathers),
+                 static_cast<unsigned long long>(dir.hits),
+                 static_cast<unsigned long long>(dir.misses),
+                 static_cast<unsigned long long>(dir.invalidations));
+        out += line;
+        metrics_.append_json(out);
+        out += "}\n";
+    } else {
+        snprintf(line, sizeof line,
+                 "requests: %llu completed, %llu cancelled, %llu coalesced\n"
+                 "cache: %llu hits, %llu disk hits, %llu misses, %llu entries, %llu similar\n"
+                 "rate limit: %llu throttled, %llu rate limited (429), %llu dropped\n"
+                 "directory context: %llu gathers, %llu hits, %llu misses, %llu invalidations\n",
+                 static_cast<unsigned long long>(requests.completed),
+                 static_cast<unsigned long long>(requests.cancelled),
+                 static_cast<unsigned long long>(requests.coalesced),
+                 static_cast<unsigned long long>(cache.hits),
+                 static_cast<unsigned long long>(cache.disk_hits),
+                 static_cast<unsigned long long>(cache.misses),
+                 static_cast<unsigned long long>(cache.entries),
+                 static_cast<unsigned long long>(cache.similar_hits),
+                 static_cast<unsigned long long>(rate.throttled),
+                 static_cast<unsigned long long>(rate.rate_limited),
+                 static_cast<unsigned long long>(rate.dropped),
+                 static_cast<unsigned long long>(dir.gathers),
+                 static_cast<unsigned long long>(dir.hits),
+                 static_cast<unsigned long long>(dir.misses),
+                 static_cast<unsigned long long>(dir.invalidations));
+        out += line;
+        metrics_.append_text(out);
+    }
+    return out;
+}
+
+// 결과 파싱: 응답을 한 번 훑으면서 줄마다 코드 블록 구분 줄, 목록 표시, "|" 구분자를
+// 제자리(string_view)에서 처리하고, 제안에 담을 필드만 문자열로 만듦
+void AIManager::parse_suggestions(std::string_view response) {
+    size_t start = 0;
+
+    // 원격 제안은 최대 5개 (로컬 결과는 별도)
+    while (start < response.size() && suggestions_.size() < local_count_ + 5) {
+        size_t newline = response.find('\n', start);
+        if (newline == std::string_view::npos) newline = response.size();
+        std::string_view line = trim(response.substr(start, newline - start));
+        start = newline + 1;
+
+        // 코드 블록 구분 줄("```", "```bash")
+        if (line.compare(0, 3, "```") == 0) continue;
+        // 통합 응답의 섹션 제목 줄
+        if (PromptBuilder::section_mode(line) != 0) continue;
+
+        // "1. ", "10) ", "- ", "* " 등 목록 표시 제거
+        line = trim(line, WHITESPACE_AND_BACKTICKS);
+        line = trim(line.substr(list_marker_length(line)), WHITESPACE_AND_BACKTICKS);
+        if (line.empty()) continue;
+
+        // "|"로 명령어와 설명 분리
+        size_t separator = line.find('|');
+
+        if (separator != std::string_view::npos) {
+            std::string cmd = without_backticks(trim(line.substr(0, separator), WHITESPACE_AND_BACKTICKS));
+            if (!cmd.empty() && !has_local_command(cmd)) {
+                suggestions_.emplace_back(
+                    std::move(cmd),
+                    without_backticks(trim(line.substr(separator + 1), WHITESPACE_AND_BACKTICKS)));
+            }
+        } else if (current_mode_ != AIMode::GENERATION) {
+            // 설명/진단 모드: 입력값은 그대로 두고, 응답 줄을 설명으로 처리
+            suggestions_.emplace_back(last_input_, without_backticks(line));
+        } else {
+            // 자동 완성 모드: 설명 없이 명령어만 있는 경우
+            std::string cmd = without_backticks(line);
+            if (!has_local_command(cmd)) suggestions_.emplace_back(std::move(cmd), std::string());
+        }
+    }
+}
+
+#ifdef FISH_AI_BENCHMARK
+// 벤치마크 전용 단계 실행 (결과 크기를 돌려줘서 계산이 최적화로 빠지지 않게 함)
+size_t AIManager::run_bench_stage(AIBenchStage stage, const std::string& text, AIMode mode) {
+    std::lock_guard<std::mutex> state_lock(state_mutex_);
+    switch (stage) {
+    case AIBenchStage::TRIM:
+        return trim(text).size();
+    case AIBenchStage::REMOVE_MARKDOWN:
+        return markdown_body(text).size();
+    case AIBenchStage::PARSE:
+        suggestions_.clear();
+        current_mode_ = mode;
+        local_count_ = 0;
+        apply_response(text);
+        return suggestions_.size();
+    case AIBenchStage::CONTEXT:
+        collect_context(current_directory(cwd_scratch_));
+        return context_ids_.size() + workflow_scratch_.size();
+    case AIBenchStage::PROMPT:
+        build_prompt(text, mode, current_directory(cwd_scratch_));
+        return prompt_buffer_.size();
+    case AIBenchStage::RISK:
+        return static_cast<size_t>(ai_scan_risk(text).level);
+    case AIBenchStage::SIMILAR: {
+        std::string key;
+        return similar_.find(static_cast<int>(AIMode::EXPLAIN), ai_canonicalize(text), &key)
+                   ? key.size() : 0;
+    }
+    }
+    return 0;
+}
+#endif
+
+// 로컬 결과에 이미 있는 명령어인지 확인 (원격 결과와 합칠 때 중복 제거)
+// 진단 모드의 로컬 결과는 입력 명령어에 대한 경고이므로 원격 진단을 지우지 않음
+bool AIManager::has_local_command(std::string_view command) const {
+    if (current_mode_ != AIMode::GENERATION) return false;
+    for (size_t i = 0; i < local_count_ && i < suggestions_.size(); i++) {
+        if (suggestions_[i].command == command) return true;
+    }
+    return false;
+}
+
+// ---------------------------------------------------------
+// AISuggestionSet: 발행된 제안 목록 (읽는 쪽, 잠금 없음)
+// ---------------------------------------------------------
+
+const AISuggestion* AISuggestionSet::current() const {
+    uint32_t index = current_index();
+    return index < suggestions.size() ? &suggestions[index] : nullptr;
+}
+
+// 커서만 옮김: 다른 스레드가 동시에 옮겨도 한 칸씩 모두 반영됨
+void AISuggestionSet::next() const {
+    if (suggestions.empty()) return;
+    uint32_t index = cursor.load(std::memory_order_relaxed);
+    while (!cursor.compare_exchange_weak(index, static_cast<uint32_t>((index + 1) % suggestions.size()),
+                                         std::memory_order_relaxed)) {}
+}
+
+// 제안 목록 전체를 길이 접두 레코드로 기록 (리더가 한 번에 가져가 목록을 그림)
+// 레코드: [u32 명령어 길이][명령어][u32 설명 길이][설명], 네이티브 바이트 순서, 정렬 없음
+size_t AISuggestionSet::export_records(char* buf, size_t cap) const {
+    size_t needed = 0;
+    for (const auto& suggestion : suggestions) {
+        needed += 2 * sizeof(uint32_t) + suggestion.command.size() + suggestion.description.size();
+    }
+    if (buf == nullptr || needed > cap) return needed;
+
+    auto put = [&buf](const std::string& field) {
+        uint32_t length = static_cast<uint32_t>(field.size());
+        memcpy(buf, &length, sizeof length);
+        memcpy(buf + sizeof length, field.data(), field.size());
+        buf += sizeof length + field.size();
+    };
+    for (const auto& suggestion : suggestions) {
+        put(suggestion.command);
+        put(suggestion.description);
+    }
+    return needed;
 }
 
 // 다음 제안으로 순환
 void AIManager::next_suggestion() {
-    if (!suggestions_.empty()) {
-        current_index_ = (current_index_ + 1) % suggestions_.size();
-    }
+    suggestions()->next();
 }
 
 // 현재 제안 가져오기 (UI 표시용: "명령어 (설명)")
 std::string AIManager::get_current_suggestion_with_description() {
-    if (suggestions_.empty() || current_index_ >= suggestions_.size()) {
+    AISuggestionsView set = suggestions();
+    const AISuggestion* suggestion = set->current();
+    if (suggestion == nullptr) {
         return "";
     }
     
-    const auto& suggestion = suggestions_[current_index_];
-    
-    if (suggestion.description.empty()) {
-        return suggestion.command;
+    if (suggestion->description.empty()) {
+        return suggestion->command;
     }
     
     // 모드에 따라 괄호 처리 등을 다르게 할 수도 있음
-    return suggestion.command + "  (" + suggestion.description + ")";
+    return suggestion->command + "  (" + suggestion->description + ")";
 }
 
 // 현재 제안 명령어만 가져오기 (실제 입력용)
 std::string AIManager::get_current_command_only() {
-    if (suggestions_.empty() || current_index_ >= suggestions_.size()) {
-        return "";
-    }
-    
-    return suggestions_[current_index_].command;
+    AISuggestionsView set = suggestions();
+    const AISuggestion* suggestion = set->current();
+    return suggestion ? suggestion->command : "";
 }
 
 bool AIManager::has_suggestions() const {
-    return !suggestions_.empty();
+    return !suggestions()->suggestions.empty();
 }
 
 void AIManager::clear_suggestions() {
+    std::lock_guard<std::mutex> lock(state_mutex_);
     suggestions_.clear();
-    current_index_ = 0;
+    clear_mode_results();
+    local_count_ = 0;
+    local_unreported_ = false;
     last_input_.clear();
+    last_canonical_.clear();
+    publish_suggestions();
 }
 
+// 스냅숏 쪽 정규화 형태는 발행할 때 계산해 두므로 여기서는 입력 쪽만 정규화함
 bool AIManager::is_same_input(const std::string& input) const {
-    return last_input_ == input;
+    AISuggestionsView view = suggestions();
+    return view->input == input || view->canonical_input == ai_canonical_text(input);
 }
 
-// Gemini API 호출
-std::string AIManager::call_gemini_api(const std::string& prompt) {
-    if (api_key_.empty()) return "";
+// ---------------------------------------------------------
+// 백엔드 목록
+// ---------------------------------------------------------
+
+// 환경 변수로 백엔드 목록 구성
+// FISH_AI_BACKENDS가 있으면 "종류 | 주소 | 모델 | API 키" 항목을 ';'로 나열한 순서대로 사용
+// (빈 칸은 기본값, 키가 비면 GEMINI_API_KEY/OPENAI_API_KEY). 없으면 Gemini 하나만 사용
+void AIManager::load_backends_from_env() {
+    auto env = [](const char* name) {
+        const char* value = std::getenv(name);
+        return std::string(value ? value : "");
+    };
 
-    std::string api_url = "https://generativelanguage.googleapis.com/v1/models/gemini-2.5-flash:generateContent?key=" + api_key_;
+    const char* list = std::getenv("FISH_AI_BACKENDS");
+    if (list == nullptr || *list == '\0') {
+        add_backend("gemini", env("GEMINI_API_BASE_URL"), env("GEMINI_MODEL"), env("GEMINI_API_KEY"));
+        return;
+    }
 
-    json request_data;
-    request_data["contents"] = json::array({
-        {{"parts", json::array({{{"text", prompt}}})}}
-    });
-    std::string data_to_send = request_data.dump();
-
-    CURL *curl = curl_easy_init();
-    std::string response_string;
-
-    if (curl) {
-        struct curl_slist *headers = NULL;
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-
-        curl_easy_setopt(curl, CURLOPT_URL, api_url.c_str());
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data_to_send.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_string);
-
-        CURLcode res = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
-        
-        if (res != CURLE_OK) return "";
+    std::istringstream entries(list);
+    std::string entry;
+    while (std::getline(entries, entry, ';')) {
+        std::string fields[4];
+        std::istringstream parts(entry);
+        for (size_t i = 0; i < 4 && std::getline(parts, fields[i], '|'); i++) {
+            fields[i] = std::string(trim(fields[i]));
+        }
+        if (fields[0].empty()) continue;
+        if (fields[0] == "gemini") {
+            if (fields[1].empty()) fields[1] = env("GEMINI_API_BASE_URL");
+            if (fields[3].empty()) fields[3] = env("GEMINI_API_KEY");
+        } else if (fields[3].empty()) {
+            fields[3] = env("OPENAI_API_KEY");
+        }
+        add_backend(fields[0], fields[1], fields[2], fields[3]);
+    }
+}
+
+// API 서버 주소/키 변경 (로컬 대체 서버 테스트용, 메인 스레드에서 호출)
+void AIManager::set_backend(const std::string& base_url, const std::string& api_key) {
+    std::lock_guard<std::mutex> lock(transfer_mutex_);
+    backends_.clear();
+    backends_.push_back(AIBackend::create("gemini", base_url, "", api_key));
+}
+
+bool AIManager::add_backend(const std::string& kind, const std::string& base_url,
+                            const std::string& model, const std::string& api_key) {
+    std::unique_ptr<AIBackend> backend = AIBackend::create(kind, base_url, model, api_key);
+    if (!backend) return false;
+    std::lock_guard<std::mutex> lock(transfer_mutex_);
+    backends_.push_back(std::move(backend));
+    return true;
+}
+
+void AIManager::set_hedge_delay(std::chrono::milliseconds delay) {
+    hedge_delay_ms_ = delay.count();
+}
+
+// 요청을 보낼 수 있는 백엔드가 하나라도 있는지 (메인 스레드)
+bool AIManager::has_backend() const {
+    for (const auto& backend : backends_) {
+        if (backend->usable()) return true;
+    }
+    return false;
+}
+
+// 회로 차단기가 닫혀 있어 지금 요청을 보낼 수 있는 백엔드가 있는지 (메인 스레드)
+bool AIManager::backend_available() const {
+    for (const auto& backend : backends_) {
+        if (backend->usable() && backend->breaker().allow()) return true;
+    }
+    return false;
+}
+
+bool AIManager::backend_breaker(size_t index, bool* open, uint32_t* failures) const {
+    if (index >= backends_.size()) return false;
+    const AICircuitBreaker& breaker = backends_[index]->breaker();
+    if (open) *open = breaker.open();
+    if (failures) *failures = breaker.failures();
+    return true;
+}
+
+void AIManager::set_timeout(AIMode mode, std::chrono::milliseconds timeout) {
+    int index = static_cast<int>(mode);
+    if (index >= 0 && index < 4 && timeout.count() > 0) timeout_ms_[index] = timeout.count();
+}
+
+void AIManager::set_breaker_cooldown(std::chrono::milliseconds cooldown) {
+    breaker_cooldown_ms_ = std::max<long>(0, cooldown.count());
+}
+
+void AIManager::set_rate_limit(double per_minute, double burst) {
+    rate_limiter_.configure(per_minute / 60, burst);
+}
+
+AIRateLimitStats AIManager::rate_limit_stats() const {
+    return rate_limiter_.stats();
+}
+
+// 지금 시작하는 요청이 끝나야 하는 시각
+std::chrono::steady_clock::time_point AIManager::request_deadline(AIMode mode) const {
+    int index = static_cast<int>(mode);
+    long timeout = timeout_ms_[index >= 0 && index < 4 ? index : 0].load();
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+}
+
+bool AIManager::backend_stats(size_t index, uint64_t* requests, uint64_t* wins,
+                              long* p95_ms) const {
+    if (index >= backends_.size()) return false;
+    const AIBackend& backend = *backends_[index];
+    if (requests) *requests = backend.requests();
+    if (wins) *wins = backend.wins();
+    if (p95_ms) *p95_ms = backend.p95_ms();
+    return true;
+}
+
+// 헤지 대기 시간: 이 백엔드의 p95 (기록이 부족하면 설정값)
+// 너무 짧으면 매번 두 곳에 요청하게 되므로 하한을 둠
+std::chrono::milliseconds AIManager::hedge_delay(const AIBackend& backend) const {
+    static const long MIN_HEDGE_MS = 50;
+    long configured = hedge_delay_ms_.load();
+    long p95 = backend.p95_ms();
+    return std::chrono::milliseconds(p95 >= 0 ? std::max(p95, MIN_HEDGE_MS) : configured);
+}
+
+// ---------------------------------------------------------
+// 전송
+// ---------------------------------------------------------
+
+// 공유 연결 준비 (transfer_mutex_를 잡은 상태에서 호출)
+// multi/easy 핸들은 요청이 빌려 갈 때 만듦
+bool AIManager::ensure_connection() {
+    if (curl_share_) return true;
+
+    // 첫 전송에서 libcurl을 적재 (적재할 수 없으면 모든 전송이 실패)
+    const AICurl& curl = ai_curl();
+    if (!curl.loaded()) return false;
+    curl.global_init(CURL_GLOBAL_DEFAULT);
+
+    // DNS, TLS 세션, 연결 캐시를 공유하는 핸들
+    curl_share_ = curl.share_init();
+    if (curl_share_) {
+        curl.share_setopt_lock_function(curl_share_, ShareLock);
+        curl.share_setopt_unlock_function(curl_share_, ShareUnlock);
+        curl.share_setopt_userdata(curl_share_, share_locks_);
+        curl.share_setopt_data(curl_share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl.share_setopt_data(curl_share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl.share_setopt_data(curl_share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    }
+    return curl_share_ != nullptr;
+}
+
+// 전송에 쓸 백엔드 목록을 복사 (잠금은 복사하는 동안만 잡음). 연결을 준비할 수 없으면 false
+bool AIManager::copy_backends(std::vector<std::shared_ptr<AIBackend>>& out) {
+    std::lock_guard<std::mutex> lock(transfer_mutex_);
+    if (!ensure_connection()) return false;
+    out = backends_;
+    return true;
+}
+
+// 요청 하나가 쓸 multi 핸들을 빌림 (돌려줄 때까지 wake_transfer()가 깨우는 대상)
+CURLM* AIManager::acquire_multi() {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    CURLM* multi = nullptr;
+    if (!idle_multis_.empty()) {
+        multi = idle_multis_.back();
+        idle_multis_.pop_back();
     } else {
-        return "";
+        multi = ai_curl().multi_init();
+        if (!multi) return nullptr;
     }
+    busy_multis_.push_back(multi);
+    return multi;
+}
+
+void AIManager::release_multi(CURLM* multi) {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    busy_multis_.erase(std::find(busy_multis_.begin(), busy_multis_.end(), multi));
+    if (idle_multis_.size() < MAX_IDLE_HANDLES) {
+        idle_multis_.push_back(multi);
+    } else {
+        ai_curl().multi_cleanup(multi);
+    }
+}
 
-    try {
-        json response_json = json::parse(response_string);
-        if (response_json.contains("candidates") && 
-            !response_json["candidates"].empty()) {
-            return response_json["candidates"][0]["content"]["parts"][0]["text"];
+std::unique_ptr<AITransfer> AIManager::acquire_transfer() {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    if (idle_transfers_.empty()) return std::make_unique<AITransfer>();
+    std::unique_ptr<AITransfer> transfer = std::move(idle_transfers_.back());
+    idle_transfers_.pop_back();
+    return transfer;
+}
+
+void AIManager::release_transfer(std::unique_ptr<AITransfer> transfer) {
+    if (!transfer) return;
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    if (idle_transfers_.size() < MAX_IDLE_HANDLES) idle_transfers_.push_back(std::move(transfer));
+}
+
+// 실패 기록: 차단기가 열리면 확인 요청을 예약
+// 429는 백엔드 고장이 아니므로 여기로 오지 않고 속도 제한기가 처리함
+void AIManager::record_failure(AIBackend& backend) {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::milliseconds cooldown(breaker_cooldown_ms_.load());
+    if (backend.breaker().record_failure(now, cooldown)) {
+        schedule_probe(backend.breaker().probe_at());
+    }
+}
+
+// 워커가 at에 차단기 확인 요청을 보내도록 예약 (이미 더 이른 예약이 있으면 유지)
+void AIManager::schedule_probe(std::chrono::steady_clock::time_point at) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (probe_scheduled_ && probe_at_ <= at) return;
+        probe_scheduled_ = true;
+        probe_at_ = at;
+        start_worker_locked();
+    }
+    cv_.notify_one();
+}
+
+// 차단기 확인 요청 (워커 스레드): 대기 시간이 지난 백엔드에 본문 없는 요청을 보내고
+// 응답이 오면(5xx/429 제외) 차단기를 닫음. 아직 열린 차단기가 있으면 다음 확인을 예약
+void AIManager::probe_backends() {
+    static const std::chrono::milliseconds PROBE_TIMEOUT(2000);
+    std::vector<std::shared_ptr<AIBackend>> backends;
+    if (!copy_backends(backends)) return;
+
+    bool pending = false;
+    std::chrono::steady_clock::time_point next;
+    for (const auto& backend : backends) {
+        AICircuitBreaker& breaker = backend->breaker();
+        if (!backend->usable() || !breaker.open()) continue;
+        if (breaker.probe_due(std::chrono::steady_clock::now())) {
+            CURLM* multi = acquire_multi();
+            std::unique_ptr<AITransfer> transfer = acquire_transfer();
+            CURL* handle = multi ? backend->prepare_warm(*transfer, curl_share_, PROBE_TIMEOUT)
+                                 : nullptr;
+            bool cancelled = false;
+            long status = 0;
+            CURLcode result =
+                handle ? perform_transfer(multi, handle, 0, &cancelled) : CURLE_FAILED_INIT;
+            if (handle) ai_curl().easy_getinfo_long(handle, CURLINFO_RESPONSE_CODE, &status);
+            transfer->finish();
+            release_transfer(std::move(transfer));
+            if (multi) release_multi(multi);
+            if (cancelled) return;  // 종료 중
+            if (result == CURLE_OK && status < 500 && status != 429) {
+                breaker.probe_succeeded();
+                continue;
+            }
+            breaker.probe_failed(std::chrono::steady_clock::now());
         }
-    } catch (...) {
+        if (!pending || breaker.probe_at() < next) next = breaker.probe_at();
+        pending = true;
+    }
+    if (pending) schedule_probe(next);
+}
+
+// 연결 미리 맺기: 첫 번째 백엔드에 본문 없는 요청을 보내 DNS 조회, TCP/TLS 핸드셰이크를 끝내 둠
+void AIManager::warm_connection() {
+    std::vector<std::shared_ptr<AIBackend>> backends;
+    if (!copy_backends(backends)) return;
+
+    for (const auto& backend : backends) {
+        if (!backend->usable()) continue;
+        CURLM* multi = acquire_multi();
+        if (!multi) return;
+        std::unique_ptr<AITransfer> transfer = acquire_transfer();
+        CURL* handle =
+            backend->prepare_warm(*transfer, curl_share_, std::chrono::milliseconds(5000));
+        bool cancelled;
+        if (handle) perform_transfer(multi, handle, 0, &cancelled);
+        transfer->finish();
+        release_transfer(std::move(transfer));
+        release_multi(multi);
+        return;
+    }
+}
+
+// 단일 전송 실행 (multi는 acquire_multi()로 빌린 이 요청 전용 핸들)
+// 요청이 취소되면 wake_transfer()로 즉시 깨어나 전송을 중단하고 연결을 닫음
+CURLcode AIManager::perform_transfer(CURLM* multi, CURL* handle, uint64_t id, bool* cancelled) {
+    *cancelled = false;
+    ai_curl().multi_add_handle(multi, handle);
+
+    CURLcode result = CURLE_OK;
+    int running = 1;
+    while (running) {
+        if (ai_curl().multi_perform(multi, &running) != CURLM_OK) {
+            result = CURLE_FAILED_INIT;
+            break;
+        }
+        if (!running) break;
+        if (is_cancelled(id)) {
+            *cancelled = true;
+            result = CURLE_ABORTED_BY_CALLBACK;
+            break;
+        }
+        ai_curl().multi_poll(multi, nullptr, 0, 1000, nullptr);
+    }
+
+    int remaining;
+    while (CURLMsg* msg = ai_curl().multi_info_read(multi, &remaining)) {
+        if (msg->msg == CURLMSG_DONE) result = msg->data.result;
+    }
+    ai_curl().multi_remove_handle(multi, handle);
+    return result;
+}
+
+// 백엔드 호출: 속도 제한 토큰을 받고 나서 보냄
+// 토큰 대기 중에 더 새로운 요청이 들어오거나(id) 제한 시간 안에 보낼 수 없으면 보내지 않고 버림.
+// 모든 백엔드가 429로 답하면 속도 제한기가 정한 시간만큼 쉬었다가 제한 시간 안에서 다시 시도
+// 우선순위: 직접 요청한 설명/진단이 입력마다 자동으로 나가는 자동완성보다 먼저 토큰을 받음
+std::string AIManager::call_api(const std::string& prompt, AIMode mode,
+                                std::chrono::steady_clock::time_point deadline, uint64_t id,
+                                const std::function<void(const std::string&)>& on_text,
+                                bool* cancelled, bool* timed_out) {
+    static const int MAX_RATE_LIMIT_RETRIES = 2;
+    const int priority = mode == AIMode::GENERATION ? 0 : 1;
+    for (int attempt = 0;; attempt++) {
+        if (!rate_limiter_.acquire(priority, deadline, [this, id] { return is_cancelled(id); })) {
+            if (cancelled) *cancelled = is_cancelled(id);
+            if (timed_out) *timed_out = false;
+            return "";
+        }
+        bool rate_limited = false;
+        std::string text = call_backends(prompt, mode, deadline, id, on_text, cancelled, timed_out,
+                                         &rate_limited);
+        if (!rate_limited || attempt == MAX_RATE_LIMIT_RETRIES) return text;
+    }
+}
+
+// 헤지 요청으로 백엔드에 전송 (토큰 하나로 헤지/대체 백엔드 시도까지 포함)
+// 첫 번째 백엔드에 보내고, 헤지 대기 시간(그 백엔드의 p95) 안에 답이 없으면 다음 백엔드에도
+// 보내서 먼저 답한 쪽을 씀. 진 쪽의 전송은 즉시 중단됨. 헤지 요청은 호출당 한 번만 보내고,
+// 전송이 실패하거나 빈 응답이면 대기 없이 다음 백엔드로 넘어감.
+// on_text가 주어지면 스트리밍으로 받고, 첫 조각을 먼저 보낸 백엔드의 조각만 전달함
+// deadline이 지나면 모든 전송을 끝내고 빈 응답을 돌려줌 (각 전송의 curl 제한 시간도 여기에 맞춤)
+// 회로 차단기가 열린 백엔드는 건너뛰고, 실패(전송 오류, 시간 초과, 429를 뺀 HTTP 4xx/5xx)는
+// 차단기에 기록. 429는 속도 제한기에 알림
+// id가 0이 아니면 더 새로운 요청이 들어올 때 전송을 중단하고 cancelled를 설정함
+// 주고받은 바이트, 오류, 승자 전송의 연결/첫 바이트 지연은 mode의 지표로 기록
+// rate_limited는 모든 전송이 429로 끝나서 답이 없을 때 true
+std::string AIManager::call_backends(const std::string& prompt, AIMode mode,
+                                     std::chrono::steady_clock::time_point deadline, uint64_t id,
+                                     const std::function<void(const std::string&)>& on_text,
+                                     bool* cancelled, bool* timed_out, bool* rate_limited) {
+    typedef std::chrono::steady_clock Clock;
+
+    // 한 백엔드로 보낸 전송 하나
+    struct Leg {
+        AIBackend* backend;
+        std::unique_ptr<AITransfer> transfer;
+        CURL* handle;
+        Clock::time_point started;
+        bool running;
+    };
+
+    // 이 호출이 빌린 multi 핸들과 easy 핸들은 어떻게 끝나든 돌려줌
+    struct Lease {
+        AIManager* manager;
+        CURLM* multi;
+        std::vector<Leg> legs;
+        ~Lease() {
+            for (Leg& leg : legs) manager->release_transfer(std::move(leg.transfer));
+            if (multi) manager->release_multi(multi);
+        }
+    };
+
+    if (cancelled) *cancelled = false;
+    if (timed_out) *timed_out = false;
+    *rate_limited = false;
+    // 목록만 잠금 안에서 복사함 (전송하는 동안 다른 요청이 기다리지 않도록)
+    std::vector<std::shared_ptr<AIBackend>> backends;
+    if (!copy_backends(backends)) return "";
+    if (is_cancelled(id)) {
+        if (cancelled) *cancelled = true;
         return "";
     }
+    Lease lease{this, acquire_multi(), {}};
+    CURLM* multi = lease.multi;
+    if (!multi) return "";
+    const int metric_mode = static_cast<int>(mode);
+    Clock::time_point call_started = Clock::now();
+
+    std::vector<Leg>& legs = lease.legs;
+    legs.reserve(backends.size());
+    size_t next = 0;        // 다음에 시도할 백엔드
+    int winner = -1;        // 먼저 답한 전송 (legs 위치)
+    bool hedged = false;
+    Clock::time_point hedge_at;
 
-    return "";
-}
\ No newline at end of file
+    // 다음 백엔드로 전송 시작 (더 없으면 false)
+    auto start_next = [&]() -> bool {
+        while (next < backends.size()) {
+            AIBackend* backend = backends[next++].get();
+            if (!backend->usable() || !backend->breaker().allow()) continue;
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - Clock::now());
+            if (remaining.count() <= 0) return false;
+            std::function<void(const std::string&)> forward;
+            if (on_text) {
+                int leg = static_cast<int>(legs.size());
+                forward = [&winner, &on_text, leg](const std::string& chunk) {
+                    if (winner < 0) winner = leg;
+                    if (winner == leg) on_text(chunk);
+                };
+            }
+            std::unique_ptr<AITransfer> transfer = acquire_transfer();
+            CURL* handle = backend->prepare(*transfer, prompt, curl_share_, forward, remaining);
+            if (!handle) {
+                release_transfer(std::move(transfer));
+                continue;
+            }
+            backend->count_request();
+            ai_curl().multi_add_handle(multi, handle);
+            legs.push_back(Leg{backend, std::move(transfer), handle, Clock::now(), true});
+            hedge_at = legs.back().started + hedge_delay(*backend);
+            return true;
+        }
+        return false;
+    };
+
+    // 끝난(또는 중단하는) 전송의 바이트 수 기록. 승자면 연결/첫 바이트 지연도 기록
+    // 연결을 재사용했으면 새로 맺은 연결이 없으므로 연결 지연은 건너뜀
+    auto account = [this, metric_mode](const Leg& leg, bool won) {
+        long request_bytes = 0, header_bytes = 0, connects = 0;
+        curl_off_t body_sent = 0, body_received = 0, connect_us = 0, first_byte_us = 0;
+        ai_curl().easy_getinfo_long(leg.handle, CURLINFO_REQUEST_SIZE, &request_bytes);
+        ai_curl().easy_getinfo_off(leg.handle, CURLINFO_SIZE_UPLOAD_T, &body_sent);
+        ai_curl().easy_getinfo_long(leg.handle, CURLINFO_HEADER_SIZE, &header_bytes);
+        ai_curl().easy_getinfo_off(leg.handle, CURLINFO_SIZE_DOWNLOAD_T, &body_received);
+        metrics_.add(metric_mode, AICounter::BYTES_SENT, request_bytes + body_sent);
+        metrics_.add(metric_mode, AICounter::BYTES_RECEIVED, header_bytes + body_received);
+        if (!won) return;
+        ai_curl().easy_getinfo_long(leg.handle, CURLINFO_NUM_CONNECTS, &connects);
+        ai_curl().easy_getinfo_off(leg.handle, CURLINFO_APPCONNECT_TIME_T, &connect_us);
+        if (connect_us == 0) ai_curl().easy_getinfo_off(leg.handle, CURLINFO_CONNECT_TIME_T, &connect_us);
+        ai_curl().easy_getinfo_off(leg.handle, CURLINFO_STARTTRANSFER_TIME_T, &first_byte_us);
+        if (connects > 0 && connect_us > 0) {
+            metrics_.record(metric_mode, AIPhase::CONNECT, std::chrono::microseconds(connect_us));
+        }
+        if (first_byte_us > 0) {
+            metrics_.record(metric_mode, AIPhase::FIRST_BYTE, std::chrono::microseconds(first_byte_us));
+        }
+    };
+
+    auto stop = [multi, &account](Leg& leg) {
+        if (!leg.running) return;
+        account(leg, false);
+        ai_curl().multi_remove_handle(multi, leg.handle);
+        leg.transfer->finish();
+        leg.running = false;
+    };
+
+    std::string text;
+    bool done = false, aborted = false, decided = false, expired = false, throttled = false;
+    if (!start_next()) return "";
+    metrics_.add(metric_mode, AICounter::REQUESTS);
+
+    for (;;) {
+        int running;
+        if (ai_curl().multi_perform(multi, &running) != CURLM_OK) break;
+
+        // 끝난 전송 처리
+        int remaining;
+        while (CURLMsg* msg = ai_curl().multi_info_read(multi, &remaining)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURLcode result = msg->data.result;
+            for (size_t i = 0; i < legs.size(); i++) {
+                Leg& leg = legs[i];
+                if (!leg.running || leg.handle != msg->easy_handle) continue;
+                long status = 0;
+                ai_curl().easy_getinfo_long(leg.handle, CURLINFO_RESPONSE_CODE, &status);
+                ai_curl().multi_remove_handle(multi, leg.handle);
+                leg.running = false;
+                std::string leg_text = leg.transfer->finish();
+                bool ok = result == CURLE_OK && status < 400;
+                if (ok) {
+                    leg.backend->breaker().record_success();
+                    rate_limiter_.succeeded();
+                } else if (result == CURLE_OK && status == 429) {
+                    // 할당량 초과: Retry-After(초나 HTTP 날짜, 없으면 0) 동안 모든 전송을 쉼
+                    curl_off_t retry_after = 0;
+                    ai_curl().easy_getinfo_off(leg.handle, CURLINFO_RETRY_AFTER, &retry_after);
+                    rate_limiter_.throttled(Clock::now(), std::chrono::seconds(retry_after));
+                    throttled = true;
+                } else {
+                    record_failure(*leg.backend);
+                }
+                if (result == CURLE_OPERATION_TIMEDOUT) {
+                    expired = true;
+                } else if (result != CURLE_OK) {
+                    metrics_.add(metric_mode, AICounter::TRANSPORT_ERRORS);
+                } else if (status >= 400) {
+                    metrics_.add(metric_mode, AICounter::HTTP_ERRORS);
+                }
+                bool answered = ok && !leg_text.empty();
+                if (winner == static_cast<int>(i) || (winner < 0 && answered)) {
+                    winner = static_cast<int>(i);
+                    if (answered) text.swap(leg_text);
+                    done = true;
+                }
+                account(leg, winner == static_cast<int>(i));
+                break;
+            }
+        }
+
+        // 승자가 정해지면 지연을 기록하고 나머지 전송은 중단
+        if (winner >= 0 && !decided) {
+            decided = true;
+            Clock::time_point now = Clock::now();
+            Leg& won = legs[winner];
+            won.backend->count_win();
+            won.backend->record_latency(
+                std::chrono::duration_cast<std::chrono::milliseconds>(now - won.started));
+            for (size_t i = 0; i < legs.size(); i++) {
+                if (static_cast<int>(i) == winner || !legs[i].running) continue;
+                // 진 쪽은 적어도 이만큼 걸렸으므로 하한값으로 기록 (p95가 너무 낮아지지 않게)
+                legs[i].backend->record_latency(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(now - legs[i].started));
+                stop(legs[i]);
+            }
+        }
+        if (done) break;
+
+        if (is_cancelled(id)) {
+            aborted = true;
+            break;
+        }
+
+        // 제한 시간 초과: 아직 끝나지 않은 백엔드는 실패로 기록
+        // 스트리밍 중이던 승자가 있으면 지금까지 받은 부분만 돌려줌 (캐시하지 않음)
+        if (Clock::now() >= deadline) {
+            for (size_t i = 0; i < legs.size(); i++) {
+                if (!legs[i].running) continue;
+                record_failure(*legs[i].backend);
+                if (static_cast<int>(i) != winner) continue;
+                account(legs[i], true);
+                ai_curl().multi_remove_handle(multi, legs[i].handle);
+                legs[i].running = false;
+                text = legs[i].transfer->finish();
+            }
+            expired = true;
+            if (timed_out) *timed_out = true;
+            break;
+        }
+
+        bool any_running = std::any_of(legs.begin(), legs.end(),
+                                       [](const Leg& leg) { return leg.running; });
+        if (winner < 0 && !any_running) {
+            // 모두 실패: 다음 백엔드로 바로 넘어감
+            if (start_next()) continue;
+            break;
+        }
+        if (winner < 0 && !hedged && hedge_delay_ms_.load() >= 0 && next < backends.size() &&
+            Clock::now() >= hedge_at) {
+            hedged = true;
+            if (start_next()) continue;
+        }
+
+        // 헤지 시각이나 제한 시간까지만 기다림 (취소되면 wake_transfer()로 바로 깨어남)
+        long timeout_ms = std::min(1000L, 1 + static_cast<long>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count()));
+        if (winner < 0 && !hedged && hedge_delay_ms_.load() >= 0 && next < backends.size()) {
+            long until_hedge = std::chrono::duration_cast<std::chrono::milliseconds>(
+                hedge_at - Clock::now()).count();
+            timeout_ms = std::min(timeout_ms, until_hedge + 1);
+        }
+        timeout_ms = std::max(0L, timeout_ms);
+        ai_curl().multi_poll(multi, nullptr, 0, static_cast<int>(timeout_ms), nullptr);
+    }
+
+    for (auto& leg : legs) stop(leg);
+    if (cancelled) *cancelled = aborted;
+    if (aborted) return "";
+
+    if (expired) metrics_.add(metric_mode, AICounter::TIMEOUTS);
+    if (text.empty()) metrics_.add(metric_mode, AICounter::EMPTY_RESPONSES);
+    *rate_limited = throttled && text.empty() && !expired;
+    metrics_.record(metric_mode, AIPhase::TOTAL, elapsed_since(call_started));
+    return text;
+}
@@ -1,32 +1,66 @@
 #ifndef FISH_AI_MANAGER_H
 #define FISH_AI_MANAGER_H
 
+#include "ai_backend.h"
+#include "ai_cache.h"
+#include "ai_daemon.h"
+#include "ai_directory.h"
+#include "ai_history_store.h"
+#include "ai_local_engine.h"
+#include "ai_metrics.h"
+#include "ai_prompt.h"
+#include "ai_rate_limit.h"
+#include "ai_similarity.h"
+#include "ai_snapshot.h"
+#include "ai_workflow.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <curl/curl.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
-#include <deque>
 
 // ---------------------------------------------------------
 // 데이터 구조체 정의
 // ---------------------------------------------------------
 
-// 명령어 히스토리 항목
-struct CommandHistoryEntry {
-    std::string command;
-    long long timestamp;  // Unix timestamp
-    
-    CommandHistoryEntry(const std::string& cmd, long long ts) 
-        : command(cmd), timestamp(ts) {}
-};
-
 // 단일 AI 제안 (명령어 + 설명)
 struct AISuggestion {
     std::string command;      // 예: "ls -la"
     std::string description;  // 예: "모든 파일을 상세히 표시"
     
-    AISuggestion(const std::string& cmd, const std::string& desc)
-        : command(cmd), description(desc) {}
+    AISuggestion(std::string cmd, std::string desc)
+        : command(std::move(cmd)), description(std::move(desc)) {}
 };
 
+// 발행된 제안 목록 (불변 스냅숏). 읽는 쪽은 잠금 없이 읽고, 커서(현재 위치)만 atomic으로 옮김
+struct AISuggestionSet {
+    std::vector<AISuggestion> suggestions;
+    std::string input;                      // 이 목록을 만든 입력
+    std::string canonical_input;            // input의 정규화 형태 (같은 입력 판단용)
+    uint64_t generation = 0;                // 목록이 바뀔 때마다 증가
+    mutable std::atomic<uint32_t> cursor{0};
+
+    // 현재 제안 (없으면 nullptr)
+    const AISuggestion* current() const;
+    uint32_t current_index() const { return cursor.load(std::memory_order_relaxed); }
+    // 다음 제안으로 순환
+    void next() const;
+    // 목록 전체를 buf에 기록 (형식은 ai_manager.cpp 참고)
+    // 필요한 바이트 수를 반환하고, cap보다 크면 아무것도 쓰지 않음
+    size_t export_records(char* buf, size_t cap) const;
+};
+
+using AISuggestionsView = AISnapshot<AISuggestionSet>::Reader;
+
 // [핵심] AI 동작 모드 정의
 enum class AIMode {
     GENERATION = 1, // 1. 자동 완성 (Alt+W)
@@ -38,13 +72,121 @@ enum class AIMode {
 // AIManager 클래스 정의
 // ---------------------------------------------------------
 
+// 비동기 요청 상태 (poll_request의 반환값)
+enum AIRequestStatus {
+    AI_REQUEST_IDLE = -1,    // 진행 중인 요청 없음
+    AI_REQUEST_PENDING = 0,  // 워커 스레드에서 처리 중
+    AI_REQUEST_READY = 1,    // 결과가 제안 목록에 반영됨
+    AI_REQUEST_PARTIAL = 2   // 스트리밍 중: 일부 제안이 먼저 반영됨
+};
+
+// 요청 처리 통계
+struct AIRequestStats {
+    uint64_t completed;  // 네트워크 전송이 끝까지 완료된 요청 수
+    uint64_t cancelled;  // 시작 전 대체되었거나 전송 중 중단된 요청 수
+    uint64_t coalesced;  // 같은 요청이 이미 진행 중이어서 새 전송 없이 합류한 요청 수
+};
+
+#ifdef FISH_AI_BENCHMARK
+// 벤치마크에서 따로 측정하는 처리 단계 (네트워크 없이 실행, 값은 브리지 인자와 같음)
+enum class AIBenchStage {
+    TRIM = 0,             // 앞뒤 공백 제거
+    REMOVE_MARKDOWN = 1,  // 코드 블록 범위 찾기
+    PARSE = 2,            // 응답 정리 + 제안 파싱 (apply_response)
+    CONTEXT = 3,          // 히스토리/작업 패턴에서 프롬프트 컨텍스트 수집
+    PROMPT = 4,           // 컨텍스트 수집 + 프롬프트 조립
+    SIMILAR = 5,          // 입력 정규화 + 유사 입력 색인 조회 (설명 모드)
+    RISK = 6              // 로컬 위험 검사
+};
+#endif
+
 class AIManager {
 public:
     AIManager();
+    ~AIManager();
+
+    AIManager(const AIManager&) = delete;
+    AIManager& operator=(const AIManager&) = delete;
 
     // [수정] 모드(mode)를 인자로 받아 제안 생성
     void generate_suggestions(const std::string& current_input, AIMode mode);
+
+    // 비동기 요청 제출: 네트워크 호출은 워커 스레드에서 수행되고,
+    // 완료되면 notify_fd()가 읽기 가능 상태가 됨. 요청 번호를 반환.
+    // 같은 (입력, 모드, 컨텍스트) 요청이나 같은 입력의 통합 요청이 이미 대기/전송 중이면
+    // 새로 보내지 않고 그 요청에 합류 (이때는 기존 요청 번호를 반환)
+    // 같은 입력에 대해 이미 받은 모드의 답은 네트워크 없이 바로 완료됨
+    uint64_t submit_request(const std::string& current_input, AIMode mode);
+
+    // 통합 요청 사용 여부: 켜져 있으면 입력마다 첫 요청에서 세 모드의 답을 한 번에 받음
+    // (요청한 모드의 답을 먼저 스트리밍하고, 나머지 모드는 이어서 받아 둠). 기본값은
+    // $FISH_AI_COMBINED=1 이면 켬
+    void set_combined_requests(bool enabled);
+
+    // 설명 결과 재사용 문턱값: 캐시에 정확히 같은 입력이 없으면, 정규화한 입력의
+    // 추정 유사도가 이 값 이상인 이전 입력의 답을 씀 (0이면 끔). 기본값은
+    // $FISH_AI_SIMILARITY 또는 AISimilarityIndex::DEFAULT_THRESHOLD
+    void set_similarity_threshold(double threshold);
+
+    // 완료된 결과를 반영하고 상태를 반환 (메인 스레드 전용)
+    AIRequestStatus poll_request();
+
+    // 요청 완료 알림용 파일 디스크립터 (select 대상)
+    int notify_fd() const;
+
+    // 진행 중이거나 대기 중인 요청 취소 (전송 중이면 즉시 중단)
+    void cancel_request();
+
+    // 현재 입력이 요청 당시 입력과 다르면 취소 (취소했으면 true)
+    bool cancel_if_stale(const std::string& current_input);
+
+    // 연속 요청을 하나로 합치는 대기 시간 설정
+    void set_debounce(std::chrono::milliseconds debounce);
+
+    // 완료/취소 요청 수
+    AIRequestStats request_stats() const;
+
+    // 백그라운드에서 API 서버와의 연결(DNS/TCP/TLS)을 미리 맺어 둠
+    void prewarm_connection();
+
+    // 결과 캐시 통계 (적중/미스 카운터)
+    AICacheStats cache_stats() const;
+
+    // 요청/캐시 통계와 모드별 실행 지표(카운터, 단계별 지연)를 사람이 읽는 형식이나 JSON으로
+    std::string format_stats(bool json) const;
+
+    // API 서버 주소와 키 변경: 백엔드 목록을 Gemini 하나로 교체 (로컬 대체 서버 테스트용)
+    void set_backend(const std::string& base_url, const std::string& api_key);
+
+    // 백엔드 추가 (kind: "gemini" 또는 "openai"). 모르는 종류면 false
+    bool add_backend(const std::string& kind, const std::string& base_url,
+                     const std::string& model, const std::string& api_key);
+
+    // 헤지 요청 대기 시간: 응답 기록이 충분하면 백엔드의 p95를 쓰고, 그 전에는 이 값을 씀
+    // 음수면 헤지 요청을 보내지 않음 (실패 시 다음 백엔드로 넘어가는 것은 유지)
+    void set_hedge_delay(std::chrono::milliseconds delay);
+
+    // index번째 백엔드 통계 (없으면 false)
+    bool backend_stats(size_t index, uint64_t* requests, uint64_t* wins, long* p95_ms) const;
+    // index번째 백엔드의 회로 차단기 상태 (열려 있으면 open=true, 연속 실패 횟수)
+    bool backend_breaker(size_t index, bool* open, uint32_t* failures) const;
+
+    // 모드별 요청 제한 시간: 연결, 헤지 요청, 대체 백엔드 시도를 모두 포함한 전체 시간
+    void set_timeout(AIMode mode, std::chrono::milliseconds timeout);
+    // 회로 차단기가 열린 뒤 첫 확인 요청까지의 대기 시간
+    void set_breaker_cooldown(std::chrono::milliseconds cooldown);
+    // 요청 속도 제한: 분당 요청 수와 한 번에 몰아 보낼 수 있는 수 (per_minute가 0이면 끔,
+    // 429 응답의 Retry-After와 백오프는 그대로 따름). 기본값은 $FISH_AI_RATE_LIMIT,
+    // $FISH_AI_RATE_BURST 또는 분당 120개, 10개
+    void set_rate_limit(double per_minute, double burst);
+    // 속도 제한 통계 (토큰을 기다린 요청, 429 응답, 버린 요청)
+    AIRateLimitStats rate_limit_stats() const;
     
+    // ----- 제안 읽기: 발행된 스냅숏만 보므로 어느 스레드에서든 잠금 없이 호출 가능 -----
+
+    // 현재 제안 목록 스냅숏 (목록, 커서, 세대를 한 시점 기준으로 함께 읽을 때)
+    AISuggestionsView suggestions() const { return published_.read(); }
+
     // 다음 제안으로 순환 (자동완성 모드에서 주로 사용)
     void next_suggestion();
     
@@ -56,37 +198,264 @@ class AIManager {
     
     // 제안이 존재하는지 확인
     bool has_suggestions() const;
+
+    // 마지막 입력과 같은 명령어인지 확인 (중복 요청 방지용, 공백과 옵션 순서 차이는 무시)
+    bool is_same_input(const std::string& input) const;
+
+    // ----- 제안 작업 상태/히스토리를 바꾸는 호출: 요청 제출/반영과 함께 state_mutex_로 순서화됨 -----
     
     // 제안 초기화
     void clear_suggestions();
     
-    // 마지막 입력과 동일한지 확인 (중복 요청 방지용)
-    bool is_same_input(const std::string& input) const;
-    
     // 명령어 히스토리 관리
     void add_command_to_history(const std::string& command);
+    // 실행 시각(초)과 디렉토리를 이미 아는 명령어 (매니저가 생기기 전에 실행된 명령어)
+    void add_command_to_history(const std::string& command, long long timestamp,
+                                const std::string& cwd);
     void clear_history();
 
+    // fish 히스토리 파일을 히스토리 저장소로 적재
+    bool load_history(const std::string& history_path);
+    // 워커 스레드에서 적재 (첫 프롬프트를 막지 않음)
+    void load_history_in_background(const std::string& history_path);
+    AIHistoryStats history_stats() const;
+
+    // 작업 디렉토리 컨텍스트 사용 여부와 통계 (수집, 캐시 적중/미스, 무효화)
+    void set_directory_context(bool enabled);
+    AIDirectoryStats directory_stats() const;
+
+    // 프롬프트 토큰 예산 (넘치면 덜 중요한 컨텍스트부터 뺌)
+    void set_prompt_budget(size_t tokens);
+
+    // 작업 패턴 규칙 교체 (기본 규칙 + rules, 형식은 ai_workflow.h 참고)
+    void set_workflow_rules(const std::string& rules);
+
+    // private 모드 (`fish --private`): 입력이 디스크 캐시에 남지 않게 하고, 실행한 명령어를
+    // 히스토리에 넣지 않으며, 데몬에도 보내지 않음 (데몬은 자기 캐시와 히스토리에 남기므로)
+    void set_private_mode(bool enabled);
+
+    // ----- 공유 데몬 (ai_daemon.h) -----
+
+    // 세션 쪽: 데몬 소켓 경로 (빈 문자열이면 데몬을 쓰지 않음, private 모드에서는 끄고 기억만 함)
+    void set_daemon_socket(const std::string& path);
+
+    // 데몬 쪽: 세션 요청 하나의 번호를 받음. 세션이 연결을 끊으면 cancel_daemon_request로
+    // 그 요청의 전송을 바로 중단하고, 끝나면 close_daemon_request로 반납
+    uint64_t open_daemon_request();
+    void cancel_daemon_request(uint64_t id);
+    void close_daemon_request(uint64_t id);
+    // 데몬 쪽: 입력/모드/디렉토리에 대한 응답을 공유 캐시나 백엔드에서 가져옴 (블록됨)
+    // combined면 통합 요청 (mode가 맨 앞 섹션). id는 open_daemon_request()의 번호
+    std::string fetch_response(uint64_t id, const std::string& input, AIMode mode, bool combined,
+                               const std::string& cwd,
+                               const std::function<void(const std::string&)>& on_text,
+                               bool* timed_out);
+    // 데몬 쪽: 세션에서 실행한 명령어를 공유 히스토리에 기록
+    void record_command(const std::string& command, long long timestamp, const std::string& cwd);
+    // 데몬 쪽: 히스토리 파일 적재 (요청을 받기 전에 한 번, 이미 받은 명령어는 유지)
+    bool share_history(const std::string& history_path);
+
+#ifdef FISH_AI_BENCHMARK
+    // 벤치마크 전용: stage 단계를 text에 대해 한 번 실행하고 결과 크기를 반환
+    size_t run_bench_stage(AIBenchStage stage, const std::string& text, AIMode mode);
+#endif
+
 private:
-    std::string api_key_;
     
-    // 명령어 히스토리 큐
-    std::deque<CommandHistoryEntry> command_history_;
-    static const size_t MAX_HISTORY_SIZE = 20;
+    // 명령어 히스토리 저장소 (fish 히스토리 파일 + 세션 중 실행한 명령어)
+    AIHistoryStore history_;
+    WorkflowDetector workflows_;    // 최근 명령어의 작업 패턴 (증분 갱신)
+    static const size_t CONTEXT_RECENT_COMMANDS = 20;   // 프롬프트에 넣을 최근 명령어 수
+    static const size_t CONTEXT_DIRECTORY_COMMANDS = 5; // 프롬프트에 넣을 현재 디렉토리 명령어 수
+
+    // 프롬프트 조립 (state_mutex_ 안에서만 사용, 버퍼는 요청마다 재사용)
+    PromptBuilder prompt_builder_;
+    std::string prompt_buffer_;
+    std::string workflow_scratch_;
+    std::string cwd_scratch_;
+    std::vector<uint32_t> context_ids_;
+
+    // 작업 디렉토리 정보 (백그라운드에서 수집, inotify로 무효화). 프롬프트에는 캐시된 글만 씀
+    AIDirectoryContext directory_context_;
+    std::string directory_facts_;
+    std::string directory_details_;
     
-    // 생성된 제안 목록
+    // 제안 작업 상태: 쓰는 쪽 호출(요청 제출/반영, 초기화, 히스토리 변경)은 state_mutex_를
+    // 잡고 suggestions_를 고친 뒤 publish_suggestions()로 불변 스냅숏을 발행함.
+    // 읽는 쪽은 published_만 봄 (state_mutex_를 기다리지 않음)
+    mutable std::mutex state_mutex_;
     std::vector<AISuggestion> suggestions_;
-    size_t current_index_;
+    uint64_t generation_;
+    AISnapshot<AISuggestionSet> published_;
     
     // 상태 추적용 변수
     std::string last_input_;
+    std::string last_canonical_;    // last_input_의 정규화 형태 (입력이 바뀔 때만 다시 계산)
     AIMode current_mode_;
 
+    // last_input_에 대해 받아 둔 모드별 응답 (AIMode 값 위치, 입력이 바뀌면 비움)
+    // 통합 요청은 한 번에 모든 모드를 채우고, 단일 요청은 자기 모드만 채움
+    std::string mode_responses_[4];
+    bool mode_ready_[4];
+    bool combined_requests_;
+    int combined_first_;            // 지금 요청이 통합 요청이면 맨 앞 섹션의 모드 (아니면 0)
+    int stream_section_;            // 스트리밍 중인 통합 응답에서 지금 받는 섹션
+
+    // 모드/입력/컨텍스트별 응답 캐시 (메모리 LRU + 디스크)
+    AIResultCache cache_;
+    // 설명 답을 비슷한 입력에 재사용하기 위한 색인 (값은 cache_의 키)
+    AISimilarityIndex similar_;
+    std::atomic<uint64_t> similar_hits_;
+
+    // 히스토리 기반 로컬 자동완성: suggestions_의 앞쪽 local_count_개가 로컬 결과이고
+    // 원격 결과는 그 뒤에 합쳐짐
+    LocalCompletionEngine local_engine_;
+    size_t local_count_;
+    bool local_unreported_;         // 로컬 결과를 아직 리더에 알리지 않음
+
+    // 비동기 요청 처리용 워커 스레드 상태 (mutex_로 보호)
+    std::thread worker_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<uint64_t> request_seq_;  // 마지막으로 제출된 요청 번호 (이보다 오래된 요청은 취소 대상)
+    uint64_t queued_id_;            // 대기 중인 요청 번호 (0이면 없음)
+    std::string queued_prompt_;
+    std::string spare_prompt_;      // 워커가 다 쓴 프롬프트 버퍼 (메인 스레드가 재사용)
+    std::string queued_cache_key_;
+    std::string queued_input_;      // 데몬에 맡길 때 보낼 입력과 디렉토리
+    std::string queued_cwd_;
+    AIMode queued_mode_;
+    bool queued_combined_;
+    std::string queued_section_keys_[4];  // 통합 요청이면 모드별 섹션을 저장할 캐시 키
+    std::chrono::steady_clock::time_point queued_at_;
+    uint64_t active_id_;            // 워커가 처리 중인 요청 번호
+    std::string active_cache_key_;  // 처리 중인 요청의 캐시 키 (같은 요청 합류 판단용)
+    std::string active_input_;      // 처리 중인 통합 요청의 입력과 맨 앞 모드 (합류 판단용)
+    AIMode active_mode_;
+    bool active_combined_;
+    std::condition_variable flight_done_;  // 처리 중인 요청이 끝나면 알림 (동기 호출 합류용)
+    uint64_t completed_id_;         // 완료되었지만 아직 반영되지 않은 요청 번호
+    std::string completed_response_;
+    bool completed_timed_out_;      // 시간 초과로 잘린 응답인지
+    bool prewarm_requested_;        // 연결 미리 맺기는 세션당 한 번만
+    bool prewarm_pending_;
+    std::string pending_history_;   // 워커가 적재할 히스토리 파일 (비어 있으면 없음)
+    std::atomic<bool> shutting_down_;
+    int notify_pipe_[2];
+
+    // 디바운스 대기 시간과 완료/취소 카운터
+    std::chrono::milliseconds debounce_;
+    std::atomic<uint64_t> completed_count_;
+    std::atomic<uint64_t> cancelled_count_;
+    std::atomic<uint64_t> coalesced_count_;
+
+    // 모드별 실행 지표. 파싱 시간은 스트리밍 중 나눠서 걸리므로 요청 하나 동안 모아 두었다가
+    // 완료 시 기록 (메인 스레드 전용)
+    AIMetrics metrics_;
+    std::chrono::microseconds parse_time_;
+
+    // 공유 데몬: 세션 쪽 연결
+    AIDaemonClient daemon_;
+    std::string daemon_socket_;     // 설정된 소켓 경로 (private 모드가 끝나면 되돌림)
+    bool private_mode_;
+
+    // 스트리밍 응답: 워커가 stream_text_에 조각을 붙이고(mutex_로 보호),
+    // 메인 스레드는 stream_consumed_까지 처리한 뒤 완성된 줄만 제안으로 반영
+    bool streaming_;
+    std::string stream_text_;
+    size_t stream_consumed_;
+
+    // 요청을 보낼 백엔드 목록 (앞쪽이 우선). 목록 변경과 복사는 transfer_mutex_로 보호되며,
+    // 목록을 바꾸는 것은 메인 스레드뿐이므로 메인 스레드에서는 잠금 없이 읽음
+    // 전송은 잠금 안에서 복사한 목록으로 하므로, 전송 중에 목록이 바뀌어도 백엔드는 살아 있음
+    std::vector<std::shared_ptr<AIBackend>> backends_;
+    std::atomic<long> hedge_delay_ms_;
+    std::atomic<long> timeout_ms_[4];          // AIMode 값 위치에 모드별 제한 시간
+    std::atomic<long> breaker_cooldown_ms_;
+    AIRateLimiter rate_limiter_;               // 모든 백엔드 전송이 함께 씀 (할당량은 대개 키 단위)
+    bool probe_scheduled_;                     // 차단기 확인 요청 예약 여부 (mutex_로 보호)
+    std::chrono::steady_clock::time_point probe_at_;
+
+    // 재사용되는 HTTP 연결 (keep-alive, HTTP/2, DNS/TLS 세션 캐시)
+    // 모든 전송이 share 캐시 하나를 함께 씀 (첫 요청 시 생성, 그 뒤로 바뀌지 않음)
+    // 요청마다 multi 핸들 하나를, 백엔드 전송마다 easy 핸들(AITransfer) 하나를 빌려 쓰므로
+    // 여러 요청(데몬이 받은 세션 요청들)이 서로 기다리지 않고 동시에 전송됨
+    std::mutex transfer_mutex_;
+    CURLSH* curl_share_;
+
+    // 다 쓴 핸들은 돌려받아 재사용 (pool_mutex_로 보호)
+    // 쓰는 중인 multi 핸들은 취소 시 curl_multi_wakeup으로 즉시 깨우기 위해 기억해 둠
+    static const size_t MAX_IDLE_HANDLES = 8;
+    std::mutex pool_mutex_;
+    std::vector<CURLM*> busy_multis_;
+    std::vector<CURLM*> idle_multis_;
+    std::vector<std::unique_ptr<AITransfer>> idle_transfers_;
+
+    // 데몬이 받은 세션 요청 번호 (DAEMON_REQUEST 비트로 워커 요청 번호와 구분)
+    // 목록에 없는 번호는 취소된 것으로 봄
+    static const uint64_t DAEMON_REQUEST = 1ull << 63;
+    mutable std::mutex daemon_requests_mutex_;
+    uint64_t daemon_request_seq_;
+    std::vector<uint64_t> live_daemon_requests_;
+    std::mutex share_locks_[CURL_LOCK_DATA_LAST];
+
     // 내부 헬퍼 함수
-    std::string call_gemini_api(const std::string& prompt);
-    std::string analyze_context();
-    std::string detect_workflow_pattern();
-    void parse_suggestions(const std::string& response);
+    void start_worker_locked();
+    void notify_completion_locked(uint64_t id, std::string response, bool timed_out = false);
+    void clear_queued_locked();
+    void wake_reader();
+    void wake_transfer();
+    bool is_cancelled(uint64_t id) const;
+    uint64_t find_flight_locked(const std::string& key, const std::string& input,
+                                int* combined_first = nullptr) const;
+    void worker_loop();
+    bool ensure_connection();
+    bool copy_backends(std::vector<std::shared_ptr<AIBackend>>& out);
+    CURLM* acquire_multi();
+    void release_multi(CURLM* multi);
+    std::unique_ptr<AITransfer> acquire_transfer();
+    void release_transfer(std::unique_ptr<AITransfer> transfer);
+    void warm_connection();
+    CURLcode perform_transfer(CURLM* multi, CURL* handle, uint64_t id, bool* cancelled);
+    bool has_backend() const;
+    bool backend_available() const;
+    std::chrono::steady_clock::time_point request_deadline(AIMode mode) const;
+    void record_failure(AIBackend& backend);
+    void schedule_probe(std::chrono::steady_clock::time_point at);
+    void probe_backends();
+    void load_backends_from_env();
+    std::chrono::milliseconds hedge_delay(const AIBackend& backend) const;
+    void publish_suggestions();
+    void reset_for_input(const std::string& current_input, AIMode mode);
+    void clear_mode_results();
+    bool any_mode_ready() const;
+    void store_mode_results(const std::string& response, bool timed_out);
+    void store_sections(const std::string& response, const std::string& input, AIMode first,
+                        const std::string* keys, bool timed_out);
+    bool lookup_response(const std::string& key, const std::string& input, AIMode mode,
+                         std::string& response);
+    void store_response(const std::string& key, const std::string& input, AIMode mode,
+                        const std::string& response);
+    void fill_local_suggestions();
+    std::string cache_key(const std::string& current_input, AIMode mode,
+                          std::string_view context);
+    std::string_view build_prompt(const std::string& current_input, AIMode mode,
+                                  const std::string& cwd, bool combined = false);
+    void apply_response(const std::string& response);
+    size_t parse_stream_lines(const std::string& text);
+    size_t parse_stream_sections(std::string_view text);
+    std::string call_api(const std::string& prompt, AIMode mode,
+                         std::chrono::steady_clock::time_point deadline, uint64_t id = 0,
+                         const std::function<void(const std::string&)>& on_text = nullptr,
+                         bool* cancelled = nullptr, bool* timed_out = nullptr);
+    std::string call_backends(const std::string& prompt, AIMode mode,
+                              std::chrono::steady_clock::time_point deadline, uint64_t id,
+                              const std::function<void(const std::string&)>& on_text,
+                              bool* cancelled, bool* timed_out, bool* rate_limited);
+    void collect_context(const std::string& cwd);
+    void refill_workflows();
+    void parse_suggestions(std::string_view response);
+    bool has_local_command(std::string_view command) const;
 };
 
 #endif // FISH_AI_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "ai_metrics.h"
+#include <algorithm>
+#include <cstdio>
+
+static const char* const MODE_NAMES[AIMetrics::MODES] = {"", "generation", "explain", "diagnose"};
+
+static const char* const PHASE_NAMES[] = {
+    "prompt_build", "connect", "first_byte", "total", "parse",
+};
+
+static const char* const COUNTER_NAMES[] = {
+    "requests", "bytes_sent", "bytes_received", "empty_responses",
+    "parse_failures", "transport_errors", "http_errors", "timeouts",
+};
+
+static const size_t PHASE_COUNT = static_cast<size_t>(AIPhase::COUNT);
+static const size_t COUNTER_COUNT = static_cast<size_t>(AICounter::COUNT);
+
+// ---------------------------------------------------------
+// AILatencyHistogram 구현
+// ---------------------------------------------------------
+
+AILatencyHistogram::AILatencyHistogram() {
+    reset();
+}
+
+void AILatencyHistogram::record(std::chrono::microseconds latency) {
+    uint64_t us = latency.count() > 0 ? static_cast<uint64_t>(latency.count()) : 0;
+    size_t bucket = 0;
+    for (uint64_t v = us; v != 0 && bucket + 1 < BUCKETS; v >>= 1) bucket++;
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_us_.fetch_add(us, std::memory_order_relaxed);
+    uint64_t max = max_us_.load(std::memory_order_relaxed);
+    while (us > max && !max_us_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {}
+}
+
+void AILatencyHistogram::reset() {
+    for (auto& bucket : buckets_) bucket.store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+    sum_us_.store(0, std::memory_order_relaxed);
+    max_us_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t AILatencyHistogram::percentile_us(double q) const {
+    uint64_t total = 0;
+    for (const auto& bucket : buckets_) total += bucket.load(std::memory_order_relaxed);
+    if (total == 0) return 0;
+
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t upper = i == 0 ? 0 : (uint64_t(1) << i) - 1;
+            return std::min(upper, max_us());
+        }
+    }
+    return max_us();
+}
+
+// ---------------------------------------------------------
+// AIMetrics 구현
+// ---------------------------------------------------------
+
+size_t AIMetrics::index(int mode) {
+    return mode > 0 && static_cast<size_t>(mode) < MODES ? static_cast<size_t>(mode) : 0;
+}
+
+void AIMetrics::add(int mode, AICounter counter, uint64_t n) {
+    counters_[index(mode)][static_cast<size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+}
+
+void AIMetrics::record(int mode, AIPhase phase, std::chrono::microseconds latency) {
+    histograms_[index(mode)][static_cast<size_t>(phase)].record(latency);
+}
+
+void AIMetrics::reset() {
+    for (size_t m = 0; m < MODES; m++) {
+        for (auto& counter : counters_[m]) counter.store(0, std::memory_order_relaxed);
+        for (auto& histogram : histograms_[m]) histogram.reset();
+    }
+}
+
+uint64_t AIMetrics::counter(int mode, AICounter counter) const {
+    return counters_[index(mode)][static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+}
+
+const AILatencyHistogram& AIMetrics::histogram(int mode, AIPhase phase) const {
+    return histograms_[index(mode)][static_cast<size_t>(phase)];
+}
+
+// 모드마다 카운터 목록, 그리고 기록이 있는 단계마다 지연 요약 한 줄
+void AIMetrics::append_text(std::string& out) const {
+    char line[256];
+    for (size_t m = 1; m < MODES; m++) {
+        snprintf(line, sizeof line, "%s:\n", MODE_NAMES[m]);
+        out += line;
+        for (size_t c = 0; c < COUNTER_COUNT; c++) {
+            snprintf(line, sizeof line, "  %-18s %llu\n", COUNTER_NAMES[c],
+                     static_cast<unsigned long long>(counters_[m][c].load(std::memory_order_relaxed)));
+            out += line;
+        }
+        for (size_t p = 0; p < PHASE_COUNT; p++) {
+            const AILatencyHistogram& h = histograms_[m][p];
+            uint64_t count = h.count();
+            if (count == 0) continue;
+            snprintf(line, sizeof line,
+                     "  %-18s count %llu  mean %lluus  p50 %lluus  p99 %lluus  max %lluus\n",
+                     PHASE_NAMES[p], static_cast<unsigned long long>(count),
+                     static_cast<unsigned long long>(h.sum_us() / count),
+                     static_cast<unsigned long long>(h.percentile_us(0.5)),
+                     static_cast<unsigned long long>(h.percentile_us(0.99)),
+                     static_cast<unsigned long long>(h.max_us()));
+            out += line;
+        }
+    }
+}
+
+// {"generation":{"requests":N,...,"latency_us":{"total":{"count":N,"mean":..,"p50":..,"p99":..,"max":..},...}},...}
+void AIMetrics::append_json(std::string& out) const {
+    char field[160];
+    out += '{';
+    for (size_t m = 1; m < MODES; m++) {
+        if (m > 1) out += ',';
+        out += '"';
+        out += MODE_NAMES[m];
+        out += "\":{";
+        for (size_t c = 0; c < COUNTER_COUNT; c++) {
+            snprintf(field, sizeof field, "\"%s\":%llu,", COUNTER_NAMES[c],
+                     static_cast<unsigned long long>(counters_[m][c].load(std::memory_order_relaxed)));
+            out += field;
+        }
+        out += "\"latency_us\":{";
+        for (size_t p = 0; p < PHASE_COUNT; p++) {
+            const AILatencyHistogram& h = histograms_[m][p];
+            uint64_t count = h.count();
+            snprintf(field, sizeof field,
+                     "%s\"%s\":{\"count\":%llu,\"mean\":%llu,\"p50\":%llu,\"p99\":%llu,\"max\":%llu}",
+                     p > 0 ? "," : "", PHASE_NAMES[p], static_cast<unsigned long long>(count),
+                     static_cast<unsigned long long>(count ? h.sum_us() / count : 0),
+                     static_cast<unsigned long long>(h.percentile_us(0.5)),
+                     static_cast<unsigned long long>(h.percentile_us(0.99)),
+                     static_cast<unsigned long long>(h.max_us()));
+            out += field;
+        }
+        out += "}}";
+    }
+    out += '}';
+}
@@ -0,0 +1,85 @@
+#ifndef FISH_AI_METRICS_H
+#define FISH_AI_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ---------------------------------------------------------
+// AI 요청 실행 지표
+//  - 모드(AIMode 값)별 카운터와 단계별 지연 히스토그램
+//  - 모두 relaxed atomic이라 메인/워커 스레드에서 잠금 없이 기록
+//  - 조회는 각 값을 따로 읽으므로 기록 중에 읽으면 값들 사이가 조금 어긋날 수 있음
+// ---------------------------------------------------------
+
+// 지연을 나눠 재는 단계
+enum class AIPhase {
+    PROMPT_BUILD = 0,  // 컨텍스트 수집 + 프롬프트 조립 (메인 스레드)
+    CONNECT,           // TCP/TLS 연결 (연결을 재사용하면 기록하지 않음)
+    FIRST_BYTE,        // 전송 시작부터 첫 응답 바이트까지
+    TOTAL,             // 네트워크 호출 전체 (헤지/대체 백엔드 포함)
+    PARSE,             // 응답 정리 + 제안 파싱 (스트리밍이면 요청 하나의 합)
+    COUNT
+};
+
+// 모드별 카운터
+enum class AICounter {
+    REQUESTS = 0,      // 네트워크로 보낸 요청
+    BYTES_SENT,        // 보낸 바이트 (헤더 포함, 헤지 요청 포함)
+    BYTES_RECEIVED,    // 받은 바이트 (헤더 포함)
+    EMPTY_RESPONSES,   // 취소되지 않았는데 빈 응답으로 끝난 요청
+    PARSE_FAILURES,    // 응답은 있었지만 제안을 하나도 얻지 못한 요청
+    TRANSPORT_ERRORS,  // 연결/전송 오류 (curl 오류)
+    HTTP_ERRORS,       // HTTP 4xx/5xx 응답
+    TIMEOUTS,          // 제한 시간 초과
+    COUNT
+};
+
+// 지연 히스토그램: i번째 구간은 [2^(i-1), 2^i) 마이크로초 (0번은 1us 미만)
+class AILatencyHistogram {
+public:
+    static const size_t BUCKETS = 32;
+
+    AILatencyHistogram();
+
+    void record(std::chrono::microseconds latency);
+    void reset();
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum_us() const { return sum_us_.load(std::memory_order_relaxed); }
+    uint64_t max_us() const { return max_us_.load(std::memory_order_relaxed); }
+    // q 분위수 추정치 (해당 구간의 상한, 최대값을 넘지 않음). 기록이 없으면 0
+    uint64_t percentile_us(double q) const;
+
+private:
+    std::atomic<uint64_t> buckets_[BUCKETS];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_us_;
+    std::atomic<uint64_t> max_us_;
+};
+
+class AIMetrics {
+public:
+    static const size_t MODES = 4;  // AIMode 값 위치 (0번은 쓰지 않음)
+
+    void add(int mode, AICounter counter, uint64_t n = 1);
+    void record(int mode, AIPhase phase, std::chrono::microseconds latency);
+    void reset();
+
+    uint64_t counter(int mode, AICounter counter) const;
+    const AILatencyHistogram& histogram(int mode, AIPhase phase) const;
+
+    // 모드별 지표를 사람이 읽는 형식 또는 JSON 객체("modes" 값)로 out 뒤에 붙임
+    void append_text(std::string& out) const;
+    void append_json(std::string& out) const;
+
+private:
+    static size_t index(int mode);
+
+    std::atomic<uint64_t> counters_[MODES][static_cast<size_t>(AICounter::COUNT)] = {};
+    AILatencyHistogram histograms_[MODES][static_cast<size_t>(AIPhase::COUNT)];
+};
+
+#endif // FISH_AI_METRICS_H
@@ -0,0 +1,308 @@
+#include "ai_prompt.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+// ---------------------------------------------------------
+// 고정 문구 (모드 번호는 AIMode 값과 같음)
+// ---------------------------------------------------------
+static const std::string_view PROMPT_HEAD = "You are a Linux shell expert assistant.\n\n";
+static const std::string_view PROMPT_TAIL = "\nNO markdown. Output:";
+
+static const std::string_view MODE_BODIES[] = {
+    // 0: 알 수 없는 모드
+    "",
+    // 1: 자동 완성 (Alt+W)
+    "TASK: Provide 3-5 most useful command completion options.\n"
+    "OUTPUT FORMAT: COMMAND | DESCRIPTION\n"
+    "RULES:\n"
+    "- If input is incomplete, complete it.\n"
+    "- If input is a question (Korean/English), convert intent to a command.\n"
+    "- One option per line.\n"
+    "Example:\nls -al | List all files details\n",
+    // 2: 설명 (Alt+Q)
+    "TASK: Explain exactly what the User Input command does in KOREAN.\n"
+    "RULES:\n"
+    "- Explain flags/options clearly.\n"
+    "- Use friendly tone.\n"
+    "- Keep it under 2 sentences.\n"
+    "OUTPUT FORMAT: ORIGINAL_COMMAND | EXPLANATION_IN_KOREAN\n"
+    "Example:\ntar -czvf a.tar.gz . | 현재 폴더를 gzip으로 압축합니다.\n",
+    // 3: 진단 (Alt+R)
+    "TASK: Analyze the User Input command for safety risks, efficiency, or improvements.\n"
+    "RULES:\n"
+    "- If dangerous (e.g., rm -rf /), warn strongly.\n"
+    "- If safe but old, suggest modern alternatives.\n"
+    "- If correct, just say 'Safe and correct'.\n"
+    "- Answer in KOREAN.\n"
+    "OUTPUT FORMAT: ORIGINAL_COMMAND | DIAGNOSIS_IN_KOREAN\n"
+    "Example:\nrm -rf / | ⚠️ 루트 디렉토리가 삭제될 수 있어 매우 위험합니다!\n",
+};
+static const size_t MODE_COUNT = sizeof(MODE_BODIES) / sizeof(MODE_BODIES[0]);
+
+// 통합 요청: 작업마다 제목 줄을 붙여서 모두 요청 (제목은 "### " + 모드 이름)
+static const std::string_view COMBINED_HEAD =
+    "Answer ALL of the tasks below for the same User Input, in the order given.\n"
+    "Start each answer with its heading line exactly as written, then follow that task's OUTPUT FORMAT.\n\n";
+static const std::string_view SECTION_PREFIX = "### ";
+static const std::string_view SECTION_NAMES[] = {"", "GENERATION", "EXPLAIN", "DIAGNOSE"};
+
+// 섹션 제목 ("User's recent activity:", "Recent commands:" 등)에 드는 토큰 여유분
+static const size_t SECTION_HEADER_TOKENS = 24;
+static const size_t DEFAULT_TOKEN_BUDGET = 512;
+
+// 최근 명령어 중 이 개수만큼은 디렉토리 명령어보다 중요하게 취급
+static const size_t PRIMARY_RECENT = 5;
+
+// ---------------------------------------------------------
+// PromptBuilder 구현
+// ---------------------------------------------------------
+
+PromptBuilder::PromptBuilder() : budget_(DEFAULT_TOKEN_BUDGET) {
+    const char* env = std::getenv("FISH_AI_PROMPT_TOKENS");
+    if (env && atoi(env) > 0) budget_ = atoi(env);
+}
+
+size_t PromptBuilder::estimate_tokens(std::string_view text) {
+    size_t ascii = 0, other = 0;
+    for (unsigned char c : text) {
+        if (c < 0x80) {
+            ascii++;
+        } else if ((c & 0xC0) != 0x80) {
+            other++;  // UTF-8 문자의 첫 바이트만 셈
+        }
+    }
+    return (ascii + 3) / 4 + other;
+}
+
+// 공백 차이를 무시하고 같은 명령어인지 비교 ("git  add ." == "git add .")
+static bool same_command(std::string_view a, std::string_view b) {
+    auto is_space = [](char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; };
+    size_t i = 0, j = 0;
+    for (;;) {
+        bool space_a = false, space_b = false;
+        while (i < a.size() && is_space(a[i])) i++, space_a = true;
+        while (j < b.size() && is_space(b[j])) j++, space_b = true;
+        if (i == a.size() || j == b.size()) return i == a.size() && j == b.size();
+        if (space_a != space_b && i > 0 && j > 0) return false;
+        if (a[i++] != b[j++]) return false;
+    }
+}
+
+void PromptBuilder::reset() {
+    workflows_ = std::string_view();
+    directory_facts_ = std::string_view();
+    directory_details_ = std::string_view();
+    lines_.clear();
+}
+
+void PromptBuilder::set_workflows(std::string_view workflows) {
+    workflows_ = workflows;
+}
+
+void PromptBuilder::set_directory(std::string_view facts, std::string_view details) {
+    directory_facts_ = facts;
+    directory_details_ = details;
+}
+
+bool PromptBuilder::has_context() const {
+    return !workflows_.empty() || !directory_facts_.empty() || !lines_.empty();
+}
+
+void PromptBuilder::add_line(std::string_view text, Section section) {
+    size_t tokens = estimate_tokens(text.substr(0, MAX_LINE_BYTES)) + 1;  // "- "와 줄바꿈
+    lines_.push_back(Line{text, section, 0, static_cast<uint16_t>(tokens), true});
+}
+
+void PromptBuilder::add_recent(std::string_view command) {
+    if (command.find_first_not_of(" \t\r\n") == std::string_view::npos) return;
+    // 같은 명령어는 가장 최근 것 하나만 남김
+    for (auto it = lines_.begin(); it != lines_.end(); ++it) {
+        if (it->section == RECENT && same_command(it->text, command)) {
+            lines_.erase(it);
+            break;
+        }
+    }
+    add_line(command, RECENT);
+}
+
+void PromptBuilder::add_directory(std::string_view command) {
+    if (command.find_first_not_of(" \t\r\n") == std::string_view::npos) return;
+    // 이미 최근 명령어에 있으면 생략
+    for (const auto& line : lines_) {
+        if (same_command(line.text, command)) return;
+    }
+    add_line(command, DIRECTORY);
+}
+
+// 예산을 넘으면 우선순위가 낮은 줄부터 제외
+// 우선순위: 작업 패턴 > 작업 디렉토리 정보 > 최근 5개(최신 순) > 디렉토리 명령어(빈도 순) >
+//           변경 파일/항목 목록 > 나머지 최근 명령어
+void PromptBuilder::apply_budget(size_t fixed_tokens) {
+    size_t recent_total = 0, directory_rank = 0;
+    for (const auto& line : lines_) {
+        if (line.section == RECENT) recent_total++;
+    }
+
+    size_t total = fixed_tokens + estimate_tokens(workflows_) +
+                   estimate_tokens(directory_facts_) + estimate_tokens(directory_details_);
+    size_t recent_rank = recent_total;
+    for (auto& line : lines_) {
+        if (line.section == RECENT) {
+            size_t age = --recent_rank;  // 0이 가장 최근
+            line.priority = static_cast<uint16_t>(age < PRIMARY_RECENT ? 3000 - age : 1000 - age);
+        } else {
+            line.priority = static_cast<uint16_t>(2000 - directory_rank++);
+        }
+        line.keep = true;
+        total += line.tokens;
+    }
+    if (total <= budget_) return;
+
+    order_.clear();
+    for (size_t i = 0; i < lines_.size(); i++) order_.push_back(static_cast<uint16_t>(i));
+    std::sort(order_.begin(), order_.end(), [this](uint16_t a, uint16_t b) {
+        return lines_[a].priority < lines_[b].priority;
+    });
+    for (uint16_t i : order_) {
+        if (total <= budget_) break;
+        if (lines_[i].priority >= 1000 && !directory_details_.empty()) {
+            total -= estimate_tokens(directory_details_);
+            directory_details_ = std::string_view();
+            if (total <= budget_) break;
+        }
+        lines_[i].keep = false;
+        total -= lines_[i].tokens;
+    }
+    // 명령어를 모두 빼도 넘치면 디렉토리 정보, 작업 패턴 요약 순으로 제외
+    if (total > budget_ && !directory_details_.empty()) {
+        total -= estimate_tokens(directory_details_);
+        directory_details_ = std::string_view();
+    }
+    if (total > budget_ && !directory_facts_.empty()) {
+        total -= estimate_tokens(directory_facts_);
+        directory_facts_ = std::string_view();
+    }
+    if (total > budget_) workflows_ = std::string_view();
+}
+
+// 공백을 한 칸으로 줄이고 너무 긴 명령어는 잘라서 붙임
+void PromptBuilder::append_compact(std::string& out, std::string_view text) {
+    size_t start = out.size();
+    bool pending_space = false;
+    for (char c : text) {
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            pending_space = out.size() > start;
+            continue;
+        }
+        if (out.size() - start >= MAX_LINE_BYTES) {
+            // UTF-8 문자 중간에서 자르지 않도록 이어지는 바이트는 버림
+            while (out.size() > start && (static_cast<unsigned char>(out.back()) & 0xC0) == 0x80) {
+                out.pop_back();
+            }
+            if (out.size() > start) out.pop_back();
+            out += "...";
+            return;
+        }
+        if (pending_space) out += ' ';
+        pending_space = false;
+        out += c;
+    }
+}
+
+size_t PromptBuilder::fixed_tokens(std::string_view body, const std::string& input) const {
+    return estimate_tokens(PROMPT_HEAD) + estimate_tokens(body) + estimate_tokens(PROMPT_TAIL) +
+           estimate_tokens(input) + SECTION_HEADER_TOKENS;
+}
+
+std::string_view PromptBuilder::build(int mode, const std::string& input, std::string& out) {
+    std::string_view body = MODE_BODIES[mode > 0 && static_cast<size_t>(mode) < MODE_COUNT ? mode : 0];
+    apply_budget(fixed_tokens(body, input));
+    return assemble(body, input, out);
+}
+
+std::string_view PromptBuilder::build_combined(int mode, const std::string& input, std::string& out) {
+    if (mode <= 0 || static_cast<size_t>(mode) >= MODE_COUNT) return build(mode, input, out);
+    // 다른 작업 문구만큼 길어지지만 컨텍스트는 단일 요청 기준으로 고름
+    apply_budget(fixed_tokens(MODE_BODIES[mode], input));
+
+    combined_body_.assign(COMBINED_HEAD);
+    auto add_task = [this](size_t task) {
+        combined_body_ += SECTION_PREFIX;
+        combined_body_ += SECTION_NAMES[task];
+        combined_body_ += "\n";
+        combined_body_ += MODE_BODIES[task];
+        combined_body_ += "\n";
+    };
+    add_task(mode);
+    for (size_t task = 1; task < MODE_COUNT; task++) {
+        if (task != static_cast<size_t>(mode)) add_task(task);
+    }
+    return assemble(combined_body_, input, out);
+}
+
+// "### EXPLAIN", "## Explain:", "**DIAGNOSE**" 같은 줄 (모델이 꾸밈을 조금 바꿔도 인식)
+int PromptBuilder::section_mode(std::string_view line) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string_view::npos || (line[start] != '#' && line[start] != '*')) return 0;
+    line.remove_prefix(start);
+    size_t name = line.find_first_not_of("#* \t");
+    size_t end = line.find_last_not_of("#*: \t\r");
+    if (name == std::string_view::npos || end < name) return 0;
+    line = line.substr(name, end + 1 - name);
+    for (size_t task = 1; task < MODE_COUNT; task++) {
+        std::string_view expected = SECTION_NAMES[task];
+        if (line.size() != expected.size()) continue;
+        bool same = true;
+        for (size_t i = 0; i < line.size() && same; i++) {
+            same = toupper(static_cast<unsigned char>(line[i])) == expected[i];
+        }
+        if (same) return static_cast<int>(task);
+    }
+    return 0;
+}
+
+// 고정 문구와 예산 안의 컨텍스트로 프롬프트 조립 (apply_budget 다음에 호출)
+std::string_view PromptBuilder::assemble(std::string_view body, const std::string& input,
+                                         std::string& out) {
+    out.clear();
+    out += PROMPT_HEAD;
+
+    size_t context_start = out.size(), context_end = out.size();
+    bool any_line = std::any_of(lines_.begin(), lines_.end(), [](const Line& l) { return l.keep; });
+    bool activity = !workflows_.empty() || any_line;
+    if (!directory_facts_.empty() || activity) {
+        // 디렉토리 정보가 없으면 컨텍스트는 제목 뒤부터 (이전과 같은 캐시 키)
+        out += directory_facts_;
+        if (activity) out += "User's recent activity:\n";
+        if (directory_facts_.empty()) context_start = out.size();
+        if (!workflows_.empty()) {
+            out += "Context: ";
+            out += workflows_;
+            out += "\n";
+        }
+        for (Section section : {RECENT, DIRECTORY}) {
+            bool header = false;
+            for (const auto& line : lines_) {
+                if (line.section != section || !line.keep) continue;
+                if (!header) {
+                    out += section == RECENT ? "Recent commands:\n" : "Frequently used in this directory:\n";
+                    header = true;
+                }
+                out += "- ";
+                append_compact(out, line.text);
+                out += "\n";
+            }
+        }
+        context_end = out.size();
+        out += directory_details_;
+        out += "\n";
+    }
+
+    out += "User Input: \"";
+    out += input;
+    out += "\"\n\n";
+    out += body;
+    out += PROMPT_TAIL;
+    return std::string_view(out.data() + context_start, context_end - context_start);
+}
@@ -0,0 +1,79 @@
+#ifndef FISH_AI_PROMPT_H
+#define FISH_AI_PROMPT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ---------------------------------------------------------
+// 토큰 예산이 있는 프롬프트 조립기
+//  - 모드별 고정 문구(시스템/작업/규칙/예시)는 미리 만들어 두고 길이만 더함
+//  - 컨텍스트 줄(작업 패턴, 작업 디렉토리 정보, 최근 명령어, 디렉토리 명령어)은
+//    중복 제거/공백 정리 후 예산을 넘으면 덜 중요한 줄부터 뺌
+//  - 결과는 호출자가 넘긴 버퍼에 씀 (용량 재사용, 요청마다 할당 없음)
+// 컨텍스트 줄은 string_view로 받으므로 build()까지 원본이 유효해야 함. 메인 스레드 전용.
+// ---------------------------------------------------------
+
+class PromptBuilder {
+public:
+    PromptBuilder();
+
+    // 프롬프트 전체의 토큰 예산 (기본값: $FISH_AI_PROMPT_TOKENS 또는 512)
+    void set_token_budget(size_t tokens) { budget_ = tokens; }
+    size_t token_budget() const { return budget_; }
+
+    // 컨텍스트 수집 (요청마다 reset 후 추가)
+    void reset();
+    void set_workflows(std::string_view workflows);
+    // 작업 디렉토리 정보 (AIDirectoryContext의 글). facts는 컨텍스트(캐시 키)에 넣고,
+    // 자주 바뀌는 details는 컨텍스트 뒤에 붙여서 파일을 고칠 때마다 키가 바뀌지 않게 함
+    void set_directory(std::string_view facts, std::string_view details);
+    void add_recent(std::string_view command);      // 오래된 것부터 순서대로
+    void add_directory(std::string_view command);   // 중요한 것부터 순서대로
+    bool has_context() const;
+
+    // 프롬프트를 out에 조립하고, out 안에서 컨텍스트 부분을 돌려줌 (캐시 키용)
+    std::string_view build(int mode, const std::string& input, std::string& out);
+
+    // 세 모드의 답을 한 번에 받는 통합 프롬프트: mode의 작업을 먼저, 나머지는 모드 순서대로.
+    // 각 답은 제목 줄("### GENERATION" 등)로 시작하게 함. 컨텍스트는 build(mode, ...)와 같은
+    // 예산으로 고르므로 돌려주는 컨텍스트 부분(캐시 키)도 단일 요청과 같음
+    std::string_view build_combined(int mode, const std::string& input, std::string& out);
+
+    // 통합 응답의 제목 줄이면 그 모드 번호, 아니면 0
+    static int section_mode(std::string_view line);
+
+    // 대략적인 토큰 수 (ASCII 4바이트당 1, 그 밖의 문자는 글자당 1)
+    static size_t estimate_tokens(std::string_view text);
+
+    static const size_t MAX_LINE_BYTES = 160;  // 이보다 긴 명령어는 잘라서 넣음
+
+private:
+    enum Section : uint8_t { WORKFLOWS, RECENT, DIRECTORY };
+
+    struct Line {
+        std::string_view text;
+        Section section;
+        uint16_t priority;   // 클수록 중요 (예산 초과 시 작은 것부터 제외)
+        uint16_t tokens;
+        bool keep;
+    };
+
+    size_t budget_;
+    std::string combined_body_;      // 통합 프롬프트의 작업 문구 (재사용)
+    std::string_view workflows_;
+    std::string_view directory_facts_;
+    std::string_view directory_details_;
+    std::vector<Line> lines_;        // 재사용 (용량 유지)
+    std::vector<uint16_t> order_;    // 제외 순서 계산용 (재사용)
+
+    void add_line(std::string_view text, Section section);
+    size_t fixed_tokens(std::string_view body, const std::string& input) const;
+    std::string_view assemble(std::string_view body, const std::string& input, std::string& out);
+    void apply_budget(size_t fixed_tokens);
+    static void append_compact(std::string& out, std::string_view text);
+};
+
+#endif // FISH_AI_PROMPT_H
@@ -0,0 +1,130 @@
+#include "ai_rate_limit.h"
+#include <algorithm>
+
+// ---------------------------------------------------------
+// AIRateLimiter 구현
+// ---------------------------------------------------------
+
+AIRateLimiter::AIRateLimiter()
+    : rate_(0), burst_(1), tokens_(1), refilled_at_(Clock::now()), paused_until_(),
+      backoff_step_(0),
+      jitter_(static_cast<std::minstd_rand::result_type>(
+          Clock::now().time_since_epoch().count())),
+      next_ticket_(0), stats_{0, 0, 0} {}
+
+void AIRateLimiter::configure(double rate, double burst) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rate_ = rate > 0 ? rate : 0;
+        burst_ = std::max(1.0, burst);
+        tokens_ = burst_;
+        refilled_at_ = Clock::now();
+    }
+    cv_.notify_all();
+}
+
+// 먼저 토큰을 받을 쪽인지: 우선순위가 높은 것, 같으면 나중에 온 것
+bool AIRateLimiter::before(const Waiter* a, const Waiter* b) {
+    if (a->priority != b->priority) return a->priority > b->priority;
+    return a->ticket > b->ticket;
+}
+
+// 지난 시간만큼 토큰을 채움 (429로 쉬는 동안은 채우지 않음)
+void AIRateLimiter::refill_locked(Clock::time_point now) {
+    if (now <= refilled_at_) return;
+    if (rate_ > 0) {
+        double elapsed = std::chrono::duration<double>(now - refilled_at_).count();
+        tokens_ = std::min(burst_, tokens_ + elapsed * rate_);
+    }
+    refilled_at_ = now;
+}
+
+// 다음 토큰을 쓸 수 있는 시각 (지금 쓸 수 있으면 now)
+AIRateLimiter::Clock::time_point AIRateLimiter::ready_at_locked(Clock::time_point now) const {
+    if (now < paused_until_) return paused_until_;
+    if (rate_ <= 0 || tokens_ >= 1) return now;
+    auto wait = std::chrono::duration<double>((1 - tokens_) / rate_);
+    return now + std::chrono::duration_cast<Clock::duration>(wait) + Clock::duration(1);
+}
+
+void AIRateLimiter::remove_locked(Waiter* waiter) {
+    waiters_.erase(std::remove(waiters_.begin(), waiters_.end(), waiter), waiters_.end());
+}
+
+bool AIRateLimiter::acquire(int priority, Clock::time_point deadline,
+                            const std::function<bool()>& cancelled) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Waiter self{priority, ++next_ticket_, false};
+    waiters_.push_back(&self);
+    if (waiters_.size() > QUEUE_CAPACITY) {
+        // 대기열이 넘치면 가장 뒤의 요청을 밀어냄 (방금 온 요청일 수도 있음)
+        auto last = std::min_element(waiters_.begin(), waiters_.end(),
+                                     [](const Waiter* a, const Waiter* b) { return before(b, a); });
+        (*last)->evicted = true;
+        cv_.notify_all();
+    }
+
+    bool waited = false;
+    for (;;) {
+        Clock::time_point now = Clock::now();
+        refill_locked(now);
+        Clock::time_point ready = ready_at_locked(now);
+        // 제한 시간 안에 보낼 수 없는 요청은 기다리지 않고 버림
+        if (self.evicted || (cancelled && cancelled()) || ready > deadline || now >= deadline) {
+            remove_locked(&self);
+            stats_.dropped++;
+            cv_.notify_all();
+            return false;
+        }
+        bool first = std::none_of(waiters_.begin(), waiters_.end(),
+                                  [&self](const Waiter* other) { return before(other, &self); });
+        if (ready <= now && first) {
+            if (rate_ > 0) tokens_ -= 1;
+            remove_locked(&self);
+            if (waited) stats_.throttled++;
+            cv_.notify_all();
+            return true;
+        }
+        // 앞선 요청이 토큰을 가져가면 깨어나서 다시 확인
+        waited = true;
+        cv_.wait_until(lock, ready > now ? std::min(ready, deadline) : deadline);
+    }
+}
+
+void AIRateLimiter::wake() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cv_.notify_all();
+}
+
+std::chrono::milliseconds AIRateLimiter::throttled(Clock::time_point now,
+                                                   std::chrono::milliseconds retry_after) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.rate_limited++;
+    std::chrono::milliseconds pause;
+    if (retry_after.count() > 0) {
+        pause = std::min(retry_after, std::chrono::milliseconds(MAX_RETRY_AFTER_MS));
+    } else {
+        // 지수 백오프의 절반은 고정, 절반은 무작위 (여러 세션이 같은 시각에 다시 몰리지 않게)
+        long cap = BACKOFF_BASE_MS << std::min<uint32_t>(backoff_step_, 16);
+        cap = std::min(cap, BACKOFF_MAX_MS);
+        std::uniform_int_distribution<long> half(0, cap / 2);
+        pause = std::chrono::milliseconds(cap / 2 + half(jitter_));
+        backoff_step_++;
+    }
+    refill_locked(now);
+    paused_until_ = std::max(paused_until_, now + pause);
+    // 쉬는 동안 토큰이 쌓이지 않게 하고, 끝나면 거절된 요청을 바로 다시 보낼 수 있게 둠
+    tokens_ = 1;
+    refilled_at_ = paused_until_;
+    return pause;
+}
+
+void AIRateLimiter::succeeded() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    backoff_step_ = 0;
+}
+
+AIRateLimitStats AIRateLimiter::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
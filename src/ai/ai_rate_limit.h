@@ -0,0 +1,92 @@
+#ifndef FISH_AI_RATE_LIMIT_H
+#define FISH_AI_RATE_LIMIT_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <vector>
+
+// ---------------------------------------------------------
+// 클라이언트 쪽 요청 속도 제한
+//  - 토큰 버킷: 초당 rate개씩 채워지고 최대 burst개까지 모임. 요청 하나가 토큰 하나를 씀
+//  - 서버가 429로 답하면 Retry-After 동안(없으면 지터를 준 지수 백오프 동안) 아무것도
+//    보내지 않음. 성공 응답이 오면 백오프 단계를 처음으로 되돌림
+//  - 토큰을 기다리는 요청은 작은 대기열에 들어가고, 우선순위가 높은 것부터, 같으면
+//    나중에 온 것부터 토큰을 받음. 대기열이 넘치면 가장 뒤의 요청을 버림
+//  - 제한 시간 안에 토큰을 받을 수 없거나 취소된(더 새로운 입력에 밀린) 요청은
+//    기다리지 않고 바로 버림
+// 스레드 안전.
+// ---------------------------------------------------------
+
+// 속도 제한 통계
+struct AIRateLimitStats {
+    uint64_t throttled;     // 토큰을 기다린 뒤 보낸 요청 수
+    uint64_t rate_limited;  // 서버가 429로 답한 수
+    uint64_t dropped;       // 토큰을 받지 못하고 버린 요청 수 (취소, 제한 시간, 대기열 넘침)
+};
+
+class AIRateLimiter {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const size_t QUEUE_CAPACITY = 4;            // 토큰을 기다릴 수 있는 요청 수
+    static constexpr long BACKOFF_BASE_MS = 500;       // Retry-After가 없을 때 첫 백오프
+    static constexpr long BACKOFF_MAX_MS = 30000;
+    static constexpr long MAX_RETRY_AFTER_MS = 300000; // 이보다 긴 Retry-After는 잘라냄
+
+    AIRateLimiter();
+
+    AIRateLimiter(const AIRateLimiter&) = delete;
+    AIRateLimiter& operator=(const AIRateLimiter&) = delete;
+
+    // 초당 요청 수와 한 번에 몰아 보낼 수 있는 수. rate가 0 이하면 토큰 제한 없음
+    // (429 대기는 그대로 적용). 버킷은 가득 찬 상태로 다시 시작
+    void configure(double rate, double burst);
+
+    // 토큰 하나를 받을 때까지 기다림. 받으면 true
+    // deadline 안에 받을 수 없거나, 대기열에서 밀려나거나, cancelled()가 true가 되면 false
+    // cancelled는 잠금 안에서 불리므로 가벼워야 함 (wake()가 불리면 다시 확인)
+    bool acquire(int priority, Clock::time_point deadline, const std::function<bool()>& cancelled);
+
+    // 기다리는 요청이 cancelled를 다시 확인하게 함
+    void wake();
+
+    // 서버가 429로 답함: retry_after(0이면 백오프) 동안 보내지 않음. 쉬는 시간을 반환
+    std::chrono::milliseconds throttled(Clock::time_point now, std::chrono::milliseconds retry_after);
+
+    // 정상 응답: 백오프 단계를 처음으로
+    void succeeded();
+
+    AIRateLimitStats stats() const;
+
+private:
+    struct Waiter {
+        int priority;
+        uint64_t ticket;  // 도착 순서 (클수록 새 요청)
+        bool evicted;
+    };
+
+    static bool before(const Waiter* a, const Waiter* b);
+    void refill_locked(Clock::time_point now);
+    Clock::time_point ready_at_locked(Clock::time_point now) const;
+    void remove_locked(Waiter* waiter);
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    double rate_;                    // 초당 토큰 (0 이하면 제한 없음)
+    double burst_;
+    double tokens_;
+    Clock::time_point refilled_at_;  // 마지막으로 토큰을 채운 시각
+    Clock::time_point paused_until_; // 429 이후 다시 보낼 수 있는 시각
+    uint32_t backoff_step_;
+    std::minstd_rand jitter_;
+    std::vector<Waiter*> waiters_;
+    uint64_t next_ticket_;
+    AIRateLimitStats stats_;
+};
+
+#endif // FISH_AI_RATE_LIMIT_H
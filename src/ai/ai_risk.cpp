@@ -0,0 +1,538 @@
+#include "ai_risk.h"
+#include <cstddef>
+
+// ---------------------------------------------------------
+// 경고 문구 (진단 모드 응답과 같은 어조)
+// ---------------------------------------------------------
+static const std::string_view MSG_ROOT = "⚠️ 루트 디렉토리 전체가 삭제될 수 있어 매우 위험합니다!";
+static const std::string_view MSG_HOME = "⚠️ 홈 디렉토리 전체가 삭제되어 매우 위험합니다!";
+static const std::string_view MSG_SYSTEM = "⚠️ 시스템 디렉토리가 삭제되어 시스템이 망가질 수 있습니다!";
+static const std::string_view MSG_CWD_ALL = "주의: 현재 디렉토리의 모든 파일이 확인 없이 삭제됩니다.";
+static const std::string_view MSG_DISK = "⚠️ 디스크 장치에 직접 써서 데이터가 모두 지워집니다!";
+static const std::string_view MSG_MKFS = "⚠️ 장치를 새로 포맷해서 데이터가 모두 지워집니다!";
+static const std::string_view MSG_PERMISSIONS =
+    "⚠️ 시스템 전체의 권한이나 소유자가 바뀌어 시스템이 망가질 수 있습니다!";
+static const std::string_view MSG_777 = "주의: 모든 사용자에게 읽기/쓰기/실행 권한을 주어 보안상 위험합니다.";
+static const std::string_view MSG_FIND_DELETE = "⚠️ 시스템 전체에서 파일을 찾아 삭제하므로 매우 위험합니다!";
+static const std::string_view MSG_KILL_ALL = "⚠️ 내 모든 프로세스를 종료해서 세션이 끝납니다!";
+static const std::string_view MSG_FORK_BOMB = "⚠️ 포크 폭탄입니다. 프로세스가 끝없이 늘어나 시스템이 멈춥니다!";
+static const std::string_view MSG_PIPE_SHELL =
+    "주의: 인터넷에서 받은 스크립트를 내용 확인 없이 바로 실행합니다.";
+static const std::string_view MSG_FORCE_PUSH = "주의: 원격 브랜치의 기록을 덮어써서 다른 사람의 커밋이 사라질 수 있습니다.";
+static const std::string_view MSG_RESET_HARD = "주의: 커밋하지 않은 변경 사항이 모두 사라집니다.";
+static const std::string_view MSG_GIT_CLEAN = "주의: 추적하지 않는 파일이 모두 삭제됩니다.";
+
+// ---------------------------------------------------------
+// 단어 분류
+// ---------------------------------------------------------
+
+enum class Program { NONE, OTHER, RM, DD, MKFS, CHMOD, CHOWN, FIND, KILL, GIT, DOWNLOADER, SHELL };
+
+// 인자가 가리키는 대상 (큰 값일수록 위험)
+enum class Target { NONE, CWD_ALL, SYSTEM, HOME, ROOT };
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool starts_with(std::string_view text, std::string_view prefix) {
+    return text.substr(0, prefix.size()) == prefix;
+}
+
+// 양쪽을 감싼 따옴표 하나 제거 ("\"$HOME\"" → "$HOME")
+static std::string_view unquote(std::string_view word) {
+    if (word.size() >= 2 && (word[0] == '\'' || word[0] == '"') && word.back() == word[0]) {
+        return word.substr(1, word.size() - 2);
+    }
+    return word;
+}
+
+// 경로 앞부분과 '\' 별칭 우회 제거 ("/bin/rm", "\rm" → "rm")
+static std::string_view program_name(std::string_view word) {
+    word = unquote(word);
+    if (!word.empty() && word[0] == '\\') word.remove_prefix(1);
+    size_t slash = word.rfind('/');
+    return slash == std::string_view::npos ? word : word.substr(slash + 1);
+}
+
+static Program classify_program(std::string_view name) {
+    static const struct {
+        std::string_view name;
+        Program program;
+    } PROGRAMS[] = {
+        {"rm", Program::RM},           {"dd", Program::DD},        {"mkfs", Program::MKFS},
+        {"mke2fs", Program::MKFS},     {"mkswap", Program::MKFS},  {"wipefs", Program::MKFS},
+        {"shred", Program::MKFS},      {"chmod", Program::CHMOD},  {"chown", Program::CHOWN},
+        {"chgrp", Program::CHOWN},     {"find", Program::FIND},    {"kill", Program::KILL},
+        {"git", Program::GIT},         {"curl", Program::DOWNLOADER}, {"wget", Program::DOWNLOADER},
+        {"sh", Program::SHELL},        {"bash", Program::SHELL},   {"zsh", Program::SHELL},
+        {"dash", Program::SHELL},      {"ksh", Program::SHELL},    {"fish", Program::SHELL},
+        {"python", Program::SHELL},    {"python3", Program::SHELL}, {"perl", Program::SHELL},
+        {"ruby", Program::SHELL},      {"node", Program::SHELL},   {"source", Program::SHELL},
+        {".", Program::SHELL},
+    };
+    for (const auto& entry : PROGRAMS) {
+        if (name == entry.name) return entry.program;
+    }
+    if (starts_with(name, "mkfs.")) return Program::MKFS;
+    return Program::OTHER;
+}
+
+// 앞에 붙어서 뒤의 명령어를 실행하는 프로그램과, 값을 받는 그 옵션 글자
+static bool is_wrapper(std::string_view name, std::string_view* value_options) {
+    static const struct {
+        std::string_view name;
+        std::string_view value_options;
+    } WRAPPERS[] = {
+        {"sudo", "ugCDpUrt"}, {"doas", "uC"}, {"env", "uCS"}, {"nohup", ""}, {"time", "fo"},
+        {"command", ""},      {"exec", "a"},  {"nice", "n"},  {"xargs", "InPLdEs"},
+    };
+    for (const auto& entry : WRAPPERS) {
+        if (name == entry.name) {
+            *value_options = entry.value_options;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 환경 변수 지정 ("LANG=C")
+static bool is_assignment(std::string_view word) {
+    size_t equals = word.find('=');
+    if (equals == 0 || equals == std::string_view::npos) return false;
+    for (size_t i = 0; i < equals; i++) {
+        char c = word[i];
+        bool ok = c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                  (i > 0 && c >= '0' && c <= '9');
+        if (!ok) return false;
+    }
+    return true;
+}
+
+// 디렉토리 자체나 그 안 전체 ("", "/", "/*", "/.")
+static bool whole_directory_suffix(std::string_view rest) {
+    return rest.empty() || rest == "/" || rest == "/*" || rest == "/." || rest == "/.*";
+}
+
+static Target classify_target(std::string_view word) {
+    // 따옴표를 모두 뺀 모양으로 비교 ("\"$HOME\"/" → "$HOME/"). 긴 단어는 대상 경로일 수 없음
+    char buf[64];
+    if (word.size() > sizeof buf) return Target::NONE;
+    size_t len = 0;
+    for (char c : word) {
+        if (c != '\'' && c != '"') buf[len++] = c;
+    }
+    word = std::string_view(buf, len);
+    if (word.empty()) return Target::NONE;
+    if (word == "/" || word == "//" || word == "/*" || word == "/." || word == "/.*") {
+        return Target::ROOT;
+    }
+    for (std::string_view home : {"~", "$HOME", "${HOME}"}) {
+        if (starts_with(word, home) && whole_directory_suffix(word.substr(home.size()))) {
+            return Target::HOME;
+        }
+    }
+    if (word == "*" || word == "." || word == "./" || word == "./*" || word == ".*") {
+        return Target::CWD_ALL;
+    }
+    static const std::string_view SYSTEM_DIRS[] = {
+        "/bin", "/boot", "/dev",  "/etc", "/home", "/lib",  "/lib32", "/lib64",
+        "/opt", "/proc", "/root", "/sbin", "/srv", "/sys", "/usr",   "/var",
+        "/Applications", "/Library", "/System", "/Users",
+    };
+    for (std::string_view dir : SYSTEM_DIRS) {
+        if (starts_with(word, dir) && whole_directory_suffix(word.substr(dir.size()))) {
+            return Target::SYSTEM;
+        }
+    }
+    return Target::NONE;
+}
+
+// 디스크 장치 ("/dev/sda", "/dev/nvme0n1", "/dev/disk2"). /dev/null 등은 아님
+static bool is_disk_device(std::string_view word) {
+    word = unquote(word);
+    if (!starts_with(word, "/dev/")) return false;
+    std::string_view name = word.substr(5);
+    static const std::string_view DISKS[] = {"sd", "hd", "vd", "xvd", "nvme", "mmcblk",
+                                             "disk", "rdisk", "md", "dm-", "mapper/"};
+    for (std::string_view disk : DISKS) {
+        if (starts_with(name, disk) && name.size() > disk.size()) return true;
+    }
+    return false;
+}
+
+// "NAME() { NAME | NAME & }" 형태의 함수 정의 (paren은 '('의 위치)
+static bool is_fork_bomb(std::string_view text, size_t paren) {
+    auto skip_spaces = [&](size_t i) {
+        while (i < text.size() && is_space(text[i])) i++;
+        return i;
+    };
+    size_t close = skip_spaces(paren + 1);
+    if (close >= text.size() || text[close] != ')') return false;
+    size_t brace = skip_spaces(close + 1);
+    if (brace >= text.size() || text[brace] != '{') return false;
+
+    size_t name_end = paren;
+    while (name_end > 0 && is_space(text[name_end - 1])) name_end--;
+    size_t name_start = name_end;
+    while (name_start > 0 && !is_space(text[name_start - 1]) && text[name_start - 1] != ';' &&
+           text[name_start - 1] != '\n') {
+        name_start--;
+    }
+    std::string_view name = text.substr(name_start, name_end - name_start);
+    if (name.empty()) return false;
+
+    // 본문에서 "NAME | NAME"을 찾음
+    size_t end = text.find('}', brace);
+    std::string_view body = text.substr(brace + 1, end == std::string_view::npos ? end : end - brace - 1);
+    for (size_t at = body.find(name); at != std::string_view::npos; at = body.find(name, at + 1)) {
+        size_t i = at + name.size();
+        while (i < body.size() && is_space(body[i])) i++;
+        if (i >= body.size() || body[i] != '|') continue;
+        i++;
+        while (i < body.size() && is_space(body[i])) i++;
+        if (body.substr(i, name.size()) == name) return true;
+    }
+    return false;
+}
+
+// ---------------------------------------------------------
+// 검사기: 단어를 받는 대로 단순 명령어 상태를 갱신하고, 구간이 끝나면 규칙 적용
+// ---------------------------------------------------------
+
+namespace {
+
+class RiskScanner {
+public:
+    RiskScanner() : best_{AIRiskLevel::NONE, std::string_view()} { reset_segment(); }
+
+    void report(AIRiskLevel level, std::string_view message) {
+        if (level > best_.level) best_ = AIRiskFinding{level, message};
+    }
+
+    // 리다이렉션 대상은 인자가 아니므로 따로 받음
+    void redirect_target(std::string_view word) {
+        if (is_disk_device(word)) report(AIRiskLevel::DANGER, MSG_DISK);
+    }
+
+    void word(std::string_view word) {
+        if (skip_next_) {
+            skip_next_ = false;
+            return;
+        }
+        if (program_ == Program::NONE) {
+            command_word(word);
+        } else {
+            argument(word);
+        }
+    }
+
+    // piped: 이 구간의 출력이 다음 구간의 입력으로 이어짐
+    void end_segment(bool piped) {
+        apply_rules();
+        bool downloader = program_ == Program::DOWNLOADER && piped;
+        reset_segment();
+        piped_from_downloader_ = downloader;
+    }
+
+    AIRiskFinding result() const { return best_; }
+
+private:
+    void reset_segment() {
+        program_ = Program::NONE;
+        value_options_ = std::string_view();
+        in_wrapper_ = skip_next_ = false;
+        options_done_ = false;
+        recursive_ = force_ = no_preserve_root_ = false;
+        target_ = Target::NONE;
+        device_ = mode_777_ = find_delete_ = false;
+        signal_given_ = kill_all_ = false;
+        git_subcommand_ = std::string_view();
+        git_force_ = git_hard_ = git_clean_force_ = git_clean_dirs_ = false;
+        shell_fetch_ = piped_from_downloader_ = false;
+    }
+
+    // 프로그램 이름을 찾는 중 (접두어와 그 옵션은 건너뜀)
+    void command_word(std::string_view word) {
+        if (in_wrapper_ && word.size() >= 2 && word[0] == '-') {
+            if (word.size() == 2 && value_options_.find(word[1]) != std::string_view::npos) {
+                skip_next_ = true;
+            }
+            return;
+        }
+        if (is_assignment(word)) return;
+        std::string_view name = program_name(word);
+        if (is_wrapper(name, &value_options_)) {
+            in_wrapper_ = true;
+            return;
+        }
+        program_ = classify_program(name);
+    }
+
+    void argument(std::string_view word) {
+        bool option = !options_done_ && word.size() >= 2 && word[0] == '-';
+        if (word == "--") {
+            options_done_ = true;
+            return;
+        }
+        switch (program_) {
+        case Program::RM:
+            if (word == "--no-preserve-root") no_preserve_root_ = true;
+            if (option) {
+                flag_letters(word, "rR", "recursive", &recursive_);
+                flag_letters(word, "f", "force", &force_);
+            } else {
+                target(word);
+            }
+            break;
+        case Program::DD:
+            if (starts_with(word, "of=") && is_disk_device(word.substr(3))) device_ = true;
+            break;
+        case Program::MKFS:
+            if (!option && is_disk_device(word)) device_ = true;
+            break;
+        case Program::CHMOD:
+        case Program::CHOWN:
+            if (option) {
+                flag_letters(word, "R", "recursive", &recursive_);
+            } else if (program_ == Program::CHMOD &&
+                       (word == "777" || word == "0777" || word == "a+rwx" || word == "ugo+rwx")) {
+                mode_777_ = true;
+            } else {
+                target(word);
+            }
+            break;
+        case Program::FIND:
+            if (word == "-delete" || word == "rm") find_delete_ = true;
+            if (!option) target(word);
+            break;
+        case Program::KILL:
+            if (word == "-1" && (signal_given_ || options_done_)) {
+                kill_all_ = true;
+            } else if (option) {
+                signal_given_ = true;
+            }
+            break;
+        case Program::GIT:
+            git_argument(word, option);
+            break;
+        case Program::SHELL:
+            // "$(curl ...)", "<(curl ...)", fish의 "(curl ... | psub)"
+            if (word.find("(curl") != std::string_view::npos ||
+                word.find("(wget") != std::string_view::npos) {
+                shell_fetch_ = true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // "-rf" 같은 짧은 옵션 묶음에 letters 중 하나가 있거나 "--long"이면 설정
+    static void flag_letters(std::string_view word, std::string_view letters,
+                             std::string_view long_name, bool* flag) {
+        if (word[1] == '-') {
+            if (word.substr(2) == long_name) *flag = true;
+            return;
+        }
+        if (word.substr(1).find_first_of(letters) != std::string_view::npos) *flag = true;
+    }
+
+    void target(std::string_view word) {
+        Target found = classify_target(word);
+        if (found > target_) target_ = found;
+    }
+
+    void git_argument(std::string_view word, bool option) {
+        if (git_subcommand_.empty()) {
+            if (!option) git_subcommand_ = word;
+            return;
+        }
+        if (git_subcommand_ == "push") {
+            if (word == "--force" || (option && word[1] != '-' && word.find('f') != std::string_view::npos)) {
+                git_force_ = true;
+            }
+            if (!option && word[0] == '+') git_force_ = true;  // "+main" refspec
+        } else if (git_subcommand_ == "reset") {
+            if (word == "--hard") git_hard_ = true;
+        } else if (git_subcommand_ == "clean" && option) {
+            flag_letters(word, "f", "force", &git_clean_force_);
+            flag_letters(word, "dxX", "", &git_clean_dirs_);
+        }
+    }
+
+    void apply_rules() {
+        switch (program_) {
+        case Program::RM:
+            if (recursive_ && (target_ == Target::ROOT || no_preserve_root_)) {
+                report(AIRiskLevel::DANGER, MSG_ROOT);
+            } else if (recursive_ && target_ == Target::HOME) {
+                report(AIRiskLevel::DANGER, MSG_HOME);
+            } else if (recursive_ && target_ == Target::SYSTEM) {
+                report(AIRiskLevel::DANGER, MSG_SYSTEM);
+            } else if (recursive_ && force_ && target_ == Target::CWD_ALL) {
+                report(AIRiskLevel::WARNING, MSG_CWD_ALL);
+            }
+            break;
+        case Program::DD:
+            if (device_) report(AIRiskLevel::DANGER, MSG_DISK);
+            break;
+        case Program::MKFS:
+            if (device_) report(AIRiskLevel::DANGER, MSG_MKFS);
+            break;
+        case Program::CHMOD:
+        case Program::CHOWN:
+            if (recursive_ && target_ >= Target::SYSTEM) {
+                report(AIRiskLevel::DANGER, MSG_PERMISSIONS);
+            } else if (mode_777_) {
+                report(AIRiskLevel::WARNING, MSG_777);
+            }
+            break;
+        case Program::FIND:
+            if (find_delete_ && target_ >= Target::SYSTEM) report(AIRiskLevel::DANGER, MSG_FIND_DELETE);
+            break;
+        case Program::KILL:
+            if (kill_all_) report(AIRiskLevel::DANGER, MSG_KILL_ALL);
+            break;
+        case Program::GIT:
+            if (git_force_) report(AIRiskLevel::WARNING, MSG_FORCE_PUSH);
+            if (git_hard_) report(AIRiskLevel::WARNING, MSG_RESET_HARD);
+            if (git_clean_force_ && git_clean_dirs_) report(AIRiskLevel::WARNING, MSG_GIT_CLEAN);
+            break;
+        case Program::SHELL:
+            if (piped_from_downloader_ || shell_fetch_) report(AIRiskLevel::WARNING, MSG_PIPE_SHELL);
+            break;
+        default:
+            break;
+        }
+    }
+
+    AIRiskFinding best_;
+    Program program_;
+    std::string_view value_options_;  // 접두어 프로그램에서 값을 받는 옵션 글자
+    bool in_wrapper_, skip_next_, options_done_;
+    bool recursive_, force_, no_preserve_root_;
+    Target target_;
+    bool device_, mode_777_, find_delete_;
+    bool signal_given_, kill_all_;
+    std::string_view git_subcommand_;
+    bool git_force_, git_hard_, git_clean_force_, git_clean_dirs_;
+    bool shell_fetch_, piped_from_downloader_;
+};
+
+} // namespace
+
+// 한 번 훑으면서 셸 단어와 구분자를 나눠 검사기에 넘김 (따옴표 안의 구분자는 무시)
+AIRiskFinding ai_scan_risk(std::string_view command) {
+    RiskScanner scanner;
+    size_t start = std::string_view::npos;
+    char quote = 0;
+    bool redirect = false;  // 다음 단어가 출력 리다이렉션 대상
+    bool input = false;     // 다음 단어가 입력 리다이렉션 대상 (검사하지 않음)
+
+    auto end_word = [&](size_t end) {
+        if (start == std::string_view::npos) return;
+        std::string_view word = command.substr(start, end - start);
+        start = std::string_view::npos;
+        if (redirect) {
+            scanner.redirect_target(word);
+        } else if (!input) {
+            scanner.word(word);
+        }
+        redirect = input = false;
+    };
+    auto peek = [&](size_t i) { return i < command.size() ? command[i] : '\0'; };
+
+    for (size_t i = 0; i < command.size(); i++) {
+        char c = command[i];
+        if (quote != 0) {
+            if (c == '\\' && quote == '"') {
+                i++;
+            } else if (c == quote) {
+                quote = 0;
+            }
+            continue;
+        }
+        switch (c) {
+        case '\\':
+            if (start == std::string_view::npos) start = i;
+            i++;
+            break;
+        case '\'':
+        case '"':
+            if (start == std::string_view::npos) start = i;
+            quote = c;
+            break;
+        case '(':
+            if (is_fork_bomb(command, i)) scanner.report(AIRiskLevel::DANGER, MSG_FORK_BOMB);
+            if (start == std::string_view::npos) start = i;
+            break;
+        case ' ':
+        case '\t':
+        case '\r':
+            end_word(i);
+            break;
+        case '\n':
+        case ';':
+            end_word(i);
+            scanner.end_segment(false);
+            break;
+        case '|':
+            end_word(i);
+            if (peek(i + 1) == '|') {
+                i++;
+                scanner.end_segment(false);
+            } else {
+                if (peek(i + 1) == '&') i++;
+                scanner.end_segment(true);
+            }
+            break;
+        case '&':
+            end_word(i);
+            if (peek(i + 1) == '>') {
+                // "&>" / "&>>": 출력 리다이렉션
+                while (peek(i + 1) == '>') i++;
+                redirect = true;
+            } else {
+                if (peek(i + 1) == '&') i++;
+                scanner.end_segment(false);
+            }
+            break;
+        case '>': {
+            // "2>"의 fd 번호는 단어가 아님
+            bool fd = start != std::string_view::npos;
+            for (size_t j = start; fd && j < i; j++) fd = command[j] >= '0' && command[j] <= '9';
+            if (fd) {
+                start = std::string_view::npos;
+            } else {
+                end_word(i);
+            }
+            while (peek(i + 1) == '>' || peek(i + 1) == '|') i++;
+            if (peek(i + 1) == '&') {
+                // "2>&1": fd 복제
+                i++;
+                while (peek(i + 1) == '-' || (peek(i + 1) >= '0' && peek(i + 1) <= '9')) i++;
+            } else {
+                redirect = true;
+            }
+            break;
+        }
+        case '<':
+            if (peek(i + 1) == '(') {
+                // 프로세스 치환 "<(curl ...)"은 단어로 둠
+                if (start == std::string_view::npos) start = i;
+            } else {
+                end_word(i);
+                while (peek(i + 1) == '<') i++;
+                input = true;
+            }
+            break;
+        default:
+            if (start == std::string_view::npos) start = i;
+            break;
+        }
+    }
+    end_word(command.size());
+    scanner.end_segment(false);
+    return scanner.result();
+}
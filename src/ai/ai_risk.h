@@ -0,0 +1,30 @@
+#ifndef FISH_AI_RISK_H
+#define FISH_AI_RISK_H
+
+#include <string_view>
+
+// ---------------------------------------------------------
+// 로컬 명령어 위험 검사
+//  - 네트워크 없이 규칙으로 바로 판단: 진단 모드의 첫 결과, 실행 전 검사,
+//    히스토리 기록 시 걸러내기에 씀 (원격 진단은 이 결과 뒤에 덧붙음)
+//  - 입력을 한 번 훑으면서 단어를 끊고, 단순 명령어(|, ;, &&, ||, & 로 나뉜 구간)가
+//    끝날 때마다 그 구간의 프로그램별 규칙을 적용. 할당 없음
+//  - sudo/doas/env/nohup/time/command/exec/nice/xargs와 VAR=값 접두어는 건너뛰고
+//    실제 프로그램을 봄
+// ---------------------------------------------------------
+
+enum class AIRiskLevel {
+    NONE = 0,
+    WARNING = 1,  // 되돌리기 어렵거나 보안상 위험 (git reset --hard, curl | sh 등)
+    DANGER = 2    // 시스템이나 디스크 전체를 망가뜨림 (rm -rf /, dd of=/dev/sda 등)
+};
+
+struct AIRiskFinding {
+    AIRiskLevel level;
+    std::string_view message;  // 사용자에게 보여 줄 설명 (정적 문자열, NONE이면 빈 문자열)
+};
+
+// 명령어에서 가장 위험한 항목 하나 (같은 수준이면 먼저 나온 것)
+AIRiskFinding ai_scan_risk(std::string_view command);
+
+#endif // FISH_AI_RISK_H
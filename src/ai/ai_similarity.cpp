@@ -0,0 +1,421 @@
+#include "ai_similarity.h"
+#include "ai_cache.h"
+#include <algorithm>
+
+// ---------------------------------------------------------
+// 입력 정규화
+// ---------------------------------------------------------
+
+// 단어 종류 (가림과 특징 만들기에서 다르게 다룸)
+enum class WordKind {
+    PROGRAM,    // 명령어 이름 (입력 맨 앞이나 구분자 뒤)
+    SEPARATOR,  // |, ||, &&, ;, &
+    FLAGS,      // 짧은 옵션 묶음 ("-la")
+    WORD        // 나머지 인자 ("--" 포함)
+};
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool is_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool is_hex(char c) {
+    return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// 따옴표 밖의 공백으로 단어를 나눔 (따옴표와 역슬래시는 단어에 그대로 남김)
+static void split_words(std::string_view input, std::vector<std::string_view>& words) {
+    size_t start = 0;
+    bool in_word = false;
+    char quote = 0;
+    for (size_t i = 0; i < input.size(); i++) {
+        char c = input[i];
+        if (!in_word) {
+            if (is_space(c)) continue;
+            in_word = true;
+            start = i;
+        }
+        if (quote != 0) {
+            if (c == '\\' && quote == '"' && i + 1 < input.size()) {
+                i++;
+            } else if (c == quote) {
+                quote = 0;
+            }
+        } else if (c == '\\' && i + 1 < input.size()) {
+            i++;
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (is_space(c)) {
+            words.push_back(input.substr(start, i - start));
+            in_word = false;
+        }
+    }
+    if (in_word) words.push_back(input.substr(start));
+}
+
+static bool is_separator(std::string_view word) {
+    return word == "|" || word == "||" || word == "&&" || word == ";" || word == "&";
+}
+
+// 짧은 옵션 묶음: "-l", "-la" (글자만, "-5"나 "--x"는 아님)
+static bool is_short_flags(std::string_view word) {
+    if (word.size() < 2 || word[0] != '-' || word[1] == '-') return false;
+    for (size_t i = 1; i < word.size(); i++) {
+        if (!is_alpha(word[i])) return false;
+    }
+    return true;
+}
+
+static bool is_option(std::string_view word) {
+    return word.size() >= 2 && word[0] == '-' && !is_digit(word[1]);
+}
+
+// 앞 옵션의 값이 될 수 없는 단어 (끝, 구분자, 다른 옵션)
+static bool ends_option_value(const std::vector<std::string_view>& words, size_t i) {
+    return i == words.size() || is_separator(words[i]) || is_option(words[i]);
+}
+
+// 정규화 결과 단어 목록 (text와 종류)
+static void canonical_words(std::string_view input, std::vector<std::string>& out,
+                            std::vector<WordKind>& kinds) {
+    std::vector<std::string_view> words;
+    split_words(input, words);
+
+    bool command_start = true, options = true;
+    for (size_t i = 0; i < words.size(); i++) {
+        std::string_view word = words[i];
+        if (is_separator(word)) {
+            out.emplace_back(word);
+            kinds.push_back(WordKind::SEPARATOR);
+            command_start = options = true;
+            continue;
+        }
+        if (command_start) {
+            out.emplace_back(word);
+            kinds.push_back(WordKind::PROGRAM);
+            command_start = false;
+            continue;
+        }
+        if (word == "--") options = false;
+        if (!options || !is_short_flags(word)) {
+            out.emplace_back(word);
+            kinds.push_back(WordKind::WORD);
+            continue;
+        }
+
+        // 이어지는 짧은 옵션들: 뒤에 값이 올 수 없는 것만 글자와 순서를 정렬
+        // (마지막 묶음 뒤에 값이 오면 그 값은 마지막 글자의 것일 수 있으므로 그대로 둠)
+        size_t end = i;
+        while (end < words.size() && is_short_flags(words[end])) end++;
+        size_t free_end = ends_option_value(words, end) ? end : end - 1;
+        size_t first = out.size();
+        for (size_t j = i; j < free_end; j++) {
+            std::string flags(words[j]);
+            std::sort(flags.begin() + 1, flags.end());
+            out.push_back(std::move(flags));
+            kinds.push_back(WordKind::FLAGS);
+        }
+        std::sort(out.begin() + first, out.end());
+        if (free_end < end) {
+            out.emplace_back(words[free_end]);
+            kinds.push_back(WordKind::FLAGS);
+        }
+        i = end - 1;
+    }
+}
+
+static bool is_number(std::string_view word) {
+    size_t i = (word[0] == '+' || word[0] == '-') ? 1 : 0;
+    if (i == word.size()) return false;
+    if (word.size() > i + 2 && word[i] == '0' && (word[i + 1] == 'x' || word[i + 1] == 'X')) {
+        return std::all_of(word.begin() + i + 2, word.end(), is_hex);
+    }
+    bool digit = false;
+    for (; i < word.size(); i++) {
+        if (is_digit(word[i])) {
+            digit = true;
+        } else if (word[i] != '.' && word[i] != ':' && word[i] != '_') {
+            return false;
+        }
+    }
+    return digit;
+}
+
+// 커밋 해시, 컨테이너 ID 같은 16진 문자열 (숫자와 글자가 섞인 7자 이상)
+static bool is_hash(std::string_view word) {
+    if (word.size() < 7 || !std::all_of(word.begin(), word.end(), is_hex)) return false;
+    return std::any_of(word.begin(), word.end(), is_digit) &&
+           !std::all_of(word.begin(), word.end(), is_digit);
+}
+
+// "/"가 있거나 "~"로 시작하거나 확장자("main.rs", "a.tar.gz")가 있는 단어
+static bool is_path(std::string_view word) {
+    if (word.find('/') != std::string_view::npos || word[0] == '~') return true;
+    size_t dot = word.rfind('.');
+    if (dot == std::string_view::npos || dot == 0 || word.size() - dot - 1 > 5) return false;
+    return dot + 1 < word.size() &&
+           std::all_of(word.begin() + dot + 1, word.end(), [](char c) {
+               return is_alpha(c) || is_digit(c);
+           });
+}
+
+// 바뀌기 쉬운 인자 가리기. 루트, 홈, 현재 디렉토리처럼 위험도 판단이 달라지는 경로는 그대로 둠
+static std::string mask_word(std::string_view word) {
+    static const std::string_view KEEP[] = {"/", "/*", "~", "~/", ".", "..", "./", "*", "-", "--"};
+    for (std::string_view keep : KEEP) {
+        if (word == keep) return std::string(word);
+    }
+    if (word[0] == '\'' || word[0] == '"') return "<str>";
+    if (word.size() > 2 && word[0] == '-' && word[1] == '-') {
+        size_t equals = word.find('=');
+        if (equals == std::string_view::npos || equals + 1 == word.size()) return std::string(word);
+        return std::string(word.substr(0, equals + 1)) + mask_word(word.substr(equals + 1));
+    }
+    if (is_number(word)) return "<num>";
+    if (is_hash(word)) return "<hash>";
+    if (is_path(word)) return "<path>";
+    return std::string(word);
+}
+
+// 특징 해시: 종류 글자 + 내용
+static uint64_t feature_hash(char kind, std::string_view text) {
+    std::string feature;
+    feature.reserve(text.size() + 1);
+    feature += kind;
+    feature += text;
+    return AIResultCache::hash(feature.data(), feature.size());
+}
+
+AICanonicalInput ai_canonicalize(std::string_view input) {
+    AICanonicalInput result;
+    result.program = 0;
+    std::vector<std::string> words;
+    std::vector<WordKind> kinds;
+    canonical_words(input, words, kinds);
+
+    for (size_t i = 0; i < words.size(); i++) {
+        const std::string& word = words[i];
+        std::string masked;
+        switch (kinds[i]) {
+        case WordKind::PROGRAM:
+            masked = word;
+            if (i == 0) result.program = AIResultCache::hash(word.data(), word.size());
+            result.features.push_back(feature_hash('^', word));
+            break;
+        case WordKind::SEPARATOR:
+            masked = word;
+            result.features.push_back(feature_hash('|', word));
+            break;
+        case WordKind::FLAGS:
+            masked = word;
+            for (size_t j = 1; j < word.size(); j++) {
+                result.features.push_back(feature_hash('-', std::string_view(&word[j], 1)));
+            }
+            break;
+        case WordKind::WORD:
+            masked = mask_word(word);
+            result.features.push_back(feature_hash(' ', masked));
+            break;
+        }
+        if (i > 0) {
+            result.text += ' ';
+            result.masked += ' ';
+        }
+        result.text += word;
+        result.masked += masked;
+    }
+    std::sort(result.features.begin(), result.features.end());
+    result.features.erase(std::unique(result.features.begin(), result.features.end()),
+                          result.features.end());
+    return result;
+}
+
+std::string ai_canonical_text(std::string_view input) {
+    std::vector<std::string> words;
+    std::vector<WordKind> kinds;
+    canonical_words(input, words, kinds);
+    std::string text;
+    for (const std::string& word : words) {
+        if (!text.empty()) text += ' ';
+        text += word;
+    }
+    return text;
+}
+
+// ---------------------------------------------------------
+// AISimilarityIndex 구현
+// ---------------------------------------------------------
+
+static const size_t ROWS = AISimilarityIndex::HASHES / AISimilarityIndex::BANDS;
+
+// splitmix64 마무리 단계 (특징 해시를 서명 위치마다 다른 해시로 바꿈)
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+AISimilarityIndex::AISimilarityIndex(size_t capacity)
+    : threshold_(DEFAULT_THRESHOLD), entries_(capacity), next_(0), size_(0) {
+    for (Entry& entry : entries_) entry.mode = 0;
+}
+
+void AISimilarityIndex::set_threshold(double threshold) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    threshold_ = std::min(std::max(threshold, 0.0), 1.0);
+}
+
+double AISimilarityIndex::threshold() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return threshold_;
+}
+
+// MinHash 서명: 위치 i의 해시는 특징마다 두 번 섞은 값의 h1 + i * h2 (이중 해싱),
+// 그중 가장 작은 값 (상위 32비트)
+void AISimilarityIndex::sign(const AICanonicalInput& input, uint32_t* signature) {
+    for (size_t i = 0; i < HASHES; i++) signature[i] = UINT32_MAX;
+    for (uint64_t feature : input.features) {
+        uint64_t h1 = mix(feature);
+        uint64_t h2 = mix(feature ^ 0x9e3779b97f4a7c15ULL) | 1;
+        for (size_t i = 0; i < HASHES; i++) {
+            signature[i] = std::min(signature[i], static_cast<uint32_t>((h1 + i * h2) >> 32));
+        }
+    }
+}
+
+// 정렬된 두 특징 집합의 자카드 유사도 (교집합 / 합집합)
+static double jaccard(const std::vector<uint64_t>& a, const std::vector<uint64_t>& b) {
+    size_t i = 0, j = 0, common = 0;
+    while (i < a.size() && j < b.size()) {
+        if (a[i] == b[j]) {
+            common++, i++, j++;
+        } else if (a[i] < b[j]) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+    size_t total = a.size() + b.size() - common;
+    return total == 0 ? 0 : static_cast<double>(common) / total;
+}
+
+uint64_t AISimilarityIndex::band_hash(int mode, uint64_t program, const uint32_t* signature,
+                                      size_t band) {
+    uint64_t h = mix(program ^ (static_cast<uint64_t>(mode) << 56) ^ band);
+    for (size_t r = 0; r < ROWS; r++) h = mix(h ^ signature[band * ROWS + r]);
+    return h;
+}
+
+bool AISimilarityIndex::find(int mode, const AICanonicalInput& input, std::string* key,
+                             double* similarity) const {
+    if (input.features.empty()) return false;
+    uint32_t signature[HASHES];
+    sign(input, signature);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (threshold_ <= 0 || size_ == 0) return false;
+    // 밴드 하나라도 같으면 후보. 후보는 특징 집합으로 정확한 자카드 유사도를 계산
+    // (서명 일치 비율로 추정하면 문턱값 근처에서 오차가 커서 위험도가 다른 입력이 섞일 수 있음)
+    std::vector<uint32_t> candidates;
+    for (size_t band = 0; band < BANDS; band++) {
+        auto bucket = buckets_.find(band_hash(mode, input.program, signature, band));
+        if (bucket == buckets_.end()) continue;
+        candidates.insert(candidates.end(), bucket->second.begin(), bucket->second.end());
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    const Entry* best = nullptr;
+    double best_similarity = 0;
+    for (uint32_t slot : candidates) {
+        const Entry& entry = entries_[slot];
+        if (entry.mode != mode || entry.program != input.program) continue;
+        double value = jaccard(entry.features, input.features);
+        if (value > best_similarity) {
+            best = &entry;
+            best_similarity = value;
+            if (value == 1.0) break;  // 특징이 모두 같으면 더 나은 후보는 없음
+        }
+    }
+    if (best == nullptr || best_similarity < threshold_) return false;
+    *key = best->key;
+    if (similarity) *similarity = best_similarity;
+    return true;
+}
+
+void AISimilarityIndex::add(int mode, const AICanonicalInput& input, const std::string& key) {
+    if (input.features.empty() || entries_.empty()) return;
+    uint32_t signature[HASHES];
+    sign(input, signature);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 특징이 같은 입력(가리면 같아지는 입력)이 이미 있으면 그 칸을 새 입력으로 바꿈
+    // (find에서 구별되지 않으므로 하나만 두어 후보 수를 줄임)
+    auto bucket = buckets_.find(band_hash(mode, input.program, signature, 0));
+    if (bucket != buckets_.end()) {
+        for (uint32_t slot : bucket->second) {
+            Entry& entry = entries_[slot];
+            if (entry.mode == mode && entry.program == input.program &&
+                entry.features == input.features) {
+                entry.key = key;
+                return;
+            }
+        }
+    }
+
+    uint32_t slot = static_cast<uint32_t>(next_);
+    next_ = (next_ + 1) % entries_.size();
+    if (entries_[slot].mode != 0) {
+        unlink_locked(slot);
+    } else {
+        size_++;
+    }
+    Entry& entry = entries_[slot];
+    entry.mode = mode;
+    entry.program = input.program;
+    std::copy(signature, signature + HASHES, entry.signature);
+    entry.features = input.features;
+    entry.key = key;
+    for (size_t band = 0; band < BANDS; band++) {
+        buckets_[band_hash(mode, entry.program, entry.signature, band)].push_back(slot);
+    }
+}
+
+// 덮어쓸 칸을 밴드 목록에서 뺌
+void AISimilarityIndex::unlink_locked(uint32_t slot) {
+    const Entry& entry = entries_[slot];
+    for (size_t band = 0; band < BANDS; band++) {
+        auto bucket = buckets_.find(band_hash(entry.mode, entry.program, entry.signature, band));
+        if (bucket == buckets_.end()) continue;
+        std::vector<uint32_t>& slots = bucket->second;
+        slots.erase(std::remove(slots.begin(), slots.end(), slot), slots.end());
+        if (slots.empty()) buckets_.erase(bucket);
+    }
+}
+
+void AISimilarityIndex::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Entry& entry : entries_) {
+        entry.mode = 0;
+        entry.features.clear();
+        entry.key.clear();
+    }
+    buckets_.clear();
+    next_ = 0;
+    size_ = 0;
+}
+
+size_t AISimilarityIndex::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
@@ -0,0 +1,82 @@
+#ifndef FISH_AI_SIMILARITY_H
+#define FISH_AI_SIMILARITY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// ---------------------------------------------------------
+// 입력 정규화와 유사 입력 색인
+//  - 정규화: 공백 정리 + 독립 짧은 옵션 정렬 ("ls  -la ", "ls -al" → "ls -al")
+//    결과는 캐시 키와 같은 입력 판단에 씀
+//  - 가림: 정규화 결과에서 자주 바뀌는 인자(경로, 해시, 숫자, 따옴표 문자열)를
+//    <path>/<hash>/<num>/<str>로 바꾼 것. 유사도 특징은 이 토큰들로 만듦
+//  - 색인: 특징 집합의 MinHash 서명을 LSH 밴드로 나눠 후보를 찾고, 후보 중 자카드 유사도가
+//    문턱값 이상이면서 가장 높은 이전 입력의 캐시 키를 돌려줌 (같은 모드, 같은 프로그램만)
+// ---------------------------------------------------------
+
+// 정규화한 입력
+struct AICanonicalInput {
+    std::string text;                // 공백 정리 + 독립 짧은 옵션 정렬
+    std::string masked;              // text에서 바뀌기 쉬운 인자를 가린 것
+    uint64_t program;                // 첫 단어 해시 (다른 프로그램끼리는 비교하지 않음)
+    std::vector<uint64_t> features;  // 유사도 특징 해시 (정렬, 중복 없음. 짧은 옵션은 글자마다 하나)
+};
+
+// 입력 정규화 (셸 따옴표 안의 공백은 그대로 둠)
+AICanonicalInput ai_canonicalize(std::string_view input);
+
+// 정규화한 text만 (캐시 키, 같은 입력 판단용)
+std::string ai_canonical_text(std::string_view input);
+
+class AISimilarityIndex {
+public:
+    static const size_t HASHES = 64;      // MinHash 서명 길이
+    static const size_t BANDS = 16;       // LSH 밴드 수 (밴드마다 HASHES / BANDS개)
+    static constexpr double DEFAULT_THRESHOLD = 0.85;
+
+    explicit AISimilarityIndex(size_t capacity = 1024);
+
+    AISimilarityIndex(const AISimilarityIndex&) = delete;
+    AISimilarityIndex& operator=(const AISimilarityIndex&) = delete;
+
+    // 재사용 문턱값 (0이면 유사 입력을 찾지 않음)
+    void set_threshold(double threshold);
+    double threshold() const;
+
+    // input과 가장 비슷한 이전 입력의 키. 문턱값 이상인 것이 없으면 false
+    bool find(int mode, const AICanonicalInput& input, std::string* key,
+              double* similarity = nullptr) const;
+
+    // 입력과 그 답의 캐시 키 등록 (가득 차면 가장 오래된 항목을 덮어씀)
+    void add(int mode, const AICanonicalInput& input, const std::string& key);
+
+    void clear();
+    size_t size() const;
+
+private:
+    struct Entry {
+        int mode;                // 0이면 빈 칸
+        uint64_t program;
+        uint32_t signature[HASHES];
+        std::vector<uint64_t> features;
+        std::string key;
+    };
+
+    static void sign(const AICanonicalInput& input, uint32_t* signature);
+    static uint64_t band_hash(int mode, uint64_t program, const uint32_t* signature, size_t band);
+    void unlink_locked(uint32_t slot);
+
+    mutable std::mutex mutex_;
+    double threshold_;
+    std::vector<Entry> entries_;
+    size_t next_;  // 다음에 덮어쓸 칸
+    size_t size_;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> buckets_;  // 밴드 해시 → 칸 번호
+};
+
+#endif // FISH_AI_SIMILARITY_H
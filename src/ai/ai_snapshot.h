@@ -0,0 +1,58 @@
+#ifndef FISH_AI_SNAPSHOT_H
+#define FISH_AI_SNAPSHOT_H
+
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// ---------------------------------------------------------
+// RCU 방식 스냅숏 셀
+//  - 쓰는 쪽은 새 값을 통째로 만들어 교체 (쓰는 쪽끼리는 writer_mutex_로 순서화)
+//  - 읽는 쪽은 read()로 현재 값의 참조를 하나 잡고 읽음 (shared_ptr의 atomic 읽기)
+//  - 값마다 참조 카운트가 따로 있으므로, 교체된 값은 그 값을 잡은 마지막 읽는 쪽이 놓을 때
+//    해제됨 (읽는 쪽이 끊이지 않아도 교체된 값이 쌓이지 않음)
+// 값은 발행 뒤 바뀌지 않아야 함 (mutable atomic 멤버는 예외)
+// ---------------------------------------------------------
+template <typename T>
+class AISnapshot {
+public:
+    // 읽는 동안 값을 붙잡아 두는 핸들 (살아 있는 동안 값이 해제되지 않음)
+    class Reader {
+    public:
+        Reader(Reader&& other) noexcept = default;
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+        Reader& operator=(Reader&&) = delete;
+
+        const T& operator*() const { return *value_; }
+        const T* operator->() const { return value_.get(); }
+
+    private:
+        friend class AISnapshot;
+        explicit Reader(std::shared_ptr<const T> value) : value_(std::move(value)) {}
+
+        std::shared_ptr<const T> value_;
+    };
+
+    explicit AISnapshot(std::unique_ptr<const T> initial) : current_(std::move(initial)) {}
+
+    AISnapshot(const AISnapshot&) = delete;
+    AISnapshot& operator=(const AISnapshot&) = delete;
+
+    Reader read() const { return Reader(std::atomic_load(&current_)); }
+
+    // make(현재 값)이 돌려준 새 값을 발행. 쓰는 쪽끼리만 잠금을 잡으므로
+    // make 안에서는 현재 값을 그대로 읽어도 됨 (교체는 쓰는 쪽만 하므로)
+    template <typename Make>
+    void update(Make&& make) {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        std::shared_ptr<const T> next(make(*current_));
+        std::atomic_store(&current_, std::move(next));
+    }
+
+private:
+    std::shared_ptr<const T> current_;  // std::atomic_load/atomic_store로만 읽고 씀
+    std::mutex writer_mutex_;
+};
+
+#endif // FISH_AI_SNAPSHOT_H
@@ -0,0 +1,300 @@
+#include "ai_workflow.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+// ---------------------------------------------------------
+// 기본 규칙 표 (형식은 사용자 규칙 파일과 같음)
+// ---------------------------------------------------------
+static const char DEFAULT_RULES[] = R"(
+# 이름 | 최소 횟수 | 패턴
+Git Workflow | 2 | git, git-*, gitk, tig, gh, lazygit
+Build Workflow | 2 | make, npm, cmake, ninja, meson, bazel, scons
+Rust Workflow | 2 | cargo, rustc, rustup
+Go Workflow | 2 | go build, go test, go run, go mod, go get, go vet, gofmt
+Node.js Workflow | 2 | npm, npx, yarn, pnpm, node, bun, deno
+Python Workflow | 2 | python, python3, pip, pip3, pytest, poetry, uv, ipython, pipenv
+Python Virtualenv | 1 | python -m venv, python3 -m venv, virtualenv, source *activate, source *activate.fish, . *activate.fish, deactivate, conda activate, pyenv
+Java Workflow | 2 | java, javac, mvn, ./mvnw, gradle, ./gradlew
+Ruby Workflow | 2 | ruby, gem, bundle, rake, rails, irb
+PHP Workflow | 2 | php, composer, artisan
+.NET Workflow | 2 | dotnet
+C/C++ Toolchain | 2 | gcc, g++, clang, clang++, cc, c++, ld, objdump
+Debugging | 2 | gdb, lldb, valgrind, strace, ltrace, perf
+Haskell Workflow | 2 | ghc, ghci, cabal, stack
+Elixir Workflow | 2 | mix, iex, elixir
+Swift/iOS Workflow | 2 | swift, xcodebuild, xcrun, pod
+Android Workflow | 2 | adb, fastboot, emulator, sdkmanager
+Docker Workflow | 2 | docker, docker-compose, podman, podman-compose, buildah
+Kubernetes Workflow | 2 | kubectl, k9s, helm, kubectx, kubens, minikube, kind, k3d, kustomize
+Terraform Workflow | 2 | terraform, tofu, terragrunt
+Ansible Workflow | 2 | ansible, ansible-playbook, ansible-galaxy, ansible-vault
+AWS Workflow | 2 | aws, sam, cdk, eksctl
+GCP Workflow | 2 | gcloud, gsutil, bq
+Azure Workflow | 2 | az, func
+Nix Workflow | 2 | nix, nix-shell, nix-env, nix-build, nixos-rebuild, home-manager
+Virtual Machines | 2 | vagrant, virsh, multipass, qemu-img, qemu-system-*
+Database Workflow | 2 | psql, mysql, sqlite3, redis-cli, mongosh, mongo, pg_dump, pg_restore, mysqldump
+Remote Access | 2 | ssh, scp, sftp, rsync, mosh
+Network Debugging | 2 | curl, wget, ping, dig, nslookup, host, traceroute, mtr, nc, ss, netstat, ip, tcpdump, nmap
+Process Monitoring | 2 | top, htop, btop, ps, kill, pkill, killall, lsof, pgrep
+Service Management | 2 | systemctl, journalctl, service, launchctl
+Package Management | 2 | apt, apt-get, dnf, yum, pacman, yay, brew, snap, flatpak, zypper, apk, port
+File Navigation | 3 | cd, ls, tree, z, pushd, popd, exa, eza
+File Search | 2 | find, fd, grep, rg, ag, ack, locate, fzf
+Text Editing | 2 | vim, nvim, vi, nano, emacs, code, hx, micro
+Log Inspection | 2 | tail -f, tail -F, less, journalctl -f, journalctl -u, multitail
+Archive Handling | 2 | tar, zip, unzip, gzip, gunzip, xz, 7z, zstd
+Permission Changes | 2 | chmod, chown, chgrp, umask, setfacl
+Disk Usage | 2 | df, du, ncdu, lsblk, mount, umount, fdisk, parted
+Terminal Multiplexer | 2 | tmux, screen, zellij
+Testing | 2 | pytest, jest, vitest, mocha, ctest, go test, cargo test, npm test, yarn test, make test, tox
+Lint/Format | 2 | eslint, prettier, black, ruff, flake8, mypy, pylint, clang-format, clang-tidy, rustfmt, cargo fmt, cargo clippy, shellcheck, gofmt
+Jupyter/Data Science | 2 | jupyter, jupyter-lab, conda, mamba, R, Rscript
+Secrets/Crypto | 2 | openssl, gpg, ssh-keygen, age, vault, sops, pass
+Fish Configuration | 2 | funced, funcsave, fish_config, abbr, set -U, fish_add_path
+)";
+
+// 앞에 붙어도 실제 명령어가 바뀌지 않는 단어
+static bool is_wrapper_word(std::string_view word) {
+    static const char* const WRAPPERS[] = {
+        "sudo", "doas", "env", "command", "builtin", "exec", "time", "nice", "nohup",
+    };
+    for (const char* wrapper : WRAPPERS) {
+        if (word == wrapper) return true;
+    }
+    // VAR=value 형태의 환경 변수 지정
+    size_t eq = word.find('=');
+    return eq != std::string_view::npos && eq > 0 && word[0] != '-';
+}
+
+static std::string_view trim_view(std::string_view s) {
+    size_t first = s.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos) return std::string_view();
+    size_t last = s.find_last_not_of(" \t\r");
+    return s.substr(first, last - first + 1);
+}
+
+// '*' 하나가 들어간 단어 일치 ("git-*" 접두사, "*activate" 접미사)
+static bool wildcard_match(std::string_view pattern, std::string_view word) {
+    size_t star = pattern.find('*');
+    std::string_view head = pattern.substr(0, star);
+    std::string_view tail = pattern.substr(star + 1);
+    return word.size() >= head.size() + tail.size() &&
+           word.compare(0, head.size(), head) == 0 &&
+           word.compare(word.size() - tail.size(), tail.size(), tail) == 0;
+}
+
+// 사용자 규칙 파일: $XDG_CONFIG_HOME/fish/ai_workflows (기본 ~/.config/fish/ai_workflows)
+static std::string read_user_rules() {
+    std::string path;
+    const char* xdg = std::getenv("XDG_CONFIG_HOME");
+    const char* home = std::getenv("HOME");
+    if (xdg && xdg[0] == '/') {
+        path = std::string(xdg) + "/fish/ai_workflows";
+    } else if (home && *home) {
+        path = std::string(home) + "/.config/fish/ai_workflows";
+    } else {
+        return "";
+    }
+
+    std::ifstream file(path);
+    if (!file) return "";
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+// ---------------------------------------------------------
+// WorkflowDetector 구현
+// ---------------------------------------------------------
+
+WorkflowDetector::WorkflowDetector()
+    : user_rules_loaded_(false), window_(WINDOW), window_next_(0) {}
+
+void WorkflowDetector::ensure_rules() {
+    if (!user_rules_loaded_) set_rules(read_user_rules());
+}
+
+void WorkflowDetector::set_rules(const std::string& extra_rules) {
+    user_rules_loaded_ = true;
+    rules_.clear();
+    nodes_.assign(1, Node());
+    parse_rules(std::string(DEFAULT_RULES) + "\n" + extra_rules);
+    clear();
+}
+
+void WorkflowDetector::parse_rules(const std::string& text) {
+    // 이름 -> (최소 횟수, 패턴 목록). 같은 이름이 다시 나오면 뒤의 것이 대체
+    std::vector<std::pair<uint32_t, std::vector<std::string_view>>> patterns;
+
+    std::string_view rest(text);
+    while (!rest.empty()) {
+        size_t newline = rest.find('\n');
+        std::string_view line = trim_view(rest.substr(0, newline));
+        rest = newline == std::string_view::npos ? std::string_view() : rest.substr(newline + 1);
+        if (line.empty() || line[0] == '#') continue;
+
+        size_t bar1 = line.find('|');
+        size_t bar2 = bar1 == std::string_view::npos ? bar1 : line.find('|', bar1 + 1);
+        if (bar2 == std::string_view::npos) continue;  // 형식 오류는 무시
+
+        std::string name(trim_view(line.substr(0, bar1)));
+        std::string min_text(trim_view(line.substr(bar1 + 1, bar2 - bar1 - 1)));
+        int min_count = atoi(min_text.c_str());
+        if (name.empty() || min_count <= 0) continue;
+
+        std::vector<std::string_view> list;
+        std::string_view items = line.substr(bar2 + 1);
+        while (!items.empty()) {
+            size_t comma = items.find(',');
+            std::string_view item = trim_view(items.substr(0, comma));
+            if (!item.empty()) list.push_back(item);
+            items = comma == std::string_view::npos ? std::string_view() : items.substr(comma + 1);
+        }
+
+        auto existing = std::find_if(rules_.begin(), rules_.end(),
+                                     [&](const Rule& r) { return r.name == name; });
+        if (existing != rules_.end()) {
+            size_t index = existing - rules_.begin();
+            existing->min_count = min_count;
+            patterns[index] = {static_cast<uint32_t>(min_count), list};
+        } else {
+            rules_.push_back(Rule{name, static_cast<uint32_t>(min_count), 0});
+            patterns.push_back({static_cast<uint32_t>(min_count), list});
+        }
+    }
+
+    for (uint32_t rule = 0; rule < patterns.size(); rule++) {
+        for (std::string_view pattern : patterns[rule].second) add_pattern(pattern, rule);
+    }
+}
+
+// node의 자식 중 word 노드 (create면 없을 때 만듦). 없으면 0
+uint32_t WorkflowDetector::child(uint32_t node, std::string_view word, bool create) {
+    bool wildcard = word.find('*') != std::string_view::npos;
+    auto& list = wildcard ? nodes_[node].wildcards : nodes_[node].children;
+    auto pos = std::lower_bound(list.begin(), list.end(), word,
+                                [](const std::pair<std::string, uint32_t>& a, std::string_view b) {
+                                    return std::string_view(a.first) < b;
+                                });
+    if (pos != list.end() && pos->first == word) return pos->second;
+    if (!create) return 0;
+
+    uint32_t id = static_cast<uint32_t>(nodes_.size());
+    list.insert(pos, {std::string(word), id});
+    nodes_.emplace_back();  // list를 먼저 갱신한 뒤 추가 (nodes_ 재할당 대비)
+    return id;
+}
+
+void WorkflowDetector::add_pattern(std::string_view pattern, uint32_t rule) {
+    uint32_t node = 0;
+    while (!pattern.empty()) {
+        size_t space = pattern.find(' ');
+        std::string_view word = pattern.substr(0, space);
+        pattern = space == std::string_view::npos ? std::string_view() : trim_view(pattern.substr(space));
+        if (!word.empty()) node = child(node, word, true);
+    }
+    if (node != 0) nodes_[node].rules.push_back(rule);
+}
+
+// 한 구간(파이프/; 사이)의 단어들을 트라이로 따라가며 일치한 규칙 수집
+void WorkflowDetector::match_segment(const std::vector<std::string_view>& words, size_t first,
+                                     std::vector<uint32_t>& out) const {
+    // 래퍼 단어(sudo, VAR=value 등) 건너뛰기
+    while (first < words.size() && is_wrapper_word(words[first])) first++;
+
+    // (노드, 다음 단어 위치) 목록. 와일드카드 때문에 갈래가 생길 수 있음
+    std::vector<std::pair<uint32_t, size_t>> frontier{{0, first}};
+    while (!frontier.empty()) {
+        auto [node, pos] = frontier.back();
+        frontier.pop_back();
+        const Node& n = nodes_[node];
+        if (node != 0) out.insert(out.end(), n.rules.begin(), n.rules.end());
+        if (pos >= words.size()) continue;
+
+        std::string_view word = words[pos];
+        auto it = std::lower_bound(n.children.begin(), n.children.end(), word,
+                                   [](const std::pair<std::string, uint32_t>& a, std::string_view b) {
+                                       return std::string_view(a.first) < b;
+                                   });
+        if (it != n.children.end() && it->first == word) frontier.push_back({it->second, pos + 1});
+        for (const auto& wild : n.wildcards) {
+            if (wildcard_match(wild.first, word)) frontier.push_back({wild.second, pos + 1});
+        }
+    }
+}
+
+// 명령어를 한 번 훑어 단어로 나누고, 구간(;, |, &)마다 트라이와 대조
+void WorkflowDetector::match(std::string_view command, std::vector<uint32_t>& out) const {
+    std::vector<std::string_view> words;
+    size_t segment_start = 0;
+    size_t word_start = std::string_view::npos;
+    char quote = 0;
+
+    auto end_word = [&](size_t i) {
+        if (word_start != std::string_view::npos) words.push_back(command.substr(word_start, i - word_start));
+        word_start = std::string_view::npos;
+    };
+    auto end_segment = [&]() {
+        match_segment(words, segment_start, out);
+        segment_start = words.size();
+    };
+
+    for (size_t i = 0; i < command.size(); i++) {
+        char c = command[i];
+        if (quote) {
+            if (c == quote) quote = 0;
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+            if (word_start == std::string_view::npos) word_start = i;
+        } else if (c == ' ' || c == '\t' || c == '\n') {
+            end_word(i);
+        } else if (c == ';' || c == '|' || c == '&') {
+            end_word(i);
+            if (segment_start < words.size()) end_segment();
+        } else if (word_start == std::string_view::npos) {
+            word_start = i;
+        }
+    }
+    end_word(command.size());
+    if (segment_start < words.size()) end_segment();
+
+    // 한 명령어는 규칙마다 한 번만 셈
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+void WorkflowDetector::add(std::string_view command) {
+    ensure_rules();
+
+    // 창에서 밀려나는 명령어의 카운트 제거
+    std::vector<uint32_t>& slot = window_[window_next_];
+    for (uint32_t rule : slot) rules_[rule].count--;
+    slot.clear();
+
+    match(command, slot);
+    for (uint32_t rule : slot) rules_[rule].count++;
+    window_next_ = (window_next_ + 1) % WINDOW;
+}
+
+void WorkflowDetector::clear() {
+    for (auto& slot : window_) slot.clear();
+    window_next_ = 0;
+    for (auto& rule : rules_) rule.count = 0;
+}
+
+std::string WorkflowDetector::detect() const {
+    std::string context;
+    detect(context);
+    return context;
+}
+
+void WorkflowDetector::detect(std::string& out) const {
+    for (const auto& rule : rules_) {
+        if (rule.count < rule.min_count) continue;
+        out += rule.name;
+        out += "; ";
+    }
+}
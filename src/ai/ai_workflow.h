@@ -0,0 +1,75 @@
+#ifndef FISH_AI_WORKFLOW_H
+#define FISH_AI_WORKFLOW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ---------------------------------------------------------
+// 작업 패턴(워크플로) 감지기
+// 규칙 표(텍스트)로 정의된 명령어 패턴을 단어 트라이 하나로 합쳐 두고,
+// 명령어가 추가될 때 한 번만 훑어서 최근 WINDOW개 명령어에 대한 규칙별
+// 카운터를 갱신함. 창에서 밀려난 명령어의 카운트는 바로 빠짐.
+// 감지 비용은 규칙 수에만 비례하고 히스토리 크기와 무관. 메인 스레드 전용.
+//
+// 규칙 형식 (한 줄에 하나, '#'은 주석):
+//   이름 | 최소 횟수 | 패턴, 패턴, ...
+// 패턴은 명령어 앞부분 단어들 (예: "git", "python -m venv").
+// 단어 끝의 '*'는 접두사, 앞의 '*'는 접미사 일치 (예: "*activate").
+// 기본 규칙 뒤에 $XDG_CONFIG_HOME/fish/ai_workflows 규칙이 적용되며,
+// 같은 이름의 규칙은 사용자 규칙이 대체함.
+// ---------------------------------------------------------
+
+class WorkflowDetector {
+public:
+    WorkflowDetector();
+
+    // 규칙 표 교체: 기본 규칙 + extra_rules (사용자 규칙). 카운터는 초기화됨
+    void set_rules(const std::string& extra_rules);
+
+    // 실행된 명령어 반영 (창이 가득 차면 가장 오래된 명령어의 카운트를 뺌)
+    void add(std::string_view command);
+    void clear();
+
+    // 최소 횟수를 넘은 워크플로 이름들 ("Git Workflow; Docker Workflow; ")
+    std::string detect() const;
+    void detect(std::string& out) const;  // out 뒤에 붙임 (버퍼 재사용용)
+
+    size_t rule_count() const { return rules_.size(); }
+
+    static const size_t WINDOW = 20;
+
+private:
+    struct Rule {
+        std::string name;
+        uint32_t min_count;
+        uint32_t count;   // 창 안에서 일치한 명령어 수
+    };
+
+    // 단어 트라이 노드
+    struct Node {
+        std::vector<std::pair<std::string, uint32_t>> children;  // 단어 순 정렬
+        std::vector<std::pair<std::string, uint32_t>> wildcards; // '*' 포함 단어
+        std::vector<uint32_t> rules;                             // 여기서 끝나는 패턴의 규칙
+    };
+
+    std::vector<Rule> rules_;
+    std::vector<Node> nodes_;
+    bool user_rules_loaded_;
+
+    // 창: 명령어별로 일치한 규칙 id 목록 (순환 버퍼)
+    std::vector<std::vector<uint32_t>> window_;
+    size_t window_next_;
+
+    void parse_rules(const std::string& text);
+    void add_pattern(std::string_view pattern, uint32_t rule);
+    uint32_t child(uint32_t node, std::string_view word, bool create);
+    void match(std::string_view command, std::vector<uint32_t>& out) const;
+    void match_segment(const std::vector<std::string_view>& words, size_t first,
+                       std::vector<uint32_t>& out) const;
+    void ensure_rules();
+};
+
+#endif // FISH_AI_WORKFLOW_H
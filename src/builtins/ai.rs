@@ -0,0 +1,139 @@
+//! Implementation of the ai builtin.
+
+use super::prelude::*;
+use crate::common::{str2wcstring, wcs2string};
+use crate::history::{history_session_id, in_private_mode};
+use crate::path::path_get_data;
+use std::ffi::CString;
+
+extern "C" {
+    fn get_ai_stats_from_cpp(json: bool, buf: *mut libc::c_char, cap: usize) -> usize;
+    fn run_ai_daemon_from_cpp(
+        socket_path: *const libc::c_char,
+        history_path: *const libc::c_char,
+    ) -> bool;
+}
+
+const short_options: &wstr = L!("sjdh");
+const long_options: &[WOption] = &[
+    wopt(L!("stats"), NoArgument, 's'),
+    wopt(L!("json"), NoArgument, 'j'),
+    wopt(L!("daemon"), NoArgument, 'd'),
+    wopt(L!("help"), NoArgument, 'h'),
+];
+
+/// Fetch the AI statistics report, growing the buffer until it fits.
+fn ai_stats(json: bool) -> Vec<u8> {
+    let mut buf = vec![0u8; 4096];
+    loop {
+        let len = unsafe { get_ai_stats_from_cpp(json, buf.as_mut_ptr().cast(), buf.len()) };
+        if len <= buf.len() {
+            buf.truncate(len);
+            return buf;
+        }
+        buf.resize(len, 0);
+    }
+}
+
+/// The ai builtin. `ai --stats` prints request, cache and latency statistics of the AI layer,
+/// `--json` prints them as a single JSON object. `ai --daemon [SOCKET]` serves AI requests of
+/// other fish sessions of this user until it receives SIGINT, SIGTERM or SIGHUP.
+pub fn ai(parser: &Parser, streams: &mut IoStreams, argv: &mut [&wstr]) -> BuiltinResult {
+    let cmd = argv[0];
+    let argc = argv.len();
+    let mut stats = false;
+    let mut json = false;
+    let mut daemon = false;
+    let mut w = WGetopter::new(short_options, long_options, argv);
+    while let Some(opt) = w.next_opt() {
+        match opt {
+            's' => stats = true,
+            'j' => json = true,
+            'd' => daemon = true,
+            'h' => {
+                builtin_print_help(parser, streams, cmd);
+                return Ok(SUCCESS);
+            }
+            ';' => {
+                builtin_unexpected_argument(parser, streams, cmd, argv[w.wopt_index - 1], false);
+                return Err(STATUS_INVALID_ARGS);
+            }
+            '?' => {
+                builtin_unknown_option(parser, streams, cmd, argv[w.wopt_index - 1], false);
+                return Err(STATUS_INVALID_ARGS);
+            }
+            _ => panic!("unexpected retval from WGetopter"),
+        }
+    }
+
+    if daemon {
+        return run_daemon(parser, streams, cmd, &argv[w.wopt_index..]);
+    }
+
+    if w.wopt_index != argc {
+        streams.err.append(wgettext_fmt!(
+            BUILTIN_ERR_ARG_COUNT1,
+            cmd,
+            0,
+            argc - w.wopt_index
+        ));
+        return Err(STATUS_INVALID_ARGS);
+    }
+    if !stats {
+        streams
+            .err
+            .append(wgettext_fmt!("%s: expected --stats or --daemon\n", cmd));
+        builtin_print_error_trailer(parser, streams.err, cmd);
+        return Err(STATUS_INVALID_ARGS);
+    }
+
+    streams.out.append(str2wcstring(&ai_stats(json)));
+    Ok(SUCCESS)
+}
+
+/// The history file of this shell, which the daemon reads before it serves requests.
+/// Empty in private mode or when history is disabled.
+fn daemon_history_path(parser: &Parser) -> Vec<u8> {
+    let name = history_session_id(parser.vars());
+    if name.is_empty() || in_private_mode(parser.vars()) {
+        return Vec::new();
+    }
+    let Some(mut path) = path_get_data() else {
+        return Vec::new();
+    };
+    path.push('/');
+    path.push_utfstr(&name);
+    path.push_utfstr(L!("_history"));
+    wcs2string(&path)
+}
+
+/// Run the shared AI daemon on the given socket, or the default one, until it is stopped.
+fn run_daemon(
+    parser: &Parser,
+    streams: &mut IoStreams,
+    cmd: &wstr,
+    args: &[&wstr],
+) -> BuiltinResult {
+    if args.len() > 1 {
+        streams.err.append(wgettext_fmt!(
+            BUILTIN_ERR_MAX_ARG_COUNT1,
+            cmd,
+            1,
+            args.len()
+        ));
+        return Err(STATUS_INVALID_ARGS);
+    }
+    let path = CString::new(args.first().map(|p| wcs2string(p)).unwrap_or_default());
+    let Ok(path) = path else {
+        return Err(STATUS_INVALID_ARGS);
+    };
+    let history = CString::new(daemon_history_path(parser)).unwrap_or_default();
+    if unsafe { run_ai_daemon_from_cpp(path.as_ptr(), history.as_ptr()) } {
+        return Ok(SUCCESS);
+    }
+    streams.err.append(wgettext_fmt!(
+        "%s: could not start the daemon: it is already running or the socket cannot be created\n",
+        cmd
+    ));
+    Err(STATUS_CMD_ERROR)
+}
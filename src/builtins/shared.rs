@@ -201,6 +201,10 @@ struct BuiltinData {
         name: L!("abbr"),
         func: abbr::abbr,
     },
+    BuiltinData {
+        name: L!("ai"),
+        func: ai::ai,
+    },
     BuiltinData {
         name: L!("and"),
         func: builtin_generic,
@@ -551,6 +555,7 @@ pub fn builtin_get_desc(name: &wstr) -> Option<&'static wstr> {
         _ if name == "[" => wgettext!("Test a condition"), // ]
         _ if name == "_" => wgettext!("Translate a string"),
         _ if name == "abbr" => wgettext!("Manage abbreviations"),
+        _ if name == "ai" => wgettext!("Show AI assistant statistics"),
         _ if name == "and" => wgettext!("Run command if last command succeeded"),
         _ if name == "argparse" => wgettext!("Parse options in fish script"),
         _ if name == "begin" => wgettext!("Create a block of code"),
@@ -425,6 +425,10 @@ fn ioport_notified(&mut self) {
         iothread_service_main(self);
     }
 
+    fn ai_request_notified(&mut self) {
+        self.ai_request_completed();
+    }
+
     fn paste_start_buffering(&mut self) {
         self.input_data.paste_buffer = Some(vec![]);
         self.push_front(CharEvent::from_readline(ReadlineCmd::BeginUndoGroup));
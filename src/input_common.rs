@@ -524,9 +524,9 @@ pub fn from_check_exit() -> CharEvent {
 static WAIT_ON_SEQUENCE_KEY_MS: AtomicUsize = AtomicUsize::new(WAIT_ON_SEQUENCE_KEY_INFINITE);
 
 /// Internal function used by readch to read one byte.
-/// This calls select() on three fds: input (e.g. stdin), the ioport notifier fd (for main thread
-/// requests), and the uvar notifier. This returns either the byte which was read, or one of the
-/// special values below.
+/// This calls select() on four fds: input (e.g. stdin), the ioport notifier fd (for main thread
+/// requests), the uvar notifier and the AI request notifier. This returns either the byte which
+/// was read, or one of the special values below.
 enum InputEventTrigger {
     // A byte was successfully read.
     Byte(u8),
@@ -543,6 +543,9 @@ enum InputEventTrigger {
     // Our ioport reported a change, so service main thread requests.
     IOPortNotified,
 
+    // A background AI request finished.
+    AiNotified,
+
     // No file descriptor was ready within the query timeout.
     TimeoutElapsed,
 }
@@ -561,6 +564,10 @@ fn readb(in_fd: RawFd) -> Option<u8> {
 }
 
 fn next_input_event(in_fd: RawFd, timeout: Timeout) -> InputEventTrigger {
+    extern "C" {
+        fn ai_notify_fd_from_cpp() -> libc::c_int;
+    }
+
     let mut fdset = FdReadableSet::new();
     loop {
         fdset.clear();
@@ -577,6 +584,12 @@ fn next_input_event(in_fd: RawFd, timeout: Timeout) -> InputEventTrigger {
             fdset.add(notifier_fd);
         }
 
+        // Add the AI request completion fd (possibly none).
+        let ai_fd = unsafe { ai_notify_fd_from_cpp() };
+        if ai_fd >= 0 {
+            fdset.add(ai_fd);
+        }
+
         // Here's where we call select().
         let select_res = fdset.check_readable(timeout);
         if select_res < 0 {
@@ -595,7 +608,7 @@ fn next_input_event(in_fd: RawFd, timeout: Timeout) -> InputEventTrigger {
         }
 
         // select() did not return an error, so we may have a readable fd.
-        // The priority order is: uvars, stdin, ioport.
+        // The priority order is: uvars, stdin, ioport, AI requests.
         // Check to see if we want a universal variable barrier.
         if let Some(notifier_fd) = notifier_fd {
             if fdset.test(notifier_fd) && notifier.notification_fd_became_readable(notifier_fd) {
@@ -613,6 +626,10 @@ fn next_input_event(in_fd: RawFd, timeout: Timeout) -> InputEventTrigger {
         if fdset.test(ioport_fd) {
             return InputEventTrigger::IOPortNotified;
         }
+
+        if ai_fd >= 0 && fdset.test(ai_fd) {
+            return InputEventTrigger::AiNotified;
+        }
     }
 }
 
@@ -868,6 +885,10 @@ fn readch(&mut self) -> CharEvent {
                     self.ioport_notified();
                 }
 
+                InputEventTrigger::AiNotified => {
+                    self.ai_request_notified();
+                }
+
                 InputEventTrigger::Byte(read_byte) => {
                     let mut have_escape_prefix = false;
                     let mut buffer = vec![read_byte];
@@ -1663,6 +1684,10 @@ fn uvar_change_notified(&mut self) {}
     /// The default does nothing.
     fn ioport_notified(&mut self) {}
 
+    /// Override point for when a background AI request has finished.
+    /// The default does nothing.
+    fn ai_request_notified(&mut self) {}
+
     /// Reset the function status.
     fn get_function_status(&self) -> bool {
         self.get_input_data().function_status
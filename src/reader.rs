@@ -57,7 +57,7 @@
     EscapeFlags, EscapeStringStyle, PROGRAM_NAME, ScopeGuard, UTF8_BOM_WCHAR, escape,
     escape_string, exit_without_destructors, get_ellipsis_char, get_is_multibyte_locale,
     get_obfuscation_read_char, restore_term_foreground_process_group_for_exit, shell_modes,
-    str2wcstring, write_loop,
+    str2wcstring, wcs2string, write_loop,
 };
 use crate::complete::{
     CompleteFlags, Completion, CompletionList, CompletionRequestOptions, complete, complete_load,
@@ -114,6 +114,7 @@
     parse_util_lineno, parse_util_locate_cmdsubst_range, parse_util_token_extent,
 };
 use crate::parser::{BlockType, EvalRes, Parser};
+use crate::path::path_get_data;
 use crate::proc::{
     have_proc_stat, hup_jobs, is_interactive_session, job_reap, jobs_requiring_warning_on_exit,
     print_exit_warning_for_jobs, proc_update_jiffies,
@@ -165,17 +166,111 @@
 
 use std::ffi::CString;
 extern "C" {
-    // [중요] C++의 generate_ai_suggestions_from_cpp 함수와 매칭
-    fn generate_ai_suggestions_from_cpp(input: *const libc::c_char, mode: libc::c_int);
-    
+    // 비동기 요청: 제출 후 완료 알림 fd가 읽기 가능해지면 poll로 결과 반영
+    fn submit_ai_request_from_cpp(input: *const libc::c_char, mode: libc::c_int) -> u64;
+    fn poll_ai_request_from_cpp() -> libc::c_int;
+    fn prewarm_ai_connection_from_cpp();
+    fn queue_ai_history_load_from_cpp(history_path: *const libc::c_char);
+    fn cancel_stale_ai_request_from_cpp(input: *const libc::c_char) -> bool;
+
     fn next_ai_suggestion_from_cpp();
-    fn get_ai_suggestion_with_description_from_cpp() -> *mut libc::c_char;
-    fn get_ai_command_only_from_cpp() -> *mut libc::c_char;
+    fn get_ai_suggestions_from_cpp(
+        known_generation: u64,
+        buf: *mut libc::c_char,
+        cap: usize,
+        generation: *mut u64,
+        count: *mut u32,
+        current: *mut u32,
+    ) -> usize;
     fn has_ai_suggestions_from_cpp() -> bool;
     fn clear_ai_suggestions_from_cpp();
     fn is_same_input_from_cpp(input: *const libc::c_char) -> bool;
-    fn free_ai_suggestion(ptr: *mut libc::c_char);
     fn add_command_history_from_cpp(command: *const libc::c_char);
+    fn set_ai_private_mode_from_cpp(enabled: bool);
+}
+
+/// poll_ai_request_from_cpp 반환값
+const AI_REQUEST_PENDING: libc::c_int = 0;
+const AI_REQUEST_READY: libc::c_int = 1;
+const AI_REQUEST_PARTIAL: libc::c_int = 2;
+
+/// AI 제안 목록 사본 (get_ai_suggestions_from_cpp로 한 번에 가져옴)
+/// 버퍼와 범위 목록은 재사용되고, C++ 쪽 세대가 그대로면 다시 복사하지 않음
+#[derive(Default)]
+struct AiSuggestionList {
+    /// [u32 길이][명령어][u32 길이][설명] 레코드들
+    buf: Vec<u8>,
+    /// 제안별 (명령어, 설명) 범위
+    items: Vec<(Range<usize>, Range<usize>)>,
+    generation: u64,
+    current: usize,
+}
+
+impl AiSuggestionList {
+    /// C++ 쪽 목록과 맞춤 (현재 제안 번호는 항상 갱신)
+    fn refresh(&mut self) {
+        let mut generation = 0;
+        let mut count = 0;
+        let mut current = 0;
+        loop {
+            let needed = unsafe {
+                get_ai_suggestions_from_cpp(
+                    self.generation,
+                    self.buf.as_mut_ptr().cast(),
+                    self.buf.len(),
+                    &mut generation,
+                    &mut count,
+                    &mut current,
+                )
+            };
+            if generation == self.generation {
+                break;
+            }
+            if needed > self.buf.len() {
+                // 버퍼가 작으면 키워서 한 번 더 요청
+                self.buf.resize(needed, 0);
+                continue;
+            }
+            self.generation = generation;
+            self.parse(needed, count as usize);
+            break;
+        }
+        self.current = current as usize;
+    }
+
+    fn parse(&mut self, len: usize, count: usize) {
+        self.items.clear();
+        let mut pos = 0;
+        let field = |pos: &mut usize| -> Option<Range<usize>> {
+            let header = self.buf.get(*pos..*pos + 4)?;
+            let start = *pos + 4;
+            let end = start + u32::from_ne_bytes(header.try_into().unwrap()) as usize;
+            if end > len {
+                return None;
+            }
+            *pos = end;
+            Some(start..end)
+        };
+        while self.items.len() < count {
+            let (Some(command), Some(description)) = (field(&mut pos), field(&mut pos)) else {
+                break;
+            };
+            self.items.push((command, description));
+        }
+    }
+
+    fn len(&self) -> usize {
+        self.items.len()
+    }
+
+    /// 현재 제안의 (명령어, 설명)
+    fn current(&self) -> Option<(&str, &str)> {
+        let (command, description) = self.items.get(self.current)?;
+        Some((
+            std::str::from_utf8(&self.buf[command.clone()]).ok()?,
+            std::str::from_utf8(&self.buf[description.clone()]).ok()?,
+        ))
+    }
 }
 
 /// A description of where fish is in the process of exiting.
@@ -755,10 +850,14 @@ pub struct ReaderData {
 
     /// AI 제안
     ai_suggestion: Option<WString>,
+    /// C++에서 가져온 AI 제안 목록 전체
+    ai_suggestions: AiSuggestionList,
     /// AI 팝업 표시 여부
     ai_popup_visible: bool,
     /// AI 모드 (1: 자동완성, 2: 설명, 3: 진단)
     ai_mode: u8,
+    /// 백그라운드 AI 요청 진행 여부 (입력이 바뀌면 취소하기 위해 추적)
+    ai_request_in_flight: bool,
 
     rls: Option<ReadlineLoopState>,
 }
@@ -1383,8 +1482,10 @@ fn new(
             in_flight_highlight_request: Default::default(),
             in_flight_autosuggest_request: Default::default(),
             ai_suggestion: None,
+            ai_suggestions: AiSuggestionList::default(),
             ai_popup_visible: false,
             ai_mode: 1,
+            ai_request_in_flight: false,
             rls: None,
         }))
     }
@@ -1451,6 +1552,14 @@ fn command_line_changed(
             EditableLineTag::Commandline => {
                 // Update the gen count.
                 GENERATION.fetch_add(1, Ordering::Relaxed);
+                // 입력이 바뀌었으면 진행 중인 AI 요청 취소
+                if self.ai_request_in_flight {
+                    if let Ok(c_input) = CString::new(self.command_line.text().to_string()) {
+                        if unsafe { cancel_stale_ai_request_from_cpp(c_input.as_ptr()) } {
+                            self.ai_request_in_flight = false;
+                        }
+                    }
+                }
                 let saved_autosuggestion = self.saved_autosuggestion.take();
                 use AutosuggestionUpdate::*;
                 match autosuggestion_update {
@@ -2364,6 +2473,12 @@ fn readline(&mut self, nchars: Option<NonZeroUsize>) -> Option<WString> {
         if !self.first_prompt {
             self.screen
                 .reset_abandoning_line(usize::try_from(termsize_last().width).unwrap());
+        } else {
+            // 첫 프롬프트에서 AI 서버 연결을 백그라운드로 미리 맺어 둠
+            // private 모드는 매니저가 생기기 전에 알려서 처음부터 디스크 캐시에 쓰지 않게 함
+            unsafe { set_ai_private_mode_from_cpp(in_private_mode(self.vars())) };
+            unsafe { prewarm_ai_connection_from_cpp() };
+            self.load_ai_history();
         }
         self.first_prompt = false;
 
@@ -4337,7 +4452,25 @@ fn clear_ai_popup(&mut self) {
         }
     }
 
+    /// AI 컨텍스트용 히스토리 저장소에 fish 히스토리 파일을 백그라운드로 적재 (private 모드에서는 생략)
+    fn load_ai_history(&self) {
+        let name = history_session_id(self.vars());
+        if name.is_empty() || in_private_mode(self.vars()) {
+            return;
+        }
+        let Some(mut path) = path_get_data() else {
+            return;
+        };
+        path.push('/');
+        path.push_utfstr(&name);
+        path.push_utfstr(L!("_history"));
+        if let Ok(c_path) = CString::new(wcs2string(&path)) {
+            unsafe { queue_ai_history_load_from_cpp(c_path.as_ptr()) };
+        }
+    }
+
     /// AI 제안 요청 (모드별)
+    /// 네트워크 호출은 백그라운드에서 수행되고, 결과는 ai_request_completed에서 표시됨
     fn request_ai_suggestion(&mut self, mode: u8) {
         let input_text = self.command_line.text().to_string();
         
@@ -4347,99 +4480,133 @@ fn request_ai_suggestion(&mut self, mode: u8) {
         
         self.data.ai_mode = mode;
         
-        use crate::wchar::prelude::*;
-        use std::ffi::{CString, CStr};
-        
         if let Ok(c_input) = CString::new(input_text) {
             unsafe {
-                // [수정] 옛날 함수 대신 generate_... 호출 (모드 전달)
-                generate_ai_suggestions_from_cpp(c_input.as_ptr(), mode as i32);
-                
-                // [수정] 결과 가져오기
-                let ptr = get_ai_suggestion_with_description_from_cpp();
-                
-                if !ptr.is_null() {
-                    if let Ok(raw_response) = CStr::from_ptr(ptr).to_str() {
-                        let clean_response = raw_response.trim().to_string();
-
-                        if !clean_response.is_empty() {
-                            let ai_wstring = WString::from_str(&clean_response);
-                            self.data.ai_suggestion = Some(ai_wstring.clone());
-                            // 팝업 표시
-                            self.show_ai_popup(&ai_wstring, mode);
-                        }
-                    }
-                    free_ai_suggestion(ptr);
-                }
+                set_ai_private_mode_from_cpp(in_private_mode(self.vars()));
+                submit_ai_request_from_cpp(c_input.as_ptr(), mode as i32);
             }
+            self.data.ai_request_in_flight = true;
         }
     }
+
     /// Alt+W: AI 제안 생성 또는 다음 제안으로 순환
     fn request_or_cycle_ai_suggestion(&mut self) {
-        use std::ffi::{CStr, CString};
-        
         let input_text = self.command_line.text().to_string();
         
         if input_text.is_empty() {
             return;
         }
         
+        let Ok(c_input) = CString::new(input_text) else {
+            return;
+        };
+
         unsafe {
             // 입력이 바뀌었으면 기존 제안 초기화
-            if let Ok(c_input) = CString::new(input_text.clone()) {
-                if has_ai_suggestions_from_cpp() && !is_same_input_from_cpp(c_input.as_ptr()) {
-                    clear_ai_suggestions_from_cpp();
-                }
+            if has_ai_suggestions_from_cpp() && !is_same_input_from_cpp(c_input.as_ptr()) {
+                clear_ai_suggestions_from_cpp();
             }
             
             // 이미 제안이 있으면 다음으로 순환
             if has_ai_suggestions_from_cpp() {
                 next_ai_suggestion_from_cpp();
-            } else {
-                // 새로 생성
-                if let Ok(c_input) = CString::new(input_text) {
-                    // [수정] 모드 인자 '1' (GENERATION)을 추가로 전달합니다.
-                    generate_ai_suggestions_from_cpp(c_input.as_ptr(), 1); 
-                }
+                self.show_current_ai_suggestion();
+                return;
             }
-            
-            // 현재 제안 가져오기 (명령어 + 설명)
-            let ptr = get_ai_suggestion_with_description_from_cpp();
-            
-            if !ptr.is_null() {
-                if let Ok(suggestion_str) = CStr::from_ptr(ptr).to_str() {
-                    let suggestion = WString::from_str(suggestion_str);
-                    self.data.ai_suggestion = Some(suggestion.clone());
-                    self.data.ai_popup_visible = true;
-                    self.show_ai_popup(&suggestion, 1);
+
+            // 같은 입력에 대한 자동완성 요청이 이미 진행 중이면 결과를 기다림
+            if self.data.ai_mode == 1 && is_same_input_from_cpp(c_input.as_ptr()) {
+                match poll_ai_request_from_cpp() {
+                    AI_REQUEST_READY | AI_REQUEST_PARTIAL => {
+                        self.show_current_ai_suggestion();
+                        return;
+                    }
+                    AI_REQUEST_PENDING => return,
+                    _ => {}
                 }
-                free_ai_suggestion(ptr);
+            }
+
+            // 새로 생성 (모드 1: GENERATION)
+            self.data.ai_mode = 1;
+            set_ai_private_mode_from_cpp(in_private_mode(self.vars()));
+            submit_ai_request_from_cpp(c_input.as_ptr(), 1);
+            self.data.ai_request_in_flight = true;
+        }
+    }
+
+    /// 백그라운드 AI 요청 완료 시 호출됨 (알림 fd가 읽기 가능해졌을 때)
+    /// 스트리밍 중에는 첫 제안이 도착하는 즉시 표시됨
+    pub(crate) fn ai_request_completed(&mut self) {
+        match unsafe { poll_ai_request_from_cpp() } {
+            AI_REQUEST_PARTIAL => {}
+            AI_REQUEST_READY => self.data.ai_request_in_flight = false,
+            AI_REQUEST_PENDING => return,
+            _ => {
+                self.data.ai_request_in_flight = false;
+                return;
             }
         }
+
+        // 요청 이후 입력이 바뀌었으면 오래된 결과는 버림
+        let Ok(c_input) = CString::new(self.command_line.text().to_string()) else {
+            return;
+        };
+        if !unsafe { is_same_input_from_cpp(c_input.as_ptr()) } {
+            unsafe { clear_ai_suggestions_from_cpp() };
+            return;
+        }
+
+        self.show_current_ai_suggestion();
+    }
+
+    /// 현재 제안(명령어 + 설명)을 팝업으로 표시
+    /// 목록은 바뀌었을 때만 한 번에 가져오고, 여러 개면 몇 번째인지 함께 표시
+    fn show_current_ai_suggestion(&mut self) {
+        self.data.ai_suggestions.refresh();
+        let list = &self.data.ai_suggestions;
+        let Some((command, description)) = list.current() else {
+            return;
+        };
+
+        let command = command.trim();
+        let description = description.trim();
+        if command.is_empty() && description.is_empty() {
+            return;
+        }
+        let mut text = String::with_capacity(command.len() + description.len() + 16);
+        text.push_str(command);
+        if !description.is_empty() {
+            text.push_str("  (");
+            text.push_str(description);
+            text.push(')');
+        }
+        if list.len() > 1 {
+            text.push_str(&format!("  [{}/{}]", list.current + 1, list.len()));
+        }
+
+        let suggestion = WString::from_str(&text);
+        self.data.ai_suggestion = Some(suggestion.clone());
+        self.show_ai_popup(&suggestion, self.data.ai_mode);
     }
 
     /// Tab: 현재 제안의 명령어만 적용 (설명 제거)
     fn apply_ai_command(&mut self) {
-        use std::ffi::CStr;
-        
         if !self.data.ai_popup_visible {
             return;
         }
-        
-        unsafe {
-            let ptr = get_ai_command_only_from_cpp();
-            
-            if !ptr.is_null() {
-                if let Ok(command_str) = CStr::from_ptr(ptr).to_str() {
-                    let command = WString::from_str(command_str);
-                    
-                    // 명령어만 적용 (설명 제거됨!)
-                    self.set_buffer_maintaining_pager(&command, command.len());
-                    self.clear_ai_popup();
-                }
-                free_ai_suggestion(ptr);
-            }
+
+        self.data.ai_suggestions.refresh();
+        let Some((command, _)) = self.data.ai_suggestions.current() else {
+            return;
+        };
+        if command.is_empty() {
+            return;
         }
+        let command = WString::from_str(command);
+
+        // 명령어만 적용 (설명 제거됨!)
+        self.set_buffer_maintaining_pager(&command, command.len());
+        self.clear_ai_popup();
     }
 
     /// Flash the screen. This function changes the color of the current line momentarily.
@@ -6172,10 +6339,12 @@ fn add_to_history(&mut self) {
         self.history.remove_ephemeral_items();
 
         if !text.is_empty() {
-            // C++ AI 매니저에 명령어 히스토리 전달
-            if let Ok(c_text) = CString::new(text.to_string()) {
-                unsafe {
-                    add_command_history_from_cpp(c_text.as_ptr());
+            // C++ AI 매니저에 명령어 히스토리 전달 (private 모드에서는 남기지 않음)
+            if !in_private_mode(self.vars()) {
+                if let Ok(c_text) = CString::new(text.to_string()) {
+                    unsafe {
+                        add_command_history_from_cpp(c_text.as_ptr());
+                    }
                 }
             }
             
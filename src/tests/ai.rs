@@ -0,0 +1,2723 @@
+use crate::tests::prelude::*;
+use std::ffi::{CStr, CString};
+use std::io::{BufRead, BufReader, Read, Write};
+use std::net::{TcpListener, TcpStream};
+use std::sync::mpsc;
+use std::time::{Duration, Instant, SystemTime, UNIX_EPOCH};
+
+extern "C" {
+    fn set_ai_backend_from_cpp(base_url: *const libc::c_char, api_key: *const libc::c_char);
+    fn submit_ai_request_from_cpp(input: *const libc::c_char, mode: libc::c_int) -> u64;
+    fn generate_ai_suggestions_from_cpp(input: *const libc::c_char, mode: libc::c_int);
+    fn poll_ai_request_from_cpp() -> libc::c_int;
+    fn ai_notify_fd_from_cpp() -> libc::c_int;
+    fn cancel_ai_request_from_cpp();
+    fn set_ai_debounce_ms_from_cpp(ms: libc::c_int);
+    fn set_ai_combined_requests_from_cpp(enabled: bool);
+    fn set_ai_similarity_threshold_from_cpp(threshold: f64);
+    fn scan_ai_command_risk_from_cpp(
+        command: *const libc::c_char,
+        buf: *mut libc::c_char,
+        cap: usize,
+    ) -> libc::c_int;
+    fn set_ai_rate_limit_from_cpp(per_minute: f64, burst: f64);
+    fn set_ai_private_mode_from_cpp(enabled: bool);
+    fn get_ai_directory_stats_from_cpp(
+        gathers: *mut u64,
+        hits: *mut u64,
+        misses: *mut u64,
+        invalidations: *mut u64,
+    );
+    fn get_ai_rate_limit_stats_from_cpp(
+        throttled: *mut u64,
+        rate_limited: *mut u64,
+        dropped: *mut u64,
+    );
+    fn get_ai_cache_stats_from_cpp(
+        hits: *mut u64,
+        disk_hits: *mut u64,
+        misses: *mut u64,
+        entries: *mut u64,
+        similar_hits: *mut u64,
+    );
+    fn new_ai_result_cache_from_cpp(
+        disk_path: *const libc::c_char,
+        capacity: usize,
+    ) -> *mut libc::c_void;
+    fn free_ai_result_cache_from_cpp(cache: *mut libc::c_void);
+    fn ai_result_cache_store_from_cpp(
+        cache: *mut libc::c_void,
+        key: *const libc::c_char,
+        value: *const libc::c_char,
+        ttl_seconds: i64,
+    );
+    fn ai_result_cache_lookup_from_cpp(
+        cache: *mut libc::c_void,
+        key: *const libc::c_char,
+        buf: *mut libc::c_char,
+        cap: usize,
+    ) -> bool;
+    fn get_ai_result_cache_stats_from_cpp(
+        cache: *mut libc::c_void,
+        hits: *mut u64,
+        disk_hits: *mut u64,
+        misses: *mut u64,
+        entries: *mut u64,
+    );
+    fn get_ai_request_stats_from_cpp(completed: *mut u64, cancelled: *mut u64, coalesced: *mut u64);
+    fn next_ai_suggestion_from_cpp();
+    fn clear_ai_suggestions_from_cpp();
+    fn get_ai_suggestions_from_cpp(
+        known_generation: u64,
+        buf: *mut libc::c_char,
+        cap: usize,
+        generation: *mut u64,
+        count: *mut u32,
+        current: *mut u32,
+    ) -> usize;
+    fn get_ai_command_only_from_cpp() -> *mut libc::c_char;
+    fn has_ai_suggestions_from_cpp() -> bool;
+    fn is_same_input_from_cpp(input: *const libc::c_char) -> bool;
+    fn free_ai_suggestion(ptr: *mut libc::c_char);
+    fn add_command_history_from_cpp(command: *const libc::c_char);
+    fn clear_command_history_from_cpp();
+    fn set_ai_workflow_rules_from_cpp(rules: *const libc::c_char);
+    fn add_ai_backend_from_cpp(
+        kind: *const libc::c_char,
+        base_url: *const libc::c_char,
+        model: *const libc::c_char,
+        api_key: *const libc::c_char,
+    ) -> bool;
+    fn set_ai_hedge_delay_ms_from_cpp(ms: libc::c_int);
+    fn set_ai_timeout_ms_from_cpp(mode: libc::c_int, ms: libc::c_int);
+    fn set_ai_breaker_cooldown_ms_from_cpp(ms: libc::c_int);
+    fn get_ai_backend_breaker_from_cpp(
+        index: libc::c_int,
+        open: *mut bool,
+        failures: *mut u32,
+    ) -> bool;
+    fn get_ai_backend_stats_from_cpp(
+        index: libc::c_int,
+        requests: *mut u64,
+        wins: *mut u64,
+        p95_ms: *mut libc::c_long,
+    ) -> bool;
+    fn set_ai_prompt_budget_from_cpp(tokens: libc::c_int);
+    fn get_ai_stats_from_cpp(json: bool, buf: *mut libc::c_char, cap: usize) -> usize;
+    fn load_ai_history_from_cpp(history_path: *const libc::c_char) -> bool;
+    fn queue_ai_history_load_from_cpp(history_path: *const libc::c_char);
+    fn run_ai_daemon_from_cpp(
+        socket_path: *const libc::c_char,
+        history_path: *const libc::c_char,
+    ) -> bool;
+    fn stop_ai_daemon_from_cpp();
+    fn set_ai_daemon_socket_from_cpp(socket_path: *const libc::c_char);
+    fn get_ai_history_stats_from_cpp(
+        entries: *mut u64,
+        commands: *mut u64,
+        memory_bytes: *mut u64,
+        mapped_bytes: *mut u64,
+    );
+}
+
+const AI_REQUEST_IDLE: libc::c_int = -1;
+const AI_REQUEST_READY: libc::c_int = 1;
+const AI_REQUEST_PARTIAL: libc::c_int = 2;
+
+/// Point the AI manager at a local stand-in server.
+/// Stand-in servers have no quota, so the client-side rate limit is turned off as well.
+fn set_backend(port: u16) {
+    let url = CString::new(format!("http://127.0.0.1:{}/v1", port)).unwrap();
+    let key = CString::new("test-key").unwrap();
+    unsafe { set_ai_backend_from_cpp(url.as_ptr(), key.as_ptr()) };
+    unsafe { set_ai_rate_limit_from_cpp(0.0, 0.0) };
+}
+
+/// Return an input that is not in the result cache, so the request really hits the server.
+fn uncached_input(prefix: &str) -> CString {
+    let nanos = SystemTime::now()
+        .duration_since(UNIX_EPOCH)
+        .unwrap()
+        .as_nanos();
+    CString::new(format!("{} {}", prefix, nanos)).unwrap()
+}
+
+/// Read one HTTP request (headers and body) and return its request line.
+fn read_request(stream: &TcpStream) -> String {
+    read_request_with_body(stream).0
+}
+
+/// Read one HTTP request and return its request line and body.
+fn read_request_with_body(stream: &TcpStream) -> (String, String) {
+    let mut reader = BufReader::new(stream);
+    let mut request_line = String::new();
+    reader.read_line(&mut request_line).unwrap();
+    let mut content_length = 0;
+    loop {
+        let mut line = String::new();
+        reader.read_line(&mut line).unwrap();
+        if line == "\r\n" || line.is_empty() {
+            break;
+        }
+        if let Some((name, value)) = line.split_once(':') {
+            if name.eq_ignore_ascii_case("content-length") {
+                content_length = value.trim().parse().unwrap();
+            }
+        }
+    }
+    let mut body = vec![0; content_length];
+    reader.read_exact(&mut body).unwrap();
+    (request_line, String::from_utf8_lossy(&body).into_owned())
+}
+
+/// Encode one Gemini streaming event carrying `text` as an HTTP chunk.
+fn sse_chunk(text: &str) -> String {
+    let escaped = text
+        .replace('\\', "\\\\")
+        .replace('"', "\\\"")
+        .replace('\n', "\\n");
+    let event = format!(
+        "data: {{\"candidates\":[{{\"content\":{{\"parts\":[{{\"text\":\"{}\"}}]}}}}]}}\r\n\r\n",
+        escaped
+    );
+    format!("{:x}\r\n{}\r\n", event.len(), event)
+}
+
+const SSE_HEADERS: &[u8] = b"HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n\
+    Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n";
+
+/// Answer one request on `stream` with a complete streamed response.
+fn serve_sse(mut stream: TcpStream, text: &str) {
+    read_request(&stream);
+    stream.write_all(SSE_HEADERS).unwrap();
+    stream.write_all(sse_chunk(text).as_bytes()).unwrap();
+    stream.write_all(b"0\r\n\r\n").unwrap();
+}
+
+/// Return the (completed, cancelled) request counters.
+fn request_stats() -> (u64, u64) {
+    let (mut completed, mut cancelled) = (0, 0);
+    unsafe { get_ai_request_stats_from_cpp(&mut completed, &mut cancelled, std::ptr::null_mut()) };
+    (completed, cancelled)
+}
+
+fn similar_hits() -> u64 {
+    let mut similar = 0;
+    let null = std::ptr::null_mut();
+    unsafe { get_ai_cache_stats_from_cpp(null, null, null, null, &mut similar) };
+    similar
+}
+
+fn coalesced_count() -> u64 {
+    let mut coalesced = 0;
+    unsafe {
+        get_ai_request_stats_from_cpp(std::ptr::null_mut(), std::ptr::null_mut(), &mut coalesced)
+    };
+    coalesced
+}
+
+fn wait_until(what: &str, mut cond: impl FnMut() -> bool) {
+    let deadline = Instant::now() + Duration::from_secs(10);
+    while !cond() {
+        assert!(Instant::now() < deadline, "timed out waiting for {}", what);
+        std::thread::sleep(Duration::from_millis(5));
+    }
+}
+
+/// Wait on the notification fd until the request reaches the given status.
+fn wait_for_status(want: libc::c_int) {
+    let deadline = Instant::now() + Duration::from_secs(10);
+    loop {
+        let mut pfd = libc::pollfd {
+            fd: unsafe { ai_notify_fd_from_cpp() },
+            events: libc::POLLIN,
+            revents: 0,
+        };
+        unsafe { libc::poll(&mut pfd, 1, 100) };
+        if unsafe { poll_ai_request_from_cpp() } == want {
+            return;
+        }
+        assert!(
+            Instant::now() < deadline,
+            "timed out waiting for AI request status {}",
+            want
+        );
+    }
+}
+
+/// Write `contents` as a fish history file in a fresh temporary directory and return its path.
+fn temp_history_file(contents: &str) -> CString {
+    let template = CString::new("/tmp/fish_test_ai_history.XXXXXX").unwrap();
+    let dir = unsafe { CString::from_raw(libc::mkdtemp(template.into_raw())) };
+    let path = format!("{}/fish_history", dir.to_str().unwrap());
+    std::fs::write(&path, contents).unwrap();
+    CString::new(path).unwrap()
+}
+
+/// Return the (entries, distinct commands) counts of the history store.
+fn history_counts() -> (u64, u64) {
+    let (mut entries, mut commands) = (0, 0);
+    unsafe {
+        get_ai_history_stats_from_cpp(
+            &mut entries,
+            &mut commands,
+            std::ptr::null_mut(),
+            std::ptr::null_mut(),
+        )
+    };
+    (entries, commands)
+}
+
+fn current_command() -> Option<String> {
+    unsafe {
+        let ptr = get_ai_command_only_from_cpp();
+        if ptr.is_null() {
+            return None;
+        }
+        let command = CStr::from_ptr(ptr).to_string_lossy().into_owned();
+        free_ai_suggestion(ptr);
+        Some(command)
+    }
+}
+
+#[test]
+#[serial]
+fn test_ai_streaming_publishes_first_suggestion_early() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    let (release_tx, release_rx) = mpsc::channel::<()>();
+
+    let server = std::thread::spawn(move || {
+        let (mut stream, _) = listener.accept().unwrap();
+        let request_line = read_request(&stream);
+        assert!(request_line.contains(":streamGenerateContent?alt=sse"));
+        stream.write_all(SSE_HEADERS).unwrap();
+        // The first line is complete, the second one is cut in the middle.
+        stream
+            .write_all(sse_chunk("ls -la | list all\nls -lh").as_bytes())
+            .unwrap();
+        stream.flush().unwrap();
+
+        // Hold back the rest of the response until the client has seen the first line.
+        release_rx.recv().unwrap();
+        stream
+            .write_all(sse_chunk(" | human readable sizes\n").as_bytes())
+            .unwrap();
+        stream.write_all(b"0\r\n\r\n").unwrap();
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    let input = uncached_input("ls stream");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+
+    wait_for_status(AI_REQUEST_PARTIAL);
+    assert_eq!(current_command().as_deref(), Some("ls -la"));
+
+    release_tx.send(()).unwrap();
+    wait_for_status(AI_REQUEST_READY);
+    server.join().unwrap();
+
+    assert_eq!(current_command().as_deref(), Some("ls -la"));
+    unsafe { next_ai_suggestion_from_cpp() };
+    assert_eq!(current_command().as_deref(), Some("ls -lh"));
+}
+
+#[test]
+#[serial]
+fn test_ai_cancel_aborts_transfer() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    let (started_tx, started_rx) = mpsc::channel::<()>();
+
+    let server = std::thread::spawn(move || {
+        let (mut stream, _) = listener.accept().unwrap();
+        read_request(&stream);
+        stream.write_all(SSE_HEADERS).unwrap();
+        stream.write_all(sse_chunk("ls -la").as_bytes()).unwrap();
+        started_tx.send(()).unwrap();
+
+        // The client should hang up without waiting for the rest of the response.
+        stream
+            .set_read_timeout(Some(Duration::from_secs(5)))
+            .unwrap();
+        let mut buf = [0; 64];
+        match stream.read(&mut buf) {
+            Ok(n) => n == 0,
+            Err(e) => e.kind() == std::io::ErrorKind::ConnectionReset,
+        }
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    let (completed, cancelled) = request_stats();
+    let input = uncached_input("find . -exec");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 2) };
+
+    started_rx.recv_timeout(Duration::from_secs(10)).unwrap();
+    unsafe { cancel_ai_request_from_cpp() };
+    assert!(server.join().unwrap(), "transfer was not aborted");
+
+    wait_until("the cancellation to be counted", || {
+        request_stats() == (completed, cancelled + 1)
+    });
+    assert_eq!(unsafe { poll_ai_request_from_cpp() }, AI_REQUEST_IDLE);
+}
+
+/// Stand-in backend that keeps connections open and answers every request on them with `text`,
+/// streaming the first line and the rest `gap` apart. Connection warm-ups get an empty answer.
+/// Returns the port and the number of connections accepted so far.
+fn spawn_keep_alive_server(
+    text: &'static str,
+    gap: Duration,
+) -> (u16, std::sync::Arc<std::sync::atomic::AtomicUsize>) {
+    use std::sync::atomic::{AtomicUsize, Ordering};
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    let accepts = std::sync::Arc::new(AtomicUsize::new(0));
+    let counter = accepts.clone();
+    std::thread::spawn(move || {
+        for stream in listener.incoming() {
+            let Ok(mut stream) = stream else { return };
+            counter.fetch_add(1, Ordering::SeqCst);
+            // Like a real server, do not hold back small writes (Nagle) behind delayed ACKs.
+            stream.set_nodelay(true).unwrap();
+            std::thread::spawn(move || {
+                loop {
+                    let (request_line, _) = read_request_with_body(&stream);
+                    if request_line.is_empty() {
+                        return;
+                    }
+                    if !request_line.starts_with("POST") {
+                        let _ = stream.write_all(b"HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+                        continue;
+                    }
+                    let (first, rest) =
+                        text.split_at(text.find('\n').map_or(text.len(), |i| i + 1));
+                    let headers = b"HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n\
+                        Transfer-Encoding: chunked\r\n\r\n";
+                    let _ = stream.write_all(headers);
+                    let _ = stream.write_all(sse_chunk(first).as_bytes());
+                    std::thread::sleep(gap);
+                    if !rest.is_empty() {
+                        let _ = stream.write_all(sse_chunk(rest).as_bytes());
+                    }
+                    if stream.write_all(b"0\r\n\r\n").is_err() {
+                        return;
+                    }
+                }
+            });
+        }
+    });
+    (port, accepts)
+}
+
+#[test]
+#[serial]
+fn test_ai_requests_reuse_one_connection() {
+    use std::sync::atomic::Ordering;
+    let (port, accepts) = spawn_keep_alive_server("git status | show status\n", Duration::ZERO);
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+
+    // Every request after the first goes over the connection the first one opened.
+    for _ in 0..5 {
+        let input = uncached_input("git st");
+        unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+        wait_for_status(AI_REQUEST_READY);
+        assert_eq!(current_command().as_deref(), Some("git status"));
+    }
+    assert_eq!(accepts.load(Ordering::SeqCst), 1);
+}
+
+#[test]
+#[serial]
+fn test_ai_debounce_collapses_rapid_requests() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    listener.set_nonblocking(true).unwrap();
+    let (stop_tx, stop_rx) = mpsc::channel::<()>();
+
+    // Count requests until told to stop.
+    let server = std::thread::spawn(move || {
+        let mut requests = 0;
+        while stop_rx.try_recv().is_err() {
+            match listener.accept() {
+                Ok((stream, _)) => {
+                    stream.set_nonblocking(false).unwrap();
+                    serve_sse(stream, "git status | show the working tree status\n");
+                    requests += 1;
+                }
+                Err(_) => std::thread::sleep(Duration::from_millis(5)),
+            }
+        }
+        requests
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(200) };
+    let (_, cancelled) = request_stats();
+    for i in 0..5 {
+        let input = uncached_input(&format!("git st{}", i));
+        unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    }
+
+    wait_for_status(AI_REQUEST_READY);
+    assert_eq!(current_command().as_deref(), Some("git status"));
+    stop_tx.send(()).unwrap();
+    assert_eq!(server.join().unwrap(), 1);
+    assert_eq!(request_stats().1, cancelled + 4);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+}
+
+#[test]
+#[serial]
+fn test_ai_local_completion_precedes_remote() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    let (release_tx, release_rx) = mpsc::channel::<()>();
+
+    let server = std::thread::spawn(move || {
+        let (stream, _) = listener.accept().unwrap();
+        release_rx.recv().unwrap();
+        serve_sse(
+            stream,
+            "cargo build --release | optimized build\ncargo bench | run benchmarks\n",
+        );
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    let prefix = uncached_input("cargo");
+    for suffix in [" build --release", " build --release", " test"] {
+        let command = CString::new(format!("{}{}", prefix.to_str().unwrap(), suffix)).unwrap();
+        unsafe { add_command_history_from_cpp(command.as_ptr()) };
+    }
+    unsafe { submit_ai_request_from_cpp(prefix.as_ptr(), 1) };
+
+    // History matches are published before the server has answered.
+    wait_for_status(AI_REQUEST_PARTIAL);
+    let most_frequent = format!("{} build --release", prefix.to_str().unwrap());
+    assert_eq!(current_command().as_deref(), Some(most_frequent.as_str()));
+
+    release_tx.send(()).unwrap();
+    wait_for_status(AI_REQUEST_READY);
+    server.join().unwrap();
+
+    // Remote suggestions follow the local ones.
+    let mut commands = vec![];
+    for _ in 0..3 {
+        commands.push(current_command().unwrap());
+        unsafe { next_ai_suggestion_from_cpp() };
+    }
+    assert_eq!(commands[0], most_frequent);
+    assert!(commands[1].ends_with(" test"));
+    assert_eq!(commands[2], "cargo build --release");
+    unsafe { clear_command_history_from_cpp() };
+}
+
+#[test]
+#[serial]
+fn test_ai_history_store_loads_fish_history() {
+    let path = temp_history_file(concat!(
+        "- cmd: make -j8\n",
+        "  when: 1700000000\n",
+        "- cmd: echo one\\ntwo\n",
+        "  when: 1700000001\n",
+        "  paths:\n",
+        "    - two\n",
+        "- cmd: make -j8\n",
+        "  when: 1700000002\n",
+        "- cmd: make install\n",
+        "  when: 1700000003\n",
+    ));
+    assert!(unsafe { load_ai_history_from_cpp(path.as_ptr()) });
+    assert_eq!(history_counts(), (4, 3));
+
+    // Without an API key, generation is answered from the loaded history alone.
+    let url = CString::new("http://127.0.0.1:9/v1").unwrap();
+    let no_key = CString::new("").unwrap();
+    unsafe { set_ai_backend_from_cpp(url.as_ptr(), no_key.as_ptr()) };
+    let input = CString::new("make").unwrap();
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    assert_eq!(current_command().as_deref(), Some("make -j8"));
+    unsafe { next_ai_suggestion_from_cpp() };
+    assert_eq!(current_command().as_deref(), Some("make install"));
+
+    let input = CString::new("echo").unwrap();
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    assert_eq!(current_command().as_deref(), Some("echo one\ntwo"));
+
+    // The first prompt hands the load to the worker instead of waiting for it.
+    unsafe { clear_command_history_from_cpp() };
+    assert_eq!(history_counts(), (0, 0));
+    unsafe { queue_ai_history_load_from_cpp(path.as_ptr()) };
+    wait_until("the history to load in the background", || {
+        history_counts() == (4, 3)
+    });
+    unsafe { clear_command_history_from_cpp() };
+}
+
+#[test]
+#[serial]
+fn test_ai_commands_recorded_before_history_load_survive_it() {
+    let path = temp_history_file(concat!(
+        "- cmd: git status\n",
+        "  when: 1700000000\n",
+        "- cmd: git log\n",
+        "  when: 1700000001\n",
+    ));
+    unsafe { clear_command_history_from_cpp() };
+
+    // Commands run before the lazily created manager reads the history file are replayed
+    // first and the file is loaded on the worker afterwards; the load must keep them.
+    for command in ["git push --force-with-lease", "git log"] {
+        let command = CString::new(command).unwrap();
+        unsafe { add_command_history_from_cpp(command.as_ptr()) };
+    }
+    unsafe { queue_ai_history_load_from_cpp(path.as_ptr()) };
+    wait_until("the history to load in the background", || {
+        history_counts() == (4, 3)
+    });
+
+    let url = CString::new("http://127.0.0.1:9/v1").unwrap();
+    let no_key = CString::new("").unwrap();
+    unsafe { set_ai_backend_from_cpp(url.as_ptr(), no_key.as_ptr()) };
+    let input = CString::new("git p").unwrap();
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    assert_eq!(
+        current_command().as_deref(),
+        Some("git push --force-with-lease")
+    );
+    unsafe { clear_command_history_from_cpp() };
+}
+
+#[test]
+#[serial]
+fn test_ai_history_survives_rewritten_history_file() {
+    let path = temp_history_file(concat!(
+        "- cmd: cargo build --workspace\n",
+        "  when: 1700000000\n",
+        "- cmd: cargo bench\n",
+        "  when: 1700000001\n",
+    ));
+    assert!(unsafe { load_ai_history_from_cpp(path.as_ptr()) });
+
+    // fish rewrites its history file in place when it vacuums or merges sessions.
+    std::fs::write(path.to_str().unwrap(), "").unwrap();
+
+    let url = CString::new("http://127.0.0.1:9/v1").unwrap();
+    let no_key = CString::new("").unwrap();
+    unsafe { set_ai_backend_from_cpp(url.as_ptr(), no_key.as_ptr()) };
+    let input = CString::new("cargo b").unwrap();
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    let commands: Vec<String> = all_suggestions().into_iter().map(|(c, _)| c).collect();
+    assert!(
+        commands.contains(&"cargo build --workspace".to_string()),
+        "{:?}",
+        commands
+    );
+    unsafe { clear_command_history_from_cpp() };
+}
+
+// Run with cargo +nightly bench --features=benchmark (or benchmarks/ai_driver.sh)
+#[cfg(feature = "benchmark")]
+mod bench {
+    extern crate test;
+    use super::{
+        AI_REQUEST_PARTIAL, AI_REQUEST_READY, ai_notify_fd_from_cpp, get_ai_history_stats_from_cpp,
+        load_ai_history_from_cpp, poll_ai_request_from_cpp, read_request_with_body, request_stats,
+        set_ai_debounce_ms_from_cpp, set_ai_similarity_threshold_from_cpp, set_backend,
+        similar_hits, spawn_keep_alive_server, sse_chunk, submit_ai_request_from_cpp,
+        temp_history_file, uncached_input, wait_for_status,
+    };
+    use std::ffi::CString;
+    use std::io::Write;
+    use std::net::{TcpListener, TcpStream};
+    use std::time::{Duration, Instant};
+    use test::Bencher;
+
+    extern "C" {
+        fn run_ai_bench_stage_from_cpp(
+            stage: libc::c_int,
+            text: *const libc::c_char,
+            mode: libc::c_int,
+        ) -> usize;
+        fn get_ai_alloc_count_from_cpp() -> u64;
+    }
+
+    // Stage numbers of run_ai_bench_stage_from_cpp (AIBenchStage).
+    const STAGE_TRIM: libc::c_int = 0;
+    const STAGE_REMOVE_MARKDOWN: libc::c_int = 1;
+    const STAGE_PARSE: libc::c_int = 2;
+    const STAGE_CONTEXT: libc::c_int = 3;
+    const STAGE_PROMPT: libc::c_int = 4;
+    const STAGE_SIMILAR: libc::c_int = 5;
+    const STAGE_RISK: libc::c_int = 6;
+
+    /// A history with `entries` entries over `entries / 5` distinct commands.
+    fn generate_history(entries: u32) -> String {
+        let distinct = (entries / 5).max(1);
+        let mut history = String::new();
+        for i in 0..entries {
+            let k = i.wrapping_mul(7919) % distinct;
+            history += &format!(
+                "- cmd: git commit -m \"change {}\" && make -j8 target{}\n  when: {}\n",
+                k,
+                k % 50,
+                1_700_000_000 + i
+            );
+            if i % 10 == 0 {
+                history += &format!("  paths:\n    - src/file{}.c\n", k);
+            }
+        }
+        history
+    }
+
+    /// A model answer with `lines` suggestions, optionally wrapped in a markdown code block.
+    fn generate_response(lines: usize, markdown: bool) -> String {
+        let mut response = String::new();
+        if markdown {
+            response += "Here you go:\n```bash\n";
+        }
+        for i in 0..lines {
+            response += &format!(
+                "{}. `find . -name '*.rs' -newer file{}` | 최근에 바뀐 Rust 파일 {}개 찾기\n",
+                i % 9 + 1,
+                i,
+                i
+            );
+        }
+        if markdown {
+            response += "```\n";
+        }
+        format!("  \n{}\n\t ", response)
+    }
+
+    /// Run `f` a number of times and return the C++ allocations per call.
+    fn allocs_per_call(mut f: impl FnMut()) -> f64 {
+        const CALLS: u64 = 100;
+        let before = unsafe { get_ai_alloc_count_from_cpp() };
+        for _ in 0..CALLS {
+            f();
+        }
+        (unsafe { get_ai_alloc_count_from_cpp() } - before) as f64 / CALLS as f64
+    }
+
+    /// Benchmark one processing stage on `text`, reporting allocations per call.
+    fn bench_stage(b: &mut Bencher, name: &str, stage: libc::c_int, text: &str) {
+        let text = CString::new(text).unwrap();
+        let run = || unsafe { run_ai_bench_stage_from_cpp(stage, text.as_ptr(), 1) };
+        b.bytes = text.as_bytes().len() as u64;
+        b.iter(run);
+        eprintln!(
+            "ai {}: {:.1} allocations per call",
+            name,
+            allocs_per_call(|| {
+                run();
+            })
+        );
+    }
+
+    fn load_history(entries: u32) {
+        let path = temp_history_file(&generate_history(entries));
+        assert!(unsafe { load_ai_history_from_cpp(path.as_ptr()) });
+    }
+
+    #[bench]
+    fn bench_ai_history_load(b: &mut Bencher) {
+        let history = generate_history(100_000);
+        let path = temp_history_file(&history);
+        b.bytes = history.len() as u64;
+        b.iter(|| unsafe { load_ai_history_from_cpp(path.as_ptr()) });
+
+        let (mut entries, mut memory) = (0, 0);
+        unsafe {
+            get_ai_history_stats_from_cpp(
+                &mut entries,
+                std::ptr::null_mut(),
+                &mut memory,
+                std::ptr::null_mut(),
+            )
+        };
+        eprintln!(
+            "ai history: {} entries, {:.1} heap bytes per entry",
+            entries,
+            memory as f64 / entries as f64
+        );
+    }
+
+    #[bench]
+    fn bench_ai_trim(b: &mut Bencher) {
+        bench_stage(b, "trim", STAGE_TRIM, &generate_response(5, false));
+    }
+
+    #[bench]
+    fn bench_ai_remove_markdown(b: &mut Bencher) {
+        bench_stage(
+            b,
+            "remove_markdown",
+            STAGE_REMOVE_MARKDOWN,
+            &generate_response(5, true),
+        );
+    }
+
+    #[bench]
+    fn bench_ai_parse_suggestions(b: &mut Bencher) {
+        bench_stage(
+            b,
+            "parse_suggestions",
+            STAGE_PARSE,
+            &generate_response(5, true),
+        );
+    }
+
+    #[bench]
+    fn bench_ai_parse_suggestions_long(b: &mut Bencher) {
+        let response = generate_response(40, true);
+        bench_stage(b, "parse_suggestions (40 lines)", STAGE_PARSE, &response);
+    }
+
+    #[bench]
+    fn bench_ai_prompt_assembly(b: &mut Bencher) {
+        load_history(10_000);
+        bench_stage(b, "prompt assembly", STAGE_PROMPT, "git commit -m");
+    }
+
+    #[bench]
+    fn bench_ai_context_100(b: &mut Bencher) {
+        load_history(100);
+        bench_stage(b, "context (100 entries)", STAGE_CONTEXT, "");
+    }
+
+    #[bench]
+    fn bench_ai_context_10k(b: &mut Bencher) {
+        load_history(10_000);
+        bench_stage(b, "context (10k entries)", STAGE_CONTEXT, "");
+    }
+
+    #[bench]
+    fn bench_ai_context_100k(b: &mut Bencher) {
+        load_history(100_000);
+        bench_stage(b, "context (100k entries)", STAGE_CONTEXT, "");
+    }
+
+    #[bench]
+    fn bench_ai_risk_scan(b: &mut Bencher) {
+        bench_stage(
+            b,
+            "risk scan",
+            STAGE_RISK,
+            "sudo find /var/log -name '*.gz' -mtime +30 -exec rm {} \\; && \
+             tar -czf backup.tar.gz ~/projects 2>&1 | tee log.txt; curl -fsSL https://x.sh | sh",
+        );
+    }
+
+    /// A scripted mock server behavior: delay before answering and answer size.
+    struct Scenario {
+        name: &'static str,
+        latency: Duration,
+        lines: usize,
+    }
+
+    const SCENARIOS: &[Scenario] = &[
+        Scenario {
+            name: "small",
+            latency: Duration::ZERO,
+            lines: 3,
+        },
+        Scenario {
+            name: "large",
+            latency: Duration::ZERO,
+            lines: 40,
+        },
+        Scenario {
+            name: "slow",
+            latency: Duration::from_millis(20),
+            lines: 5,
+        },
+    ];
+
+    /// Answer every request on a keep-alive connection with a streamed Gemini response.
+    fn serve_mock_gemini(mut stream: TcpStream, latency: Duration, response: &str) {
+        loop {
+            let (request_line, _) = read_request_with_body(&stream);
+            if request_line.is_empty() {
+                return;
+            }
+            std::thread::sleep(latency);
+            let headers = b"HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n\
+                Transfer-Encoding: chunked\r\n\r\n";
+            let mut out = headers.to_vec();
+            for line in response.split_inclusive('\n') {
+                out.extend_from_slice(sse_chunk(line).as_bytes());
+            }
+            out.extend_from_slice(b"0\r\n\r\n");
+            if stream.write_all(&out).is_err() {
+                return;
+            }
+        }
+    }
+
+    /// Start a mock Gemini server for `scenario` and point the AI manager at it.
+    fn start_mock_gemini(scenario: &Scenario) {
+        let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+        let port = listener.local_addr().unwrap().port();
+        let (latency, response) = (scenario.latency, generate_response(scenario.lines, true));
+        std::thread::spawn(move || {
+            for stream in listener.incoming() {
+                let response = response.clone();
+                std::thread::spawn(move || serve_mock_gemini(stream.unwrap(), latency, &response));
+            }
+        });
+        set_backend(port);
+    }
+
+    /// Submit one uncached completion request and wait for the result.
+    /// Returns the latency and the number of C++ allocations made meanwhile.
+    fn timed_request() -> (Duration, u64) {
+        let input = uncached_input("git log --since");
+        let before = unsafe { get_ai_alloc_count_from_cpp() };
+        let start = Instant::now();
+        unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+        wait_for_status(AI_REQUEST_READY);
+        let elapsed = start.elapsed();
+        (elapsed, unsafe { get_ai_alloc_count_from_cpp() } - before)
+    }
+
+    /// End-to-end latency through the C API against a local mock server,
+    /// with p50/p99 latency and C++ allocations per request for each scenario.
+    #[bench]
+    fn bench_ai_end_to_end_latency(b: &mut Bencher) {
+        const REQUESTS: usize = 200;
+        unsafe { set_ai_debounce_ms_from_cpp(0) };
+        for scenario in SCENARIOS {
+            start_mock_gemini(scenario);
+            timed_request(); // warm up the connection
+            let mut latencies = Vec::with_capacity(REQUESTS);
+            let mut allocs = 0;
+            for _ in 0..REQUESTS {
+                let (latency, count) = timed_request();
+                latencies.push(latency);
+                allocs += count;
+            }
+            latencies.sort();
+            eprintln!(
+                "ai end-to-end {}: p50 {:?}, p99 {:?}, {:.1} allocations per request",
+                scenario.name,
+                latencies[REQUESTS / 2],
+                latencies[REQUESTS * 99 / 100],
+                allocs as f64 / REQUESTS as f64
+            );
+        }
+
+        start_mock_gemini(&SCENARIOS[0]);
+        b.iter(timed_request);
+    }
+
+    /// Submit one uncached completion request and return the time until its first suggestion
+    /// is published, then wait for the rest of the answer.
+    fn time_to_first_suggestion() -> Duration {
+        let input = uncached_input("git st");
+        let start = Instant::now();
+        unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+        let status = loop {
+            let mut pfd = libc::pollfd {
+                fd: unsafe { ai_notify_fd_from_cpp() },
+                events: libc::POLLIN,
+                revents: 0,
+            };
+            unsafe { libc::poll(&mut pfd, 1, 100) };
+            let status = unsafe { poll_ai_request_from_cpp() };
+            if status == AI_REQUEST_PARTIAL || status == AI_REQUEST_READY {
+                break status;
+            }
+            assert!(start.elapsed() < Duration::from_secs(10));
+        };
+        let first = start.elapsed();
+        if status == AI_REQUEST_PARTIAL {
+            wait_for_status(AI_REQUEST_READY);
+        }
+        first
+    }
+
+    /// Time to the first streamed suggestion for the first request to a new backend, which has
+    /// to connect, and for later requests over the kept-alive connection, with the number of
+    /// connections the local stand-in accepted.
+    #[bench]
+    fn bench_ai_time_to_first_byte(b: &mut Bencher) {
+        const REQUESTS: usize = 100;
+        unsafe { set_ai_debounce_ms_from_cpp(0) };
+        let (port, accepts) = spawn_keep_alive_server(
+            "git status | show status\ngit stash | stash changes\n",
+            Duration::from_millis(2),
+        );
+        set_backend(port);
+        let first = time_to_first_suggestion();
+        let mut later: Vec<Duration> = (0..REQUESTS).map(|_| time_to_first_suggestion()).collect();
+        later.sort();
+        eprintln!(
+            "ai time to first byte: first request {:?}, later requests p50 {:?}, p99 {:?}, \
+             {} connections for {} requests",
+            first,
+            later[REQUESTS / 2],
+            later[REQUESTS * 99 / 100],
+            accepts.load(std::sync::atomic::Ordering::SeqCst),
+            REQUESTS + 1
+        );
+
+        b.iter(time_to_first_suggestion);
+    }
+
+    /// A replay of `count` interactive commands: a few dozen habits typed with varying
+    /// spacing, flag order, paths, hashes and numbers. `tag` keeps runs apart in the cache.
+    fn generate_replay(count: usize, tag: &str) -> Vec<String> {
+        let mut seed = 0x2545_f491_4f6c_dd1du64;
+        let mut next = move |n: u64| {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            seed % n
+        };
+        let mut replay = Vec::with_capacity(count);
+        for _ in 0..count {
+            let (n, hash, dir) = (next(5000), next(1 << 40), next(30));
+            let path = format!("src/module{}/file{}.rs", dir, next(20));
+            let flags = ["-la", "-al", "-l -a", "-lah"][next(4) as usize];
+            let command = match next(12) {
+                0 => format!("ls {} {}", flags, path),
+                1 => format!("git show {:010x}", hash),
+                2 => format!("git commit -m \"fix issue {}\"", n),
+                3 => format!("head -n {} {}", n, path),
+                4 => format!("kill -9 {}", n),
+                5 => format!("docker logs -f {:012x}", hash),
+                6 => format!("tar -xzf release-{}.tar.gz", n),
+                7 => format!("grep -rn TODO {}", path),
+                8 => format!("cargo test --release module{}", dir),
+                9 => format!("ssh -p {} deploy@10.0.{}.{}", n, dir, next(255)),
+                10 => format!("du -sh {}", path),
+                _ => format!("chmod 644 {}", path),
+            };
+            // Stray spaces as typed by hand
+            let command = if next(3) == 0 {
+                format!("{} ", command.replacen(' ', "  ", 1))
+            } else {
+                command
+            };
+            replay.push(format!("{} {}", command, tag));
+        }
+        replay
+    }
+
+    /// Explain every command of a replay and return the number of API calls made.
+    fn replay_api_calls(replay: &[String]) -> u64 {
+        let before = request_stats().0;
+        for command in replay {
+            let input = CString::new(command.as_str()).unwrap();
+            unsafe { submit_ai_request_from_cpp(input.as_ptr(), 2) };
+            wait_for_status(AI_REQUEST_READY);
+        }
+        request_stats().0 - before
+    }
+
+    /// API calls for explaining a history replay with exact matching only and with
+    /// near-duplicate reuse, then the cost of one canonicalize + similarity lookup.
+    #[bench]
+    fn bench_ai_history_replay(b: &mut Bencher) {
+        const COMMANDS: usize = 500;
+        unsafe { set_ai_debounce_ms_from_cpp(0) };
+        start_mock_gemini(&SCENARIOS[0]);
+
+        let tag = uncached_input("run")
+            .into_string()
+            .unwrap()
+            .replace(' ', "");
+        unsafe { set_ai_similarity_threshold_from_cpp(0.0) };
+        let exact = replay_api_calls(&generate_replay(COMMANDS, &format!("{}a", tag)));
+        unsafe { set_ai_similarity_threshold_from_cpp(0.85) };
+        let similar_before = similar_hits();
+        let replay = generate_replay(COMMANDS, &format!("{}b", tag));
+        let similar = replay_api_calls(&replay);
+        eprintln!(
+            "ai history replay ({} commands): {} API calls exact, {} with similar reuse \
+             ({:.0}% fewer, {} reused)",
+            COMMANDS,
+            exact,
+            similar,
+            100.0 * (exact - similar) as f64 / exact as f64,
+            similar_hits() - similar_before
+        );
+
+        let text = CString::new(replay[COMMANDS / 2].as_str()).unwrap();
+        b.iter(|| unsafe { run_ai_bench_stage_from_cpp(STAGE_SIMILAR, text.as_ptr(), 2) });
+    }
+}
+
+#[test]
+#[serial]
+fn test_ai_workflow_rules_from_table() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+
+    // Answer each request with a fixed suggestion and hand back the prompt it carried.
+    let (prompt_tx, prompt_rx) = mpsc::channel::<String>();
+    let server = std::thread::spawn(move || {
+        for _ in 0..2 {
+            let (mut stream, _) = listener.accept().unwrap();
+            let (_, body) = read_request_with_body(&stream);
+            prompt_tx.send(body).unwrap();
+            stream.write_all(SSE_HEADERS).unwrap();
+            stream
+                .write_all(sse_chunk("ls | list\n").as_bytes())
+                .unwrap();
+            stream.write_all(b"0\r\n\r\n").unwrap();
+        }
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { clear_command_history_from_cpp() };
+    let rules = CString::new("Zig Workflow | 2 | zig build, zig test").unwrap();
+    unsafe { set_ai_workflow_rules_from_cpp(rules.as_ptr()) };
+    for command in [
+        "zig build",
+        "sudo docker ps",
+        "zig test -Doptimize=ReleaseFast",
+        "docker compose up",
+    ] {
+        let command = CString::new(command).unwrap();
+        unsafe { add_command_history_from_cpp(command.as_ptr()) };
+    }
+
+    let input = uncached_input("zig");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    let prompt = prompt_rx.recv().unwrap();
+    assert!(prompt.contains("Zig Workflow"), "{}", prompt);
+    assert!(prompt.contains("Docker Workflow"), "{}", prompt);
+
+    // Once the matching commands leave the recent window, the workflows expire.
+    for _ in 0..20 {
+        let command = CString::new("echo hi").unwrap();
+        unsafe { add_command_history_from_cpp(command.as_ptr()) };
+    }
+    let input = uncached_input("zig");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    let prompt = prompt_rx.recv().unwrap();
+    assert!(!prompt.contains("Workflow"), "{}", prompt);
+
+    server.join().unwrap();
+    unsafe { clear_command_history_from_cpp() };
+    unsafe { set_ai_workflow_rules_from_cpp(std::ptr::null()) };
+}
+
+#[test]
+#[serial]
+fn test_ai_prompt_dedupes_and_trims_to_budget() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+
+    let (prompt_tx, prompt_rx) = mpsc::channel::<String>();
+    let server = std::thread::spawn(move || {
+        for _ in 0..2 {
+            let (mut stream, _) = listener.accept().unwrap();
+            let (_, body) = read_request_with_body(&stream);
+            prompt_tx.send(body).unwrap();
+            stream.write_all(SSE_HEADERS).unwrap();
+            stream
+                .write_all(sse_chunk("ls | list\n").as_bytes())
+                .unwrap();
+            stream.write_all(b"0\r\n\r\n").unwrap();
+        }
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { clear_command_history_from_cpp() };
+    for i in 1..=12 {
+        let command = CString::new(format!("echo step-{:02}", i)).unwrap();
+        unsafe { add_command_history_from_cpp(command.as_ptr()) };
+    }
+    // Same command with different spacing: only the latest copy is kept.
+    let command = CString::new("echo   step-03").unwrap();
+    unsafe { add_command_history_from_cpp(command.as_ptr()) };
+
+    // The default budget fits the whole recent window.
+    let input = uncached_input("echo");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    let prompt = prompt_rx.recv().unwrap();
+    assert_eq!(prompt.matches("echo step-03").count(), 1, "{}", prompt);
+    assert!(prompt.contains("echo step-01"), "{}", prompt);
+
+    // A tight budget drops the oldest commands first.
+    unsafe { set_ai_prompt_budget_from_cpp(150) };
+    let input = uncached_input("echo");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    let prompt = prompt_rx.recv().unwrap();
+    assert!(!prompt.contains("echo step-01"), "{}", prompt);
+    assert!(prompt.contains("echo step-03"), "{}", prompt);
+    assert!(prompt.contains("echo step-12"), "{}", prompt);
+
+    server.join().unwrap();
+    unsafe { set_ai_prompt_budget_from_cpp(512) };
+    unsafe { clear_command_history_from_cpp() };
+}
+
+/// Decode the length-prefixed records written by get_ai_suggestions_from_cpp.
+fn decode_suggestions(buf: &[u8]) -> Vec<(String, String)> {
+    let mut fields = Vec::new();
+    let mut pos = 0;
+    while pos < buf.len() {
+        let len = u32::from_ne_bytes(buf[pos..pos + 4].try_into().unwrap()) as usize;
+        fields.push(String::from_utf8(buf[pos + 4..pos + 4 + len].to_vec()).unwrap());
+        pos += 4 + len;
+    }
+    fields
+        .chunks(2)
+        .map(|pair| (pair[0].clone(), pair[1].clone()))
+        .collect()
+}
+
+#[test]
+#[serial]
+fn test_ai_suggestions_batch_export() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    let server = std::thread::spawn(move || {
+        let (mut stream, _) = listener.accept().unwrap();
+        read_request(&stream);
+        stream.write_all(SSE_HEADERS).unwrap();
+        let text = "git status | 작업 트리 상태\ngit stash | 변경 사항 보관\ngit show\n";
+        stream.write_all(sse_chunk(text).as_bytes()).unwrap();
+        stream.write_all(b"0\r\n\r\n").unwrap();
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { clear_command_history_from_cpp() };
+    let input = uncached_input("git s");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    server.join().unwrap();
+
+    // A buffer that is too small is left untouched and the needed size is returned.
+    let (mut generation, mut count, mut current) = (0, 0, 0);
+    let needed = unsafe {
+        get_ai_suggestions_from_cpp(
+            0,
+            std::ptr::null_mut(),
+            0,
+            &mut generation,
+            &mut count,
+            &mut current,
+        )
+    };
+    assert_eq!(count, 3);
+    assert_eq!(current, 0);
+
+    let mut buf = vec![0u8; needed];
+    let written = unsafe {
+        get_ai_suggestions_from_cpp(
+            0,
+            buf.as_mut_ptr().cast(),
+            buf.len(),
+            &mut generation,
+            &mut count,
+            &mut current,
+        )
+    };
+    assert_eq!(written, needed);
+    assert_eq!(
+        decode_suggestions(&buf),
+        vec![
+            ("git status".to_string(), "작업 트리 상태".to_string()),
+            ("git stash".to_string(), "변경 사항 보관".to_string()),
+            ("git show".to_string(), String::new()),
+        ]
+    );
+
+    // Cycling keeps the generation, so the caller's copy stays valid.
+    unsafe { next_ai_suggestion_from_cpp() };
+    let known = generation;
+    let written = unsafe {
+        get_ai_suggestions_from_cpp(
+            known,
+            buf.as_mut_ptr().cast(),
+            buf.len(),
+            &mut generation,
+            &mut count,
+            &mut current,
+        )
+    };
+    assert_eq!((written, generation, current), (0, known, 1));
+
+    unsafe { clear_ai_suggestions_from_cpp() };
+    unsafe {
+        get_ai_suggestions_from_cpp(
+            known,
+            buf.as_mut_ptr().cast(),
+            buf.len(),
+            &mut generation,
+            &mut count,
+            &mut current,
+        )
+    };
+    assert_ne!(generation, known);
+    assert_eq!(count, 0);
+}
+
+/// Encode one OpenAI-compatible streaming event carrying `text` as an HTTP chunk.
+fn openai_sse_chunk(text: &str) -> String {
+    let escaped = text.replace('"', "\\\"").replace('\n', "\\n");
+    let event = format!(
+        "data: {{\"choices\":[{{\"delta\":{{\"content\":\"{}\"}}}}]}}\r\n\r\ndata: [DONE]\r\n\r\n",
+        escaped
+    );
+    format!("{:x}\r\n{}\r\n", event.len(), event)
+}
+
+/// Stand-in backend: answer `requests` connections, each after `delay`.
+/// Sends back the request lines it saw.
+fn spawn_delayed_server(
+    requests: usize,
+    delay: Duration,
+    chunk: String,
+) -> (u16, std::thread::JoinHandle<Vec<String>>) {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    let server = std::thread::spawn(move || {
+        let mut seen = Vec::new();
+        for _ in 0..requests {
+            let (mut stream, _) = listener.accept().unwrap();
+            seen.push(read_request(&stream));
+            std::thread::sleep(delay);
+            // The client may already have hung up if the other backend won.
+            let _ = stream.write_all(SSE_HEADERS);
+            let _ = stream.write_all(chunk.as_bytes());
+            let _ = stream.write_all(b"0\r\n\r\n");
+        }
+        seen
+    });
+    (port, server)
+}
+
+fn backend_stats(index: i32) -> (u64, u64) {
+    let (mut requests, mut wins) = (0, 0);
+    assert!(unsafe {
+        get_ai_backend_stats_from_cpp(index, &mut requests, &mut wins, std::ptr::null_mut())
+    });
+    (requests, wins)
+}
+
+#[test]
+#[serial]
+fn test_ai_hedged_request_takes_faster_backend() {
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { set_ai_hedge_delay_ms_from_cpp(100) };
+    unsafe { clear_command_history_from_cpp() };
+    let kind = CString::new("openai").unwrap();
+    let model = CString::new("local-model").unwrap();
+    let no_key = CString::new("").unwrap();
+
+    // A fast primary answers before the hedge delay, so the secondary is never asked.
+    let (primary, primary_server) =
+        spawn_delayed_server(1, Duration::ZERO, sse_chunk("from-primary | fast\n"));
+    let (secondary, secondary_server) = spawn_delayed_server(
+        0,
+        Duration::ZERO,
+        openai_sse_chunk("from-secondary | fast\n"),
+    );
+    set_backend(primary);
+    let url = CString::new(format!("http://127.0.0.1:{}/v1", secondary)).unwrap();
+    assert!(unsafe {
+        add_ai_backend_from_cpp(kind.as_ptr(), url.as_ptr(), model.as_ptr(), no_key.as_ptr())
+    });
+    let input = uncached_input("from");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    assert_eq!(current_command().as_deref(), Some("from-primary"));
+    assert_eq!(backend_stats(1), (0, 0));
+    primary_server.join().unwrap();
+    secondary_server.join().unwrap();
+
+    // A slow primary gets hedged: the secondary's answer is used well before the primary's.
+    let (primary, primary_server) = spawn_delayed_server(
+        1,
+        Duration::from_millis(1500),
+        sse_chunk("from-primary | slow\n"),
+    );
+    let (secondary, secondary_server) = spawn_delayed_server(
+        1,
+        Duration::from_millis(20),
+        openai_sse_chunk("from-secondary | fast\n"),
+    );
+    set_backend(primary);
+    let url = CString::new(format!("http://127.0.0.1:{}/v1", secondary)).unwrap();
+    assert!(unsafe {
+        add_ai_backend_from_cpp(kind.as_ptr(), url.as_ptr(), model.as_ptr(), no_key.as_ptr())
+    });
+    let started = Instant::now();
+    let input = uncached_input("from");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    assert!(started.elapsed() < Duration::from_millis(1000));
+    assert_eq!(current_command().as_deref(), Some("from-secondary"));
+    assert_eq!(backend_stats(0), (1, 0));
+    assert_eq!(backend_stats(1), (1, 1));
+    let seen = secondary_server.join().unwrap();
+    assert!(
+        seen[0].starts_with("POST /v1/chat/completions"),
+        "{:?}",
+        seen
+    );
+    primary_server.join().unwrap();
+
+    unsafe { set_ai_hedge_delay_ms_from_cpp(1500) };
+}
+
+#[test]
+#[serial]
+fn test_ai_identical_requests_share_one_transfer() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    let (release_tx, release_rx) = mpsc::channel::<()>();
+
+    let server = std::thread::spawn(move || {
+        let (mut stream, _) = listener.accept().unwrap();
+        read_request(&stream);
+        stream.write_all(SSE_HEADERS).unwrap();
+        stream
+            .write_all(sse_chunk("git status | first\n").as_bytes())
+            .unwrap();
+        stream.flush().unwrap();
+        release_rx.recv().unwrap();
+        stream
+            .write_all(sse_chunk("git stash | second\n").as_bytes())
+            .unwrap();
+        stream.write_all(b"0\r\n\r\n").unwrap();
+        // Any further connection would be a duplicate transfer.
+        listener.set_nonblocking(true).unwrap();
+        assert!(listener.accept().is_err());
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { clear_command_history_from_cpp() };
+    let (completed_before, cancelled_before) = request_stats();
+    let coalesced_before = coalesced_count();
+
+    let input = uncached_input("git st");
+    let first = unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_PARTIAL);
+
+    // Repeats of the same request join the transfer that is already streaming.
+    for _ in 0..4 {
+        let id = unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+        assert_eq!(id, first);
+    }
+    wait_for_status(AI_REQUEST_PARTIAL);
+    assert_eq!(current_command().as_deref(), Some("git status"));
+
+    release_tx.send(()).unwrap();
+    wait_for_status(AI_REQUEST_READY);
+    unsafe { next_ai_suggestion_from_cpp() };
+    assert_eq!(current_command().as_deref(), Some("git stash"));
+    server.join().unwrap();
+
+    let (completed, cancelled) = request_stats();
+    assert_eq!(completed - completed_before, 1);
+    assert_eq!(cancelled - cancelled_before, 0);
+    assert_eq!(coalesced_count() - coalesced_before, 4);
+}
+
+fn breaker_state() -> (bool, u32) {
+    let (mut open, mut failures) = (false, 0);
+    assert!(unsafe { get_ai_backend_breaker_from_cpp(0, &mut open, &mut failures) });
+    (open, failures)
+}
+
+/// Submit a request whose only local answer is a history entry, and return how long it took to
+/// complete and the suggestion that was left.
+fn submit_with_local_fallback() -> (Duration, Option<String>) {
+    let nanos = SystemTime::now()
+        .duration_since(UNIX_EPOCH)
+        .unwrap()
+        .as_nanos();
+    let command = CString::new(format!("fallback-{} --local", nanos)).unwrap();
+    unsafe { add_command_history_from_cpp(command.as_ptr()) };
+    let input = CString::new(format!("fallback-{}", nanos)).unwrap();
+    let started = Instant::now();
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    (started.elapsed(), current_command())
+}
+
+#[test]
+#[serial]
+fn test_ai_deadline_ends_hung_and_dropped_transfers() {
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { set_ai_timeout_ms_from_cpp(1, 300) };
+    unsafe { clear_command_history_from_cpp() };
+
+    // A server that accepts the request and then never answers.
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    let (done_tx, done_rx) = mpsc::channel::<()>();
+    let server = std::thread::spawn(move || {
+        let (stream, _) = listener.accept().unwrap();
+        read_request(&stream);
+        done_rx.recv().unwrap();
+    });
+    set_backend(port);
+    let (elapsed, command) = submit_with_local_fallback();
+    assert!(elapsed < Duration::from_millis(1500), "{:?}", elapsed);
+    assert!(command.unwrap().ends_with(" --local"));
+    assert_eq!(breaker_state(), (false, 1));
+    done_tx.send(()).unwrap();
+    server.join().unwrap();
+
+    // A server that drops the connection without answering.
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    let server = std::thread::spawn(move || {
+        let (stream, _) = listener.accept().unwrap();
+        read_request(&stream);
+    });
+    set_backend(port);
+    let (elapsed, command) = submit_with_local_fallback();
+    assert!(elapsed < Duration::from_millis(300), "{:?}", elapsed);
+    assert!(command.unwrap().ends_with(" --local"));
+    assert_eq!(breaker_state(), (false, 1));
+    server.join().unwrap();
+
+    unsafe { set_ai_timeout_ms_from_cpp(1, 5000) };
+    unsafe { clear_command_history_from_cpp() };
+}
+
+#[test]
+#[serial]
+fn test_ai_circuit_breaker_fails_fast_and_probes() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    listener.set_nonblocking(true).unwrap();
+    let (seen_tx, seen_rx) = mpsc::channel::<String>();
+    let (stop_tx, stop_rx) = mpsc::channel::<()>();
+
+    // Requests fail with 503, while the probe's HEAD request succeeds.
+    let server = std::thread::spawn(move || {
+        while stop_rx.try_recv().is_err() {
+            let Ok((mut stream, _)) = listener.accept() else {
+                std::thread::sleep(Duration::from_millis(5));
+                continue;
+            };
+            stream.set_nonblocking(false).unwrap();
+            let request_line = read_request(&stream);
+            let status = if request_line.starts_with("HEAD") {
+                "200 OK"
+            } else {
+                "503 Service Unavailable"
+            };
+            let response = format!(
+                "HTTP/1.1 {}\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+                status
+            );
+            stream.write_all(response.as_bytes()).unwrap();
+            seen_tx.send(request_line).unwrap();
+        }
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { set_ai_breaker_cooldown_ms_from_cpp(300) };
+    unsafe { clear_command_history_from_cpp() };
+
+    for failures in 1..=3 {
+        let (_, command) = submit_with_local_fallback();
+        assert!(command.unwrap().ends_with(" --local"));
+        assert!(seen_rx.recv().unwrap().starts_with("POST"));
+        assert_eq!(breaker_state(), (failures == 3, failures));
+    }
+
+    // While the breaker is open, requests complete locally without touching the network.
+    let (elapsed, command) = submit_with_local_fallback();
+    assert!(elapsed < Duration::from_millis(100), "{:?}", elapsed);
+    assert!(command.unwrap().ends_with(" --local"));
+
+    // After the cooldown a background probe closes the breaker again.
+    let probe = seen_rx.recv_timeout(Duration::from_secs(5)).unwrap();
+    assert!(probe.starts_with("HEAD /v1/models"), "{}", probe);
+    wait_until("breaker to close", || !breaker_state().0);
+
+    // The next real request reaches the server again.
+    submit_with_local_fallback();
+    assert!(seen_rx.recv().unwrap().starts_with("POST"));
+
+    stop_tx.send(()).unwrap();
+    server.join().unwrap();
+    unsafe { set_ai_breaker_cooldown_ms_from_cpp(5000) };
+    unsafe { clear_command_history_from_cpp() };
+}
+
+fn ai_stats(json: bool) -> String {
+    let len = unsafe { get_ai_stats_from_cpp(json, std::ptr::null_mut(), 0) };
+    let mut buf = vec![0u8; len];
+    let written = unsafe { get_ai_stats_from_cpp(json, buf.as_mut_ptr().cast(), buf.len()) };
+    assert_eq!(written, len);
+    String::from_utf8(buf).unwrap()
+}
+
+/// Look up a number in the JSON stats by following `path` from the outermost object.
+fn stats_number(json: &str, path: &[&str]) -> u64 {
+    let mut rest = json;
+    for key in path {
+        let pattern = format!("\"{}\":", key);
+        let at = rest
+            .find(&pattern)
+            .unwrap_or_else(|| panic!("no {} in {}", key, json));
+        rest = &rest[at + pattern.len()..];
+    }
+    let end = rest.find(|c: char| !c.is_ascii_digit()).unwrap();
+    rest[..end].parse().unwrap()
+}
+
+#[test]
+#[serial]
+fn test_ai_stats_count_phases_and_failures() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+
+    // A normal answer, one with nothing but a code fence, and an empty stream.
+    let server = std::thread::spawn(move || {
+        for text in ["ls | list\n", "```\n```", ""] {
+            let (mut stream, _) = listener.accept().unwrap();
+            read_request(&stream);
+            stream.write_all(SSE_HEADERS).unwrap();
+            if !text.is_empty() {
+                stream.write_all(sse_chunk(text).as_bytes()).unwrap();
+            }
+            stream.write_all(b"0\r\n\r\n").unwrap();
+        }
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { clear_command_history_from_cpp() };
+    let before = ai_stats(true);
+    let generation = |json: &str, key: &str| stats_number(json, &["modes", "generation", key]);
+    let total = |json: &str| stats_number(json, &["generation", "latency_us", "total", "count"]);
+
+    for _ in 0..3 {
+        let input = uncached_input("ls");
+        unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+        wait_for_status(AI_REQUEST_READY);
+    }
+    server.join().unwrap();
+
+    let after = ai_stats(true);
+    assert_eq!(
+        generation(&after, "requests") - generation(&before, "requests"),
+        3
+    );
+    assert_eq!(total(&after) - total(&before), 3);
+    assert_eq!(
+        generation(&after, "parse_failures") - generation(&before, "parse_failures"),
+        1
+    );
+    assert_eq!(
+        generation(&after, "empty_responses") - generation(&before, "empty_responses"),
+        1
+    );
+    assert!(generation(&after, "bytes_sent") > generation(&before, "bytes_sent"));
+    assert!(generation(&after, "bytes_received") > generation(&before, "bytes_received"));
+    let prompt_builds =
+        |json: &str| stats_number(json, &["generation", "latency_us", "prompt_build", "count"]);
+    assert!(prompt_builds(&after) >= prompt_builds(&before) + 3);
+    let explain_requests = |json: &str| stats_number(json, &["explain", "requests"]);
+    assert_eq!(explain_requests(&after), explain_requests(&before));
+
+    let text = ai_stats(false);
+    assert!(text.starts_with("requests: "), "{}", text);
+    assert!(text.contains("generation:\n"), "{}", text);
+    assert!(text.contains("  total "), "{}", text);
+}
+
+#[test]
+#[serial]
+fn test_ai_stream_extracts_text_from_split_events() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+
+    let server = std::thread::spawn(move || {
+        let (mut stream, _) = listener.accept().unwrap();
+        read_request(&stream);
+        stream.write_all(SSE_HEADERS).unwrap();
+        // Fields around the text, escapes, an event split over two data lines, a comment,
+        // an event without text, and a last event that is not followed by a blank line.
+        let body = concat!(
+            ": keep-alive\r\n",
+            "event: message\r\n",
+            "data: {\"candidates\":[{\"safetyRatings\":[{\"probability\":\"LOW\"}],",
+            "\"content\":{\"role\":\"model\",\"parts\":[{\"text\":",
+            "\"echo caf\\u00e9 \\ud83d\\ude00 | print \\\"it\\\"\\n\"}]},\"index\":0}]}\r\n\r\n",
+            "data: {\"candidates\":[{\"content\":\r\n",
+            "data: {\"parts\":[{\"text\":\"ls\\t-l | list\\n\"}]}}]}\r\n\r\n",
+            "data: {\"usageMetadata\":{\"promptTokenCount\":12}}\r\n\r\n",
+            "data: {\"candidates\":[{\"content\":{\"parts\":[{\"text\":\"pwd | where\\n\"}]}}]}",
+        );
+        // Deliver the stream a few bytes at a time.
+        for piece in body.as_bytes().chunks(3) {
+            stream
+                .write_all(format!("{:x}\r\n", piece.len()).as_bytes())
+                .unwrap();
+            stream.write_all(piece).unwrap();
+            stream.write_all(b"\r\n").unwrap();
+            stream.flush().unwrap();
+        }
+        stream.write_all(b"0\r\n\r\n").unwrap();
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    let input = uncached_input("echo split");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    server.join().unwrap();
+
+    assert_eq!(current_command().as_deref(), Some("echo café 😀"));
+    unsafe { next_ai_suggestion_from_cpp() };
+    assert_eq!(current_command().as_deref(), Some("ls\t-l"));
+    unsafe { next_ai_suggestion_from_cpp() };
+    assert_eq!(current_command().as_deref(), Some("pwd"));
+}
+
+#[test]
+#[serial]
+fn test_ai_parse_list_formats() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    let server = std::thread::spawn(move || {
+        let (stream, _) = listener.accept().unwrap();
+        serve_sse(
+            stream,
+            "Here you go:\n```bash\n1) `ls -la` | list all\n* pwd | where am I\n\
+             10. echo `date` | print\n+ ls *.txt | text files\n-la\n```\n",
+        );
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { clear_command_history_from_cpp() };
+    let input = uncached_input("ls");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    server.join().unwrap();
+
+    let mut commands = vec![];
+    for _ in 0..5 {
+        commands.push(current_command().unwrap());
+        unsafe { next_ai_suggestion_from_cpp() };
+    }
+    assert_eq!(commands, ["ls -la", "pwd", "echo date", "ls *.txt", "-la"]);
+}
+
+/// Readers on many threads while writers publish, cycle and clear suggestions.
+/// Every read must see one consistent list; run the suite with the tsan feature to check
+/// that readers never race the writers.
+#[test]
+#[serial]
+fn test_ai_suggestion_snapshots_under_concurrent_access() {
+    use std::sync::Arc;
+    use std::sync::atomic::{AtomicBool, Ordering};
+
+    // A backend that refuses connections: requests fail fast and only local results show.
+    let port = TcpListener::bind("127.0.0.1:0")
+        .unwrap()
+        .local_addr()
+        .unwrap()
+        .port();
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { clear_command_history_from_cpp() };
+    for command in ["git status", "git stash", "git show", "git switch main"] {
+        let command = CString::new(command).unwrap();
+        unsafe { add_command_history_from_cpp(command.as_ptr()) };
+    }
+
+    let done = Arc::new(AtomicBool::new(false));
+    let readers: Vec<_> = (0..6)
+        .map(|_| {
+            let done = Arc::clone(&done);
+            std::thread::spawn(move || {
+                let mut buf = vec![0u8; 1 << 16];
+                let input = CString::new("git s").unwrap();
+                let mut reads = 0u64;
+                while !done.load(Ordering::Relaxed) || reads < 100 {
+                    let (mut generation, mut count, mut current) = (0, 0, 0);
+                    let written = unsafe {
+                        get_ai_suggestions_from_cpp(
+                            0,
+                            buf.as_mut_ptr().cast(),
+                            buf.len(),
+                            &mut generation,
+                            &mut count,
+                            &mut current,
+                        )
+                    };
+                    assert!(written <= buf.len());
+                    assert_eq!(decode_suggestions(&buf[..written]).len(), count as usize);
+                    assert!(current < count || current == 0);
+
+                    unsafe { next_ai_suggestion_from_cpp() };
+                    let _ = current_command();
+                    unsafe { has_ai_suggestions_from_cpp() };
+                    unsafe { is_same_input_from_cpp(input.as_ptr()) };
+                    reads += 1;
+                }
+            })
+        })
+        .collect();
+
+    let submitter = std::thread::spawn(|| {
+        for i in 0..300 {
+            let input = CString::new(if i % 2 == 0 { "git s" } else { "git sw" }).unwrap();
+            unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+            unsafe { poll_ai_request_from_cpp() };
+        }
+    });
+    let clearer = std::thread::spawn(|| {
+        let command = CString::new("git stash pop").unwrap();
+        for _ in 0..300 {
+            unsafe { clear_ai_suggestions_from_cpp() };
+            unsafe { add_command_history_from_cpp(command.as_ptr()) };
+        }
+    });
+    submitter.join().unwrap();
+    clearer.join().unwrap();
+    done.store(true, Ordering::Relaxed);
+    for reader in readers {
+        reader.join().unwrap();
+    }
+
+    unsafe { cancel_ai_request_from_cpp() };
+    unsafe { clear_ai_suggestions_from_cpp() };
+    unsafe { clear_command_history_from_cpp() };
+}
+
+#[test]
+#[serial]
+fn test_ai_daemon_shares_requests_and_falls_back() {
+    let daemon_backend = TcpListener::bind("127.0.0.1:0").unwrap();
+    let local_backend = TcpListener::bind("127.0.0.1:0").unwrap();
+    let daemon_port = daemon_backend.local_addr().unwrap().port();
+    let socket = std::env::temp_dir().join(format!(
+        "fish-ai-test-{}-{}.sock",
+        std::process::id(),
+        SystemTime::now()
+            .duration_since(UNIX_EPOCH)
+            .unwrap()
+            .as_nanos()
+    ));
+    let socket_path = CString::new(socket.to_str().unwrap()).unwrap();
+
+    // The daemon reads its backend list from the environment when it starts.
+    std::env::set_var(
+        "FISH_AI_BACKENDS",
+        format!("gemini | http://127.0.0.1:{}/v1 | | test-key", daemon_port),
+    );
+    // It reads the history file before it serves anything, so the commands that sessions
+    // send afterwards are kept alongside it.
+    let history = temp_history_file("- cmd: cargo fmt --all\n  when: 1700000000\n");
+    unsafe { libc::signal(libc::SIGTERM, libc::SIG_IGN) };
+    let daemon_socket = socket_path.clone();
+    let daemon = std::thread::spawn(move || unsafe {
+        run_ai_daemon_from_cpp(daemon_socket.as_ptr(), history.as_ptr())
+    });
+    wait_until("daemon socket", || socket.exists());
+    std::env::remove_var("FISH_AI_BACKENDS");
+
+    // Only the daemon talks to its backend, and it builds the prompt from the shared history.
+    let daemon_server = std::thread::spawn(move || {
+        let (mut stream, _) = daemon_backend.accept().unwrap();
+        let (_, body) = read_request_with_body(&stream);
+        assert!(body.contains("cargo build --release"), "{}", body);
+        assert!(body.contains("cargo fmt --all"), "{}", body);
+        stream.write_all(SSE_HEADERS).unwrap();
+        stream
+            .write_all(sse_chunk("cargo test | run tests\n").as_bytes())
+            .unwrap();
+        stream.write_all(b"0\r\n\r\n").unwrap();
+        daemon_backend
+    });
+
+    set_backend(local_backend.local_addr().unwrap().port());
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { clear_command_history_from_cpp() };
+    unsafe { set_ai_daemon_socket_from_cpp(socket_path.as_ptr()) };
+    let command = CString::new("cargo build --release").unwrap();
+    unsafe { add_command_history_from_cpp(command.as_ptr()) };
+
+    let input = uncached_input("cargo t");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    let daemon_backend = daemon_server.join().unwrap();
+    unsafe { next_ai_suggestion_from_cpp() };
+    assert_eq!(current_command().as_deref(), Some("cargo test"));
+
+    // When the session gives up on a request, the daemon drops its transfer too.
+    let (started_tx, started_rx) = mpsc::channel::<()>();
+    let daemon_server = std::thread::spawn(move || {
+        let (mut stream, _) = daemon_backend.accept().unwrap();
+        read_request(&stream);
+        stream.write_all(SSE_HEADERS).unwrap();
+        stream
+            .write_all(sse_chunk("The command removes").as_bytes())
+            .unwrap();
+        started_tx.send(()).unwrap();
+        stream
+            .set_read_timeout(Some(Duration::from_secs(5)))
+            .unwrap();
+        let mut buf = [0; 64];
+        let aborted = match stream.read(&mut buf) {
+            Ok(n) => n == 0,
+            Err(e) => e.kind() == std::io::ErrorKind::ConnectionReset,
+        };
+        (daemon_backend, aborted)
+    });
+    let input = uncached_input("rm -rf ./build");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 2) };
+    started_rx.recv_timeout(Duration::from_secs(10)).unwrap();
+    unsafe { cancel_ai_request_from_cpp() };
+    let daemon_backend = daemon_server.join().unwrap();
+    assert!(daemon_backend.1, "daemon transfer was not aborted");
+    let daemon_backend = daemon_backend.0;
+
+    // Requests of different sessions are sent at the same time: the backend sees the second
+    // request while the first one is still unanswered.
+    let daemon_server = std::thread::spawn(move || {
+        let (mut first, _) = daemon_backend.accept().unwrap();
+        read_request(&first);
+        daemon_backend.set_nonblocking(true).unwrap();
+        let deadline = Instant::now() + Duration::from_secs(5);
+        let second = loop {
+            match daemon_backend.accept() {
+                Ok((stream, _)) => break Some(stream),
+                Err(_) if Instant::now() < deadline => std::thread::sleep(Duration::from_millis(5)),
+                Err(_) => break None,
+            }
+        };
+        daemon_backend.set_nonblocking(false).unwrap();
+        let overlapped = second.is_some();
+        first.write_all(SSE_HEADERS).unwrap();
+        first.write_all(sse_chunk("first").as_bytes()).unwrap();
+        first.write_all(b"0\r\n\r\n").unwrap();
+        drop(first);
+        let second = second.unwrap_or_else(|| daemon_backend.accept().unwrap().0);
+        second.set_nonblocking(false).unwrap();
+        serve_sse(second, "second");
+        overlapped
+    });
+    let sessions: Vec<_> = ["make all", "make check"]
+        .into_iter()
+        .map(|prefix| {
+            let socket = socket.clone();
+            let input = uncached_input(prefix).into_string().unwrap();
+            std::thread::spawn(move || daemon_request(&socket, &input))
+        })
+        .collect();
+    let overlapped = daemon_server.join().unwrap();
+    let mut replies: Vec<String> = sessions.into_iter().map(|s| s.join().unwrap()).collect();
+    replies.sort();
+    assert!(overlapped, "daemon sent the requests one after another");
+    assert_eq!(replies, ["T 5\nfirstE 0\n", "T 6\nsecondE 0\n"]);
+
+    // SIGTERM stops the daemon, which removes its socket and then passes the signal on to the
+    // handler it replaced (ignored here, a shell would exit).
+    unsafe { libc::kill(libc::getpid(), libc::SIGTERM) };
+    assert!(daemon.join().unwrap());
+    assert!(!socket.exists());
+    unsafe { libc::signal(libc::SIGTERM, libc::SIG_DFL) };
+
+    // Without the daemon the session sends the request itself.
+    let local_server = std::thread::spawn(move || {
+        let (stream, _) = local_backend.accept().unwrap();
+        serve_sse(stream, "cargo check | check\n");
+    });
+    let input = uncached_input("cargo c");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    local_server.join().unwrap();
+    assert_eq!(current_command().as_deref(), Some("cargo check"));
+
+    let none = CString::new("").unwrap();
+    unsafe { set_ai_daemon_socket_from_cpp(none.as_ptr()) };
+    unsafe { clear_command_history_from_cpp() };
+}
+
+/// Send one streaming explain request for `input` straight to the daemon on `socket`, the way a
+/// session does, and return the daemon's raw reply.
+fn daemon_request(socket: &std::path::Path, input: &str) -> String {
+    let mut stream = std::os::unix::net::UnixStream::connect(socket).unwrap();
+    stream
+        .set_read_timeout(Some(Duration::from_secs(10)))
+        .unwrap();
+    let cwd = "/tmp";
+    write!(
+        stream,
+        "R 2 1 {} {}\n{}{}",
+        input.len(),
+        cwd.len(),
+        input,
+        cwd
+    )
+    .unwrap();
+    let mut reply = String::new();
+    stream.read_to_string(&mut reply).unwrap();
+    reply
+}
+
+/// Return every published suggestion as (command, description).
+fn all_suggestions() -> Vec<(String, String)> {
+    let (mut generation, mut count, mut current) = (0, 0, 0);
+    let mut buf = vec![0u8; 4096];
+    let len = unsafe {
+        get_ai_suggestions_from_cpp(
+            u64::MAX,
+            buf.as_mut_ptr().cast(),
+            buf.len(),
+            &mut generation,
+            &mut count,
+            &mut current,
+        )
+    };
+    decode_suggestions(&buf[..len])
+}
+
+#[test]
+#[serial]
+fn test_ai_combined_request_fills_every_mode() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+
+    // A sectioned answer for the first input, then an answer without headings for the next.
+    let (prompt_tx, prompt_rx) = mpsc::channel::<String>();
+    let server = std::thread::spawn(move || {
+        for reply in [
+            "### GENERATION\ncargo test | run tests\n### EXPLAIN\ncargo t | 테스트를 실행합니다\n\
+             ### DIAGNOSE\ncargo t | 안전합니다\n",
+            "cargo b | 빌드합니다\n",
+        ] {
+            let (mut stream, _) = listener.accept().unwrap();
+            let (_, body) = read_request_with_body(&stream);
+            prompt_tx.send(body).unwrap();
+            stream.write_all(SSE_HEADERS).unwrap();
+            stream.write_all(sse_chunk(reply).as_bytes()).unwrap();
+            stream.write_all(b"0\r\n\r\n").unwrap();
+        }
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { clear_command_history_from_cpp() };
+    unsafe { set_ai_combined_requests_from_cpp(true) };
+    let (completed_before, _) = request_stats();
+
+    let input = uncached_input("cargo t");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    let prompt = prompt_rx.recv().unwrap();
+    assert!(prompt.contains("### EXPLAIN"), "{}", prompt);
+    assert!(prompt.contains("### DIAGNOSE"), "{}", prompt);
+    assert_eq!(
+        all_suggestions(),
+        [("cargo test".to_string(), "run tests".to_string())]
+    );
+
+    // Every other mode on the same input is answered from that one response.
+    for (mode, description) in [
+        (2, "테스트를 실행합니다"),
+        (3, "안전합니다"),
+        (1, "run tests"),
+    ] {
+        unsafe { submit_ai_request_from_cpp(input.as_ptr(), mode) };
+        wait_for_status(AI_REQUEST_READY);
+        let suggestions = all_suggestions();
+        assert_eq!(suggestions.len(), 1, "{:?}", suggestions);
+        assert_eq!(suggestions[0].1, description);
+    }
+    assert_eq!(request_stats().0, completed_before + 1);
+
+    // A new input drops the stored answers. The requested mode leads the prompt, and an
+    // answer without headings belongs to it.
+    let input = uncached_input("cargo b");
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 2) };
+    wait_for_status(AI_REQUEST_READY);
+    let prompt = prompt_rx.recv().unwrap();
+    assert!(
+        prompt.find("### EXPLAIN").unwrap() < prompt.find("### GENERATION").unwrap(),
+        "{}",
+        prompt
+    );
+    assert_eq!(
+        all_suggestions(),
+        [("cargo b".to_string(), "빌드합니다".to_string())]
+    );
+    assert_eq!(request_stats().0, completed_before + 2);
+
+    server.join().unwrap();
+    unsafe { set_ai_combined_requests_from_cpp(false) };
+    unsafe { clear_ai_suggestions_from_cpp() };
+}
+
+#[test]
+#[serial]
+fn test_ai_similar_inputs_reuse_answers() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+
+    // Answer each request with a numbered explanation and hand back the prompt it carried.
+    let (prompt_tx, prompt_rx) = mpsc::channel::<String>();
+    let server = std::thread::spawn(move || {
+        for n in 1..=3 {
+            let (mut stream, _) = listener.accept().unwrap();
+            let (_, body) = read_request_with_body(&stream);
+            prompt_tx.send(body).unwrap();
+            stream.write_all(SSE_HEADERS).unwrap();
+            let reply = format!("listed | 설명 {}\n", n);
+            stream.write_all(sse_chunk(&reply).as_bytes()).unwrap();
+            stream.write_all(b"0\r\n\r\n").unwrap();
+        }
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { set_ai_similarity_threshold_from_cpp(0.85) };
+    // A program name no other test uses, so earlier answers cannot match.
+    let program = uncached_input("lister")
+        .into_string()
+        .unwrap()
+        .replace(' ', "");
+    let explain = |args: &str| {
+        let input = CString::new(format!("{} {}", program, args)).unwrap();
+        unsafe { submit_ai_request_from_cpp(input.as_ptr(), 2) };
+        wait_for_status(AI_REQUEST_READY);
+        input
+    };
+    let similar_before = similar_hits();
+
+    explain("-la /tmp/one");
+    prompt_rx.recv().unwrap();
+    assert_eq!(all_suggestions()[0].1, "설명 1");
+
+    // Other spacing, flag order, path: the explanation is reused for the new input.
+    let input = explain(" -al   /srv/two ");
+    assert_eq!(
+        all_suggestions(),
+        [(input.clone().into_string().unwrap(), "설명 1".to_string())]
+    );
+    assert!(prompt_rx.try_recv().is_err());
+    assert_eq!(similar_hits(), similar_before + 1);
+    let respaced = CString::new(format!("{}  -al /srv/two", program)).unwrap();
+    assert!(unsafe { is_same_input_from_cpp(respaced.as_ptr()) });
+
+    // A different flag set is not similar enough.
+    explain("-R /tmp/one");
+    prompt_rx.recv().unwrap();
+    assert_eq!(all_suggestions()[0].1, "설명 2");
+
+    // With the threshold at 0 only exact matches are reused.
+    unsafe { set_ai_similarity_threshold_from_cpp(0.0) };
+    explain("-la /opt/three");
+    prompt_rx.recv().unwrap();
+    assert_eq!(all_suggestions()[0].1, "설명 3");
+    assert_eq!(similar_hits(), similar_before + 1);
+
+    server.join().unwrap();
+    unsafe { set_ai_similarity_threshold_from_cpp(0.85) };
+    unsafe { clear_ai_suggestions_from_cpp() };
+}
+
+#[test]
+#[serial]
+fn test_ai_diagnoses_are_not_reused_for_similar_inputs() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    let (prompt_tx, prompt_rx) = mpsc::channel::<String>();
+    let server = std::thread::spawn(move || {
+        for reply in ["PID 1234만 종료합니다", "모든 프로세스를 종료합니다"] {
+            let (mut stream, _) = listener.accept().unwrap();
+            let (_, body) = read_request_with_body(&stream);
+            prompt_tx.send(body).unwrap();
+            stream.write_all(SSE_HEADERS).unwrap();
+            let reply = format!("{}\n", reply);
+            stream.write_all(sse_chunk(&reply).as_bytes()).unwrap();
+            stream.write_all(b"0\r\n\r\n").unwrap();
+        }
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { set_ai_similarity_threshold_from_cpp(0.85) };
+    // The same trailing comment keeps both inputs out of the cache but leaves them similar.
+    let tag = uncached_input("#").into_string().unwrap().replace(' ', "");
+    let diagnose = |command: &str| {
+        let input = CString::new(format!("{} {}", command, tag)).unwrap();
+        unsafe { submit_ai_request_from_cpp(input.as_ptr(), 3) };
+        wait_for_status(AI_REQUEST_READY);
+    };
+    let similar_before = similar_hits();
+
+    diagnose("kill -9 1234");
+    prompt_rx.recv_timeout(Duration::from_secs(10)).unwrap();
+
+    // Only a number differs, but signalling -1 kills every process: ask the backend again.
+    diagnose("kill -9 -1");
+    let prompt = prompt_rx.recv_timeout(Duration::from_secs(10)).unwrap();
+    assert!(prompt.contains("kill -9 -1"), "{}", prompt);
+    assert!(
+        all_suggestions()
+            .iter()
+            .any(|(_, description)| description == "모든 프로세스를 종료합니다")
+    );
+    assert_eq!(similar_hits(), similar_before);
+
+    server.join().unwrap();
+    unsafe { clear_ai_suggestions_from_cpp() };
+}
+
+/// A result cache of its own, apart from the manager's, freed on drop.
+struct ResultCache(*mut libc::c_void);
+
+impl ResultCache {
+    /// `disk_path` names the disk-tier file; without it only the memory tier is used.
+    fn new(disk_path: Option<&str>) -> Self {
+        let path = disk_path.map(|p| CString::new(p).unwrap());
+        let path_ptr = path.as_ref().map_or(std::ptr::null(), |p| p.as_ptr());
+        ResultCache(unsafe { new_ai_result_cache_from_cpp(path_ptr, 256) })
+    }
+
+    fn store(&self, key: &str, value: &str) {
+        let key = CString::new(key).unwrap();
+        let value = CString::new(value).unwrap();
+        unsafe { ai_result_cache_store_from_cpp(self.0, key.as_ptr(), value.as_ptr(), 3600) };
+    }
+
+    fn lookup(&self, key: &str) -> Option<String> {
+        let key = CString::new(key).unwrap();
+        let mut buf = [0u8; 256];
+        let hit = unsafe {
+            ai_result_cache_lookup_from_cpp(
+                self.0,
+                key.as_ptr(),
+                buf.as_mut_ptr().cast(),
+                buf.len(),
+            )
+        };
+        let len = buf.iter().position(|&b| b == 0).unwrap();
+        hit.then(|| String::from_utf8(buf[..len].to_vec()).unwrap())
+    }
+
+    /// Return the (hits, disk hits, misses, entries) counters.
+    fn stats(&self) -> (u64, u64, u64, u64) {
+        let (mut hits, mut disk_hits, mut misses, mut entries) = (0, 0, 0, 0);
+        unsafe {
+            get_ai_result_cache_stats_from_cpp(
+                self.0,
+                &mut hits,
+                &mut disk_hits,
+                &mut misses,
+                &mut entries,
+            )
+        };
+        (hits, disk_hits, misses, entries)
+    }
+}
+
+impl Drop for ResultCache {
+    fn drop(&mut self) {
+        unsafe { free_ai_result_cache_from_cpp(self.0) };
+    }
+}
+
+/// Return a path for a disk-tier cache file in a new temporary directory.
+fn temp_cache_path() -> String {
+    let template = CString::new("/tmp/fish_test_ai_cache.XXXXXX").unwrap();
+    let dir = unsafe { CString::from_raw(libc::mkdtemp(template.into_raw())) };
+    format!("{}/ai_cache", dir.to_str().unwrap())
+}
+
+#[test]
+#[serial]
+fn test_ai_result_cache_evicts_least_recently_used() {
+    let cache = ResultCache::new(None);
+    for i in 0..256 {
+        cache.store(&format!("key{}", i), &format!("value{}", i));
+    }
+    assert_eq!(cache.stats().3, 256);
+
+    // Using key0 makes key1 the least recently used entry, so the next store evicts it.
+    assert_eq!(cache.lookup("key0").as_deref(), Some("value0"));
+    cache.store("key256", "value256");
+    assert_eq!(cache.stats().3, 256);
+    assert_eq!(cache.lookup("key1"), None);
+    assert_eq!(cache.lookup("key0").as_deref(), Some("value0"));
+    assert_eq!(cache.lookup("key2").as_deref(), Some("value2"));
+    assert_eq!(cache.lookup("key256").as_deref(), Some("value256"));
+}
+
+#[test]
+#[serial]
+fn test_ai_result_cache_counts_hits_and_misses() {
+    let cache = ResultCache::new(None);
+    assert_eq!(cache.stats(), (0, 0, 0, 0));
+    assert_eq!(cache.lookup("ls"), None);
+    cache.store("ls", "ls -la");
+    cache.store("git", "git status");
+    assert_eq!(cache.lookup("ls").as_deref(), Some("ls -la"));
+    assert_eq!(cache.lookup("ls").as_deref(), Some("ls -la"));
+    assert_eq!(cache.lookup("cd"), None);
+    // Empty answers are not stored.
+    cache.store("cd", "");
+    assert_eq!(cache.lookup("cd"), None);
+    assert_eq!(cache.stats(), (2, 0, 3, 2));
+}
+
+#[test]
+#[serial]
+fn test_ai_result_cache_disk_round_trip() {
+    let path = temp_cache_path();
+    {
+        let writer = ResultCache::new(Some(&path));
+        writer.store("git st", "git status");
+    }
+
+    // Until the disk tier is opened, lookups only see the memory tier.
+    let unopened = ResultCache::new(None);
+    assert_eq!(unopened.lookup("git st"), None);
+    assert!(std::fs::metadata(&path).is_ok());
+
+    let reader = ResultCache::new(Some(&path));
+    assert_eq!(reader.lookup("git st").as_deref(), Some("git status"));
+    assert_eq!(reader.stats(), (0, 1, 0, 1));
+    // The disk hit was copied into the memory tier.
+    assert_eq!(reader.lookup("git st").as_deref(), Some("git status"));
+    assert_eq!(reader.stats(), (1, 1, 0, 1));
+    assert_eq!(reader.lookup("git log"), None);
+    assert_eq!(reader.stats(), (1, 1, 1, 1));
+}
+
+#[test]
+#[serial]
+fn test_ai_result_cache_rejects_corrupted_slots() {
+    let path = temp_cache_path();
+    {
+        let writer = ResultCache::new(Some(&path));
+        writer.store("bad checksum", "value one");
+        writer.store("bad tag", "value two");
+        writer.store("intact", "value three");
+    }
+
+    // A slot is a 32-byte header (tag, expiry, checksum, lengths) followed by the key.
+    let mut file = std::fs::read(&path).unwrap();
+    let slot_of = |file: &[u8], key: &str| {
+        let key = key.as_bytes();
+        file.windows(key.len()).position(|w| w == key).unwrap() - 32
+    };
+    let slot = slot_of(&file, "bad checksum");
+    file[slot + 16] ^= 0xff;
+    let slot = slot_of(&file, "bad tag");
+    file[slot] ^= 0xfe;
+    std::fs::write(&path, &file).unwrap();
+
+    let reader = ResultCache::new(Some(&path));
+    assert_eq!(reader.lookup("bad checksum"), None);
+    assert_eq!(reader.lookup("bad tag"), None);
+    assert_eq!(reader.lookup("intact").as_deref(), Some("value three"));
+    assert_eq!(reader.stats(), (0, 1, 2, 1));
+}
+
+/// Scan `command` with the local risk rules and return the level and the warning.
+fn command_risk(command: &str) -> (libc::c_int, String) {
+    let command = CString::new(command).unwrap();
+    let mut buf = [0u8; 256];
+    let level = unsafe {
+        scan_ai_command_risk_from_cpp(command.as_ptr(), buf.as_mut_ptr().cast(), buf.len())
+    };
+    let len = buf.iter().position(|&b| b == 0).unwrap();
+    (level, String::from_utf8(buf[..len].to_vec()).unwrap())
+}
+
+#[test]
+#[serial]
+fn test_ai_local_risk_scan() {
+    for (command, level) in [
+        ("rm -rf /", 2),
+        ("sudo rm -rf --no-preserve-root /", 2),
+        ("rm -rf \"$HOME\"/", 2),
+        ("dd if=/dev/zero of=/dev/sda bs=1M", 2),
+        ("mkfs.ext4 /dev/nvme0n1p1", 2),
+        ("chmod -R 777 /", 2),
+        (":(){ :|:& };:", 2),
+        ("echo x > /dev/sdb", 2),
+        ("curl -fsSL https://example.com/install.sh | sh", 1),
+        ("curl -sL https://example.com/install.fish | source", 1),
+        ("git push --force origin main", 1),
+        ("rm -rf ./build", 0),
+        ("echo 'rm -rf /'", 0),
+        ("dd if=disk.img of=/dev/null", 0),
+        ("ls -la 2>/dev/null | grep x", 0),
+    ] {
+        assert_eq!(command_risk(command).0, level, "{}", command);
+    }
+
+    // DIAGNOSE shows the local warning before the remote diagnosis arrives, which then
+    // follows it.
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    let (go_tx, go_rx) = mpsc::channel::<()>();
+    let server = std::thread::spawn(move || {
+        let (mut stream, _) = listener.accept().unwrap();
+        read_request(&stream);
+        go_rx.recv().unwrap();
+        stream.write_all(SSE_HEADERS).unwrap();
+        stream
+            .write_all(sse_chunk("rm -rf / | 원격 진단\n").as_bytes())
+            .unwrap();
+        stream.write_all(b"0\r\n\r\n").unwrap();
+    });
+
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    let input = uncached_input("sudo rm -rf /");
+    let start = Instant::now();
+    unsafe { submit_ai_request_from_cpp(input.as_ptr(), 3) };
+    wait_for_status(AI_REQUEST_PARTIAL);
+    let local = all_suggestions();
+    assert_eq!(local.len(), 1, "{:?}", local);
+    assert_eq!(local[0].1, command_risk("rm -rf /").1);
+    assert!(start.elapsed() < Duration::from_secs(1));
+
+    go_tx.send(()).unwrap();
+    wait_for_status(AI_REQUEST_READY);
+    let all = all_suggestions();
+    assert_eq!(all.len(), 2, "{:?}", all);
+    assert_eq!(all[0], local[0]);
+    assert_eq!(all[1].1, "원격 진단");
+
+    server.join().unwrap();
+    unsafe { clear_ai_suggestions_from_cpp() };
+}
+
+/// Return the (throttled, rate limited, dropped) counters of the client-side rate limiter.
+fn rate_limit_stats() -> (u64, u64, u64) {
+    let (mut throttled, mut rate_limited, mut dropped) = (0, 0, 0);
+    unsafe { get_ai_rate_limit_stats_from_cpp(&mut throttled, &mut rate_limited, &mut dropped) };
+    (throttled, rate_limited, dropped)
+}
+
+/// Stand-in backend that allows `quota` requests per one-second window and answers the rest
+/// with 429 and `Retry-After: 1`. Sends the body of every request it sees over `seen`.
+fn spawn_quota_server(
+    quota: usize,
+    seen: mpsc::Sender<String>,
+) -> (u16, mpsc::Sender<()>, std::thread::JoinHandle<()>) {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    listener.set_nonblocking(true).unwrap();
+    let (stop_tx, stop_rx) = mpsc::channel::<()>();
+    let server = std::thread::spawn(move || {
+        let mut window = Instant::now();
+        let mut used = 0;
+        while stop_rx.try_recv().is_err() {
+            let Ok((mut stream, _)) = listener.accept() else {
+                std::thread::sleep(Duration::from_millis(2));
+                continue;
+            };
+            stream.set_nonblocking(false).unwrap();
+            let (_, body) = read_request_with_body(&stream);
+            if window.elapsed() >= Duration::from_secs(1) {
+                window = Instant::now();
+                used = 0;
+            }
+            if used < quota {
+                used += 1;
+                stream.write_all(SSE_HEADERS).unwrap();
+                stream
+                    .write_all(sse_chunk("quota-ok | served").as_bytes())
+                    .unwrap();
+                stream.write_all(b"0\r\n\r\n").unwrap();
+            } else {
+                stream
+                    .write_all(
+                        b"HTTP/1.1 429 Too Many Requests\r\nRetry-After: 1\r\n\
+                          Content-Length: 0\r\nConnection: close\r\n\r\n",
+                    )
+                    .unwrap();
+            }
+            seen.send(body).unwrap();
+        }
+    });
+    (port, stop_tx, server)
+}
+
+#[test]
+#[serial]
+fn test_ai_rate_limit_honors_quota_and_retry_after() {
+    let (seen_tx, seen_rx) = mpsc::channel::<String>();
+    let (port, stop_tx, server) = spawn_quota_server(2, seen_tx);
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { clear_command_history_from_cpp() };
+    // Ten requests per second, at most two at once.
+    unsafe { set_ai_rate_limit_from_cpp(600.0, 2.0) };
+    let (throttled, rate_limited, dropped) = rate_limit_stats();
+
+    // The burst goes out at once. The third request waits for a token, is refused by the
+    // server, and is sent again once Retry-After has passed instead of ending up empty.
+    let started = Instant::now();
+    for i in 0..3 {
+        let input = uncached_input(&format!("quota{}", i));
+        unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+        wait_for_status(AI_REQUEST_READY);
+        assert_eq!(current_command().as_deref(), Some("quota-ok"));
+    }
+    assert!(
+        started.elapsed() >= Duration::from_millis(1000),
+        "{:?}",
+        started.elapsed()
+    );
+    let bodies: Vec<String> = seen_rx.try_iter().collect();
+    assert_eq!(bodies.len(), 4);
+    assert_eq!(bodies[2], bodies[3]);
+    let stats = rate_limit_stats();
+    assert!(stats.0 > throttled);
+    assert_eq!(stats.1 - rate_limited, 1);
+    // Rate limiting is not a backend failure.
+    assert_eq!(breaker_state(), (false, 0));
+
+    // Use up the new window, then get refused again.
+    let filler = uncached_input("quota-filler");
+    unsafe { submit_ai_request_from_cpp(filler.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    let stale = uncached_input("quota-stale");
+    unsafe { submit_ai_request_from_cpp(stale.as_ptr(), 1) };
+    wait_until("the server to refuse a request", || {
+        rate_limit_stats().1 - rate_limited == 2
+    });
+
+    // A newer input replaces the request waiting out Retry-After, which is dropped.
+    let fresh = uncached_input("quota-fresh");
+    unsafe { submit_ai_request_from_cpp(fresh.as_ptr(), 1) };
+    wait_for_status(AI_REQUEST_READY);
+    assert_eq!(current_command().as_deref(), Some("quota-ok"));
+    assert_eq!(rate_limit_stats().2 - dropped, 1);
+    let bodies: Vec<String> = seen_rx.try_iter().collect();
+    let stale = stale.to_str().unwrap();
+    let fresh = fresh.to_str().unwrap();
+    assert_eq!(bodies.iter().filter(|body| body.contains(stale)).count(), 1);
+    assert!(bodies.last().unwrap().contains(fresh));
+
+    assert!(ai_stats(false).contains("\nrate limit: "));
+    stop_tx.send(()).unwrap();
+    server.join().unwrap();
+    unsafe { set_ai_rate_limit_from_cpp(0.0, 0.0) };
+}
+
+/// Return the (gathers, hits, misses, invalidations) counters of the directory context.
+fn directory_stats() -> (u64, u64, u64, u64) {
+    let (mut gathers, mut hits, mut misses, mut invalidations) = (0, 0, 0, 0);
+    unsafe {
+        get_ai_directory_stats_from_cpp(&mut gathers, &mut hits, &mut misses, &mut invalidations)
+    };
+    (gathers, hits, misses, invalidations)
+}
+
+#[test]
+#[serial]
+fn test_ai_directory_context_gathered_in_background_and_invalidated() {
+    let nanos = SystemTime::now()
+        .duration_since(UNIX_EPOCH)
+        .unwrap()
+        .as_nanos();
+    let dir = std::env::temp_dir().join(format!("fish-ai-dir-{}", nanos));
+    std::fs::create_dir_all(dir.join("src")).unwrap();
+    std::fs::write(dir.join("Cargo.toml"), "[package]\n").unwrap();
+    let git = std::process::Command::new("git")
+        .args(["init", "-q"])
+        .current_dir(&dir)
+        .status()
+        .unwrap();
+    assert!(git.success());
+    let old_cwd = std::env::current_dir().unwrap();
+    std::env::set_current_dir(&dir).unwrap();
+
+    // The stand-in server never refuses; it only hands back the prompts.
+    let (seen_tx, seen_rx) = mpsc::channel::<String>();
+    let (port, stop_tx, server) = spawn_quota_server(usize::MAX, seen_tx);
+    set_backend(port);
+    unsafe { set_ai_debounce_ms_from_cpp(0) };
+    unsafe { clear_command_history_from_cpp() };
+    let submit = |prefix: &str| {
+        let input = uncached_input(prefix);
+        unsafe { submit_ai_request_from_cpp(input.as_ptr(), 1) };
+        wait_for_status(AI_REQUEST_READY);
+        seen_rx.recv().unwrap()
+    };
+
+    // The first prompt in a new directory does not wait for it to be read.
+    let (gathers, _, misses, invalidations) = directory_stats();
+    let prompt = submit("dir");
+    assert!(!prompt.contains("Build files"), "{}", prompt);
+    assert!(directory_stats().2 > misses);
+    wait_until("the directory to be gathered", || {
+        directory_stats().0 > gathers
+    });
+
+    let prompt = submit("dir");
+    assert!(prompt.contains("Build files: Cargo.toml"), "{}", prompt);
+    assert!(prompt.contains("Git branch: "), "{}", prompt);
+    assert!(prompt.contains("src/"), "{}", prompt);
+
+    // A new file only marks the cached context stale; the next prompt still uses the old
+    // text and has it gathered again in the background.
+    let (gathers, ..) = directory_stats();
+    std::fs::write(dir.join("package.json"), "{}\n").unwrap();
+    wait_until("the change to be noticed", || {
+        directory_stats().3 > invalidations
+    });
+    std::thread::sleep(Duration::from_millis(200));
+    assert_eq!(directory_stats().0, gathers);
+    let prompt = submit("dir");
+    assert!(!prompt.contains("package.json"), "{}", prompt);
+    wait_until("the directory to be gathered again", || {
+        directory_stats().0 > gathers
+    });
+    let prompt = submit("dir");
+    assert!(prompt.contains("package.json"), "{}", prompt);
+
+    // Git bookkeeping inside .git does not invalidate it.
+    let (_, _, _, invalidations) = directory_stats();
+    std::fs::write(dir.join(".git").join("FETCH_HEAD"), "\n").unwrap();
+    std::thread::sleep(Duration::from_millis(200));
+    assert_eq!(directory_stats().3, invalidations);
+
+    // Unchanged directories are served from the cache.
+    let (gathers, hits, ..) = directory_stats();
+    for _ in 0..3 {
+        submit("dir");
+    }
+    let stats = directory_stats();
+    assert_eq!(stats.0, gathers);
+    assert!(stats.1 >= hits + 3);
+    assert!(ai_stats(false).contains("\ndirectory context: "));
+
+    std::env::set_current_dir(old_cwd).unwrap();
+    stop_tx.send(()).unwrap();
+    server.join().unwrap();
+    std::fs::remove_dir_all(&dir).unwrap();
+}
+
+#[test]
+#[serial]
+fn test_ai_blocking_generation_leaves_state_unlocked() {
+    // The blocking call does not stream, so the answer is one JSON body.
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    let server = std::thread::spawn(move || {
+        let (mut stream, _) = listener.accept().unwrap();
+        read_request(&stream);
+        std::thread::sleep(Duration::from_millis(500));
+        let body = r#"{"candidates":[{"content":{"parts":[{"text":"slow-answer | blocking"}]}}]}"#;
+        let response = format!(
+            "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: {}\r\n\r\n{}",
+            body.len(),
+            body
+        );
+        stream.write_all(response.as_bytes()).unwrap();
+    });
+    set_backend(port);
+    unsafe { clear_command_history_from_cpp() };
+
+    let input = uncached_input("blocking");
+    let generator = std::thread::spawn(move || {
+        unsafe { generate_ai_suggestions_from_cpp(input.as_ptr(), 1) };
+    });
+    // Let the other thread build its prompt and start the transfer.
+    std::thread::sleep(Duration::from_millis(100));
+
+    // Recording a command does not wait for the transfer on the other thread.
+    let started = Instant::now();
+    let command = CString::new("echo while-blocked").unwrap();
+    unsafe { add_command_history_from_cpp(command.as_ptr()) };
+    assert!(
+        started.elapsed() < Duration::from_millis(200),
+        "{:?}",
+        started.elapsed()
+    );
+
+    generator.join().unwrap();
+    assert_eq!(current_command().as_deref(), Some("slow-answer"));
+    server.join().unwrap();
+    unsafe { clear_command_history_from_cpp() };
+}
+
+#[test]
+#[serial]
+fn test_ai_blocking_generation_drops_superseded_result() {
+    let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+    let port = listener.local_addr().unwrap().port();
+    let (started_tx, started_rx) = mpsc::channel::<()>();
+    let server = std::thread::spawn(move || {
+        let (mut stream, _) = listener.accept().unwrap();
+        read_request(&stream);
+        started_tx.send(()).unwrap();
+        std::thread::sleep(Duration::from_millis(300));
+        let body = r#"{"candidates":[{"content":{"parts":[{"text":"stale-answer | late"}]}}]}"#;
+        let response = format!(
+            "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: {}\r\n\r\n{}",
+            body.len(),
+            body
+        );
+        stream.write_all(response.as_bytes()).unwrap();
+    });
+    set_backend(port);
+    unsafe { clear_command_history_from_cpp() };
+
+    let input = uncached_input("superseded");
+    let generator = std::thread::spawn(move || {
+        unsafe { generate_ai_suggestions_from_cpp(input.as_ptr(), 1) };
+    });
+    started_rx.recv_timeout(Duration::from_secs(10)).unwrap();
+
+    // The user moves on while the answer is still on its way.
+    unsafe { clear_ai_suggestions_from_cpp() };
+    generator.join().unwrap();
+    server.join().unwrap();
+    assert!(all_suggestions().is_empty(), "{:?}", all_suggestions());
+    assert_eq!(current_command(), None);
+}
+
+#[test]
+#[serial]
+fn test_ai_private_mode_keeps_commands_out_of_history() {
+    unsafe { clear_command_history_from_cpp() };
+    let command = CString::new("echo public").unwrap();
+    unsafe { add_command_history_from_cpp(command.as_ptr()) };
+    assert_eq!(history_counts(), (1, 1));
+
+    unsafe { set_ai_private_mode_from_cpp(true) };
+    let command = CString::new("echo secret").unwrap();
+    unsafe { add_command_history_from_cpp(command.as_ptr()) };
+    assert_eq!(history_counts(), (1, 1));
+
+    unsafe { set_ai_private_mode_from_cpp(false) };
+    unsafe { add_command_history_from_cpp(command.as_ptr()) };
+    assert_eq!(history_counts(), (2, 2));
+    unsafe { clear_command_history_from_cpp() };
+}
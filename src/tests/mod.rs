@@ -1,4 +1,5 @@
 mod abbrs;
+mod ai;
 mod ast;
 mod ast_bench;
 mod common;